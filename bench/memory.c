@@ -0,0 +1,175 @@
+/*
+ * Memory_Copy, Memory_Set and Memory_Compare against plain byte loops, from 1 byte to 1 MB.
+ *
+ * The byte loops are the scalar variants os.c falls back to for short inputs. They are kept from
+ * being vectorized or turned into library calls here, so the numbers show what the SIMD paths the
+ * dispatcher picks (AVX2 or SSE2) gain over them. Every size is also checked for equal results.
+ * Build it with the library sources:
+ *
+ *   Linux:   gcc -O2 -DLINUX -I. bench/memory.c *.c -lpthread -o memory
+ *   Windows: cl /O2 /D_WIN32 /I. bench\memory.c *.c
+ */
+#include "os.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _MSC_VER
+#define BENCH_SCALAR __declspec(noinline)
+#define BENCH_NO_VECTOR __pragma(loop(no_vector))
+#else
+#define BENCH_SCALAR __attribute__((noipa, optimize("no-tree-vectorize", "no-tree-loop-distribute-patterns")))
+#define BENCH_NO_VECTOR
+#endif /* _MSC_VER */
+
+#define BENCH_MAX_LEN (1U << 20)
+/* Bytes moved per measurement, short lengths are repeated until they add up to this. */
+#define BENCH_BYTES_PER_RUN (32ULL << 20)
+#define BENCH_MIN_ROUNDS (1000ULL)
+
+static volatile int giSink = 0;
+
+static BENCH_SCALAR void* BenchCopyScalar(void* const pDest, void const * const pSrc, U64 uLen)
+{
+	BYTE* d = pDest;
+	BYTE const* s = pSrc;
+	BENCH_NO_VECTOR
+	while (uLen--)
+	{
+		*d++ = *s++;
+	}
+	return pDest;
+}
+
+static BENCH_SCALAR void* BenchSetScalar(void* const pDest, BYTE const uValue, U64 uLen)
+{
+	BYTE* d = pDest;
+	BENCH_NO_VECTOR
+	while (uLen--)
+	{
+		*d++ = uValue;
+	}
+	return pDest;
+}
+
+static BENCH_SCALAR int BenchCompareScalar(void const * const pLeft, void const * const pRight, U64 const uLen)
+{
+	BYTE const * const l = pLeft;
+	BYTE const * const r = pRight;
+	BENCH_NO_VECTOR
+	for (U64 i = 0; i < uLen; i++)
+	{
+		if (l[i] != r[i])
+		{
+			return (l[i] < r[i]) ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+static U64 BenchRounds(U32 const uLen)
+{
+	U64 const uRounds = BENCH_BYTES_PER_RUN / uLen;
+	return (uRounds < BENCH_MIN_ROUNDS) ? BENCH_MIN_ROUNDS : uRounds;
+}
+
+static double BenchNsPer(U64 const uStart, U64 const uRounds)
+{
+	return (double)(Time_Now() - uStart) / (double)uRounds;
+}
+
+static BOOL BenchRun(BYTE* const pSrc, BYTE* const pDest, BYTE* const pCheck, U32 const uLen)
+{
+	U64 const uRounds = BenchRounds(uLen);
+	double adNs[6];
+
+	U64 uStart = Time_Now();
+	for (U64 i = 0; i < uRounds; i++)
+	{
+		BenchCopyScalar(pDest, pSrc, uLen);
+	}
+	adNs[0] = BenchNsPer(uStart, uRounds);
+	uStart = Time_Now();
+	for (U64 i = 0; i < uRounds; i++)
+	{
+		Memory_Copy(pDest, pSrc, uLen);
+	}
+	adNs[1] = BenchNsPer(uStart, uRounds);
+
+	uStart = Time_Now();
+	for (U64 i = 0; i < uRounds; i++)
+	{
+		BenchSetScalar(pDest, (BYTE)i, uLen);
+	}
+	adNs[2] = BenchNsPer(uStart, uRounds);
+	uStart = Time_Now();
+	for (U64 i = 0; i < uRounds; i++)
+	{
+		Memory_Set(pDest, (BYTE)i, uLen);
+	}
+	adNs[3] = BenchNsPer(uStart, uRounds);
+
+	/* Equal buffers are the worst case, both sides have to look at every byte. */
+	Memory_Copy(pDest, pSrc, uLen);
+	int iSum = 0;
+	uStart = Time_Now();
+	for (U64 i = 0; i < uRounds; i++)
+	{
+		iSum += BenchCompareScalar(pDest, pSrc, uLen);
+	}
+	adNs[4] = BenchNsPer(uStart, uRounds);
+	uStart = Time_Now();
+	for (U64 i = 0; i < uRounds; i++)
+	{
+		iSum += Memory_Compare(pDest, pSrc, uLen);
+	}
+	adNs[5] = BenchNsPer(uStart, uRounds);
+	giSink += iSum;
+
+	printf("%8u  copy %10.1f %10.1f ns (x%5.1f)  set %10.1f %10.1f ns (x%5.1f)  compare %10.1f %10.1f ns (x%5.1f)\n", (unsigned)uLen,
+		adNs[0], adNs[1], adNs[0] / adNs[1], adNs[2], adNs[3], adNs[2] / adNs[3], adNs[4], adNs[5], adNs[4] / adNs[5]);
+
+	/* Both sides have to agree, on the copied bytes and on the sign of a difference at the last byte. */
+	BenchCopyScalar(pCheck, pSrc, uLen);
+	Memory_Copy(pDest, pSrc, uLen);
+	BOOL bOk = (0 == BenchCompareScalar(pDest, pCheck, uLen));
+	BenchSetScalar(pCheck, 0x5A, uLen);
+	Memory_Set(pDest, 0x5A, uLen);
+	bOk = bOk && (0 == BenchCompareScalar(pDest, pCheck, uLen));
+	pDest[uLen - 1] = 0x5B;
+	bOk = bOk && (BenchCompareScalar(pDest, pCheck, uLen) == Memory_Compare(pDest, pCheck, uLen));
+	bOk = bOk && (BenchCompareScalar(pCheck, pDest, uLen) == Memory_Compare(pCheck, pDest, uLen));
+	return bOk;
+}
+
+int main(void)
+{
+	/* One byte more than the largest length, so unaligned starts stay inside the buffers. */
+	BYTE* const pSrc = malloc(BENCH_MAX_LEN + 1);
+	BYTE* const pDest = malloc(BENCH_MAX_LEN + 1);
+	BYTE* const pCheck = malloc(BENCH_MAX_LEN + 1);
+	if (NULL == pSrc || NULL == pDest || NULL == pCheck)
+	{
+		return 1;
+	}
+	for (U32 i = 0; i <= BENCH_MAX_LEN; i++)
+	{
+		pSrc[i] = (BYTE)(i * 31);
+	}
+
+	printf("     len        scalar       simd              scalar       simd              scalar       simd\n");
+	int iRet = 0;
+	for (U32 uLen = 1; uLen <= BENCH_MAX_LEN; uLen *= 2)
+	{
+		/* Odd offsets, the SIMD paths use unaligned loads and stores and should not depend on alignment. */
+		if (!BenchRun(pSrc + 1, pDest + 1, pCheck + 1, uLen))
+		{
+			printf("%8u  results differ\n", (unsigned)uLen);
+			iRet = 1;
+		}
+	}
+	free(pSrc);
+	free(pDest);
+	free(pCheck);
+	return iRet;
+}
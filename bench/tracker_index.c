@@ -0,0 +1,124 @@
+/*
+ * Add and hit-dispatch times of the tracker index at 1k, 100k and 1M trackers.
+ *
+ * The benchmark targets its own process: breakpoints are added on every byte of a buffer, which
+ * only reads the original bytes, and hits are dispatched by calling the breakpoint handler the
+ * debug loop calls, so nothing is ever written into the code. Build it with the library sources:
+ *
+ *   Linux:   gcc -O2 -DLINUX -I. bench/tracker_index.c *.c -lpthread -o tracker_index
+ *   Windows: cl /O2 /D_WIN32 /I. bench\tracker_index.c *.c
+ */
+#include "flocdll.h"
+#include "floc.h"
+#include "tracker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define BENCH_PID_SELF ((PID)GetCurrentProcessId())
+#else
+#include <unistd.h>
+#define BENCH_PID_SELF ((PID)getpid())
+#endif /* _WIN32 */
+
+#define BENCH_SIZE_COUNT (3)
+
+static U32 const guSizes[BENCH_SIZE_COUNT] = { 1000, 100000, 1000000 };
+
+static double BenchNsPer(U64 const uStart, U32 const uCount)
+{
+	return (double)(Time_Now() - uStart) / (double)uCount;
+}
+
+static BOOL BenchRun(BYTE const * const pCode, U32 const uCount, BOOL const bBatch)
+{
+	FLOC_HANDLE hHandle = NULL;
+	if (FLOC_STATUS_SUCCESS != FLOCDLL_Initialize(&hHandle))
+	{
+		return FALSE;
+	}
+	if (FLOC_STATUS_SUCCESS != FLOCDLL_TargetSet(hHandle, BENCH_PID_SELF))
+	{
+		FLOCDLL_Uninitialize(hHandle);
+		return FALSE;
+	}
+
+	ADDRESS* const pAddresses = malloc((size_t)uCount * sizeof(ADDRESS));
+	if (NULL == pAddresses)
+	{
+		FLOCDLL_Uninitialize(hHandle);
+		return FALSE;
+	}
+	/* Every 7th byte first, so the index does not see the addresses in order. */
+	for (U32 i = 0; i < uCount; i++)
+	{
+		pAddresses[i] = (ADDRESS)(pCode + ((U64)i * 7) % uCount);
+	}
+
+	U64 uStart = Time_Now();
+	if (bBatch)
+	{
+		FLOCDLL_TrackerAddBreakpointMany(hHandle, pAddresses, uCount, NULL);
+	}
+	else
+	{
+		for (U32 i = 0; i < uCount; i++)
+		{
+			FLOCDLL_TrackerAddBreakpoint(hHandle, pAddresses[i]);
+		}
+	}
+	double const dAdd = BenchNsPer(uStart, uCount);
+
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	U32 uFound = 0;
+	uStart = Time_Now();
+	for (U32 i = 0; i < uCount; i++)
+	{
+		uFound += (NULL != FLOC_TrackerFind(pCtx, pAddresses[i])) ? 1 : 0;
+	}
+	double const dFind = BenchNsPer(uStart, uCount);
+
+	/* The handler disables every breakpoint it dispatches, like a real hit. */
+	U32 uDispatched = 0;
+	uStart = Time_Now();
+	for (U32 i = 0; i < uCount; i++)
+	{
+		BYTE uOriginalByte = 0;
+		uDispatched += FLOC_BreakpointHandler(pCtx, 0, pAddresses[i], &uOriginalByte) ? 1 : 0;
+	}
+	double const dDispatch = BenchNsPer(uStart, uCount);
+
+	printf("%8u %-6s add %8.1f ns  find %6.1f ns  dispatch %6.1f ns  (%u found, %u dispatched)\n",
+		uCount, bBatch ? "batch" : "single", dAdd, dFind, dDispatch, uFound, uDispatched);
+
+	free(pAddresses);
+	FLOCDLL_Uninitialize(hHandle);
+	return uFound == uCount && uDispatched == uCount;
+}
+
+int main(void)
+{
+	U32 const uMax = guSizes[BENCH_SIZE_COUNT - 1];
+	BYTE* const pCode = malloc(uMax);
+	if (NULL == pCode)
+	{
+		return 1;
+	}
+	for (U32 i = 0; i < uMax; i++)
+	{
+		pCode[i] = (BYTE)(i * 31);
+	}
+
+	int iRet = 0;
+	for (U32 i = 0; i < BENCH_SIZE_COUNT; i++)
+	{
+		if (!BenchRun(pCode, guSizes[i], FALSE) || !BenchRun(pCode, guSizes[i], TRUE))
+		{
+			iRet = 1;
+		}
+	}
+	free(pCode);
+	return iRet;
+}
@@ -0,0 +1,504 @@
+#include "decode.h"
+#include "os.h"
+
+typedef signed char I8;
+typedef signed int I32;
+typedef signed long long I64;
+
+/* Operand layout per opcode. Prefixes and escapes are handled before the tables are consulted. */
+#define D_M (0x01) /* ModRM, with SIB and displacement */
+#define D_I8 (0x02) /* imm8 */
+#define D_I16 (0x04) /* imm16 */
+#define D_IZ (0x08) /* imm16 / imm32 by operand size */
+#define D_IV (0x10) /* imm16 / imm32 / imm64 by operand size */
+#define D_R8 (0x20) /* rel8 */
+#define D_RZ (0x40) /* rel32 */
+#define D_X (0x80) /* invalid in 64-bit mode or not supported */
+
+#define DECODE_RELOCATED_MAX (32)
+
+static BYTE const gOneByte[256] = {
+	/* 0x00 */ D_M, D_M, D_M, D_M, D_I8, D_IZ, D_X, D_X, D_M, D_M, D_M, D_M, D_I8, D_IZ, D_X, 0,
+	/* 0x10 */ D_M, D_M, D_M, D_M, D_I8, D_IZ, D_X, D_X, D_M, D_M, D_M, D_M, D_I8, D_IZ, D_X, D_X,
+	/* 0x20 */ D_M, D_M, D_M, D_M, D_I8, D_IZ, 0, D_X, D_M, D_M, D_M, D_M, D_I8, D_IZ, 0, D_X,
+	/* 0x30 */ D_M, D_M, D_M, D_M, D_I8, D_IZ, 0, D_X, D_M, D_M, D_M, D_M, D_I8, D_IZ, 0, D_X,
+	/* 0x40 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 0x50 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 0x60 */ D_X, D_X, D_X, D_M, 0, 0, 0, 0, D_IZ, D_M | D_IZ, D_I8, D_M | D_I8, 0, 0, 0, 0,
+	/* 0x70 */ D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8, D_R8,
+	/* 0x80 */ D_M | D_I8, D_M | D_IZ, D_X, D_M | D_I8, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0x90 */ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, D_X, 0, 0, 0, 0, 0,
+	/* 0xA0 */ 0, 0, 0, 0, 0, 0, 0, 0, D_I8, D_IZ, 0, 0, 0, 0, 0, 0,
+	/* 0xB0 */ D_I8, D_I8, D_I8, D_I8, D_I8, D_I8, D_I8, D_I8, D_IV, D_IV, D_IV, D_IV, D_IV, D_IV, D_IV, D_IV,
+	/* 0xC0 */ D_M | D_I8, D_M | D_I8, D_I16, 0, D_X, D_X, D_M | D_I8, D_M | D_IZ, D_I16 | D_I8, 0, D_I16, 0, 0, D_I8, D_X, 0,
+	/* 0xD0 */ D_M, D_M, D_M, D_M, D_X, D_X, D_X, 0, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0xE0 */ D_R8, D_R8, D_R8, D_R8, D_I8, D_I8, D_I8, D_I8, D_RZ, D_RZ, D_X, D_R8, 0, 0, 0, 0,
+	/* 0xF0 */ 0, 0, 0, 0, 0, 0, D_M, D_M, 0, 0, 0, 0, 0, 0, D_M, D_M
+};
+
+static BYTE const gTwoByte[256] = {
+	/* 0x00 */ D_M, D_M, D_M, D_M, D_X, 0, 0, 0, 0, 0, D_X, 0, D_X, D_M, 0, D_M | D_I8,
+	/* 0x10 */ D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0x20 */ D_M, D_M, D_M, D_M, D_X, D_X, D_X, D_X, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0x30 */ 0, 0, 0, 0, 0, 0, D_X, 0, D_X, D_X, D_X, D_X, D_X, D_X, D_X, D_X,
+	/* 0x40 */ D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0x50 */ D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0x60 */ D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0x70 */ D_M | D_I8, D_M | D_I8, D_M | D_I8, D_M | D_I8, D_M, D_M, D_M, 0, D_M, D_M, D_X, D_X, D_M, D_M, D_M, D_M,
+	/* 0x80 */ D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ, D_RZ,
+	/* 0x90 */ D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0xA0 */ 0, 0, 0, D_M, D_M | D_I8, D_M, D_X, D_X, 0, 0, 0, D_M, D_M | D_I8, D_M, D_M, D_M,
+	/* 0xB0 */ D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M | D_I8, D_M, D_M, D_M, D_M, D_M,
+	/* 0xC0 */ D_M, D_M, D_M | D_I8, D_M, D_M | D_I8, D_M | D_I8, D_M | D_I8, D_M, 0, 0, 0, 0, 0, 0, 0, 0,
+	/* 0xD0 */ D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0xE0 */ D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M,
+	/* 0xF0 */ D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M, D_M
+};
+
+static BOOL Decode_IsLegacyPrefix(BYTE uByte);
+static BYTE Decode_MapFlags(U32 uMap, BYTE uOpcode);
+static DECODE_FLOW Decode_Flow(U32 uMap, BYTE uOpcode, BYTE uModRm);
+static BOOL Decode_Rel32(ADDRESS aNext, ADDRESS aTarget, I32* piRel);
+static U32 Decode_EmitJump(BYTE* pOut, ADDRESS aAt, ADDRESS aTarget);
+static U32 Decode_EmitBranch(BYTE const* pInsn, DECODED const* pDecoded, ADDRESS aAt, ADDRESS aTarget, BYTE* pOut);
+static ADDRESS Decode_BranchTarget(BYTE const* pInsn, DECODED const* pDecoded, ADDRESS aInsn);
+
+static BOOL Decode_IsLegacyPrefix(BYTE const uByte)
+{
+	switch (uByte)
+	{
+	case 0x26: case 0x2E: case 0x36: case 0x3E: case 0x64: case 0x65:
+	case 0x66: case 0x67: case 0xF0: case 0xF2: case 0xF3:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static BYTE Decode_MapFlags(U32 const uMap, BYTE const uOpcode)
+{
+	/* Maps 1-3 are 0F, 0F 38 and 0F 3A. VEX and EVEX reach the same maps, 5 and 6 are EVEX only, 8-A are XOP. */
+	switch (uMap)
+	{
+	case 0:
+		return gOneByte[uOpcode];
+	case 1:
+		return gTwoByte[uOpcode];
+	case 2:
+	case 5:
+	case 6:
+	case 9:
+		return D_M;
+	case 3:
+	case 8:
+		return D_M | D_I8;
+	case 0xA:
+		return D_M | D_IZ;
+	default:
+		return D_X;
+	}
+}
+
+static DECODE_FLOW Decode_Flow(U32 const uMap, BYTE const uOpcode, BYTE const uModRm)
+{
+	if (1 == uMap)
+	{
+		if (0x80 == (uOpcode & 0xF0))
+		{
+			return DECODE_FLOW_JCC;
+		}
+		/* ud2, ud1, ud0 */
+		return (0x0B == uOpcode || 0xB9 == uOpcode || 0xFF == uOpcode) ? DECODE_FLOW_END : DECODE_FLOW_NEXT;
+	}
+	if (0 != uMap)
+	{
+		return DECODE_FLOW_NEXT;
+	}
+	if (0x70 == (uOpcode & 0xF0))
+	{
+		return DECODE_FLOW_JCC;
+	}
+	switch (uOpcode)
+	{
+	case 0xE0: case 0xE1: case 0xE2: case 0xE3:
+		return DECODE_FLOW_LOOP;
+	case 0xE8:
+		return DECODE_FLOW_CALL;
+	case 0xE9: case 0xEB:
+		return DECODE_FLOW_JUMP;
+	case 0xC2: case 0xC3: case 0xCA: case 0xCB: case 0xCC: case 0xCF: case 0xF4:
+		return DECODE_FLOW_END;
+	case 0xFF:
+		/* FF /4 and FF /5 are indirect jumps. */
+		return (4 == ((uModRm >> 3) & 7) || 5 == ((uModRm >> 3) & 7)) ? DECODE_FLOW_END : DECODE_FLOW_NEXT;
+	default:
+		return DECODE_FLOW_NEXT;
+	}
+}
+
+BOOL Decode_Instruction(BYTE const * const pCode, U32 const uAvailable, DECODED* const pDecoded)
+{
+	U32 const uLimit = (uAvailable < DECODE_MAX_INSTRUCTION_LEN) ? uAvailable : DECODE_MAX_INSTRUCTION_LEN;
+	U32 i = 0;
+	BOOL bOperand16 = FALSE;
+	BOOL bAddress32 = FALSE;
+	BOOL bRexW = FALSE;
+
+	/* A REX prefix only counts right before the opcode, a legacy prefix after it cancels it. */
+	while (i < uLimit)
+	{
+		BYTE const uByte = pCode[i];
+		if (Decode_IsLegacyPrefix(uByte))
+		{
+			bOperand16 = bOperand16 || (0x66 == uByte);
+			bAddress32 = bAddress32 || (0x67 == uByte);
+			bRexW = FALSE;
+		}
+		else if (0x40 == (uByte & 0xF0))
+		{
+			bRexW = (0 != (uByte & 0x08));
+		}
+		else
+		{
+			break;
+		}
+		i++;
+	}
+	if (i + 1 > uLimit)
+	{
+		return FALSE;
+	}
+
+	U32 uMap = 0;
+	BOOL bVex = FALSE;
+	BYTE uOpcode = pCode[i];
+	if (0x0F == uOpcode)
+	{
+		if (i + 2 > uLimit)
+		{
+			return FALSE;
+		}
+		uMap = 1;
+		i++;
+		if (0x38 == pCode[i] || 0x3A == pCode[i])
+		{
+			uMap = (0x38 == pCode[i]) ? 2 : 3;
+			i++;
+		}
+	}
+	else if (0xC5 == uOpcode)
+	{
+		/* VEX is always VEX in 64-bit mode. The operand size comes from the prefix, never from 66. */
+		uMap = 1;
+		i += 2;
+		bOperand16 = FALSE;
+		bVex = TRUE;
+	}
+	else if (0xC4 == uOpcode || (0x8F == uOpcode && i + 1 < uLimit && 8 <= (pCode[i + 1] & 0x1F)))
+	{
+		/* 3-byte VEX, or XOP: 8F is pop r/m64 unless its map field is 8 or above. */
+		if (i + 3 > uLimit)
+		{
+			return FALSE;
+		}
+		uMap = pCode[i + 1] & 0x1F;
+		i += 3;
+		bOperand16 = FALSE;
+		bVex = TRUE;
+	}
+	else if (0x62 == uOpcode)
+	{
+		if (i + 4 > uLimit)
+		{
+			return FALSE;
+		}
+		uMap = pCode[i + 1] & 0x07;
+		i += 4;
+		bOperand16 = FALSE;
+		bVex = TRUE;
+	}
+	if (i + 1 > uLimit)
+	{
+		return FALSE;
+	}
+	uOpcode = pCode[i++];
+
+	BYTE uFlags = Decode_MapFlags(uMap, uOpcode);
+	/* No VEX, EVEX or XOP encoding has a relative operand, and none lives in the one-byte map. */
+	if (bVex && (0 == uMap || 0 != (uFlags & (D_R8 | D_RZ))))
+	{
+		return FALSE;
+	}
+	if (0 != (uFlags & D_X))
+	{
+		return FALSE;
+	}
+
+	pDecoded->uDispOffset = 0;
+	pDecoded->uRelOffset = 0;
+	pDecoded->uRelLen = 0;
+	pDecoded->uOpcode = uOpcode;
+
+	BYTE uModRm = 0;
+	if (0 != (uFlags & D_M))
+	{
+		if (i + 1 > uLimit)
+		{
+			return FALSE;
+		}
+		uModRm = pCode[i++];
+		BYTE const uMod = uModRm >> 6;
+		BYTE const uRm = uModRm & 7;
+		U32 uDispLen = (1 == uMod) ? 1 : ((2 == uMod) ? 4 : 0);
+		if (3 != uMod && 4 == uRm)
+		{
+			if (i + 1 > uLimit)
+			{
+				return FALSE;
+			}
+			uDispLen = (0 == uMod && 5 == (pCode[i] & 7)) ? 4 : uDispLen;
+			i++;
+		}
+		else if (0 == uMod && 5 == uRm)
+		{
+			pDecoded->uDispOffset = i;
+			uDispLen = 4;
+		}
+		i += uDispLen;
+
+		/* test r/m, imm is the only member of the F6 / F7 groups with an immediate. */
+		if (0 == uMap && (0xF6 == uOpcode || 0xF7 == uOpcode) && 2 > ((uModRm >> 3) & 7))
+		{
+			uFlags |= (0xF6 == uOpcode) ? D_I8 : D_IZ;
+		}
+		/* xbegin rel32 has no short form to widen. */
+		if (0 == uMap && 0xC7 == uOpcode && 0xF8 == uModRm)
+		{
+			return FALSE;
+		}
+	}
+
+	if (0 == uMap && 0xA0 <= uOpcode && 0xA3 >= uOpcode)
+	{
+		/* mov with a moffs operand, as wide as an address. */
+		i += bAddress32 ? 4 : 8;
+	}
+	i += (0 != (uFlags & D_I8)) ? 1 : 0;
+	i += (0 != (uFlags & D_I16)) ? 2 : 0;
+	i += (0 != (uFlags & D_IZ)) ? ((bOperand16 && !bRexW) ? 2 : 4) : 0;
+	i += (0 != (uFlags & D_IV)) ? (bRexW ? 8 : (bOperand16 ? 2 : 4)) : 0;
+	if (0 != (uFlags & (D_R8 | D_RZ)))
+	{
+		/* 66 truncates the target on some processors unless REX.W overrides it, compilers only pad TLS calls that way. */
+		if (bOperand16 && !bRexW)
+		{
+			return FALSE;
+		}
+		pDecoded->uRelOffset = i;
+		pDecoded->uRelLen = (0 != (uFlags & D_R8)) ? 1 : 4;
+		i += pDecoded->uRelLen;
+	}
+
+	if (i > uLimit)
+	{
+		return FALSE;
+	}
+	pDecoded->uLen = i;
+	pDecoded->eFlow = Decode_Flow(uMap, uOpcode, uModRm);
+	return TRUE;
+}
+
+static BOOL Decode_Rel32(ADDRESS const aNext, ADDRESS const aTarget, I32* const piRel)
+{
+	I64 const iDistance = (I64)(aTarget - aNext);
+	if (iDistance < -(I64)0x80000000LL || iDistance > (I64)0x7FFFFFFF)
+	{
+		return FALSE;
+	}
+	*piRel = (I32)iDistance;
+	return TRUE;
+}
+
+static U32 Decode_EmitJump(BYTE* const pOut, ADDRESS const aAt, ADDRESS const aTarget)
+{
+	/* E9 rel32 when the target is in reach, otherwise FF 25 00000000 followed by the absolute target. */
+	I32 iRel = 0;
+	if (Decode_Rel32(aAt + 5, aTarget, &iRel))
+	{
+		pOut[0] = 0xE9;
+		Memory_Copy(&pOut[1], &iRel, sizeof(iRel));
+		return 5;
+	}
+	pOut[0] = 0xFF;
+	pOut[1] = 0x25;
+	Memory_Set(&pOut[2], 0, 4);
+	Memory_Copy(&pOut[6], &aTarget, sizeof(aTarget));
+	return 14;
+}
+
+static U32 Decode_EmitBranch(BYTE const * const pInsn, DECODED const * const pDecoded, ADDRESS const aAt, ADDRESS const aTarget, BYTE* const pOut)
+{
+	I32 iRel = 0;
+	switch (pDecoded->eFlow)
+	{
+	case DECODE_FLOW_CALL:
+		if (Decode_Rel32(aAt + 5, aTarget, &iRel))
+		{
+			pOut[0] = 0xE8;
+			Memory_Copy(&pOut[1], &iRel, sizeof(iRel));
+			return 5;
+		}
+		/* call [rip+2] ; jmp +8 ; target. The call returns onto the short jump over the target. */
+		pOut[0] = 0xFF;
+		pOut[1] = 0x15;
+		pOut[2] = 0x02;
+		Memory_Set(&pOut[3], 0, 3);
+		pOut[6] = 0xEB;
+		pOut[7] = 0x08;
+		Memory_Copy(&pOut[8], &aTarget, sizeof(aTarget));
+		return 16;
+
+	case DECODE_FLOW_JUMP:
+		return Decode_EmitJump(pOut, aAt, aTarget);
+
+	case DECODE_FLOW_JCC:
+	{
+		BYTE const uCondition = pDecoded->uOpcode & 0x0F;
+		if (Decode_Rel32(aAt + 6, aTarget, &iRel))
+		{
+			pOut[0] = 0x0F;
+			pOut[1] = (BYTE)(0x80 | uCondition);
+			Memory_Copy(&pOut[2], &iRel, sizeof(iRel));
+			return 6;
+		}
+		/* The inverted condition skips the absolute jump. */
+		U32 const uJumpLen = Decode_EmitJump(&pOut[2], aAt + 2, aTarget);
+		pOut[0] = (BYTE)(0x70 | (uCondition ^ 1));
+		pOut[1] = (BYTE)uJumpLen;
+		return 2 + uJumpLen;
+	}
+
+	case DECODE_FLOW_LOOP:
+	{
+		/* loop +2 ; jmp short over ; jump to the target. Prefixes stay, 67 selects ecx. */
+		U32 const uPrefixLen = pDecoded->uRelOffset - 1;
+		Memory_Copy(pOut, pInsn, uPrefixLen);
+		pOut[uPrefixLen] = pDecoded->uOpcode;
+		pOut[uPrefixLen + 1] = 0x02;
+		U32 const uJumpLen = Decode_EmitJump(&pOut[uPrefixLen + 4], aAt + uPrefixLen + 4, aTarget);
+		pOut[uPrefixLen + 2] = 0xEB;
+		pOut[uPrefixLen + 3] = (BYTE)uJumpLen;
+		return uPrefixLen + 4 + uJumpLen;
+	}
+
+	default:
+		return 0;
+	}
+}
+
+static ADDRESS Decode_BranchTarget(BYTE const * const pInsn, DECODED const * const pDecoded, ADDRESS const aInsn)
+{
+	I64 iRel = (I8)pInsn[pDecoded->uRelOffset];
+	if (4 == pDecoded->uRelLen)
+	{
+		I32 iRel32 = 0;
+		Memory_Copy(&iRel32, pInsn + pDecoded->uRelOffset, sizeof(iRel32));
+		iRel = iRel32;
+	}
+	return aInsn + pDecoded->uLen + (ADDRESS)iRel;
+}
+
+BOOL Decode_Relocate(BYTE const * const pCode, U32 const uCodeLen, ADDRESS const aFrom, ADDRESS const aTo, U32 const uMinLen, U32 const uFuncLen, BYTE* const pOut, U32 const uOutCapacity, U32* const puTaken, U32* const puOutLen)
+{
+	U32 uTaken = 0;
+	U32 uOutLen = 0;
+	ADDRESS aInnerTarget = (ADDRESS)-1;
+	while (uTaken < uMinLen)
+	{
+		DECODED decoded;
+		if (!Decode_Instruction(pCode + uTaken, uCodeLen - uTaken, &decoded))
+		{
+			return FALSE;
+		}
+		if (0 != uFuncLen && uTaken + decoded.uLen > uFuncLen)
+		{
+			return FALSE;
+		}
+
+		BYTE const* const pInsn = pCode + uTaken;
+		ADDRESS const aNext = aFrom + uTaken + decoded.uLen;
+		ADDRESS const aAt = aTo + uOutLen;
+		BYTE bufInsn[DECODE_RELOCATED_MAX];
+		U32 uInsnLen = decoded.uLen;
+		if (0 != decoded.uRelOffset)
+		{
+			ADDRESS const aTarget = Decode_BranchTarget(pInsn, &decoded, aFrom + uTaken);
+			if (aTarget > aFrom && aTarget < aInnerTarget)
+			{
+				aInnerTarget = aTarget;
+			}
+			uInsnLen = Decode_EmitBranch(pInsn, &decoded, aAt, aTarget, bufInsn);
+		}
+		else
+		{
+			Memory_Copy(bufInsn, pInsn, decoded.uLen);
+			if (0 != decoded.uDispOffset)
+			{
+				/* The operand keeps pointing at the same data, measured from the end of the moved instruction. */
+				I32 iDisp = 0;
+				Memory_Copy(&iDisp, pInsn + decoded.uDispOffset, sizeof(iDisp));
+				if (!Decode_Rel32(aAt + decoded.uLen, aNext + (ADDRESS)(I64)iDisp, &iDisp))
+				{
+					return FALSE;
+				}
+				Memory_Copy(&bufInsn[decoded.uDispOffset], &iDisp, sizeof(iDisp));
+			}
+		}
+		if (0 == uInsnLen || uOutLen + uInsnLen > uOutCapacity)
+		{
+			return FALSE;
+		}
+		Memory_Copy(pOut + uOutLen, bufInsn, uInsnLen);
+		uOutLen += uInsnLen;
+		uTaken += decoded.uLen;
+
+		/* Without a known length, whatever follows the end of the code may belong to another function. */
+		BOOL const bEnds = (DECODE_FLOW_END == decoded.eFlow || DECODE_FLOW_JUMP == decoded.eFlow);
+		if (bEnds && uTaken < uMinLen && 0 == uFuncLen)
+		{
+			return FALSE;
+		}
+	}
+
+	/*
+	 * The rest of the code is only scanned: a branch back into the taken bytes, from them or from
+	 * further on, would land in the middle of the jump to the stub. Scanning stops at the first
+	 * byte that does not decode, code past the function end cannot branch there anyway.
+	 */
+	U32 const uScanEnd = (0 != uFuncLen && uFuncLen < uCodeLen) ? uFuncLen : uCodeLen;
+	U32 uOffset = uTaken;
+	while (uOffset < uScanEnd)
+	{
+		DECODED decoded;
+		if (!Decode_Instruction(pCode + uOffset, uScanEnd - uOffset, &decoded))
+		{
+			break;
+		}
+		if (0 != decoded.uRelOffset)
+		{
+			ADDRESS const aTarget = Decode_BranchTarget(pCode + uOffset, &decoded, aFrom + uOffset);
+			if (aTarget > aFrom && aTarget < aInnerTarget)
+			{
+				aInnerTarget = aTarget;
+			}
+		}
+		uOffset += decoded.uLen;
+	}
+	if (aInnerTarget < aFrom + uTaken)
+	{
+		return FALSE;
+	}
+	*puTaken = uTaken;
+	*puOutLen = uOutLen;
+	return TRUE;
+}
@@ -0,0 +1,44 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include "types.h"
+
+#define DECODE_MAX_INSTRUCTION_LEN (15)
+
+typedef enum tdDECODE_FLOW {
+	DECODE_FLOW_NEXT, /* falls through to the next instruction */
+	DECODE_FLOW_CALL, /* call rel32, returns to the next instruction */
+	DECODE_FLOW_JUMP, /* jmp rel8 / rel32 */
+	DECODE_FLOW_JCC, /* jcc rel8 / rel32 */
+	DECODE_FLOW_LOOP, /* loop / loope / loopne / jrcxz rel8, no rel32 form exists */
+	DECODE_FLOW_END /* ret, indirect jmp, int3, ud2, hlt... nothing after it is reached */
+} DECODE_FLOW;
+
+/*
+ * Length and address dependencies of one instruction, offsets are from its first byte.
+ * uDispOffset locates the disp32 of a RIP-relative memory operand, uRelOffset the rel8 / rel32
+ * of a relative branch (uRelLen bytes). Both are 0 when absent, an opcode byte never sits at 0 for them.
+ */
+typedef struct tdDECODED {
+	U32 uLen;
+	U32 uDispOffset;
+	U32 uRelOffset;
+	U32 uRelLen;
+	DECODE_FLOW eFlow;
+	BYTE uOpcode; /* last opcode byte, the condition code for jcc */
+	BYTE _padding[3];
+} DECODED;
+
+/* Table driven length decoder for 64-bit mode. FALSE for invalid or unsupported encodings, or when uAvailable is too short. */
+BOOL Decode_Instruction(BYTE const* pCode, U32 uAvailable, DECODED* pDecoded);
+
+/*
+ * Rewrites whole instructions from pCode, which was read at aFrom, to run at aTo until at least uMinLen
+ * bytes are taken. RIP-relative operands are re-aimed, short branches widened and branches out of
+ * rel32 reach turned into absolute jumps. Fails for operands that cannot reach their target from aTo,
+ * for branches into the taken bytes from anywhere in pCode and, when uFuncLen is 0 (function length
+ * unknown), when the code ends before uMinLen. A non-zero uFuncLen bounds *puTaken and the scanned code.
+ */
+BOOL Decode_Relocate(BYTE const* pCode, U32 uCodeLen, ADDRESS aFrom, ADDRESS aTo, U32 uMinLen, U32 uFuncLen, BYTE* pOut, U32 uOutCapacity, U32* puTaken, U32* puOutLen);
+
+#endif /* DECODE_H */
@@ -1,212 +1,1406 @@
 #include "floc.h"
 #include "tracker.h"
 #include "hook.h"
+#include "sort.h"
 
-#define MAX_CONTEXTS_COUNT 4
-static FLOC_CTX* gContexts[MAX_CONTEXTS_COUNT] = { 0 };
-static U32 gContextCount = 0;
+typedef struct tdTRACKER_RANGE_COLLECT {
+	ADDRESS* pAddresses;
+	U32 uCapacity;
+	U32 uCount;
+} TRACKER_RANGE_COLLECT;
+
+typedef struct tdTRACKER_PAGE_COLLECT {
+	FLOC_CTX const* pCtx;
+	ADDRESS* pPages;
+	TRACKER** ppTrackers;
+	U32 uCapacity;
+	U32 uCount;
+	BOOL bHitOnly;
+	BYTE _padding[4];
+} TRACKER_PAGE_COLLECT;
+
+typedef struct tdTRACKER_SNAPSHOT_COLLECT {
+	FLOC_CTX const* pCtx;
+	TRACKER* const* ppPages;
+	TRACKER* const* ppDeleted;
+	ADDRESS* pAddresses;
+	U64* puHitBits;
+	U64* puEnabledBits;
+	U64* puAliveBits;
+	U32 uPageCount;
+	U32 uPageNext;
+	U32 uDeletedCount;
+	U32 uDeletedNext;
+	U32 uCapacity;
+	U32 uCount;
+} TRACKER_SNAPSHOT_COLLECT;
+
+typedef struct tdTRACKER_LIVE_COLLECT {
+	VECTOR const* pvecTrackers;
+	TRACKER** ppTrackers;
+	U32 uCount;
+	BYTE _padding[4];
+} TRACKER_LIVE_COLLECT;
+
+typedef struct tdHW_CANDIDATES {
+	TRACKER* apBest[HW_BREAKPOINT_COUNT];
+	U32 uBest;
+	U32 uFree;
+} HW_CANDIDATES;
+
+typedef struct tdTRACKER_COUNTER_COLLECT {
+	FLOC_CTX const* pCtx;
+	HIT_SNAPSHOT const* pSnapshot;
+	ADDRESS* pAddresses;
+	U64* puCounts;
+	U32 uCapacity;
+	U32 uCount;
+} TRACKER_COUNTER_COLLECT;
+
+static INDEX* FLOC_TrackerIndexOf(FLOC_CTX* pCtx, TRACKER const* pTracker);
+static LOOKUP* FLOC_TrackerLookupOf(FLOC_CTX* pCtx, TRACKER const* pTracker);
+static BOOL FLOC_TrackerRangeVisit(void* pParam, ADDRESS aAddress, U32 uIndex);
+static BOOL FLOC_PageRangeVisit(void* pParam, ADDRESS aAddress, U32 uIndex);
+static BOOL FLOC_TrackerLiveVisit(void* pParam, ADDRESS aAddress, U32 uIndex);
+static U32 FLOC_PageRunEnd(TRACKER* const* ppTrackers, U32 uFirst, U32 uCount);
+static void FLOC_PagesProtect(TRACKER* const* ppTrackers, U32 uCount, BOOL bRevoke, PROCESS hProcess);
+static BOOL FLOC_TrackerCounterVisit(void* pParam, ADDRESS aAddress, U32 uIndex);
+static int FLOC_TrackerAddressCompare(void const* pLeft, void const* pRight);
+static void FLOC_HitPublish(FLOC_CTX* pCtx, TID tidThread, TRACKER const* pTracker);
+static void FLOC_SnapshotEmit(TRACKER_SNAPSHOT_COLLECT* pCollect, TRACKER const* pTracker);
+static void FLOC_SnapshotDrain(TRACKER_SNAPSHOT_COLLECT* pCollect, ADDRESS aBefore, BOOL bAll);
+static BOOL FLOC_SnapshotVisit(void* pParam, ADDRESS aAddress, U32 uIndex);
+static BOOL FLOC_TrackerPatchRestore(TRACKER const* pTracker, U32 uTag, PATCH_BATCH* pBatch, PROCESS hProcess);
+static void FLOC_HitPublish(FLOC_CTX* const pCtx, TID const tidThread, TRACKER const * const pTracker)
+{
+	if (NULL == pCtx->pHitRing)
+	{
+		return;
+	}
+	HIT_RECORD record;
+	record.aAddress = pTracker->aAddress;
+	record.uTimestamp = Time_Now();
+	record.tidThread = tidThread;
+	record.uType = (U32)pTracker->eType;
+	Ring_Push(pCtx->pHitRing, &record);
+}
+
+BOOL FLOC_PageFaultHandler(void* const pParam, TID const tidThread, ADDRESS const aPage, U32* const puProtect)
+{
+	FLOC_CTX* const pCtx = (FLOC_CTX*)pParam;
+	TRACKER* const pTracker = FLOC_PageFind(pCtx, aPage);
+	if (NULL == pTracker || !pTracker->bEnabled)
+	{
+		return FALSE;
+	}
+
+	if (pCtx->bIsStepActive)
+	{
+		pTracker->bHit = TRUE;
+	}
+
+	/* The protection is put back inside Target_WaitForBreakpoint immediately after return from here. */
+	pTracker->bEnabled = FALSE;
+	Atomic_Increment(&(pCtx->uGeneration));
+	FLOC_HitPublish(pCtx, tidThread, pTracker);
+	*puProtect = pTracker->u.page.uProtect;
+	return TRUE;
+}
+
+static BOOL FLOC_HwIsHotter(TRACKER const* pLeft, TRACKER const* pRight);
+static BOOL FLOC_HwCandidateVisit(void* pParam, ADDRESS aAddress, void* pValue);
+static BOOL FLOC_HwSlotsFill(FLOC_CTX* pCtx);
+static BOOL FLOC_HwUnarm(FLOC_CTX* pCtx, TRACKER* pTracker);
+static BOOL FLOC_HwSlotsSync(FLOC_CTX* pCtx);
+static BOOL FLOC_HwSlotsRotate(FLOC_CTX* pCtx);
+static BOOL FLOC_HwOwnedByLoop(FLOC_CTX const* pCtx);
+static void FLOC_HwRequestsServe(FLOC_CTX* pCtx);
+static BOOL FLOC_TrackerCompactDue(FLOC_CTX const* pCtx);
+static void FLOC_TrackerCompactNow(FLOC_CTX* pCtx);
+static void FLOC_CompactRequestsServe(FLOC_CTX* pCtx);
+
+#define DEBUG_LOOP_WAIT_MS (2)
+
+/* Segment k holds HANDLE_SEGMENT_BASE << k slots, so the table grows without moving a slot. */
+#define HANDLE_SEGMENT_BASE (16)
+#define HANDLE_SEGMENT_COUNT (28)
+#define HANDLE_FREE_NONE (0xFFFFFFFF)
+#define HANDLE_KIND_CONTEXT (1)
+#define HANDLE_KIND_GROUP (2)
+
+typedef struct tdHANDLE_SLOT {
+	U64 volatile uObject; /* FLOC_CTX* or GROUP*, read with Atomic_LoadAcquire */
+	U64 volatile uGeneration; /* bumped on every clear, handles of the previous owner stop matching */
+	U32 uKind;
+	U32 uNextFree;
+} HANDLE_SLOT;
+
+static HANDLE_SLOT* FLOC_HandleSlotOf(U32 uIndex);
+static void FLOC_HandleLock(void);
+static void FLOC_HandleUnlock(void);
+static void* FLOC_HandleGet(U64 uHandle, U32 uKind);
+static U64 FLOC_HandleInsert(void* pObject, U32 uKind);
+static void FLOC_HandleClear(U64 uHandle);
+
+/*
+ * Context and group handles share one table. A handle is the slot index in the low half and the slot
+ * generation in the high half, the kind of the slot tells contexts and groups apart. Lookups take no
+ * lock, segments are published before any of their slots is handed out and are never freed. Insert
+ * and clear serialize on gHandleLock. Free slots are chained through uNextFree.
+ */
+static U64 volatile gHandleSegments[HANDLE_SEGMENT_COUNT] = { 0 };
+static U32 volatile gHandleLock = 0;
+static U32 gHandleSlotCount = 0;
+static U32 gHandleFreeHead = HANDLE_FREE_NONE;
+
+static HANDLE_SLOT* FLOC_HandleSlotOf(U32 const uIndex)
+{
+	U32 uSegment = 0;
+	U64 uFirst = 0;
+	while (uSegment < HANDLE_SEGMENT_COUNT && uIndex - uFirst >= ((U64)HANDLE_SEGMENT_BASE << uSegment))
+	{
+		uFirst += (U64)HANDLE_SEGMENT_BASE << uSegment;
+		uSegment++;
+	}
+	if (HANDLE_SEGMENT_COUNT == uSegment)
+	{
+		return NULL;
+	}
+	HANDLE_SLOT* const pSegment = (HANDLE_SLOT*)Atomic_LoadAcquire(&(gHandleSegments[uSegment]));
+	return (NULL == pSegment) ? NULL : &(pSegment[uIndex - uFirst]);
+}
+
+static void FLOC_HandleLock(void)
+{
+	/* Held only for a few stores, a waiter pauses first and yields if the holder was preempted. */
+	for (U32 uRound = 0; !Atomic_CompareExchange(&gHandleLock, 0, 1); uRound++)
+	{
+		Thread_SpinWait(uRound);
+	}
+}
+
+static void FLOC_HandleUnlock(void)
+{
+	Atomic_CompareExchange(&gHandleLock, 1, 0);
+}
+
+static void* FLOC_HandleGet(U64 const uHandle, U32 const uKind)
+{
+	U32 const uIndex = (U32)uHandle;
+	U64 const uGeneration = uHandle >> 32;
+	HANDLE_SLOT* const pSlot = FLOC_HandleSlotOf(uIndex);
+	if (NULL == pSlot || 0 == uGeneration || uGeneration != Atomic_LoadAcquire(&(pSlot->uGeneration)))
+	{
+		return NULL;
+	}
+
+	/* A clear in between bumps the generation first, the second check catches it. */
+	void* const pObject = (void*)Atomic_LoadAcquire(&(pSlot->uObject));
+	U32 const uSlotKind = pSlot->uKind;
+	if (uGeneration != Atomic_LoadAcquire(&(pSlot->uGeneration)) || uKind != uSlotKind)
+	{
+		return NULL;
+	}
+	return pObject;
+}
+
+static U64 FLOC_HandleInsert(void* const pObject, U32 const uKind)
+{
+	U64 uHandle = 0;
+	FLOC_HandleLock();
+
+	U32 uIndex = gHandleFreeHead;
+	HANDLE_SLOT* pSlot = NULL;
+	if (HANDLE_FREE_NONE != uIndex)
+	{
+		pSlot = FLOC_HandleSlotOf(uIndex);
+		gHandleFreeHead = pSlot->uNextFree;
+	}
+	else
+	{
+		uIndex = gHandleSlotCount;
+		pSlot = FLOC_HandleSlotOf(uIndex);
+		if (NULL == pSlot)
+		{
+			/* The first index past the last segment, the next one starts here. */
+			U32 uSegment = 0;
+			U64 uFirst = 0;
+			while (uFirst < uIndex)
+			{
+				uFirst += (U64)HANDLE_SEGMENT_BASE << uSegment;
+				uSegment++;
+			}
+			U64 const uSize = ((U64)HANDLE_SEGMENT_BASE << uSegment) * sizeof(HANDLE_SLOT);
+			HANDLE_SLOT* const pSegment = (uSegment < HANDLE_SEGMENT_COUNT) ? Memory_Alloc(uSize) : NULL;
+			if (NULL != pSegment)
+			{
+				Memory_Set(pSegment, 0, uSize);
+				Atomic_StoreRelease(&(gHandleSegments[uSegment]), (U64)pSegment);
+				pSlot = pSegment;
+			}
+		}
+		if (NULL != pSlot)
+		{
+			gHandleSlotCount++;
+			Atomic_StoreRelease(&(pSlot->uGeneration), 1);
+		}
+	}
+
+	if (NULL != pSlot)
+	{
+		pSlot->uNextFree = HANDLE_FREE_NONE;
+		pSlot->uKind = uKind;
+		Atomic_StoreRelease(&(pSlot->uObject), (U64)pObject);
+		uHandle = (pSlot->uGeneration << 32) | uIndex;
+	}
+
+	FLOC_HandleUnlock();
+	return uHandle;
+}
+
+static void FLOC_HandleClear(U64 const uHandle)
+{
+	FLOC_HandleLock();
+
+	U32 const uIndex = (U32)uHandle;
+	U64 const uGeneration = uHandle >> 32;
+	HANDLE_SLOT* const pSlot = FLOC_HandleSlotOf(uIndex);
+	if (NULL != pSlot && 0 != uGeneration && uGeneration == pSlot->uGeneration)
+	{
+		/* Generation 0 is never handed out, so no handle is ever NULL or matches a fresh slot. */
+		U64 const uNext = (uGeneration + 1) & 0xFFFFFFFF;
+		Atomic_StoreRelease(&(pSlot->uGeneration), (0 == uNext) ? 1 : uNext);
+		Atomic_StoreRelease(&(pSlot->uObject), 0);
+		pSlot->uNextFree = gHandleFreeHead;
+		gHandleFreeHead = uIndex;
+	}
+
+	FLOC_HandleUnlock();
+}
 
 FLOC_CTX* FLOC_ContextGet(FLOC_HANDLE const hHandle)
 {
-	if (gContexts[0] == (FLOC_CTX*)hHandle)
+	return FLOC_HandleGet((U64)hHandle, HANDLE_KIND_CONTEXT);
+}
+
+FLOC_HANDLE FLOC_ContextInsert(FLOC_CTX* const pCtx)
+{
+	return (FLOC_HANDLE)FLOC_HandleInsert(pCtx, HANDLE_KIND_CONTEXT);
+}
+
+void FLOC_ContextClear(FLOC_HANDLE const hHandle)
+{
+	if (NULL != FLOC_ContextGet(hHandle))
+	{
+		FLOC_HandleClear((U64)hHandle);
+	}
+}
+
+GROUP* FLOC_GroupGet(FLOC_GROUP_HANDLE const hGroup)
+{
+	return FLOC_HandleGet((U64)hGroup, HANDLE_KIND_GROUP);
+}
+
+FLOC_GROUP_HANDLE FLOC_GroupInsert(GROUP* const pGroup)
+{
+	return (FLOC_GROUP_HANDLE)FLOC_HandleInsert(pGroup, HANDLE_KIND_GROUP);
+}
+
+void FLOC_GroupClear(FLOC_GROUP_HANDLE const hGroup)
+{
+	if (NULL != FLOC_GroupGet(hGroup))
+	{
+		FLOC_HandleClear((U64)hGroup);
+	}
+}
+
+BOOL FLOC_BreakpointHandler(FLOC_CTX* const pCtx, TID const tidThread, ADDRESS const aAddress, BYTE* const puOriginalByte)
+{
+	TRACKER* const pTracker = FLOC_TrackerFind(pCtx, aAddress);
+	if (NULL == pTracker || TRACKER_TYPE_BREAKPOINT_SW != pTracker->eType)
+	{
+		return FALSE;
+	}
+
+	if (pCtx->bIsStepActive)
+	{
+		pTracker->bHit = TRUE;
+	}
+	
+	/* Breakpoint will be removed inside Target_WaitForBreakpoint immediately after return from here. */
+	pTracker->bEnabled = FALSE;
+	Atomic_Increment(&(pCtx->uGeneration));
+	FLOC_HitPublish(pCtx, tidThread, pTracker);
+
+	*puOriginalByte = pTracker->u.bp.uOriginalByte;
+	return TRUE;
+}
+
+void FLOC_HwBreakpointHandler(void* const pParam, TID const tidThread, ADDRESS const aAddress)
+{
+	FLOC_CTX* const pCtx = (FLOC_CTX*)pParam;
+	/* Hits of slots freed in the meantime find no armed tracker. */
+	TRACKER* const pTracker = FLOC_TrackerFind(pCtx, aAddress);
+	if (NULL == pTracker || TRACKER_TYPE_BREAKPOINT_HW != pTracker->eType || !pTracker->u.hwbp.bArmed)
+	{
+		return;
+	}
+
+	if (pCtx->bIsStepActive)
+	{
+		pTracker->bHit = TRUE;
+	}
+	pTracker->bEnabled = FALSE;
+	pTracker->u.hwbp.uHitCount++;
+	Atomic_Increment(&(pCtx->uGeneration));
+	FLOC_HitPublish(pCtx, tidThread, pTracker);
+	FLOC_HwUnarm(pCtx, pTracker);
+
+	/* We are on the debug loop, it writes the new slots into the threads before the target continues. */
+	FLOC_HwSlotsFill(pCtx);
+	pCtx->hwBreakpoints.uGeneration++;
+}
+
+static BOOL FLOC_HwIsHotter(TRACKER const * const pLeft, TRACKER const * const pRight)
+{
+	if (pLeft->u.hwbp.uHitCount != pRight->u.hwbp.uHitCount)
+	{
+		return pLeft->u.hwbp.uHitCount > pRight->u.hwbp.uHitCount;
+	}
+	if (pLeft->u.hwbp.uArmSequence != pRight->u.hwbp.uArmSequence)
+	{
+		return pLeft->u.hwbp.uArmSequence < pRight->u.hwbp.uArmSequence;
+	}
+	/* The lookup has no order of its own, the address makes the choice the same on every walk. */
+	return pLeft->aAddress < pRight->aAddress;
+}
+
+static BOOL FLOC_HwCandidateVisit(void* const pParam, ADDRESS const aAddress, void* const pValue)
+{
+	(void)aAddress;
+	HW_CANDIDATES* const pCandidates = (HW_CANDIDATES*)pParam;
+	TRACKER* const pTracker = (TRACKER*)pValue;
+	if (TRACKER_TYPE_BREAKPOINT_HW != pTracker->eType || !pTracker->bEnabled || pTracker->u.hwbp.bArmed)
+	{
+		return TRUE;
+	}
+	U32 uPos = pCandidates->uBest;
+	while (uPos > 0 && FLOC_HwIsHotter(pTracker, pCandidates->apBest[uPos - 1]))
+	{
+		uPos--;
+	}
+	if (uPos >= pCandidates->uFree)
+	{
+		return TRUE;
+	}
+	for (U32 j = (pCandidates->uBest < pCandidates->uFree) ? pCandidates->uBest : (pCandidates->uFree - 1); j > uPos; j--)
+	{
+		pCandidates->apBest[j] = pCandidates->apBest[j - 1];
+	}
+	pCandidates->apBest[uPos] = pTracker;
+	if (pCandidates->uBest < pCandidates->uFree)
+	{
+		pCandidates->uBest++;
+	}
+	return TRUE;
+}
+
+static BOOL FLOC_HwSlotsFill(FLOC_CTX* const pCtx)
+{
+	/* Free slots are only left over when no other hardware breakpoint is enabled. */
+	HW_BREAKPOINTS* const pHwBreakpoints = &(pCtx->hwBreakpoints);
+	HW_CANDIDATES candidates;
+	candidates.uBest = 0;
+	candidates.uFree = 0;
+	for (U32 i = 0; i < HW_BREAKPOINT_COUNT; i++)
+	{
+		if (0 == pHwBreakpoints->aSlots[i])
+		{
+			candidates.uFree++;
+		}
+	}
+	if (0 == candidates.uFree)
+	{
+		return FALSE;
+	}
+
+	/* One pass over the trackers keeps the uFree best candidates, hottest first. */
+	Lookup_Visit(&(pCtx->lkpTrackers), FLOC_HwCandidateVisit, &candidates);
+
+	U32 uNext = 0;
+	for (U32 i = 0; i < HW_BREAKPOINT_COUNT && uNext < candidates.uBest; i++)
+	{
+		if (0 != pHwBreakpoints->aSlots[i])
+		{
+			continue;
+		}
+		TRACKER* const pTracker = candidates.apBest[uNext++];
+		pTracker->u.hwbp.bArmed = TRUE;
+		pTracker->u.hwbp.bWatchedStep = FALSE;
+		pTracker->u.hwbp.uArmSequence = ++(pCtx->uHwArmSequence);
+		pHwBreakpoints->aSlots[i] = pTracker->aAddress;
+	}
+	return 0 != candidates.uBest;
+}
+
+static BOOL FLOC_HwUnarm(FLOC_CTX* const pCtx, TRACKER* const pTracker)
+{
+	if (!pTracker->u.hwbp.bArmed)
+	{
+		return FALSE;
+	}
+	for (U32 i = 0; i < HW_BREAKPOINT_COUNT; i++)
+	{
+		if (pTracker->aAddress == pCtx->hwBreakpoints.aSlots[i])
+		{
+			pCtx->hwBreakpoints.aSlots[i] = 0;
+		}
+	}
+	pTracker->u.hwbp.bArmed = FALSE;
+	pTracker->u.hwbp.bWatchedStep = FALSE;
+	return TRUE;
+}
+
+static BOOL FLOC_HwSlotsSync(FLOC_CTX* const pCtx)
+{
+	/* Disabling and removing only change the tracker, its slot is given up here. */
+	HW_BREAKPOINTS* const pHwBreakpoints = &(pCtx->hwBreakpoints);
+	BOOL bChanged = FALSE;
+	for (U32 i = 0; i < HW_BREAKPOINT_COUNT; i++)
+	{
+		if (0 == pHwBreakpoints->aSlots[i])
+		{
+			continue;
+		}
+		TRACKER* const pTracker = FLOC_TrackerFind(pCtx, pHwBreakpoints->aSlots[i]);
+		BOOL const bHw = (NULL != pTracker && TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType);
+		if (bHw && pTracker->bEnabled)
+		{
+			continue;
+		}
+		if (bHw)
+		{
+			FLOC_HwUnarm(pCtx, pTracker);
+		}
+		pHwBreakpoints->aSlots[i] = 0;
+		bChanged = TRUE;
+	}
+	return FLOC_HwSlotsFill(pCtx) || bChanged;
+}
+
+static BOOL FLOC_HwSlotsRotate(FLOC_CTX* const pCtx)
+{
+	HW_BREAKPOINTS* const pHwBreakpoints = &(pCtx->hwBreakpoints);
+	ADDRESS aPrevious[HW_BREAKPOINT_COUNT];
+	BOOL bAnyArmed = FALSE;
+	for (U32 i = 0; i < HW_BREAKPOINT_COUNT; i++)
+	{
+		aPrevious[i] = pHwBreakpoints->aSlots[i];
+		if (0 == aPrevious[i])
+		{
+			continue;
+		}
+		bAnyArmed = TRUE;
+		TRACKER* const pTracker = FLOC_TrackerFind(pCtx, aPrevious[i]);
+		if (NULL == pTracker || TRACKER_TYPE_BREAKPOINT_HW != pTracker->eType || !FLOC_HwUnarm(pCtx, pTracker))
+		{
+			pHwBreakpoints->aSlots[i] = 0;
+		}
+	}
+	if (!bAnyArmed)
+	{
+		return FALSE;
+	}
+
+	/* Breakpoints that waited get ahead of equally hot ones that were armed during the last step. */
+	FLOC_HwSlotsFill(pCtx);
+	for (U32 i = 0; i < HW_BREAKPOINT_COUNT; i++)
+	{
+		TRACKER* const pTracker = (0 == pHwBreakpoints->aSlots[i]) ? NULL : FLOC_TrackerFind(pCtx, pHwBreakpoints->aSlots[i]);
+		if (NULL != pTracker)
+		{
+			pTracker->u.hwbp.bWatchedStep = TRUE;
+		}
+	}
+	return 0 != Memory_Compare(aPrevious, pHwBreakpoints->aSlots, sizeof(aPrevious));
+}
+
+static BOOL FLOC_HwOwnedByLoop(FLOC_CTX const * const pCtx)
+{
+	return pCtx->bDbgLoopRunning && !pCtx->bForeignDebugLoop && NULL != pCtx->hProcess;
+}
+
+static void FLOC_HwRequestsServe(FLOC_CTX* const pCtx)
+{
+	/* Requests posted while this runs differ from the counts taken here and are served next time. */
+	U32 const uRotateRequests = pCtx->uHwRotateRequests;
+	U32 const uUpdateRequests = pCtx->uHwUpdateRequests;
+	BOOL bChanged = FALSE;
+	if (uRotateRequests != pCtx->uHwRotateServed)
+	{
+		pCtx->uHwRotateServed = uRotateRequests;
+		bChanged = FLOC_HwSlotsRotate(pCtx);
+	}
+	if (uUpdateRequests != pCtx->uHwUpdateServed)
+	{
+		pCtx->uHwUpdateServed = uUpdateRequests;
+		bChanged = FLOC_HwSlotsSync(pCtx) || bChanged;
+	}
+	if (bChanged)
+	{
+		pCtx->hwBreakpoints.uGeneration++;
+		Target_HwBreakpointsApply(pCtx->hProcess, &(pCtx->threads), &(pCtx->hwBreakpoints));
+	}
+}
+
+static void FLOC_CompactRequestsServe(FLOC_CTX* const pCtx)
+{
+	/* The requesting client waits until it sees the count, so it is the only writer of the vector meanwhile. */
+	U32 const uRequests = pCtx->uCompactRequests;
+	U32 const uServed = pCtx->uCompactServed;
+	if (uRequests == uServed)
+	{
+		return;
+	}
+	FLOC_TrackerCompactNow(pCtx);
+	/* A full barrier, the client reads the moved trackers only after it saw the new count. */
+	Atomic_CompareExchange(&(pCtx->uCompactServed), uServed, uRequests);
+}
+
+void FLOC_HwBreakpointsUpdate(FLOC_CTX* const pCtx)
+{
+	if (FLOC_HwOwnedByLoop(pCtx))
+	{
+		Atomic_Increment(&(pCtx->uHwUpdateRequests));
+		return;
+	}
+	if (FLOC_HwSlotsSync(pCtx))
+	{
+		pCtx->hwBreakpoints.uGeneration++;
+	}
+}
+
+void FLOC_HwBreakpointsRotate(FLOC_CTX* const pCtx)
+{
+	if (FLOC_HwOwnedByLoop(pCtx))
+	{
+		Atomic_Increment(&(pCtx->uHwRotateRequests));
+		return;
+	}
+	if (FLOC_HwSlotsRotate(pCtx))
+	{
+		pCtx->hwBreakpoints.uGeneration++;
+	}
+}
+
+void FLOC_DebugLoop(FLOC_CTX* const pCtx)
+{
+	if (!Target_DebuggerAttach(pCtx->pidTarget, &(pCtx->threads)))
+	{
+		return;
+	}
+
+	/* Stop and client requests are looked at after every batch of events, or every DEBUG_LOOP_WAIT_MS when none come. */
+	while (!pCtx->bStopDebugLoop)
+	{
+		FLOC_CompactRequestsServe(pCtx);
+		FLOC_HwRequestsServe(pCtx);
+		BOOL const bTargetDied = Target_WaitForBreakpoint(pCtx->hProcess, &(pCtx->threads), &(pCtx->regions), &(pCtx->hwBreakpoints), FLOC_BreakpointHandler, FLOC_HwBreakpointHandler, FLOC_PageFaultHandler, pCtx, DEBUG_LOOP_WAIT_MS);
+		if (bTargetDied)
+		{
+			pCtx->bDbgLoopRunning = FALSE;
+			pCtx->bTargetDied = TRUE;
+			break;
+		}
+	}
+
+	Target_DebuggerDetach(pCtx->pidTarget, &(pCtx->threads), &(pCtx->hwBreakpoints));
+	return;
+}
+
+BOOL FLOC_IsTargetAlive(FLOC_CTX const * const pCtx)
+{
+	/* The handle is kept open for the whole session, so liveness has to come from the process state. */
+	return Target_IsAlive(pCtx->hProcess);
+}
+
+TRACKER* FLOC_TrackerFind(FLOC_CTX const * const pCtx, ADDRESS const aAddress)
+{
+	return (TRACKER*)Lookup_Find(&(pCtx->lkpTrackers), aAddress);
+}
+
+TRACKER* FLOC_PageFind(FLOC_CTX const * const pCtx, ADDRESS const aPage)
+{
+	return (TRACKER*)Lookup_Find(&(pCtx->lkpPages), aPage);
+}
+
+static INDEX* FLOC_TrackerIndexOf(FLOC_CTX* const pCtx, TRACKER const * const pTracker)
+{
+	return (TRACKER_TYPE_PAGE_EXEC == pTracker->eType) ? &(pCtx->idxPages) : &(pCtx->idxTrackers);
+}
+
+static LOOKUP* FLOC_TrackerLookupOf(FLOC_CTX* const pCtx, TRACKER const * const pTracker)
+{
+	return (TRACKER_TYPE_PAGE_EXEC == pTracker->eType) ? &(pCtx->lkpPages) : &(pCtx->lkpTrackers);
+}
+
+BOOL FLOC_TrackerInsert(FLOC_CTX* const pCtx, TRACKER const * const pTracker)
+{
+	VECTOR* const pvecTrackers = &(pCtx->vecTrackers);
+	if (!Vector_PushBackCopy(pvecTrackers, pTracker))
+	{
+		return FALSE;
+	}
+	U32 const uIndex = pvecTrackers->uElemCount - 1;
+	INDEX* const pIndex = FLOC_TrackerIndexOf(pCtx, pTracker);
+	if (!Index_Insert(pIndex, pTracker->aAddress, uIndex))
+	{
+		pvecTrackers->uElemCount--;
+		return FALSE;
+	}
+	/* Published last, the debug loop may look the tracker up from here on. */
+	if (!Lookup_Insert(FLOC_TrackerLookupOf(pCtx, pTracker), pTracker->aAddress, Vector_AddressOf(pvecTrackers, uIndex)))
+	{
+		Index_Remove(pIndex, pTracker->aAddress);
+		pvecTrackers->uElemCount--;
+		return FALSE;
+	}
+	Atomic_Increment(&(pCtx->uGeneration));
+	return TRUE;
+}
+
+static BOOL FLOC_TrackerRangeVisit(void* const pParam, ADDRESS const aAddress, U32 const uIndex)
+{
+	(void)uIndex;
+	TRACKER_RANGE_COLLECT* const pCollect = (TRACKER_RANGE_COLLECT*)pParam;
+	if (pCollect->uCount < pCollect->uCapacity)
 	{
-		return (FLOC_CTX*)hHandle;
+		pCollect->pAddresses[pCollect->uCount] = aAddress;
 	}
+	pCollect->uCount++;
+	return TRUE;
+}
+
+U32 FLOC_TrackerRangeCollect(FLOC_CTX const * const pCtx, ADDRESS const aLow, ADDRESS const aHigh, ADDRESS* const pAddresses, U32 const uCapacity)
+{
+	TRACKER_RANGE_COLLECT collect;
+	collect.pAddresses = pAddresses;
+	collect.uCapacity = (NULL == pAddresses) ? 0 : uCapacity;
+	collect.uCount = 0;
+	Index_VisitRange(&(pCtx->idxTrackers), aLow, aHigh, FLOC_TrackerRangeVisit, &collect);
+	return collect.uCount;
+}
 
-	for (U32 i = 1; i < MAX_CONTEXTS_COUNT; i++)
+static BOOL FLOC_PageRangeVisit(void* const pParam, ADDRESS const aAddress, U32 const uIndex)
+{
+	TRACKER_PAGE_COLLECT* const pCollect = (TRACKER_PAGE_COLLECT*)pParam;
+	TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(&(pCollect->pCtx->vecTrackers), uIndex);
+	if (NULL == pTracker || (pCollect->bHitOnly && !pTracker->bHit))
+	{
+		return TRUE;
+	}
+	if (pCollect->uCount < pCollect->uCapacity)
 	{
-		if (gContexts[i] == (FLOC_CTX*)hHandle)
+		if (NULL != pCollect->pPages)
+		{
+			pCollect->pPages[pCollect->uCount] = aAddress;
+		}
+		if (NULL != pCollect->ppTrackers)
 		{
-			return (FLOC_CTX*)hHandle;
+			pCollect->ppTrackers[pCollect->uCount] = pTracker;
 		}
 	}
+	pCollect->uCount++;
+	return TRUE;
+}
 
-	return NULL;
+U32 FLOC_PageRangeCollect(FLOC_CTX const * const pCtx, ADDRESS const aLow, ADDRESS const aHigh, BOOL const bHitOnly, ADDRESS* const pPages, TRACKER** const ppTrackers, U32 const uCapacity)
+{
+	TRACKER_PAGE_COLLECT collect;
+	collect.pCtx = pCtx;
+	collect.pPages = pPages;
+	collect.ppTrackers = ppTrackers;
+	collect.uCapacity = (NULL == pPages && NULL == ppTrackers) ? 0 : uCapacity;
+	collect.uCount = 0;
+	collect.bHitOnly = bHitOnly;
+	Index_VisitRange(&(pCtx->idxPages), aLow, aHigh, FLOC_PageRangeVisit, &collect);
+	return collect.uCount;
 }
 
-void FLOC_ContextInsert(FLOC_CTX* const pCtx)
+static BOOL FLOC_TrackerLiveVisit(void* const pParam, ADDRESS const aAddress, U32 const uIndex)
 {
-	for (U32 i = 0; i < MAX_CONTEXTS_COUNT; i++)
+	(void)aAddress;
+	TRACKER_LIVE_COLLECT* const pCollect = (TRACKER_LIVE_COLLECT*)pParam;
+	TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(pCollect->pvecTrackers, uIndex);
+	if (NULL != pTracker)
 	{
-		if (NULL == gContexts[i])
-		{
-			gContexts[i] = pCtx;
-			gContextCount++;
-			break;
-		}
+		pCollect->ppTrackers[pCollect->uCount++] = pTracker;
+	}
+	return TRUE;
+}
+
+TRACKER** FLOC_TrackerLiveCollect(FLOC_CTX const * const pCtx, BOOL const bPages, U32* const puCount)
+{
+	/* Removed trackers are out of the indexes, so this never looks at slots waiting for compaction. */
+	*puCount = 0;
+	U32 const uCapacity = pCtx->idxTrackers.uCount + (bPages ? pCtx->idxPages.uCount : 0);
+	TRACKER** const ppTrackers = Memory_Alloc((U64)uCapacity * sizeof(TRACKER*) + 1);
+	if (NULL == ppTrackers)
+	{
+		return NULL;
+	}
+	TRACKER_LIVE_COLLECT collect;
+	collect.pvecTrackers = &(pCtx->vecTrackers);
+	collect.ppTrackers = ppTrackers;
+	collect.uCount = 0;
+	Index_VisitRange(&(pCtx->idxTrackers), 0, (ADDRESS)-1, FLOC_TrackerLiveVisit, &collect);
+	if (bPages)
+	{
+		Index_VisitRange(&(pCtx->idxPages), 0, (ADDRESS)-1, FLOC_TrackerLiveVisit, &collect);
 	}
+	*puCount = collect.uCount;
+	return ppTrackers;
 }
-void FLOC_ContextClear(FLOC_CTX const * const pCtx)
+
+static BOOL FLOC_TrackerCounterVisit(void* const pParam, ADDRESS const aAddress, U32 const uIndex)
 {
-	for (U32 i = 0; i < MAX_CONTEXTS_COUNT; i++)
+	TRACKER_COUNTER_COLLECT* const pCollect = (TRACKER_COUNTER_COLLECT*)pParam;
+	TRACKER const * const pTracker = (TRACKER*)Vector_AddressOf(&(pCollect->pCtx->vecTrackers), uIndex);
+	if (NULL == pTracker || TRACKER_TYPE_HOOK_COUNTER != pTracker->eType)
+	{
+		return TRUE;
+	}
+	if (pCollect->uCount < pCollect->uCapacity)
 	{
-		if (pCtx == gContexts[i])
+		/* A pool that could not be read reports zero calls. */
+		U64 uCount = 0;
+		if (!Hook_SnapshotCount(pCollect->pSnapshot, pTracker, &uCount))
 		{
-			gContexts[i] = NULL;
-			gContextCount--;
-			break;
+			uCount = 0;
 		}
+		pCollect->pAddresses[pCollect->uCount] = aAddress;
+		pCollect->puCounts[pCollect->uCount] = uCount;
 	}
+	pCollect->uCount++;
+	return TRUE;
 }
 
-U32 FLOC_ContextGetCount(void)
+static int FLOC_TrackerAddressCompare(void const * const pLeft, void const * const pRight)
 {
-	return gContextCount;
+	ADDRESS const aLeft = (*(TRACKER const * const *)pLeft)->aAddress;
+	ADDRESS const aRight = (*(TRACKER const * const *)pRight)->aAddress;
+	return (aLeft < aRight) ? -1 : ((aLeft > aRight) ? 1 : 0);
 }
 
-U32 FLOC_ContextGetMax(void)
+static void FLOC_SnapshotEmit(TRACKER_SNAPSHOT_COLLECT* const pCollect, TRACKER const * const pTracker)
 {
-	return MAX_CONTEXTS_COUNT;
+	U32 const i = pCollect->uCount++;
+	if (i >= pCollect->uCapacity)
+	{
+		return;
+	}
+	U64 const uBit = (U64)1 << (i & 63);
+	pCollect->pAddresses[i] = pTracker->aAddress;
+	if (NULL != pCollect->puHitBits && pTracker->bHit)
+	{
+		pCollect->puHitBits[i >> 6] |= uBit;
+	}
+	if (NULL != pCollect->puEnabledBits && pTracker->bEnabled)
+	{
+		pCollect->puEnabledBits[i >> 6] |= uBit;
+	}
+	if (NULL != pCollect->puAliveBits && TRACKER_TYPE_DELETED != pTracker->eType)
+	{
+		pCollect->puAliveBits[i >> 6] |= uBit;
+	}
 }
 
-BOOL FLOC_BreakpointHandler(FLOC_CTX const * const pCtx, ADDRESS const aAddress, BYTE* const puOriginalByte)
+static void FLOC_SnapshotDrain(TRACKER_SNAPSHOT_COLLECT* const pCollect, ADDRESS const aBefore, BOOL const bAll)
 {
-	TRACKER* pTracker = NULL;
-	for (U32 i = 0; i < pCtx->vecTrackers.uElemCount; i++)
+	/* Pages and removed trackers below aBefore go out first, pages win ties among themselves. */
+	for (;;)
 	{
-		pTracker = (TRACKER*)Vector_AddressOf(&(pCtx->vecTrackers), i);
-		if (NULL != pTracker && aAddress == pTracker->aAddress)
+		TRACKER const * const pPage = (pCollect->uPageNext < pCollect->uPageCount) ? pCollect->ppPages[pCollect->uPageNext] : NULL;
+		TRACKER const * const pDeleted = (pCollect->uDeletedNext < pCollect->uDeletedCount) ? pCollect->ppDeleted[pCollect->uDeletedNext] : NULL;
+		if (NULL != pPage && (bAll || pPage->aAddress < aBefore) && (NULL == pDeleted || pPage->aAddress <= pDeleted->aAddress))
 		{
-			break;
+			FLOC_SnapshotEmit(pCollect, pPage);
+			pCollect->uPageNext++;
+		}
+		else if (NULL != pDeleted && (bAll || pDeleted->aAddress < aBefore))
+		{
+			FLOC_SnapshotEmit(pCollect, pDeleted);
+			pCollect->uDeletedNext++;
+		}
+		else
+		{
+			return;
 		}
 	}
-	if (NULL == pTracker)
-	{
-		return FALSE;
-	}
+}
 
-	if (pCtx->bIsStepActive)
+static BOOL FLOC_SnapshotVisit(void* const pParam, ADDRESS const aAddress, U32 const uIndex)
+{
+	TRACKER_SNAPSHOT_COLLECT* const pCollect = (TRACKER_SNAPSHOT_COLLECT*)pParam;
+	TRACKER const * const pTracker = (TRACKER*)Vector_AddressOf(&(pCollect->pCtx->vecTrackers), uIndex);
+	if (NULL == pTracker)
 	{
-		pTracker->bHit = TRUE;
+		return TRUE;
 	}
-	
-	/* Breakpoint will be removed inside Target_WaitForBreakpoint immediately after return from here. */
-	pTracker->bEnabled = FALSE;
-
-	*puOriginalByte = pTracker->u.bp.uOriginalByte;
+	FLOC_SnapshotDrain(pCollect, aAddress + 1, FALSE);
+	FLOC_SnapshotEmit(pCollect, pTracker);
 	return TRUE;
 }
 
-void FLOC_DebugLoop(FLOC_CTX* const pCtx)
+BOOL FLOC_TrackerSnapshotCollect(FLOC_CTX const * const pCtx, ADDRESS* const pAddresses, U64* const puHitBits, U64* const puEnabledBits, U64* const puAliveBits, U32 const uCapacity, U32* const puCount)
 {
-	if (!Target_DebuggerAttach(pCtx->pidTarget))
+	/* The trackers come sorted from their index, pages from theirs, only removed trackers need sorting. */
+	VECTOR const * const pvecTrackers = &(pCtx->vecTrackers);
+	U32 const uPageCount = pCtx->idxPages.uCount;
+	TRACKER** const ppOthers = Memory_Alloc(((U64)uPageCount + pCtx->uDeletedCount) * sizeof(TRACKER*) + 1);
+	if (NULL == ppOthers)
 	{
-		return;
+		return FALSE;
 	}
+	FLOC_PageRangeCollect(pCtx, 0, (ADDRESS)-1, FALSE, NULL, ppOthers, uPageCount);
+	U32 uDeletedCount = 0;
+	for (U32 i = 0; i < pvecTrackers->uElemCount && uDeletedCount < pCtx->uDeletedCount; i++)
+	{
+		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(pvecTrackers, i);
+		if (NULL != pTracker && TRACKER_TYPE_DELETED == pTracker->eType)
+		{
+			ppOthers[uPageCount + uDeletedCount++] = pTracker;
+		}
+	}
+	Sort_Heap(ppOthers + uPageCount, uDeletedCount, sizeof(TRACKER*), FLOC_TrackerAddressCompare);
 
-	while (!pCtx->bStopDebugLoop)
+	U32 const uCopied = (NULL == pAddresses) ? 0 : uCapacity;
+	U64 const uWords = ((U64)uCopied + 63) / 64;
+	U64* const apuBits[3] = { puHitBits, puEnabledBits, puAliveBits };
+	for (U32 i = 0; i < 3; i++)
 	{
-		BOOL const bTargetDied = Target_WaitForBreakpoint(FLOC_BreakpointHandler, pCtx);
-		if (bTargetDied)
+		if (NULL != apuBits[i])
 		{
-			pCtx->bDbgLoopRunning = FALSE;
-			pCtx->bTargetDied = TRUE;
-			break;
+			Memory_Set(apuBits[i], 0, uWords * sizeof(U64));
 		}
 	}
 
-	Target_DebuggerDetach(pCtx->pidTarget);
-	return;
+	TRACKER_SNAPSHOT_COLLECT collect;
+	collect.pCtx = pCtx;
+	collect.ppPages = ppOthers;
+	collect.ppDeleted = ppOthers + uPageCount;
+	collect.pAddresses = pAddresses;
+	collect.puHitBits = puHitBits;
+	collect.puEnabledBits = puEnabledBits;
+	collect.puAliveBits = puAliveBits;
+	collect.uPageCount = uPageCount;
+	collect.uPageNext = 0;
+	collect.uDeletedCount = uDeletedCount;
+	collect.uDeletedNext = 0;
+	collect.uCapacity = uCopied;
+	collect.uCount = 0;
+	Index_VisitRange(&(pCtx->idxTrackers), 0, (ADDRESS)-1, FLOC_SnapshotVisit, &collect);
+	FLOC_SnapshotDrain(&collect, 0, TRUE);
+
+	Memory_Free(ppOthers);
+	*puCount = collect.uCount;
+	return TRUE;
 }
 
-BOOL FLOC_IsTargetAlive(PID const pidTarget)
+U32 FLOC_TrackerCountersCollect(FLOC_CTX const * const pCtx, HIT_SNAPSHOT const * const pSnapshot, ADDRESS* const pAddresses, U64* const puCounts, U32 const uCapacity)
 {
-	PROCESS const hProcess = Target_HandleAcquire(pidTarget);
-	if (NULL == hProcess)
-	{
-		return FALSE;
-	}
-	Target_HandleRelease(hProcess);
-	return TRUE;
+	TRACKER_COUNTER_COLLECT collect;
+	collect.pCtx = pCtx;
+	collect.pSnapshot = pSnapshot;
+	collect.pAddresses = pAddresses;
+	collect.puCounts = puCounts;
+	collect.uCapacity = (NULL == pAddresses || NULL == puCounts) ? 0 : uCapacity;
+	collect.uCount = 0;
+	Index_VisitRange(&(pCtx->idxTrackers), 0, (ADDRESS)-1, FLOC_TrackerCounterVisit, &collect);
+	return collect.uCount;
 }
 
-void FLOC_TrackerRemove(TRACKER* const pTracker, PROCESS const hProcess)
+void FLOC_TrackerRemove(FLOC_CTX* const pCtx, TRACKER* const pTracker, PROCESS const hProcess)
 {
 	if (NULL == pTracker)
 	{
 		return;
 	}
 
+	BOOL const bHook = (TRACKER_TYPE_HOOK_INLINE == pTracker->eType || TRACKER_TYPE_HOOK_COUNTER == pTracker->eType);
+	BOOL const bHw = (TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType);
 	if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType)
 	{
 		Target_BreakpointRemoveDormant(hProcess, pTracker->aAddress, pTracker->u.bp.uOriginalByte);
 	}
-	/* Hooks will eventually remove themselves automatically inside the target process. */
+	else if (bHook && (!pTracker->bEnabled || Hook_Disable(pTracker, hProcess)))
+	{
+		/* A hook that could not be disarmed keeps its slot, the function may still jump there. */
+		Hook_Release(pTracker, &(pCtx->vecPools), &(pCtx->idxPools), &(pCtx->poolStats), &(pCtx->regions), hProcess);
+	}
+	else if (TRACKER_TYPE_PAGE_EXEC == pTracker->eType && pTracker->bEnabled)
+	{
+		Target_MemoryProtectRestore(hProcess, pTracker->aAddress, TRACKER_PAGE_SIZE, pTracker->u.page.uProtect);
+	}
 
+	Lookup_Remove(FLOC_TrackerLookupOf(pCtx, pTracker), pTracker->aAddress);
+	Index_Remove(FLOC_TrackerIndexOf(pCtx, pTracker), pTracker->aAddress);
 	pTracker->bHit = FALSE;
 	pTracker->bEnabled = FALSE;
 	pTracker->eType = TRACKER_TYPE_DELETED;
-	pTracker->aAddress = 0;
+	pCtx->uDeletedCount++;
+	Atomic_Increment(&(pCtx->uGeneration));
+
+	/* Only now the tracker is no candidate for its own slot anymore. */
+	if (bHw)
+	{
+		FLOC_HwBreakpointsUpdate(pCtx);
+	}
+}
+
+static BOOL FLOC_TrackerCompactDue(FLOC_CTX const * const pCtx)
+{
+	return NULL != pCtx->lkpTrackers.pRetired || NULL != pCtx->lkpPages.pRetired
+		|| (0 != pCtx->uDeletedCount && 2 * (U64)pCtx->uDeletedCount >= pCtx->vecTrackers.uElemCount);
+}
+
+void FLOC_TrackerCompact(FLOC_CTX* const pCtx)
+{
+	/*
+	 * Removal only marks the slot, so pointers held by a running walk stay valid.
+	 * Once deleted slots make up half of the vector, the live trackers are moved down
+	 * in order and their index entries repointed, which keeps the vector and the indexes
+	 * proportional to the live trackers. Amortized this is O(1) per removal.
+	 */
+	if (!FLOC_TrackerCompactDue(pCtx))
+	{
+		return;
+	}
+	/* A foreign debugger calls the handlers from its own threads, DebugLoopOverride compacts once it is gone. */
+	if (pCtx->bForeignDebugLoop)
+	{
+		return;
+	}
+	if (FLOC_HwOwnedByLoop(pCtx))
+	{
+		/*
+		 * Our loop may hold a tracker it just looked up, but none between two waits. It compacts there
+		 * while this thread waits, within DEBUG_LOOP_WAIT_MS when no events come.
+		 */
+		U32 const uRequest = Atomic_Increment(&(pCtx->uCompactRequests));
+		for (U32 uRound = 0; uRequest != pCtx->uCompactServed && pCtx->bDbgLoopRunning && !pCtx->bStopDebugLoop; uRound++)
+		{
+			Thread_SpinWait(uRound);
+		}
+		/* A loop that is being stopped may still hold a tracker, DebugLoopStop compacts after it exited. */
+		if (uRequest == pCtx->uCompactServed || pCtx->bStopDebugLoop)
+		{
+			return;
+		}
+		/* The loop left because the target died and touches no tracker anymore. */
+	}
+	FLOC_TrackerCompactNow(pCtx);
+}
+
+static void FLOC_TrackerCompactNow(FLOC_CTX* const pCtx)
+{
+	Lookup_Reclaim(&(pCtx->lkpTrackers));
+	Lookup_Reclaim(&(pCtx->lkpPages));
+	VECTOR* const pvecTrackers = &(pCtx->vecTrackers);
+	if (0 == pCtx->uDeletedCount || 2 * (U64)pCtx->uDeletedCount < pvecTrackers->uElemCount)
+	{
+		return;
+	}
+
+	U32 uLive = 0;
+	for (U32 i = 0; i < pvecTrackers->uElemCount; i++)
+	{
+		TRACKER const * const pTracker = (TRACKER*)Vector_AddressOf(pvecTrackers, i);
+		if (TRACKER_TYPE_DELETED == pTracker->eType)
+		{
+			continue;
+		}
+		if (i != uLive)
+		{
+			TRACKER* const pDest = (TRACKER*)Vector_AddressOf(pvecTrackers, uLive);
+			*pDest = *pTracker;
+			/* The keys already exist, so these only update the values and cannot fail. */
+			Index_Insert(FLOC_TrackerIndexOf(pCtx, pDest), pDest->aAddress, uLive);
+			Lookup_Insert(FLOC_TrackerLookupOf(pCtx, pDest), pDest->aAddress, pDest);
+		}
+		uLive++;
+	}
+	pvecTrackers->uElemCount = uLive;
+	pCtx->uDeletedCount = 0;
+	Atomic_Increment(&(pCtx->uGeneration));
 }
 
-void FLOC_TrackerDisable(TRACKER* const pTracker, PROCESS const hProcess)
+void FLOC_TrackerDisable(FLOC_CTX* const pCtx, TRACKER* const pTracker, PROCESS const hProcess)
 {
 	if (NULL == pTracker)
 	{
 		return;
 	}
 
+	BOOL bDisabled = TRUE;
 	if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType)
 	{
 		Target_BreakpointRemoveDormant(hProcess, pTracker->aAddress, pTracker->u.bp.uOriginalByte);
 	}
-	/* Hooks can simply be ignored. */
+	else if (TRACKER_TYPE_HOOK_INLINE == pTracker->eType || TRACKER_TYPE_HOOK_COUNTER == pTracker->eType)
+	{
+		/* One-shot hooks are disarmed too, their stub slot may be reused once the tracker is removed. */
+		bDisabled = Hook_Disable(pTracker, hProcess);
+	}
+	else if (TRACKER_TYPE_PAGE_EXEC == pTracker->eType)
+	{
+		bDisabled = Target_MemoryProtectRestore(hProcess, pTracker->aAddress, TRACKER_PAGE_SIZE, pTracker->u.page.uProtect);
+	}
 
-	pTracker->bEnabled = FALSE;
+	pTracker->bEnabled = !bDisabled;
+	Atomic_Increment(&(pCtx->uGeneration));
+	if (TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType)
+	{
+		FLOC_HwBreakpointsUpdate(pCtx);
+	}
 }
 
-void FLOC_TrackerEnable(TRACKER* const pTracker, PROCESS const hProcess)
+void FLOC_TrackerEnable(FLOC_CTX* const pCtx, TRACKER* const pTracker, PROCESS const hProcess)
 {
 	if (NULL == pTracker)
 	{
 		return;
 	}
 
+	/* Flagged first, a hit right after the write clears the flag and must not be overwritten. */
 	BOOL bRet = FALSE;
+	pTracker->bEnabled = TRUE;
 	if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType)
 	{
 		bRet = Target_BreakpointAdd(hProcess, pTracker->aAddress);
 	}
-	else if (TRACKER_TYPE_HOOK_INLINE == pTracker->eType)
+	else if (TRACKER_TYPE_HOOK_INLINE == pTracker->eType || TRACKER_TYPE_HOOK_COUNTER == pTracker->eType)
 	{
-		bRet = Hook_Enable(pTracker, hProcess);
+		bRet = Hook_Enable(pTracker, &(pCtx->vecPools), hProcess);
+	}
+	else if (TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType)
+	{
+		/* Enabled hardware breakpoints wait for a free slot, nothing is written to the code. */
+		bRet = TRUE;
+	}
+	else if (TRACKER_TYPE_PAGE_EXEC == pTracker->eType)
+	{
+		bRet = Target_MemoryExecRevoke(hProcess, pTracker->aAddress, TRACKER_PAGE_SIZE, pTracker->u.page.uProtect);
 	}
 
-	pTracker->bEnabled = bRet;
+	if (!bRet)
+	{
+		pTracker->bEnabled = FALSE;
+	}
+	Atomic_Increment(&(pCtx->uGeneration));
+	if (TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType)
+	{
+		FLOC_HwBreakpointsUpdate(pCtx);
+	}
 }
 
-void FLOC_StepFilterOut(FLOC_CTX* const pCtx, BOOL const bExecuted)
+void FLOC_TrackerEnableMany(FLOC_CTX* const pCtx, TRACKER* const * const ppTrackers, U32 const uCount, PROCESS const hProcess)
 {
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
-	if (NULL == hProcess)
+	PATCH_BATCH batchHits;
+	PATCH_BATCH batchCode;
+	BOOL* const pbHitCleared = Memory_Alloc((U64)uCount * sizeof(BOOL) + 1);
+	BOOL const bHitsInit = Target_PatchBatchInit(&batchHits, 16);
+	BOOL const bCodeInit = Target_PatchBatchInit(&batchCode, uCount);
+	if (NULL == pbHitCleared || !bHitsInit || !bCodeInit)
+	{
+		/* Out of memory, fall back to one write per tracker. */
+		for (U32 i = 0; i < uCount; i++)
+		{
+			FLOC_TrackerEnable(pCtx, ppTrackers[i], hProcess);
+		}
+		goto cleanup;
+	}
+
+	/* One-shot hooks must have their hit byte cleared before their jump is armed. */
+	for (U32 i = 0; i < uCount; i++)
+	{
+		pbHitCleared[i] = Hook_PatchHitClear(ppTrackers[i], &(pCtx->vecPools), i, &batchHits);
+	}
+	Target_PatchBatchApply(hProcess, &batchHits);
+	for (U32 i = 0; i < batchHits.uCount; i++)
+	{
+		if (!batchHits.pPatches[i].bApplied)
+		{
+			pbHitCleared[batchHits.pPatches[i].uTag] = FALSE;
+		}
+	}
+
+	/* Trackers are flagged before the batch arms them, like in FLOC_TrackerEnable. */
+	BYTE const uInt3 = INT3_BYTE;
+	BOOL bHw = FALSE;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		TRACKER* const pTracker = ppTrackers[i];
+		if (TRACKER_TYPE_PAGE_EXEC == pTracker->eType)
+		{
+			continue;
+		}
+		pTracker->bEnabled = FALSE;
+		if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType)
+		{
+			pTracker->bEnabled = Target_PatchBatchAdd(&batchCode, pTracker->aAddress, &uInt3, 1, i);
+		}
+		else if (TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType)
+		{
+			pTracker->bEnabled = TRUE;
+			bHw = TRUE;
+		}
+		else if (pbHitCleared[i] && (TRACKER_TYPE_HOOK_INLINE == pTracker->eType || TRACKER_TYPE_HOOK_COUNTER == pTracker->eType))
+		{
+			pTracker->bEnabled = Hook_PatchArm(pTracker, i, &batchCode);
+		}
+	}
+	Target_PatchBatchApply(hProcess, &batchCode);
+	for (U32 i = 0; i < batchCode.uCount; i++)
+	{
+		if (!batchCode.pPatches[i].bApplied)
+		{
+			ppTrackers[batchCode.pPatches[i].uTag]->bEnabled = FALSE;
+		}
+	}
+	FLOC_PagesProtect(ppTrackers, uCount, TRUE, hProcess);
+	if (bHw)
+	{
+		FLOC_HwBreakpointsUpdate(pCtx);
+	}
+
+cleanup:
+	Atomic_Increment(&(pCtx->uGeneration));
+	Memory_Free(pbHitCleared);
+	Target_PatchBatchFree(&batchHits);
+	Target_PatchBatchFree(&batchCode);
+}
+
+static U32 FLOC_PageRunEnd(TRACKER* const * const ppTrackers, U32 const uFirst, U32 const uCount)
+{
+	TRACKER const * const pFirst = ppTrackers[uFirst];
+	U32 uEnd = uFirst + 1;
+	while (uEnd < uCount
+		&& TRACKER_TYPE_PAGE_EXEC == ppTrackers[uEnd]->eType
+		&& ppTrackers[uEnd - 1]->aAddress + TRACKER_PAGE_SIZE == ppTrackers[uEnd]->aAddress
+		&& pFirst->u.page.uProtect == ppTrackers[uEnd]->u.page.uProtect
+		&& pFirst->bEnabled == ppTrackers[uEnd]->bEnabled)
+	{
+		uEnd++;
+	}
+	return uEnd;
+}
+
+static void FLOC_PagesProtect(TRACKER* const * const ppTrackers, U32 const uCount, BOOL const bRevoke, PROCESS const hProcess)
+{
+	/*
+	 * Pages come in address order when added by range, so neighbours with the same protection change
+	 * with one call. On Linux every call is a syscall the debug loop makes in the target.
+	 */
+	U32 i = 0;
+	while (i < uCount)
+	{
+		TRACKER const * const pFirst = ppTrackers[i];
+		if (TRACKER_TYPE_PAGE_EXEC != pFirst->eType || bRevoke == pFirst->bEnabled)
+		{
+			i++;
+			continue;
+		}
+
+		/* A revoked page faults as soon as the call returns, the fault handler must find it enabled already. */
+		U32 const uEnd = FLOC_PageRunEnd(ppTrackers, i, uCount);
+		U64 const uLen = (U64)(uEnd - i) * TRACKER_PAGE_SIZE;
+		for (U32 j = i; bRevoke && j < uEnd; j++)
+		{
+			ppTrackers[j]->bEnabled = TRUE;
+		}
+		BOOL const bChanged = bRevoke
+			? Target_MemoryExecRevoke(hProcess, pFirst->aAddress, uLen, pFirst->u.page.uProtect)
+			: Target_MemoryProtectRestore(hProcess, pFirst->aAddress, uLen, pFirst->u.page.uProtect);
+		for (; bChanged != bRevoke && i < uEnd; i++)
+		{
+			ppTrackers[i]->bEnabled = FALSE;
+		}
+		i = uEnd;
+	}
+}
+
+static BOOL FLOC_TrackerPatchRestore(TRACKER const * const pTracker, U32 const uTag, PATCH_BATCH* const pBatch, PROCESS const hProcess)
+{
+	/* Same bytes FLOC_TrackerDisable writes, collected instead of written. */
+	if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType)
+	{
+		return Target_PatchBatchAdd(pBatch, pTracker->aAddress, &(pTracker->u.bp.uOriginalByte), 1, uTag);
+	}
+	if (TRACKER_TYPE_HOOK_INLINE == pTracker->eType || TRACKER_TYPE_HOOK_COUNTER == pTracker->eType)
+	{
+		return Hook_PatchDisarm(pTracker, uTag, pBatch, hProcess);
+	}
+	return TRUE;
+}
+
+void FLOC_TrackerDisableMany(FLOC_CTX* const pCtx, TRACKER* const * const ppTrackers, U32 const uCount, PROCESS const hProcess)
+{
+	PATCH_BATCH batch;
+	if (!Target_PatchBatchInit(&batch, uCount))
 	{
+		for (U32 i = 0; i < uCount; i++)
+		{
+			FLOC_TrackerDisable(pCtx, ppTrackers[i], hProcess);
+		}
 		return;
 	}
-	
-	VECTOR const* const pvecTrackers = &(pCtx->vecTrackers);
-	U32 const uElemCount = pvecTrackers->uElemCount;
-	for (U32 i = 0; i < uElemCount; i++)
+
+	/* Pages leave the batch with bEnabled already telling if they got their protection back. */
+	FLOC_PagesProtect(ppTrackers, uCount, FALSE, hProcess);
+	BOOL bHw = FALSE;
+	for (U32 i = 0; i < uCount; i++)
 	{
-		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(pvecTrackers, i);
-		if (NULL == pTracker || TRACKER_TYPE_DELETED == pTracker->eType)
+		if (TRACKER_TYPE_PAGE_EXEC == ppTrackers[i]->eType)
 		{
 			continue;
 		}
+		ppTrackers[i]->bEnabled = !FLOC_TrackerPatchRestore(ppTrackers[i], i, &batch, hProcess);
+		if (TRACKER_TYPE_BREAKPOINT_HW == ppTrackers[i]->eType)
+		{
+			bHw = TRUE;
+		}
+	}
+	Target_PatchBatchApply(hProcess, &batch);
+	for (U32 i = 0; i < batch.uCount; i++)
+	{
+		if (!batch.pPatches[i].bApplied)
+		{
+			ppTrackers[batch.pPatches[i].uTag]->bEnabled = TRUE;
+		}
+	}
+	Target_PatchBatchFree(&batch);
+	Atomic_Increment(&(pCtx->uGeneration));
+	if (bHw)
+	{
+		FLOC_HwBreakpointsUpdate(pCtx);
+	}
+}
+
+void FLOC_TrackerRemoveMany(FLOC_CTX* const pCtx, TRACKER* const * const ppTrackers, U32 const uCount, PROCESS const hProcess)
+{
+	PATCH_BATCH batch;
+	BOOL* const pbRestored = Memory_Alloc((U64)uCount * sizeof(BOOL) + 1);
+	BOOL const bBatchInit = Target_PatchBatchInit(&batch, uCount);
+	if (NULL == pbRestored || !bBatchInit)
+	{
+		for (U32 i = 0; i < uCount; i++)
+		{
+			FLOC_TrackerRemove(pCtx, ppTrackers[i], hProcess);
+		}
+		goto cleanup;
+	}
+
+	FLOC_PagesProtect(ppTrackers, uCount, FALSE, hProcess);
+	for (U32 i = 0; i < uCount; i++)
+	{
+		TRACKER const * const pTracker = ppTrackers[i];
+		pbRestored[i] = TRUE;
+		if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType || pTracker->bEnabled)
+		{
+			pbRestored[i] = FLOC_TrackerPatchRestore(pTracker, i, &batch, hProcess);
+		}
+	}
+	Target_PatchBatchApply(hProcess, &batch);
+	for (U32 i = 0; i < batch.uCount; i++)
+	{
+		if (!batch.pPatches[i].bApplied)
+		{
+			pbRestored[batch.pPatches[i].uTag] = FALSE;
+		}
+	}
+
+	BOOL bHw = FALSE;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		TRACKER* const pTracker = ppTrackers[i];
+		/* A hook that could not be disarmed keeps its slot, the function may still jump there. */
+		if (pbRestored[i] && (TRACKER_TYPE_HOOK_INLINE == pTracker->eType || TRACKER_TYPE_HOOK_COUNTER == pTracker->eType))
+		{
+			Hook_Release(pTracker, &(pCtx->vecPools), &(pCtx->idxPools), &(pCtx->poolStats), &(pCtx->regions), hProcess);
+		}
+		else if (TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType)
+		{
+			bHw = TRUE;
+		}
+		Lookup_Remove(FLOC_TrackerLookupOf(pCtx, pTracker), pTracker->aAddress);
+		Index_Remove(FLOC_TrackerIndexOf(pCtx, pTracker), pTracker->aAddress);
+		pTracker->bHit = FALSE;
+		pTracker->bEnabled = FALSE;
+		if (TRACKER_TYPE_DELETED != pTracker->eType)
+		{
+			pTracker->eType = TRACKER_TYPE_DELETED;
+			pCtx->uDeletedCount++;
+		}
+	}
+	Atomic_Increment(&(pCtx->uGeneration));
+	if (bHw)
+	{
+		FLOC_HwBreakpointsUpdate(pCtx);
+	}
+
+cleanup:
+	Memory_Free(pbRestored);
+	if (bBatchInit)
+	{
+		Target_PatchBatchFree(&batch);
+	}
+}
+
+BOOL FLOC_StepFilterOut(FLOC_CTX* const pCtx, BOOL const bExecuted)
+{
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return TRUE;
+	}
+	
+	/* The trackers to remove are moved to the front of the live list, behind the ones already looked at. */
+	U32 uLiveCount = 0;
+	TRACKER** const ppLive = FLOC_TrackerLiveCollect(pCtx, TRUE, &uLiveCount);
+	if (NULL == ppLive)
+	{
+		return FALSE;
+	}
+	U32 uRemoveCount = 0;
+	STEP_RECORD record = { 0, 0, bExecuted };
+	for (U32 i = 0; i < uLiveCount; i++)
+	{
+		TRACKER* const pTracker = ppLive[i];
 
-		/* Ignore trackers that were not executed but werent enabled in the first place. */
-		if ((pTracker->bHit && bExecuted) || (!pTracker->bHit && !bExecuted && pTracker->bEnabled))
+		/* Ignore trackers that were not executed but werent enabled (or for hardware breakpoints armed) in the first place. */
+		BOOL const bWatched = (TRACKER_TYPE_BREAKPOINT_HW != pTracker->eType) || pTracker->u.hwbp.bWatchedStep;
+		if ((pTracker->bHit && bExecuted) || (!pTracker->bHit && !bExecuted && pTracker->bEnabled && bWatched))
 		{
-			FLOC_TrackerRemove(pTracker, hProcess);
+			ppLive[uRemoveCount++] = pTracker;
+			record.uRemoved++;
 		}
 		else
 		{
 			/* Prepare for the next step. */
 			pTracker->bHit = FALSE;
+			record.uRemaining++;
 		}
 	}
+	FLOC_TrackerRemoveMany(pCtx, ppLive, uRemoveCount, hProcess);
+	Memory_Free(ppLive);
+	FLOC_TrackerCompact(pCtx);
+	/* A round missing from the history for lack of memory changes nothing else. */
+	Vector_PushBackCopy(&(pCtx->vecSteps), &record);
 
 	pCtx->bIsPendingReset = FALSE;
-	Target_HandleRelease(hProcess);
+	Atomic_Increment(&(pCtx->uGeneration));
+	return TRUE;
 }
 
 BOOL FLOC_IsTargetDead(FLOC_CTX* const pCtx)
@@ -223,6 +1417,11 @@ BOOL FLOC_IsTargetDead(FLOC_CTX* const pCtx)
 		pCtx->bIsStepActive = FALSE;
 		pCtx->bStopDebugLoop = FALSE;
 		pCtx->pidTarget = 0;
+		if (NULL != pCtx->hProcess)
+		{
+			Target_HandleRelease(pCtx->hProcess);
+			pCtx->hProcess = NULL;
+		}
 		return TRUE;
 	}
 	return FALSE;
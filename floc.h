@@ -3,41 +3,124 @@
 
 #include "types.h"
 #include "vector.h"
+#include "index.h"
 #include "os.h"
+#include "pool.h"
+#include "ring.h"
+#include "lookup.h"
+#include "session.h"
 
 struct tdTRACKER;
 typedef struct tdTRACKER TRACKER;
 
+struct tdHIT_SNAPSHOT;
+typedef struct tdHIT_SNAPSHOT HIT_SNAPSHOT;
+
 typedef struct tdFLOC_HANDLE* FLOC_HANDLE;
+typedef struct tdFLOC_GROUP_HANDLE* FLOC_GROUP_HANDLE;
+
+struct tdGROUP;
+typedef struct tdGROUP GROUP;
 
+/*
+ * The debug loop runs next to the client threads and only ever touches what is marked below. It finds
+ * trackers through lkpTrackers and lkpPages, never through the vector or the indexes, which clients
+ * grow and rebalance as they like. Trackers only move while the loop holds none: our loop compacts
+ * itself between two waits for events while the requesting client waits. While our own loop runs the hardware breakpoint slots belong to it, clients only post
+ * requests which it serves between two waits for events.
+ */
 typedef struct tdFLOC_CTX {
 	VECTOR vecTrackers;
+	INDEX idxTrackers;
+	INDEX idxPages;
+	LOOKUP lkpTrackers; /* read by the loop */
+	LOOKUP lkpPages; /* read by the loop */
 	VECTOR vecPools;
+	VECTOR vecSteps; /* STEP_RECORD of every filter round, oldest first */
+	INDEX idxPools;
+	POOL_STATS poolStats;
 	THREAD thrDebug;
+	PROCESS hProcess;
+	HIT_RING* pHitRing; /* NULL unless a hit stream was started, only changes while the debug loop is stopped */
+	THREAD_TABLE threads;
+	REGION_MAP regions;
+	HW_BREAKPOINTS hwBreakpoints;
 	PID pidTarget;
+	U32 uDeletedCount;
+	U32 uHwArmSequence;
+	U32 volatile uGeneration; /* bumped with Atomic_Increment by every change of the tracker set or of a hit / enabled flag, never 0 for a snapshot to match */
+	U32 volatile uHwUpdateRequests; /* bumped by clients, the loop serves when it differs from uHwUpdateServed */
+	U32 volatile uHwRotateRequests;
+	U32 volatile uCompactRequests; /* bumped by a client that then waits until the loop compacted */
+	U32 volatile uCompactServed; /* set by the loop */
+	U32 volatile uHitDrainBusy; /* set with Atomic_CompareExchange while a client drains, starts or stops the hit stream */
+	U32 uHwUpdateServed;
+	U32 uHwRotateServed;
 	BOOL bForeignDebugLoop;
-	BOOL bIsStepActive;
-	BOOL bDbgLoopRunning;
+	BOOL volatile bIsStepActive; /* read by the loop */
+	BOOL volatile bDbgLoopRunning; /* cleared by the loop when the target dies */
 	BOOL bIsPendingReset;
-	BOOL bStopDebugLoop;
-	BOOL bTargetDied;
-	BYTE _padding[4];
+	BOOL volatile bStopDebugLoop; /* read by the loop */
+	BOOL volatile bTargetDied; /* set by the loop */
 } FLOC_CTX;
 
+/* Handles are generation-tagged slots of a table without an upper bound. Safe from any thread. */
 FLOC_CTX* FLOC_ContextGet(FLOC_HANDLE hHandle);
-U32 FLOC_ContextGetCount(void);
-U32 FLOC_ContextGetMax(void);
-void FLOC_ContextInsert(FLOC_CTX* pCtx);
-void FLOC_ContextClear(FLOC_CTX const * pCtx);
+FLOC_HANDLE FLOC_ContextInsert(FLOC_CTX* pCtx);
+void FLOC_ContextClear(FLOC_HANDLE hHandle);
+GROUP* FLOC_GroupGet(FLOC_GROUP_HANDLE hGroup);
+FLOC_GROUP_HANDLE FLOC_GroupInsert(GROUP* pGroup);
+void FLOC_GroupClear(FLOC_GROUP_HANDLE hGroup);
 
-BOOL FLOC_BreakpointHandler(FLOC_CTX const * pCtx, ADDRESS aAddress, BYTE* puOriginalByte);
+BOOL FLOC_BreakpointHandler(FLOC_CTX* pCtx, TID tidThread, ADDRESS aAddress, BYTE* puOriginalByte);
+void FLOC_HwBreakpointHandler(void* pParam, TID tidThread, ADDRESS aAddress);
+BOOL FLOC_PageFaultHandler(void* pParam, TID tidThread, ADDRESS aPage, U32* puProtect);
 void FLOC_DebugLoop(FLOC_CTX* pCtx);
 BOOL FLOC_IsTargetDead(FLOC_CTX* pCtx);
-BOOL FLOC_IsTargetAlive(PID pidTarget);
+BOOL FLOC_IsTargetAlive(FLOC_CTX const* pCtx);
+
+/* FALSE if out of memory, nothing was filtered then. */
+BOOL FLOC_StepFilterOut(FLOC_CTX* pCtx, BOOL bExecuted);
+TRACKER* FLOC_TrackerFind(FLOC_CTX const* pCtx, ADDRESS aAddress);
+TRACKER* FLOC_PageFind(FLOC_CTX const* pCtx, ADDRESS aPage);
+BOOL FLOC_TrackerInsert(FLOC_CTX* pCtx, TRACKER const* pTracker);
+U32 FLOC_TrackerRangeCollect(FLOC_CTX const* pCtx, ADDRESS aLow, ADDRESS aHigh, ADDRESS* pAddresses, U32 uCapacity);
+/*
+ * Every live tracker in address order, followed by the page trackers if bPages, walked through the
+ * indexes so the cost follows the live count and not the slots compaction has yet to free. The caller
+ * frees the array with Memory_Free. NULL if out of memory.
+ */
+TRACKER** FLOC_TrackerLiveCollect(FLOC_CTX const* pCtx, BOOL bPages, U32* puCount);
+/* Page trackers in [aLow, aHigh], only those hit since the step began if bHitOnly. ppTrackers is optional. */
+U32 FLOC_PageRangeCollect(FLOC_CTX const* pCtx, ADDRESS aLow, ADDRESS aHigh, BOOL bHitOnly, ADDRESS* pPages, TRACKER** ppTrackers, U32 uCapacity);
+/*
+ * Trackers and page trackers in address order, a page before a tracker on its first byte. Removed
+ * trackers keep their address and show up not alive until compaction. Copies up to uCapacity entries,
+ * bit i of each bitset belongs to entry i, the bitsets are optional. FALSE if out of memory.
+ */
+BOOL FLOC_TrackerSnapshotCollect(FLOC_CTX const* pCtx, ADDRESS* pAddresses, U64* puHitBits, U64* puEnabledBits, U64* puAliveBits, U32 uCapacity, U32* puCount);
+U32 FLOC_TrackerCountersCollect(FLOC_CTX const* pCtx, HIT_SNAPSHOT const* pSnapshot, ADDRESS* pAddresses, U64* puCounts, U32 uCapacity);
+void FLOC_TrackerRemove(FLOC_CTX* pCtx, TRACKER* pTracker, PROCESS hProcess);
+void FLOC_TrackerDisable(FLOC_CTX* pCtx, TRACKER* pTracker, PROCESS hProcess);
+void FLOC_TrackerEnable(FLOC_CTX* pCtx, TRACKER* pTracker, PROCESS hProcess);
+/*
+ * While our debug loop runs this posts a request and waits until the loop compacted between two
+ * waits for events. Does nothing while a foreign debugger runs, DebugLoopOverride compacts when it is gone.
+ */
+void FLOC_TrackerCompact(FLOC_CTX* pCtx);
+
+/*
+ * Hardware breakpoints take turns in the debug register slots. Update frees the slots of hardware
+ * breakpoints that were disabled or removed and fills free slots. Rotate runs when a step begins and
+ * gives every slot to the best candidate again. While our debug loop runs both only post a request,
+ * the loop picks it up within a few milliseconds and writes the slots into the threads.
+ */
+void FLOC_HwBreakpointsUpdate(FLOC_CTX* pCtx);
+void FLOC_HwBreakpointsRotate(FLOC_CTX* pCtx);
 
-void FLOC_StepFilterOut(FLOC_CTX* pCtx, BOOL bExecuted);
-void FLOC_TrackerRemove(TRACKER* pTracker, PROCESS hProcess);
-void FLOC_TrackerDisable(TRACKER* pTracker, PROCESS hProcess);
-void FLOC_TrackerEnable(TRACKER* pTracker, PROCESS hProcess);
+/* Same as the single tracker functions, but all target writes go through one patch batch. */
+void FLOC_TrackerEnableMany(FLOC_CTX* pCtx, TRACKER* const* ppTrackers, U32 uCount, PROCESS hProcess);
+void FLOC_TrackerDisableMany(FLOC_CTX* pCtx, TRACKER* const* ppTrackers, U32 uCount, PROCESS hProcess);
+void FLOC_TrackerRemoveMany(FLOC_CTX* pCtx, TRACKER* const* ppTrackers, U32 uCount, PROCESS hProcess);
 
 #endif /* FLOC_H */
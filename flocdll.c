@@ -1,9 +1,67 @@
 #include "flocdll.h"
 #include "floc.h"
 #include "vector.h"
+#include "index.h"
+#include "lookup.h"
 #include "tracker.h"
 #include "pool.h"
 #include "hook.h"
+#include "sort.h"
+#include "module.h"
+#include "group.h"
+
+/* Largest target range read with a single call when collecting original bytes for a batch. */
+#define BATCH_READ_SPAN (0x1000)
+#define DEBUG_LOOP_STOP_TIMEOUT_MS (600)
+
+typedef struct tdBATCH_ENTRY {
+	ADDRESS aAddress;
+	U32 uIndex;
+	FLOC_STATUS status;
+	BYTE uOriginalByte;
+	BYTE _padding[1];
+} BATCH_ENTRY;
+
+/* Trackers of a group that a job adds to or removes from every member. */
+typedef struct tdGROUP_TRACKER_SPAN {
+	GROUP_TRACKER const* pTrackers;
+	U32 uCount;
+	BYTE _padding[4];
+} GROUP_TRACKER_SPAN;
+
+static FLOC_STATUS TrackerAddBreakpoint(FLOC_CTX* pCtx, ADDRESS aAddress, BYTE uOriginalByte);
+static FLOC_STATUS TrackerAddBreakpointHw(FLOC_CTX* pCtx, ADDRESS aAddress);
+static FLOC_STATUS TrackerAddHook(FLOC_CTX* pCtx, ADDRESS aAddress, U32 uFuncLen, PROCESS hProcess, PATCH_BATCH* pUnprotect, U32 uTag);
+static FLOC_STATUS TrackerAddCounter(FLOC_CTX* pCtx, ADDRESS aAddress, U32 uPrologueLen, PROCESS hProcess);
+static FLOC_STATUS TrackerRemove(FLOC_CTX* pCtx, ADDRESS aAddress, PROCESS hProcess);
+static FLOC_STATUS TrackerEnable(FLOC_CTX* pCtx, ADDRESS aAddress, PROCESS hProcess);
+static FLOC_STATUS TrackerDisable(FLOC_CTX* pCtx, ADDRESS aAddress, PROCESS hProcess);
+static BOOL TrackerLacksDebugLoop(FLOC_CTX const* pCtx, TRACKER const* pTracker);
+static int BatchEntryCompare(void const* pLeft, void const* pRight);
+static BATCH_ENTRY* BatchEntriesCreate(ADDRESS const* pAddresses, U32 uCount);
+static void BatchReadOriginalBytes(PROCESS hProcess, BATCH_ENTRY* pEntries, U32 uCount);
+static FLOC_STATUS BatchFinish(BATCH_ENTRY* pEntries, U32 uCount, FLOC_STATUS* pStatuses);
+static U32 BatchTrackersCollect(FLOC_CTX const* pCtx, BATCH_ENTRY* pEntries, U32 uCount, TRACKER** ppTrackers);
+static void HitStreamRelease(FLOC_CTX* pCtx);
+static int SessionModuleCompare(void const* pLeft, void const* pRight);
+static U32 SessionModuleOf(TARGET_MODULE const* pModules, U32 uCount, ADDRESS aAddress);
+static int SessionTrackerCompare(void const* pLeft, void const* pRight);
+static BOOL SessionPatchIsOwn(SESSION_TRACKER const* pTracker, BYTE const* pBytes);
+static void SessionOriginalsVerify(PROCESS hProcess, SESSION_TRACKER const* pTrackers, ADDRESS* pAddresses, U32 uCount, PATCH_BATCH* pRestore);
+static int GroupTrackerCompare(void const* pLeft, void const* pRight);
+static ADDRESS* GroupAddressesOf(GROUP_MEMBER const* pMember, GROUP_TRACKER const* pTrackers, U32 uCount, U32* puBreakpoints);
+static FLOC_STATUS GroupJobApply(GROUP* pGroup, GROUP_MEMBER* pMember, void* pParam);
+static FLOC_STATUS GroupJobRemove(GROUP* pGroup, GROUP_MEMBER* pMember, void* pParam);
+static FLOC_STATUS GroupJobAttach(GROUP* pGroup, GROUP_MEMBER* pMember, void* pParam);
+static FLOC_STATUS GroupJobDetach(GROUP* pGroup, GROUP_MEMBER* pMember, void* pParam);
+static FLOC_STATUS GroupJobStepBegin(GROUP* pGroup, GROUP_MEMBER* pMember, void* pParam);
+static FLOC_STATUS GroupJobStepEnd(GROUP* pGroup, GROUP_MEMBER* pMember, void* pParam);
+static FLOC_STATUS GroupJobHitsCollect(GROUP* pGroup, GROUP_MEMBER* pMember, void* pParam);
+static FLOC_STATUS GroupRunAll(GROUP* pGroup, U32 uFirst, GROUP_JOB_FUNC fnJob, void* pParam);
+static FLOC_STATUS GroupTrackersAdd(GROUP* pGroup, GROUP_TRACKER* pTrackers, U32 uCount, U32* puAdded);
+static FLOC_STATUS GroupTrackersDrop(GROUP* pGroup, U64 const* puRemoveBits);
+static FLOC_STATUS GroupHitsMerge(GROUP* pGroup, BOOL bIntersection, U64** ppuMerged, U32* puMembers);
+static FLOC_STATUS GroupStepFilterOut(FLOC_GROUP_HANDLE hGroup, BOOL bExecuted, BOOL bIntersection);
 
 FLOC_STATUS FLOCDLL_Initialize(FLOC_HANDLE* const phHandle)
 {
@@ -12,11 +70,6 @@ FLOC_STATUS FLOCDLL_Initialize(FLOC_HANDLE* const phHandle)
 		return FLOC_STATUS_INSUFFICIENT_PRIVILEGES;
 	}
 	
-	if (FLOC_ContextGetCount() >= FLOC_ContextGetMax())
-	{
-		return FLOC_STATUS_TOO_MANY_CONTEXTS;
-	}
-
 	FLOC_CTX* const pCtx = Memory_Alloc(sizeof(FLOC_CTX));
 	if (NULL == pCtx)
 	{
@@ -24,6 +77,33 @@ FLOC_STATUS FLOCDLL_Initialize(FLOC_HANDLE* const phHandle)
 	}
 
 	pCtx->pidTarget = 0;
+	pCtx->uDeletedCount = 0;
+	pCtx->uGeneration = 1;
+	pCtx->uHwUpdateRequests = 0;
+	pCtx->uHwRotateRequests = 0;
+	pCtx->uHwUpdateServed = 0;
+	pCtx->uHwRotateServed = 0;
+	pCtx->uCompactRequests = 0;
+	pCtx->uCompactServed = 0;
+	pCtx->poolStats.uBytesReserved = 0;
+	pCtx->poolStats.uBytesCommitted = 0;
+	pCtx->poolStats.uBytesUsed = 0;
+	pCtx->poolStats.uBytesReclaimed = 0;
+	pCtx->poolStats.uBytesReleased = 0;
+	pCtx->poolStats.uPoolCount = 0;
+	pCtx->hProcess = NULL;
+	pCtx->pHitRing = NULL;
+	pCtx->uHitDrainBusy = 0;
+	pCtx->threads.pTids = NULL;
+	pCtx->threads.phThreads = NULL;
+	pCtx->threads.uCount = 0;
+	pCtx->threads.uCapacity = 0;
+	pCtx->regions.pRegions = NULL;
+	pCtx->regions.uCount = 0;
+	pCtx->regions.uCapacity = 0;
+	pCtx->regions.bStale = TRUE;
+	Memory_Set(&(pCtx->hwBreakpoints), 0, sizeof(pCtx->hwBreakpoints));
+	pCtx->uHwArmSequence = 0;
 	pCtx->bForeignDebugLoop = FALSE;
 	pCtx->bIsStepActive = FALSE;
 	pCtx->bDbgLoopRunning = FALSE;
@@ -38,16 +118,94 @@ FLOC_STATUS FLOCDLL_Initialize(FLOC_HANDLE* const phHandle)
 		Memory_Free(pCtx);
 		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
 	}	
+	INDEX* const pidxTrackers = &(pCtx->idxTrackers);
+	if (!Index_Init(pidxTrackers, 2000))
+	{
+		Vector_Free(pvecTrackers);
+		Memory_Free(pCtx);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	INDEX* const pidxPages = &(pCtx->idxPages);
+	if (!Index_Init(pidxPages, 16))
+	{
+		Index_Free(pidxTrackers);
+		Vector_Free(pvecTrackers);
+		Memory_Free(pCtx);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
 	VECTOR* const pvecPools = &(pCtx->vecPools);
 	if (!Vector_Init(pvecPools, sizeof(POOL), 10))
 	{
+		Index_Free(pidxPages);
+		Index_Free(pidxTrackers);
+		Vector_Free(pvecTrackers);
+		Memory_Free(pCtx);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	INDEX* const pidxPools = &(pCtx->idxPools);
+	if (!Index_Init(pidxPools, 10))
+	{
+		Vector_Free(pvecPools);
+		Index_Free(pidxPages);
+		Index_Free(pidxTrackers);
+		Vector_Free(pvecTrackers);
+		Memory_Free(pCtx);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	LOOKUP* const plkpTrackers = &(pCtx->lkpTrackers);
+	if (!Lookup_Init(plkpTrackers, 2000))
+	{
+		Index_Free(pidxPools);
+		Vector_Free(pvecPools);
+		Index_Free(pidxPages);
+		Index_Free(pidxTrackers);
+		Vector_Free(pvecTrackers);
+		Memory_Free(pCtx);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	LOOKUP* const plkpPages = &(pCtx->lkpPages);
+	if (!Lookup_Init(plkpPages, 16))
+	{
+		Lookup_Free(plkpTrackers);
+		Index_Free(pidxPools);
+		Vector_Free(pvecPools);
+		Index_Free(pidxPages);
+		Index_Free(pidxTrackers);
+		Vector_Free(pvecTrackers);
+		Memory_Free(pCtx);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	VECTOR* const pvecSteps = &(pCtx->vecSteps);
+	if (!Vector_Init(pvecSteps, sizeof(STEP_RECORD), 16))
+	{
+		Lookup_Free(plkpPages);
+		Lookup_Free(plkpTrackers);
+		Index_Free(pidxPools);
+		Vector_Free(pvecPools);
+		Index_Free(pidxPages);
+		Index_Free(pidxTrackers);
+		Vector_Free(pvecTrackers);
+		Memory_Free(pCtx);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	FLOC_HANDLE const hHandle = FLOC_ContextInsert(pCtx);
+	if (NULL == hHandle)
+	{
+		Vector_Free(pvecSteps);
+		Lookup_Free(plkpPages);
+		Lookup_Free(plkpTrackers);
+		Index_Free(pidxPools);
+		Vector_Free(pvecPools);
+		Index_Free(pidxPages);
+		Index_Free(pidxTrackers);
 		Vector_Free(pvecTrackers);
 		Memory_Free(pCtx);
 		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
 	}
 
-	FLOC_ContextInsert(pCtx);
-	*phHandle = (FLOC_HANDLE)pCtx;
+	*phHandle = hHandle;
 	return FLOC_STATUS_SUCCESS;
 }
 
@@ -68,10 +226,35 @@ FLOC_STATUS FLOCDLL_Uninitialize(FLOC_HANDLE const hHandle)
 		return FLOC_STATUS_DEBUG_LOOP_STOP_FAIL;
 	}
 
+	/* Calls racing with the teardown see a stale handle from here on. */
+	FLOC_ContextClear(hHandle);
+
+	/* Hooks give their stubs back first, only empty pools are returned to the target. */
+	PROCESS const hProcess = pCtx->hProcess;
+	U32 uLiveCount = 0;
+	TRACKER** const ppTrackers = FLOC_TrackerLiveCollect(pCtx, TRUE, &uLiveCount);
+	if (NULL != ppTrackers && NULL != hProcess)
+	{
+		FLOC_TrackerRemoveMany(pCtx, ppTrackers, uLiveCount, hProcess);
+	}
+	Memory_Free(ppTrackers);
+	Pool_FreeAll(&(pCtx->vecPools), &(pCtx->idxPools), &(pCtx->poolStats), &(pCtx->regions), hProcess);
+
 	Vector_Free(&(pCtx->vecTrackers));
+	Index_Free(&(pCtx->idxTrackers));
+	Index_Free(&(pCtx->idxPages));
+	Lookup_Free(&(pCtx->lkpTrackers));
+	Lookup_Free(&(pCtx->lkpPages));
 	Vector_Free(&(pCtx->vecPools));
-	Memory_Free(hHandle);
-	FLOC_ContextClear(pCtx);
+	Index_Free(&(pCtx->idxPools));
+	Vector_Free(&(pCtx->vecSteps));
+	Target_RegionMapFree(&(pCtx->regions));
+	HitStreamRelease(pCtx);
+	if (NULL != pCtx->hProcess)
+	{
+		Target_HandleRelease(pCtx->hProcess);
+	}
+	Memory_Free(pCtx);
 
 	return FLOC_STATUS_SUCCESS;
 }
@@ -88,15 +271,24 @@ FLOC_STATUS FLOCDLL_TargetSet(FLOC_HANDLE const hHandle, PID const pidTarget)
 	{
 		return FLOC_STATUS_TARGET_ALREADY_SET;
 	}
-	if (!FLOC_IsTargetAlive(pidTarget))
+	/* The handle stays open until the target dies or the context is uninitialized. */
+	PROCESS const hProcess = Target_HandleAcquire(pidTarget);
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_INVALID_TARGET;
+	}
+	if (!Target_IsAlive(hProcess))
 	{
+		Target_HandleRelease(hProcess);
 		return FLOC_STATUS_INVALID_TARGET;
 	}
-	if (!Target_Is64bit(pidTarget))
+	if (!Target_Is64bit(hProcess))
 	{
+		Target_HandleRelease(hProcess);
 		return FLOC_STATUS_TARGET_NOT_64BIT;
 	}
 
+	pCtx->hProcess = hProcess;
 	pCtx->pidTarget = pidTarget;
 	return FLOC_STATUS_SUCCESS;
 }
@@ -117,13 +309,13 @@ FLOC_STATUS FLOCDLL_DebugLoopStart(FLOC_HANDLE const hHandle)
 	{
 		return FLOC_STATUS_TARGET_NOT_SET;
 	}
-	if (!FLOC_IsTargetAlive(pCtx->pidTarget))
+	if (!FLOC_IsTargetAlive(pCtx))
 	{
 		return FLOC_STATUS_INVALID_TARGET;
 	}
 
 	BOOL bPresent = FALSE;
-	BOOL bRet = Target_IsDebuggerAttached(pCtx->pidTarget, &bPresent);
+	BOOL bRet = Target_IsDebuggerAttached(pCtx->hProcess, &bPresent);
 	if (!bRet)
 	{
 		return FLOC_STATUS_TARGET_CANNOT_CHECK_DEBUGGER;
@@ -168,45 +360,53 @@ FLOC_STATUS FLOCDLL_DebugLoopStop(FLOC_HANDLE const hHandle)
 		return FLOC_STATUS_DEBUG_LOOP_FOREIGN;
 	}
 
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
-	for (U32 i = 0; i < pCtx->vecTrackers.uElemCount; i++)
+	U32 uLiveCount = 0;
+	TRACKER** const ppTrackers = FLOC_TrackerLiveCollect(pCtx, TRUE, &uLiveCount);
+	if (NULL == ppTrackers)
 	{
-		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(&(pCtx->vecTrackers), i);
-		if (NULL == pTracker || pTracker->eType != TRACKER_TYPE_BREAKPOINT_SW)
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	U32 uCollected = 0;
+	for (U32 i = 0; i < uLiveCount; i++)
+	{
+		TRACKER* const pTracker = ppTrackers[i];
+		if (pTracker->eType != TRACKER_TYPE_BREAKPOINT_SW && pTracker->eType != TRACKER_TYPE_BREAKPOINT_HW && pTracker->eType != TRACKER_TYPE_PAGE_EXEC)
 		{
 			continue;
 		}
 		if (pTracker->bEnabled)
 		{
-			if (NULL == hProcess)
-			{
-				return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
-			}
-			FLOC_TrackerDisable(pTracker, hProcess);
+			ppTrackers[uCollected++] = pTracker;
+		}
+	}
+	if (0 != uCollected)
+	{
+		PROCESS const hProcess = pCtx->hProcess;
+		if (NULL == hProcess)
+		{
+			Memory_Free(ppTrackers);
+			return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
 		}
+		FLOC_TrackerDisableMany(pCtx, ppTrackers, uCollected, hProcess);
 	}
-	Target_HandleRelease(hProcess);
+	Memory_Free(ppTrackers);
 
+	/* Debug registers are cleared by the loop when it detaches. Pages got their protection back above, while the loop still ran. */
 	pCtx->bStopDebugLoop = TRUE;
 
-	BOOL bRet = Thread_WaitExit(pCtx->thrDebug, 100);
-	if (!bRet)
+	/* The loop looks at the flag between batches of events and every few milliseconds when none come. */
+	if (!Thread_WaitExit(pCtx->thrDebug, DEBUG_LOOP_STOP_TIMEOUT_MS))
 	{
-		bRet = Target_DebugBreak(pCtx->pidTarget);
-		if (!bRet)
-		{
-			return FLOC_STATUS_DEBUG_BREAK_FAIL;
-		}
-		bRet = Thread_WaitExit(pCtx->thrDebug, 500);
-		if (!bRet)
-		{
-			return FLOC_STATUS_DEBUG_LOOP_STOP_FAIL;
-		}
+		return FLOC_STATUS_DEBUG_LOOP_STOP_FAIL;
 	}
 
 	Thread_Close(pCtx->thrDebug);
 	pCtx->bDbgLoopRunning = FALSE;
 	pCtx->bStopDebugLoop = FALSE;
+
+	/* Requests the loop did not get to are served here, removals made while it ran are compacted now. */
+	FLOC_HwBreakpointsUpdate(pCtx);
+	FLOC_TrackerCompact(pCtx);
 	return FLOC_STATUS_SUCCESS;
 }
 
@@ -223,7 +423,7 @@ FLOC_STATUS FLOCDLL_DebugLoopOverride(FLOC_HANDLE const hHandle, BOOL const bLoo
 	BOOL const bOverride = bLoopRunning;
 
 	BOOL bPresent = FALSE;
-	BOOL bRet = Target_IsDebuggerAttached(pCtx->pidTarget, &bPresent);
+	BOOL bRet = Target_IsDebuggerAttached(pCtx->hProcess, &bPresent);
 	if (!bRet)
 	{
 		return FLOC_STATUS_TARGET_CANNOT_CHECK_DEBUGGER;
@@ -234,6 +434,8 @@ FLOC_STATUS FLOCDLL_DebugLoopOverride(FLOC_HANDLE const hHandle, BOOL const bLoo
 	{
 		pCtx->bForeignDebugLoop = bLoopRunning;
 		pCtx->bDbgLoopRunning = FALSE;
+		/* Removals made while it ran are compacted now. */
+		FLOC_TrackerCompact(pCtx);
 		return FLOC_STATUS_SUCCESS;
 	}
 
@@ -268,133 +470,184 @@ FLOC_STATUS FLOCDLL_DebugLoopOverride(FLOC_HANDLE const hHandle, BOOL const bLoo
 
 }
 
-FLOC_STATUS FLOCDLL_CallExceptionBreakpointHandler(FLOC_HANDLE const hHandle, PID const pidProcess, TID const tidThread, ADDRESS const aAddress)
+static void HitStreamRelease(FLOC_CTX* const pCtx)
 {
-	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx->pHitRing)
+	{
+		return;
+	}
+	Ring_Free(pCtx->pHitRing);
+	Memory_Free(pCtx->pHitRing);
+	pCtx->pHitRing = NULL;
+}
+
+FLOC_STATUS FLOCDLL_HitStreamStart(FLOC_HANDLE const hHandle, U32 const uCapacity, HIT_CALLBACK_FUNC const fnCallback, void* const pCallbackParam)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
 	if (NULL == pCtx)
 	{
 		return FLOC_STATUS_INVALID_HANDLE;
 	}
+	/* The ring is only ever pushed to from the debug loop, which must not see it change. */
+	if (pCtx->bDbgLoopRunning)
+	{
+		return FLOC_STATUS_DEBUG_LOOP_ALREADY_RUNNING;
+	}
 
-	if (!pCtx->bForeignDebugLoop)
+	HIT_RING* const pRing = Memory_Alloc(sizeof(HIT_RING));
+	if (NULL == pRing)
 	{
-		return FLOC_STATUS_FOREIGN_DEBUGGER_NOT_ATTACHED;
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
 	}
-	if (!pCtx->bDbgLoopRunning)
+	if (!Ring_Init(pRing, uCapacity, fnCallback, pCallbackParam))
 	{
-		return FLOC_STATUS_DEBUG_LOOP_STOPPED;
+		Memory_Free(pRing);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
 	}
-
-	BYTE uOriginalByte = 0;
-	BOOL const bShouldRemove = FLOC_BreakpointHandler(pCtx, aAddress, &uOriginalByte);
-	if (bShouldRemove)
+	/* A drain running on another thread still reads the old ring. */
+	if (!Atomic_CompareExchange(&(pCtx->uHitDrainBusy), 0, 1))
 	{
-		Target_BreakpointRemoveTriggered(pidProcess, tidThread, aAddress, uOriginalByte);
+		Ring_Free(pRing);
+		Memory_Free(pRing);
+		return FLOC_STATUS_HIT_STREAM_BUSY;
 	}
-
+	HitStreamRelease(pCtx);
+	pCtx->pHitRing = pRing;
+	Atomic_CompareExchange(&(pCtx->uHitDrainBusy), 1, 0);
 	return FLOC_STATUS_SUCCESS;
 }
 
-FLOC_STATUS FLOCDLL_TrackerAddBreakpoint(FLOC_HANDLE const hHandle, ADDRESS const aAddress)
+FLOC_STATUS FLOCDLL_HitStreamDrain(FLOC_HANDLE const hHandle, HIT_RECORD* const pRecords, U32 const uCapacity, U32* const puCount, U64* const puDropped)
 {
 	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
 	if (NULL == pCtx)
 	{
 		return FLOC_STATUS_INVALID_HANDLE;
 	}
-	if (0 == pCtx->pidTarget)
+	*puCount = 0;
+	/* The ring has a single consumer, a second drainer would move the read index under the first one. */
+	if (!Atomic_CompareExchange(&(pCtx->uHitDrainBusy), 0, 1))
 	{
-		return FLOC_STATUS_TARGET_NOT_SET;
+		return FLOC_STATUS_HIT_STREAM_BUSY;
 	}
-
-	for (U32 i = 0; i < pCtx->vecTrackers.uElemCount; i++)
+	FLOC_STATUS status = FLOC_STATUS_HIT_STREAM_STOPPED;
+	if (NULL != pCtx->pHitRing)
 	{
-		TRACKER const * const pTracker = (TRACKER*)Vector_AddressOf(&(pCtx->vecTrackers), i);
-		if (NULL == pTracker)
+		*puCount = Ring_Drain(pCtx->pHitRing, pRecords, uCapacity);
+		if (NULL != puDropped)
 		{
-			continue;
-		}
-		if (aAddress == pTracker->aAddress)
-		{
-			return FLOC_STATUS_TRACKER_ALREADY_EXISTS;
+			*puDropped = Ring_DroppedGet(pCtx->pHitRing);
 		}
+		status = FLOC_STATUS_SUCCESS;
 	}
+	Atomic_CompareExchange(&(pCtx->uHitDrainBusy), 1, 0);
+	return status;
+}
 
-	TRACKER tracker;
-	tracker.aAddress = aAddress;
-	tracker.eType = TRACKER_TYPE_BREAKPOINT_SW;
-	tracker.bEnabled = FALSE;
-	tracker.bHit = FALSE;
-
-	BYTE uOriginalByte = 0;
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
-	if (NULL == hProcess)
+FLOC_STATUS FLOCDLL_HitStreamStop(FLOC_HANDLE const hHandle)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
 	{
-		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+		return FLOC_STATUS_INVALID_HANDLE;
 	}
-	if (!Target_MemoryRead(hProcess, tracker.aAddress, &uOriginalByte, 1))
+	if (pCtx->bDbgLoopRunning)
 	{
-		Target_HandleRelease(hProcess);
-		return FLOC_STATUS_MEMORY_READ_FAIL;
+		return FLOC_STATUS_DEBUG_LOOP_ALREADY_RUNNING;
 	}
-	Target_HandleRelease(hProcess);
-	tracker.u.bp.uOriginalByte = uOriginalByte;	
-
-	VECTOR* const pvecTrackers = &(pCtx->vecTrackers);
-	if (!Vector_PushBackCopy(pvecTrackers, &tracker))
+	if (!Atomic_CompareExchange(&(pCtx->uHitDrainBusy), 0, 1))
 	{
-		return FLOC_STATUS_VECTOR_PUSHBACK_FAIL;
+		return FLOC_STATUS_HIT_STREAM_BUSY;
 	}
-
-	return FLOC_STATUS_SUCCESS;
+	FLOC_STATUS const status = (NULL == pCtx->pHitRing) ? FLOC_STATUS_HIT_STREAM_STOPPED : FLOC_STATUS_SUCCESS;
+	HitStreamRelease(pCtx);
+	Atomic_CompareExchange(&(pCtx->uHitDrainBusy), 1, 0);
+	return status;
 }
 
-FLOC_STATUS FLOCDLL_TrackerAddHook(FLOC_HANDLE const hHandle, ADDRESS const aAddress, U32 const uFuncLen)
+FLOC_STATUS FLOCDLL_CallExceptionBreakpointHandler(FLOC_HANDLE const hHandle, PID const pidProcess, TID const tidThread, ADDRESS const aAddress)
 {
 	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
 	if (NULL == pCtx)
 	{
 		return FLOC_STATUS_INVALID_HANDLE;
 	}
-	if (0 == pCtx->pidTarget)
+
+	if (!pCtx->bForeignDebugLoop)
 	{
-		return FLOC_STATUS_TARGET_NOT_SET;
+		return FLOC_STATUS_FOREIGN_DEBUGGER_NOT_ATTACHED;
+	}
+	if (!pCtx->bDbgLoopRunning)
+	{
+		return FLOC_STATUS_DEBUG_LOOP_STOPPED;
 	}
 
-	for (U32 i = 0; i < pCtx->vecTrackers.uElemCount; i++)
+	BYTE uOriginalByte = 0;
+	BOOL const bShouldRemove = FLOC_BreakpointHandler(pCtx, tidThread, aAddress, &uOriginalByte);
+	if (bShouldRemove)
 	{
-		TRACKER const * const pTracker = (TRACKER*)Vector_AddressOf(&(pCtx->vecTrackers), i);
-		if (NULL == pTracker)
+		/* The foreign debugger may forward events of another process, which needs its own handle. */
+		if (pidProcess == pCtx->pidTarget)
 		{
-			continue;
+			Target_BreakpointRemoveTriggered(pCtx->hProcess, NULL, tidThread, aAddress, uOriginalByte);
 		}
-		if (aAddress == pTracker->aAddress)
+		else
 		{
-			return FLOC_STATUS_TRACKER_ALREADY_EXISTS;
+			PROCESS const hProcess = Target_HandleAcquire(pidProcess);
+			if (NULL == hProcess)
+			{
+				return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+			}
+			Target_BreakpointRemoveTriggered(hProcess, NULL, tidThread, aAddress, uOriginalByte);
+			Target_HandleRelease(hProcess);
 		}
 	}
 
+	return FLOC_STATUS_SUCCESS;
+}
+
+static FLOC_STATUS TrackerAddBreakpoint(FLOC_CTX* const pCtx, ADDRESS const aAddress, BYTE const uOriginalByte)
+{
+	if (NULL != FLOC_TrackerFind(pCtx, aAddress))
+	{
+		return FLOC_STATUS_TRACKER_ALREADY_EXISTS;
+	}
+
 	TRACKER tracker;
 	tracker.aAddress = aAddress;
-	tracker.eType = TRACKER_TYPE_HOOK_INLINE;
+	tracker.eType = TRACKER_TYPE_BREAKPOINT_SW;
 	tracker.bEnabled = FALSE;
 	tracker.bHit = FALSE;
+	tracker.uParam = 0;
+	tracker.u.bp.uOriginalByte = uOriginalByte;
 
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
-	if (NULL == hProcess)
+	if (!FLOC_TrackerInsert(pCtx, &tracker))
 	{
-		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+		return FLOC_STATUS_VECTOR_PUSHBACK_FAIL;
 	}
-	VECTOR* const pvecPools = &(pCtx->vecPools);
-	if (!Hook_Create(pvecPools, &tracker, hProcess, uFuncLen))
+
+	return FLOC_STATUS_SUCCESS;
+}
+
+static FLOC_STATUS TrackerAddBreakpointHw(FLOC_CTX* const pCtx, ADDRESS const aAddress)
+{
+	if (NULL != FLOC_TrackerFind(pCtx, aAddress))
 	{
-		Target_HandleRelease(hProcess);
-		return FLOC_STATUS_HOOK_CREATE_FAIL;
+		return FLOC_STATUS_TRACKER_ALREADY_EXISTS;
 	}
-	Target_HandleRelease(hProcess);
 
-	VECTOR* const pvecTrackers = &(pCtx->vecTrackers);
-	if (!Vector_PushBackCopy(pvecTrackers, &tracker))
+	TRACKER tracker;
+	tracker.aAddress = aAddress;
+	tracker.eType = TRACKER_TYPE_BREAKPOINT_HW;
+	tracker.bEnabled = FALSE;
+	tracker.bHit = FALSE;
+	tracker.uParam = 0;
+	tracker.u.hwbp.uHitCount = 0;
+	tracker.u.hwbp.uArmSequence = 0;
+	tracker.u.hwbp.bArmed = FALSE;
+	tracker.u.hwbp.bWatchedStep = FALSE;
+
+	if (!FLOC_TrackerInsert(pCtx, &tracker))
 	{
 		return FLOC_STATUS_VECTOR_PUSHBACK_FAIL;
 	}
@@ -402,328 +655,2425 @@ FLOC_STATUS FLOCDLL_TrackerAddHook(FLOC_HANDLE const hHandle, ADDRESS const aAdd
 	return FLOC_STATUS_SUCCESS;
 }
 
-FLOC_STATUS FLOCDLL_TrackerRemove(FLOC_HANDLE const hHandle, ADDRESS const aAddress)
+static FLOC_STATUS TrackerAddHook(FLOC_CTX* const pCtx, ADDRESS const aAddress, U32 const uFuncLen, PROCESS const hProcess, PATCH_BATCH* const pUnprotect, U32 const uTag)
 {
-	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
-	if (NULL == pCtx)
+	if (NULL != FLOC_TrackerFind(pCtx, aAddress))
 	{
-		return FLOC_STATUS_INVALID_HANDLE;
+		return FLOC_STATUS_TRACKER_ALREADY_EXISTS;
 	}
-	
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
-	if (NULL == hProcess)
+
+	TRACKER tracker;
+	tracker.aAddress = aAddress;
+	tracker.eType = TRACKER_TYPE_HOOK_INLINE;
+	tracker.bEnabled = FALSE;
+	tracker.bHit = FALSE;
+	tracker.uParam = uFuncLen;
+
+	VECTOR* const pvecPools = &(pCtx->vecPools);
+	if (!Hook_Create(pvecPools, &(pCtx->idxPools), &(pCtx->poolStats), &tracker, &(pCtx->regions), hProcess, uFuncLen))
 	{
-		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+		return FLOC_STATUS_HOOK_CREATE_FAIL;
 	}
 
-	VECTOR const* const pvecTrackers = &(pCtx->vecTrackers);
-	U32 const uElemCount = pvecTrackers->uElemCount;
-	for (U32 i = 0; i < uElemCount; i++)
+	/*
+	 * A one-shot stub writes the original bytes back, so the function has to stay writable. Batches unprotect all pages at once.
+	 * Relocated stubs never write to the function.
+	 */
+	FLOC_STATUS status = FLOC_STATUS_SUCCESS;
+	BOOL const bOneShot = !tracker.u.hook.bRelocated;
+	if (bOneShot && NULL == pUnprotect)
 	{
-		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(pvecTrackers, i);
-		if (NULL == pTracker || aAddress != pTracker->aAddress || TRACKER_TYPE_DELETED == pTracker->eType)
+		if (!Target_MemoryUnprotect(hProcess, aAddress, tracker.u.hook.uJumpBytesLen))
 		{
-			continue;
+			status = FLOC_STATUS_HOOK_CREATE_FAIL;
 		}
-		FLOC_TrackerRemove(pTracker, hProcess);
-		Target_HandleRelease(hProcess);
-		return FLOC_STATUS_SUCCESS;
 	}
-
-	Target_HandleRelease(hProcess);
-	return FLOC_STATUS_TRACKER_NOT_FOUND;
-}
-
-FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerEnable(FLOC_HANDLE const hHandle, ADDRESS const aAddress)
-{
-	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
-	if (NULL == pCtx)
+	else if (bOneShot && !Target_PatchBatchAdd(pUnprotect, aAddress, tracker.u.hook.uJumpBytes, tracker.u.hook.uJumpBytesLen, uTag))
 	{
-		return FLOC_STATUS_INVALID_HANDLE;
+		status = FLOC_STATUS_MEMORY_ALLOC_FAIL;
 	}
 
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
-	if (NULL == hProcess)
+	if (FLOC_STATUS_SUCCESS == status && !FLOC_TrackerInsert(pCtx, &tracker))
 	{
-		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+		status = FLOC_STATUS_VECTOR_PUSHBACK_FAIL;
 	}
 
-	VECTOR const* const pvecTrackers = &(pCtx->vecTrackers);
-	U32 const uElemCount = pvecTrackers->uElemCount;
-	for (U32 i = 0; i < uElemCount; i++)
+	/* The hook was never armed, so its slot can go straight back to the pool. */
+	if (FLOC_STATUS_SUCCESS != status)
 	{
-		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(pvecTrackers, i);
-		if (NULL == pTracker || aAddress != pTracker->aAddress || TRACKER_TYPE_DELETED == pTracker->eType)
-		{
-			continue;
-		}
-		if (pTracker->bEnabled)
-		{
-			Target_HandleRelease(hProcess);
-			return FLOC_STATUS_SUCCESS;
-		}
-		if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType && (!pCtx->bDbgLoopRunning || pCtx->bStopDebugLoop))
-		{
-			Target_HandleRelease(hProcess);
-			return FLOC_STATUS_ENABLING_BREAKPOINT_WITHOUT_DEBUGGING;
-		}
-		FLOC_TrackerEnable(pTracker, hProcess);
-		Target_HandleRelease(hProcess);
-		return FLOC_STATUS_SUCCESS;
+		Hook_Release(&tracker, pvecPools, &(pCtx->idxPools), &(pCtx->poolStats), &(pCtx->regions), hProcess);
 	}
-
-	Target_HandleRelease(hProcess);
-	return FLOC_STATUS_TRACKER_NOT_FOUND;
+	return status;
 }
 
-FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerDisable(FLOC_HANDLE const hHandle, ADDRESS const aAddress)
+static FLOC_STATUS TrackerAddCounter(FLOC_CTX* const pCtx, ADDRESS const aAddress, U32 const uPrologueLen, PROCESS const hProcess)
 {
-	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
-	if (NULL == pCtx)
+	if (NULL != FLOC_TrackerFind(pCtx, aAddress))
 	{
-		return FLOC_STATUS_INVALID_HANDLE;
+		return FLOC_STATUS_TRACKER_ALREADY_EXISTS;
 	}
 
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
-	if (NULL == hProcess)
+	TRACKER tracker;
+	tracker.aAddress = aAddress;
+	tracker.eType = TRACKER_TYPE_HOOK_COUNTER;
+	tracker.bEnabled = FALSE;
+	tracker.bHit = FALSE;
+	tracker.uParam = uPrologueLen;
+
+	VECTOR* const pvecPools = &(pCtx->vecPools);
+	if (!Hook_CreateCounter(pvecPools, &(pCtx->idxPools), &(pCtx->poolStats), &tracker, &(pCtx->regions), hProcess, uPrologueLen))
 	{
-		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+		return FLOC_STATUS_HOOK_CREATE_FAIL;
 	}
 
-	VECTOR const * const pvecTrackers = &(pCtx->vecTrackers);
-	U32 const uElemCount = pvecTrackers->uElemCount;
-	for (U32 i = 0; i < uElemCount; i++)
+	if (!FLOC_TrackerInsert(pCtx, &tracker))
 	{
-		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(pvecTrackers, i);
-		if (NULL == pTracker || aAddress != pTracker->aAddress || TRACKER_TYPE_DELETED == pTracker->eType)
-		{
-			continue;
-		}
-		if (!pTracker->bEnabled)
-		{
-			Target_HandleRelease(hProcess);
-			return FLOC_STATUS_SUCCESS;
-		}
-		FLOC_TrackerDisable(pTracker, hProcess);
-		Target_HandleRelease(hProcess);
-		return FLOC_STATUS_SUCCESS;
+		Hook_Release(&tracker, pvecPools, &(pCtx->idxPools), &(pCtx->poolStats), &(pCtx->regions), hProcess);
+		return FLOC_STATUS_VECTOR_PUSHBACK_FAIL;
 	}
 
-	Target_HandleRelease(hProcess);
-	return FLOC_STATUS_TRACKER_NOT_FOUND;
+	return FLOC_STATUS_SUCCESS;
 }
 
-FLOC_STATUS FLOCDLL_TrackerAllGet(FLOC_HANDLE const hHandle, VECTOR const ** const ppVec)
+static FLOC_STATUS TrackerRemove(FLOC_CTX* const pCtx, ADDRESS const aAddress, PROCESS const hProcess)
 {
-	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
-	if (NULL == pCtx)
+	TRACKER* const pTracker = FLOC_TrackerFind(pCtx, aAddress);
+	if (NULL == pTracker)
 	{
-		return FLOC_STATUS_INVALID_HANDLE;
+		return FLOC_STATUS_TRACKER_NOT_FOUND;
 	}
-	*ppVec = &(pCtx->vecTrackers);
+	FLOC_TrackerRemove(pCtx, pTracker, hProcess);
+	FLOC_TrackerCompact(pCtx);
 	return FLOC_STATUS_SUCCESS;
 }
 
-FLOC_STATUS FLOCDLL_TrackerAllReset(FLOC_HANDLE const hHandle)
+static FLOC_STATUS TrackerEnable(FLOC_CTX* const pCtx, ADDRESS const aAddress, PROCESS const hProcess)
 {
-	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
-	if (NULL == pCtx)
+	TRACKER* const pTracker = FLOC_TrackerFind(pCtx, aAddress);
+	if (NULL == pTracker)
 	{
-		return FLOC_STATUS_INVALID_HANDLE;
+		return FLOC_STATUS_TRACKER_NOT_FOUND;
 	}
-
-	if (pCtx->bIsStepActive)
+	if (pTracker->bEnabled)
 	{
-		return FLOC_STATUS_STEP_ACTIVE;
+		return FLOC_STATUS_SUCCESS;
 	}
-
-	VECTOR const * const pvecTrackers = &(pCtx->vecTrackers);
-	U32 const uElemCount = pvecTrackers->uElemCount;
-	for (U32 i = 0; i < uElemCount; i++)
+	if (TrackerLacksDebugLoop(pCtx, pTracker))
 	{
-		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(pvecTrackers, i);
-		if (NULL == pTracker)
-		{
-			continue;
-		}
-		pTracker->bHit = FALSE;
+		return FLOC_STATUS_ENABLING_BREAKPOINT_WITHOUT_DEBUGGING;
 	}
+	FLOC_TrackerEnable(pCtx, pTracker, hProcess);
+	return pTracker->bEnabled ? FLOC_STATUS_SUCCESS : FLOC_STATUS_TRACKER_ENABLE_FAIL;
+}
 
-	pCtx->bIsPendingReset = FALSE;
+static FLOC_STATUS TrackerDisable(FLOC_CTX* const pCtx, ADDRESS const aAddress, PROCESS const hProcess)
+{
+	TRACKER* const pTracker = FLOC_TrackerFind(pCtx, aAddress);
+	if (NULL == pTracker)
+	{
+		return FLOC_STATUS_TRACKER_NOT_FOUND;
+	}
+	if (pTracker->bEnabled)
+	{
+		FLOC_TrackerDisable(pCtx, pTracker, hProcess);
+	}
 	return FLOC_STATUS_SUCCESS;
 }
 
-FLOC_STATUS FLOCDLL_TrackerAllEnable(FLOC_HANDLE const hHandle)
+static BOOL TrackerLacksDebugLoop(FLOC_CTX const * const pCtx, TRACKER const * const pTracker)
 {
-	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
-	if (NULL == pCtx)
+	/* Breakpoints need a running debug loop. Debug registers and page faults are only handled by our own loop. */
+	BOOL const bLoop = pCtx->bDbgLoopRunning && !pCtx->bStopDebugLoop;
+	if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType)
 	{
-		return FLOC_STATUS_INVALID_HANDLE;
+		return !bLoop;
+	}
+	if (TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType || TRACKER_TYPE_PAGE_EXEC == pTracker->eType)
+	{
+		return !bLoop || pCtx->bForeignDebugLoop;
 	}
+	return FALSE;
+}
 
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
-	if (NULL == hProcess)
+static int BatchEntryCompare(void const* const pLeft, void const* const pRight)
+{
+	ADDRESS const aLeft = ((BATCH_ENTRY const*)pLeft)->aAddress;
+	ADDRESS const aRight = ((BATCH_ENTRY const*)pRight)->aAddress;
+	return (aLeft < aRight) ? -1 : ((aLeft > aRight) ? 1 : 0);
+}
+
+static BATCH_ENTRY* BatchEntriesCreate(ADDRESS const * const pAddresses, U32 const uCount)
+{
+	BATCH_ENTRY* const pEntries = Memory_Alloc((U64)uCount * sizeof(BATCH_ENTRY));
+	if (NULL == pEntries)
 	{
-		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+		return NULL;
 	}
 
-	FLOC_STATUS status = FLOC_STATUS_SUCCESS;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		pEntries[i].aAddress = pAddresses[i];
+		pEntries[i].uIndex = i;
+		pEntries[i].status = FLOC_STATUS_FAILURE;
+		pEntries[i].uOriginalByte = 0;
+	}
 
-	VECTOR const* const pvecTrackers = &(pCtx->vecTrackers);
-	U32 const uElemCount = pvecTrackers->uElemCount;
-	for (U32 i = 0; i < uElemCount; i++)
+	/* Ascending order keeps target reads within a page together and hooks for the same module in the same pool. */
+	Sort_Heap(pEntries, uCount, sizeof(BATCH_ENTRY), BatchEntryCompare);
+	return pEntries;
+}
+
+static void BatchReadOriginalBytes(PROCESS const hProcess, BATCH_ENTRY* const pEntries, U32 const uCount)
+{
+	BYTE bufSpan[BATCH_READ_SPAN];
+
+	U32 uFirst = 0;
+	while (uFirst < uCount)
 	{
-		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(pvecTrackers, i);
-		if (NULL == pTracker || TRACKER_TYPE_DELETED == pTracker->eType)
+		/* Read every sorted address that fits into one span with a single call. */
+		ADDRESS const aBase = pEntries[uFirst].aAddress;
+		U32 uLast = uFirst;
+		while (uLast + 1 < uCount && (pEntries[uLast + 1].aAddress - aBase) < BATCH_READ_SPAN)
 		{
-			continue;
+			uLast++;
 		}
-		if (pTracker->bEnabled)
+
+		U64 const uSpanLen = pEntries[uLast].aAddress - aBase + 1;
+		BOOL const bSpanRead = Target_MemoryRead(hProcess, aBase, bufSpan, uSpanLen);
+		for (U32 i = uFirst; i <= uLast; i++)
 		{
-			continue;
+			BATCH_ENTRY* const pEntry = &(pEntries[i]);
+			BOOL bRead = bSpanRead;
+			if (bSpanRead)
+			{
+				pEntry->uOriginalByte = bufSpan[pEntry->aAddress - aBase];
+			}
+			else
+			{
+				/* Span crossed unreadable memory, fall back to individual reads. */
+				bRead = Target_MemoryRead(hProcess, pEntry->aAddress, &(pEntry->uOriginalByte), 1);
+			}
+			pEntry->status = bRead ? FLOC_STATUS_SUCCESS : FLOC_STATUS_MEMORY_READ_FAIL;
+		}
+
+		uFirst = uLast + 1;
+	}
+}
+
+static U32 BatchTrackersCollect(FLOC_CTX const * const pCtx, BATCH_ENTRY* const pEntries, U32 const uCount, TRACKER** const ppTrackers)
+{
+	/*
+	 * Entries without a tracker fail right away, the others succeed once their patches are applied.
+	 * The entries are sorted, so a repeated address finds the tracker just collected and is not queued twice.
+	 */
+	U32 uCollected = 0;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		TRACKER* const pTracker = FLOC_TrackerFind(pCtx, pEntries[i].aAddress);
+		pEntries[i].status = (NULL == pTracker) ? FLOC_STATUS_TRACKER_NOT_FOUND : FLOC_STATUS_SUCCESS;
+		if (NULL != pTracker && (0 == uCollected || pTracker != ppTrackers[uCollected - 1]))
+		{
+			ppTrackers[uCollected++] = pTracker;
+		}
+	}
+	return uCollected;
+}
+
+static FLOC_STATUS BatchFinish(BATCH_ENTRY* const pEntries, U32 const uCount, FLOC_STATUS* const pStatuses)
+{
+	FLOC_STATUS status = FLOC_STATUS_SUCCESS;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		if (FLOC_STATUS_SUCCESS != pEntries[i].status)
+		{
+			status = FLOC_STATUS_BATCH_INCOMPLETE;
 		}
-		if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType && (!pCtx->bDbgLoopRunning || pCtx->bStopDebugLoop))
+		if (NULL != pStatuses)
 		{
-			status = FLOC_STATUS_ENABLING_BREAKPOINT_WITHOUT_DEBUGGING;
-			continue;
+			pStatuses[pEntries[i].uIndex] = pEntries[i].status;
 		}
-		FLOC_TrackerEnable(pTracker, hProcess);
 	}
-	
-	Target_HandleRelease(hProcess);
+	Memory_Free(pEntries);
 	return status;
 }
 
-FLOC_STATUS FLOCDLL_TrackerAllDisable(FLOC_HANDLE const hHandle)
+FLOC_STATUS FLOCDLL_TrackerAddBreakpoint(FLOC_HANDLE const hHandle, ADDRESS const aAddress)
 {
-	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
 	if (NULL == pCtx)
 	{
 		return FLOC_STATUS_INVALID_HANDLE;
 	}
+	if (0 == pCtx->pidTarget)
+	{
+		return FLOC_STATUS_TARGET_NOT_SET;
+	}
 
-	if (pCtx->bIsStepActive)
+	if (NULL != FLOC_TrackerFind(pCtx, aAddress))
 	{
-		return FLOC_STATUS_STEP_ACTIVE;
+		return FLOC_STATUS_TRACKER_ALREADY_EXISTS;
 	}
 
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
+	BYTE uOriginalByte = 0;
+	PROCESS const hProcess = pCtx->hProcess;
 	if (NULL == hProcess)
 	{
 		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
 	}
+	if (!Target_MemoryRead(hProcess, aAddress, &uOriginalByte, 1))
+	{
+		return FLOC_STATUS_MEMORY_READ_FAIL;
+	}
+
+	return TrackerAddBreakpoint(pCtx, aAddress, uOriginalByte);
+}
+
+FLOC_STATUS FLOCDLL_TrackerAddBreakpointMany(FLOC_HANDLE const hHandle, ADDRESS const * const pAddresses, U32 const uCount, FLOC_STATUS* const pStatuses)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (0 == pCtx->pidTarget)
+	{
+		return FLOC_STATUS_TARGET_NOT_SET;
+	}
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
 
-	for (U32 i = 0; i < pCtx->vecTrackers.uElemCount; i++)
+	if (!Vector_Reserve(&(pCtx->vecTrackers), pCtx->vecTrackers.uElemCount + uCount)
+		|| !Index_Reserve(&(pCtx->idxTrackers), pCtx->idxTrackers.uCount + uCount)
+		|| !Lookup_Reserve(&(pCtx->lkpTrackers), pCtx->idxTrackers.uCount + uCount))
 	{
-		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(&(pCtx->vecTrackers), i);
-		if (NULL == pTracker || TRACKER_TYPE_DELETED == pTracker->eType)
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	BATCH_ENTRY* const pEntries = BatchEntriesCreate(pAddresses, uCount);
+	if (NULL == pEntries)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		Memory_Free(pEntries);
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	BatchReadOriginalBytes(hProcess, pEntries, uCount);
+
+	for (U32 i = 0; i < uCount; i++)
+	{
+		BATCH_ENTRY* const pEntry = &(pEntries[i]);
+		if (FLOC_STATUS_SUCCESS == pEntry->status)
 		{
-			continue;
+			pEntry->status = TrackerAddBreakpoint(pCtx, pEntry->aAddress, pEntry->uOriginalByte);
 		}
-		if (pTracker->bEnabled)
+	}
+
+	return BatchFinish(pEntries, uCount, pStatuses);
+}
+
+FLOC_STATUS FLOCDLL_TrackerAddBreakpointHw(FLOC_HANDLE const hHandle, ADDRESS const aAddress)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (0 == pCtx->pidTarget)
+	{
+		return FLOC_STATUS_TARGET_NOT_SET;
+	}
+
+	return TrackerAddBreakpointHw(pCtx, aAddress);
+}
+
+FLOC_STATUS FLOCDLL_TrackerAddPages(FLOC_HANDLE const hHandle, ADDRESS const aStart, U64 const uSize, U32* const puAdded)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	*puAdded = 0;
+	if (0 == pCtx->pidTarget)
+	{
+		return FLOC_STATUS_TARGET_NOT_SET;
+	}
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	if (0 == uSize)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	/* One protection query per region, every executable page in it gets a tracker that remembers the protection. */
+	ADDRESS aPage = aStart & ~(ADDRESS)(TRACKER_PAGE_SIZE - 1);
+	ADDRESS const aEnd = (aStart + uSize - 1 < aStart) ? (ADDRESS)-1 : (aStart + uSize - 1);
+	while (aPage <= aEnd)
+	{
+		U32 uProtect = 0;
+		ADDRESS aRegionEnd = 0;
+		BOOL bExecutable = FALSE;
+		if (!Target_MemoryProtectQuery(hProcess, aPage, &uProtect, &aRegionEnd, &bExecutable))
+		{
+			return FLOC_STATUS_MEMORY_READ_FAIL;
+		}
+		if (aRegionEnd <= aPage)
+		{
+			break;
+		}
+
+		for (; bExecutable && aPage < aRegionEnd && aPage <= aEnd; aPage += TRACKER_PAGE_SIZE)
+		{
+			if (NULL != FLOC_PageFind(pCtx, aPage))
+			{
+				continue;
+			}
+			TRACKER tracker;
+			tracker.aAddress = aPage;
+			tracker.eType = TRACKER_TYPE_PAGE_EXEC;
+			tracker.bEnabled = FALSE;
+			tracker.bHit = FALSE;
+			tracker.uParam = 0;
+			tracker.u.page.uProtect = uProtect;
+			if (!FLOC_TrackerInsert(pCtx, &tracker))
+			{
+				return FLOC_STATUS_VECTOR_PUSHBACK_FAIL;
+			}
+			(*puAdded)++;
+		}
+		if (aRegionEnd - 1 >= aEnd)
 		{
-			FLOC_TrackerDisable(pTracker, hProcess);
+			break;
 		}
+		aPage = aRegionEnd;
 	}
 
-	Target_HandleRelease(hProcess);
 	return FLOC_STATUS_SUCCESS;
 }
 
-FLOC_STATUS FLOCDLL_StepBegin(FLOC_HANDLE const hHandle)
+FLOC_STATUS FLOCDLL_TrackerAddHook(FLOC_HANDLE const hHandle, ADDRESS const aAddress, U32 const uFuncLen)
 {
-	FLOC_CTX * const pCtx = FLOC_ContextGet(hHandle);
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
 	if (NULL == pCtx)
 	{
 		return FLOC_STATUS_INVALID_HANDLE;
 	}
-
-	if (pCtx->bIsStepActive)
+	if (0 == pCtx->pidTarget)
 	{
-		return FLOC_STATUS_STEP_ALREADY_ACTIVE;
+		return FLOC_STATUS_TARGET_NOT_SET;
 	}
-	if (FLOC_IsTargetDead(pCtx))
+
+	if (NULL != FLOC_TrackerFind(pCtx, aAddress))
 	{
-		return FLOC_STATUS_TARGET_DIED;
+		return FLOC_STATUS_TRACKER_ALREADY_EXISTS;
 	}
-	if (pCtx->bIsPendingReset && FLOC_STATUS_SUCCESS != FLOCDLL_TrackerAllReset(hHandle))
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
 	{
-		return FLOC_STATUS_TRACKER_RESET_FAIL;
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
 	}
-	
-	pCtx->bIsPendingReset = FALSE;
-	pCtx->bIsStepActive = TRUE;
-	return FLOC_STATUS_SUCCESS;
+	FLOC_STATUS const status = TrackerAddHook(pCtx, aAddress, uFuncLen, hProcess, NULL, 0);
+	return status;
 }
 
-FLOC_STATUS FLOCDLL_StepEnd(FLOC_HANDLE const hHandle)
+FLOC_STATUS FLOCDLL_TrackerAddHookMany(FLOC_HANDLE const hHandle, ADDRESS const * const pAddresses, U32 const * const puFuncLens, U32 const uCount, FLOC_STATUS* const pStatuses)
 {
 	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
 	if (NULL == pCtx)
 	{
 		return FLOC_STATUS_INVALID_HANDLE;
 	}
+	if (0 == pCtx->pidTarget)
+	{
+		return FLOC_STATUS_TARGET_NOT_SET;
+	}
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
 
-	if (FLOC_IsTargetDead(pCtx))
+	if (!Vector_Reserve(&(pCtx->vecTrackers), pCtx->vecTrackers.uElemCount + uCount)
+		|| !Index_Reserve(&(pCtx->idxTrackers), pCtx->idxTrackers.uCount + uCount)
+		|| !Lookup_Reserve(&(pCtx->lkpTrackers), pCtx->idxTrackers.uCount + uCount))
 	{
-		return FLOC_STATUS_TARGET_DIED;
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
 	}
-	if (!pCtx->bIsStepActive)
+	BATCH_ENTRY* const pEntries = BatchEntriesCreate(pAddresses, uCount);
+	if (NULL == pEntries)
 	{
-		return FLOC_STATUS_STEP_ALREADY_STOPPED;
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
 	}
 
-	pCtx->bIsStepActive = FALSE;
-	pCtx->bIsPendingReset = TRUE;
+	PATCH_BATCH batchUnprotect;
+	if (!Target_PatchBatchInit(&batchUnprotect, uCount))
+	{
+		Memory_Free(pEntries);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
 
-	PROCESS const hProcess = Target_HandleAcquire(pCtx->pidTarget);
+	PROCESS const hProcess = pCtx->hProcess;
 	if (NULL == hProcess)
 	{
+		Target_PatchBatchFree(&batchUnprotect);
+		Memory_Free(pEntries);
 		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
 	}
-	VECTOR const * const pvecTrackers = &(pCtx->vecTrackers);
-	for (U32 i = 0; i < pvecTrackers->uElemCount; i++)
+	for (U32 i = 0; i < uCount; i++)
 	{
-		TRACKER* const pTracker = (TRACKER*)Vector_AddressOf(pvecTrackers, i);
+		BATCH_ENTRY* const pEntry = &(pEntries[i]);
+		U32 const uFuncLen = (NULL == puFuncLens) ? 0 : puFuncLens[pEntry->uIndex];
+		pEntry->status = TrackerAddHook(pCtx, pEntry->aAddress, uFuncLen, hProcess, &batchUnprotect, i);
+	}
 
-		/* While breakpoints are aware of the Step status when triggered, hooks are not. */
-		if (NULL == pTracker || TRACKER_TYPE_HOOK_INLINE != pTracker->eType || !pTracker->bEnabled)
+	/* Hooks whose pages could not be made writable would crash the target once hit. */
+	Target_PatchBatchUnprotect(hProcess, &batchUnprotect);
+	for (U32 i = 0; i < batchUnprotect.uCount; i++)
+	{
+		PATCH const * const pPatch = &(batchUnprotect.pPatches[i]);
+		if (!pPatch->bApplied)
 		{
-			continue;
+			FLOC_TrackerRemove(pCtx, FLOC_TrackerFind(pCtx, pPatch->aAddress), hProcess);
+			pEntries[pPatch->uTag].status = FLOC_STATUS_HOOK_CREATE_FAIL;
 		}
-		pTracker->bHit = Hook_IsHit(pTracker, hProcess);
 	}
-	Target_HandleRelease(hProcess);
+	Target_PatchBatchFree(&batchUnprotect);
+	FLOC_TrackerCompact(pCtx);
 
-	return FLOC_STATUS_SUCCESS;
+	return BatchFinish(pEntries, uCount, pStatuses);
 }
 
-FLOC_STATUS FLOCDLL_StepFilterOutExecuted(FLOC_HANDLE const hHandle)
+FLOC_STATUS FLOCDLL_TrackerAddModule(FLOC_HANDLE const hHandle, ADDRESS const aModuleBase, BOOL const bHooks, U32* const puAdded)
 {
 	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
 	if (NULL == pCtx)
 	{
 		return FLOC_STATUS_INVALID_HANDLE;
 	}
-	if (pCtx->bIsStepActive)
+	*puAdded = 0;
+	if (0 == pCtx->pidTarget)
 	{
-		return FLOC_STATUS_STEP_ACTIVE;
+		return FLOC_STATUS_TARGET_NOT_SET;
 	}
-	FLOC_StepFilterOut(pCtx, TRUE);
-	return FLOC_STATUS_SUCCESS;
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+
+	MODULE_FUNCTIONS functions;
+	if (!Module_FunctionsCollect(hProcess, aModuleBase, &functions))
+	{
+		return FLOC_STATUS_MODULE_INVALID;
+	}
+	U32 const uCount = functions.uCount;
+	if (0 == uCount)
+	{
+		Module_FunctionsFree(&functions);
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	/* One block for the batch inputs and outputs, the batch functions reserve the tracker storage for all of them. */
+	BYTE* const pBlock = Memory_Alloc((U64)uCount * (sizeof(ADDRESS) + sizeof(U32) + sizeof(FLOC_STATUS)));
+	if (NULL == pBlock)
+	{
+		Module_FunctionsFree(&functions);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	ADDRESS* const pAddresses = (ADDRESS*)pBlock;
+	U32* const puFuncLens = (U32*)(pBlock + (U64)uCount * sizeof(ADDRESS));
+	FLOC_STATUS* const pStatuses = (FLOC_STATUS*)(pBlock + (U64)uCount * (sizeof(ADDRESS) + sizeof(U32)));
+	for (U32 i = 0; i < uCount; i++)
+	{
+		pAddresses[i] = functions.pFunctions[i].aStart;
+		puFuncLens[i] = functions.pFunctions[i].uLen;
+	}
+	Module_FunctionsFree(&functions);
+
+	FLOC_STATUS const status = bHooks ?
+		FLOCDLL_TrackerAddHookMany(hHandle, pAddresses, puFuncLens, uCount, pStatuses) :
+		FLOCDLL_TrackerAddBreakpointMany(hHandle, pAddresses, uCount, pStatuses);
+	for (U32 i = 0; i < uCount; i++)
+	{
+		if (FLOC_STATUS_SUCCESS == pStatuses[i])
+		{
+			(*puAdded)++;
+		}
+	}
+
+	Memory_Free(pBlock);
+	return status;
 }
 
-FLOC_STATUS FLOCDLL_StepFilterOutNotExecuted(FLOC_HANDLE const hHandle)
+FLOC_STATUS FLOCDLL_TrackerAddCounter(FLOC_HANDLE const hHandle, ADDRESS const aAddress, U32 const uPrologueLen)
 {
 	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
 	if (NULL == pCtx)
 	{
 		return FLOC_STATUS_INVALID_HANDLE;
 	}
-	if (pCtx->bIsStepActive)
+	if (0 == pCtx->pidTarget)
 	{
-		return FLOC_STATUS_STEP_ACTIVE;
+		return FLOC_STATUS_TARGET_NOT_SET;
 	}
-	FLOC_StepFilterOut(pCtx, FALSE);
-	return FLOC_STATUS_SUCCESS;
+
+	if (NULL != FLOC_TrackerFind(pCtx, aAddress))
+	{
+		return FLOC_STATUS_TRACKER_ALREADY_EXISTS;
+	}
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	FLOC_STATUS const status = TrackerAddCounter(pCtx, aAddress, uPrologueLen, hProcess);
+	return status;
+}
+
+FLOC_STATUS FLOCDLL_TrackerRemove(FLOC_HANDLE const hHandle, ADDRESS const aAddress)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	FLOC_STATUS const status = TrackerRemove(pCtx, aAddress, hProcess);
+	return status;
+}
+
+FLOC_STATUS FLOCDLL_TrackerRemoveMany(FLOC_HANDLE const hHandle, ADDRESS const * const pAddresses, U32 const uCount, FLOC_STATUS* const pStatuses)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	BATCH_ENTRY* const pEntries = BatchEntriesCreate(pAddresses, uCount);
+	TRACKER** const ppTrackers = Memory_Alloc((U64)uCount * sizeof(TRACKER*));
+	if (NULL == pEntries || NULL == ppTrackers)
+	{
+		Memory_Free(pEntries);
+		Memory_Free(ppTrackers);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		Memory_Free(pEntries);
+		Memory_Free(ppTrackers);
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+
+	U32 const uCollected = BatchTrackersCollect(pCtx, pEntries, uCount, ppTrackers);
+	FLOC_TrackerRemoveMany(pCtx, ppTrackers, uCollected, hProcess);
+	FLOC_TrackerCompact(pCtx);
+
+	Memory_Free(ppTrackers);
+	return BatchFinish(pEntries, uCount, pStatuses);
+}
+
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerEnable(FLOC_HANDLE const hHandle, ADDRESS const aAddress)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	FLOC_STATUS const status = TrackerEnable(pCtx, aAddress, hProcess);
+	return status;
+}
+
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerEnableMany(FLOC_HANDLE const hHandle, ADDRESS const * const pAddresses, U32 const uCount, FLOC_STATUS* const pStatuses)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	BATCH_ENTRY* const pEntries = BatchEntriesCreate(pAddresses, uCount);
+	TRACKER** const ppTrackers = Memory_Alloc((U64)uCount * sizeof(TRACKER*));
+	if (NULL == pEntries || NULL == ppTrackers)
+	{
+		Memory_Free(pEntries);
+		Memory_Free(ppTrackers);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		Memory_Free(pEntries);
+		Memory_Free(ppTrackers);
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+
+	/* Same checks as TrackerEnable, trackers that pass all of them are enabled with one patch batch. */
+	U32 uCollected = 0;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		BATCH_ENTRY* const pEntry = &(pEntries[i]);
+		TRACKER* const pTracker = FLOC_TrackerFind(pCtx, pEntry->aAddress);
+		pEntry->status = FLOC_STATUS_SUCCESS;
+		if (NULL == pTracker)
+		{
+			pEntry->status = FLOC_STATUS_TRACKER_NOT_FOUND;
+		}
+		else if (!pTracker->bEnabled && TrackerLacksDebugLoop(pCtx, pTracker))
+		{
+			pEntry->status = FLOC_STATUS_ENABLING_BREAKPOINT_WITHOUT_DEBUGGING;
+		}
+		else if (!pTracker->bEnabled && (0 == uCollected || pTracker != ppTrackers[uCollected - 1]))
+		{
+			ppTrackers[uCollected++] = pTracker;
+		}
+	}
+	FLOC_TrackerEnableMany(pCtx, ppTrackers, uCollected, hProcess);
+	for (U32 i = 0; i < uCount; i++)
+	{
+		TRACKER const * const pTracker = FLOC_TrackerFind(pCtx, pEntries[i].aAddress);
+		if (FLOC_STATUS_SUCCESS == pEntries[i].status && !pTracker->bEnabled)
+		{
+			pEntries[i].status = FLOC_STATUS_TRACKER_ENABLE_FAIL;
+		}
+	}
+
+	Memory_Free(ppTrackers);
+	return BatchFinish(pEntries, uCount, pStatuses);
+}
+
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerDisable(FLOC_HANDLE const hHandle, ADDRESS const aAddress)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	FLOC_STATUS const status = TrackerDisable(pCtx, aAddress, hProcess);
+	return status;
+}
+
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerDisableMany(FLOC_HANDLE const hHandle, ADDRESS const * const pAddresses, U32 const uCount, FLOC_STATUS* const pStatuses)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	BATCH_ENTRY* const pEntries = BatchEntriesCreate(pAddresses, uCount);
+	TRACKER** const ppTrackers = Memory_Alloc((U64)uCount * sizeof(TRACKER*));
+	if (NULL == pEntries || NULL == ppTrackers)
+	{
+		Memory_Free(pEntries);
+		Memory_Free(ppTrackers);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		Memory_Free(pEntries);
+		Memory_Free(ppTrackers);
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+
+	/* Disabled trackers need no write, like in TrackerDisable. */
+	U32 const uFound = BatchTrackersCollect(pCtx, pEntries, uCount, ppTrackers);
+	U32 uCollected = 0;
+	for (U32 i = 0; i < uFound; i++)
+	{
+		if (ppTrackers[i]->bEnabled)
+		{
+			ppTrackers[uCollected++] = ppTrackers[i];
+		}
+	}
+	FLOC_TrackerDisableMany(pCtx, ppTrackers, uCollected, hProcess);
+
+	Memory_Free(ppTrackers);
+	return BatchFinish(pEntries, uCount, pStatuses);
+}
+
+FLOC_STATUS FLOCDLL_TrackerAllGet(FLOC_HANDLE const hHandle, VECTOR const ** const ppVec)
+{
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	*ppVec = &(pCtx->vecTrackers);
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_TrackerSnapshotGet(FLOC_HANDLE const hHandle, U32 const uKnownGeneration, ADDRESS* const pAddresses, U64* const puHitBits, U64* const puEnabledBits, U64* const puAliveBits, U32 const uCapacity, U32* const puCount, U32* const puGeneration)
+{
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	/*
+	 * The generation is read before the walk. A hit the debug loop records meanwhile may or may not be
+	 * in this copy, but it has bumped the generation, so the next call takes a fresh one.
+	 */
+	U32 const uGeneration = pCtx->uGeneration;
+	*puGeneration = uGeneration;
+	if (0 != uKnownGeneration && uKnownGeneration == uGeneration)
+	{
+		return FLOC_STATUS_SNAPSHOT_UNCHANGED;
+	}
+
+	*puCount = 0;
+	U32 uCount = 0;
+	if (!FLOC_TrackerSnapshotCollect(pCtx, pAddresses, puHitBits, puEnabledBits, puAliveBits, uCapacity, &uCount))
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	*puCount = uCount;
+	return (uCount > uCapacity) ? FLOC_STATUS_BUFFER_TOO_SMALL : FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_TrackerRangeGet(FLOC_HANDLE const hHandle, ADDRESS const aStart, U64 const uSize, ADDRESS* const pAddresses, U32 const uCapacity, U32* const puCount)
+{
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	*puCount = 0;
+	if (0 == uSize)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	/* Reports every tracker in [aStart, aStart + uSize) but only copies up to uCapacity addresses, in ascending order. */
+	ADDRESS const aEnd = (aStart + uSize - 1 < aStart) ? (ADDRESS)-1 : (aStart + uSize - 1);
+	U32 const uCount = FLOC_TrackerRangeCollect(pCtx, aStart, aEnd, pAddresses, uCapacity);
+	*puCount = uCount;
+	return (uCount > uCapacity) ? FLOC_STATUS_BUFFER_TOO_SMALL : FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_ModuleFunctionsGet(FLOC_HANDLE const hHandle, ADDRESS const aModuleBase, ADDRESS* const pAddresses, U32* const puFuncLens, U32 const uCapacity, U32* const puCount)
+{
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	*puCount = 0;
+	if (0 == pCtx->pidTarget)
+	{
+		return FLOC_STATUS_TARGET_NOT_SET;
+	}
+	if (NULL == pCtx->hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+
+	MODULE_FUNCTIONS functions;
+	if (!Module_FunctionsCollect(pCtx->hProcess, aModuleBase, &functions))
+	{
+		return FLOC_STATUS_MODULE_INVALID;
+	}
+	for (U32 i = 0; i < functions.uCount && i < uCapacity; i++)
+	{
+		pAddresses[i] = functions.pFunctions[i].aStart;
+		if (NULL != puFuncLens)
+		{
+			puFuncLens[i] = functions.pFunctions[i].uLen;
+		}
+	}
+	U32 const uCount = functions.uCount;
+	Module_FunctionsFree(&functions);
+
+	*puCount = uCount;
+	return (uCount > uCapacity) ? FLOC_STATUS_BUFFER_TOO_SMALL : FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_TrackerPagesGet(FLOC_HANDLE const hHandle, ADDRESS const aStart, U64 const uSize, BOOL const bHitOnly, ADDRESS* const pPages, U32 const uCapacity, U32* const puCount)
+{
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	*puCount = 0;
+	if (0 == uSize)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	ADDRESS const aEnd = (aStart + uSize - 1 < aStart) ? (ADDRESS)-1 : (aStart + uSize - 1);
+	U32 const uCount = FLOC_PageRangeCollect(pCtx, aStart & ~(ADDRESS)(TRACKER_PAGE_SIZE - 1), aEnd, bHitOnly, pPages, NULL, uCapacity);
+	*puCount = uCount;
+	return (uCount > uCapacity) ? FLOC_STATUS_BUFFER_TOO_SMALL : FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_TrackerRemovePages(FLOC_HANDLE const hHandle, ADDRESS const aStart, U64 const uSize)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	if (0 == uSize)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	ADDRESS const aLow = aStart & ~(ADDRESS)(TRACKER_PAGE_SIZE - 1);
+	ADDRESS const aEnd = (aStart + uSize - 1 < aStart) ? (ADDRESS)-1 : (aStart + uSize - 1);
+	U32 const uCount = FLOC_PageRangeCollect(pCtx, aLow, aEnd, FALSE, NULL, NULL, 0);
+	TRACKER** const ppTrackers = Memory_Alloc((U64)uCount * sizeof(TRACKER*) + 1);
+	if (NULL == ppTrackers)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	FLOC_PageRangeCollect(pCtx, aLow, aEnd, FALSE, NULL, ppTrackers, uCount);
+	FLOC_TrackerRemoveMany(pCtx, ppTrackers, uCount, hProcess);
+	FLOC_TrackerCompact(pCtx);
+
+	Memory_Free(ppTrackers);
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_TrackerCountersGet(FLOC_HANDLE const hHandle, ADDRESS* const pAddresses, U64* const puCounts, U32 const uCapacity, U32* const puCount)
+{
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	*puCount = 0;
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	HIT_SNAPSHOT snapshot;
+	BOOL const bRet = Hook_SnapshotTake(&snapshot, &(pCtx->vecPools), hProcess);
+	if (!bRet)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	/* Reports every counter hook but only copies up to uCapacity entries, in ascending address order. */
+	U32 const uCount = FLOC_TrackerCountersCollect(pCtx, &snapshot, pAddresses, puCounts, uCapacity);
+	Hook_SnapshotFree(&snapshot);
+	*puCount = uCount;
+	return (uCount > uCapacity) ? FLOC_STATUS_BUFFER_TOO_SMALL : FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_PoolStatsGet(FLOC_HANDLE const hHandle, POOL_STATS* const pStats)
+{
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	*pStats = pCtx->poolStats;
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_TrackerAllReset(FLOC_HANDLE const hHandle)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	if (pCtx->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ACTIVE;
+	}
+
+	U32 uLiveCount = 0;
+	TRACKER** const ppLive = FLOC_TrackerLiveCollect(pCtx, TRUE, &uLiveCount);
+	if (NULL == ppLive)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	for (U32 i = 0; i < uLiveCount; i++)
+	{
+		ppLive[i]->bHit = FALSE;
+	}
+	Memory_Free(ppLive);
+
+	pCtx->bIsPendingReset = FALSE;
+	Atomic_Increment(&(pCtx->uGeneration));
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_TrackerAllEnable(FLOC_HANDLE const hHandle)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+
+	FLOC_STATUS status = FLOC_STATUS_SUCCESS;
+
+	/* The trackers to enable are kept at the front of the live list. */
+	U32 uLiveCount = 0;
+	TRACKER** const ppTrackers = FLOC_TrackerLiveCollect(pCtx, TRUE, &uLiveCount);
+	if (NULL == ppTrackers)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	U32 uCollected = 0;
+	for (U32 i = 0; i < uLiveCount; i++)
+	{
+		TRACKER* const pTracker = ppTrackers[i];
+		if (pTracker->bEnabled)
+		{
+			continue;
+		}
+		if (TrackerLacksDebugLoop(pCtx, pTracker))
+		{
+			status = FLOC_STATUS_ENABLING_BREAKPOINT_WITHOUT_DEBUGGING;
+			continue;
+		}
+		ppTrackers[uCollected++] = pTracker;
+	}
+	FLOC_TrackerEnableMany(pCtx, ppTrackers, uCollected, hProcess);
+	
+	Memory_Free(ppTrackers);
+	return status;
+}
+
+FLOC_STATUS FLOCDLL_TrackerAllDisable(FLOC_HANDLE const hHandle)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	if (pCtx->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ACTIVE;
+	}
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+
+	U32 uLiveCount = 0;
+	TRACKER** const ppTrackers = FLOC_TrackerLiveCollect(pCtx, TRUE, &uLiveCount);
+	if (NULL == ppTrackers)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	U32 uCollected = 0;
+	for (U32 i = 0; i < uLiveCount; i++)
+	{
+		if (ppTrackers[i]->bEnabled)
+		{
+			ppTrackers[uCollected++] = ppTrackers[i];
+		}
+	}
+	FLOC_TrackerDisableMany(pCtx, ppTrackers, uCollected, hProcess);
+
+	Memory_Free(ppTrackers);
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_StepBegin(FLOC_HANDLE const hHandle)
+{
+	FLOC_CTX * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	if (pCtx->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ALREADY_ACTIVE;
+	}
+	if (FLOC_IsTargetDead(pCtx))
+	{
+		return FLOC_STATUS_TARGET_DIED;
+	}
+	if (pCtx->bIsPendingReset && FLOC_STATUS_SUCCESS != FLOCDLL_TrackerAllReset(hHandle))
+	{
+		return FLOC_STATUS_TRACKER_RESET_FAIL;
+	}
+	
+	/* Counter and relocated hooks never leave the target, remember where their counts stand and drop older hits. */
+	if (0 != pCtx->vecPools.uElemCount)
+	{
+		PROCESS const hProcess = pCtx->hProcess;
+		if (NULL == hProcess)
+		{
+			return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+		}
+		U32 uLiveCount = 0;
+		TRACKER** const ppLive = FLOC_TrackerLiveCollect(pCtx, FALSE, &uLiveCount);
+		if (NULL == ppLive)
+		{
+			return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+		}
+		Hook_StepBegin(&(pCtx->vecPools), ppLive, uLiveCount, hProcess);
+		Memory_Free(ppLive);
+	}
+	FLOC_HwBreakpointsRotate(pCtx);
+
+	pCtx->bIsPendingReset = FALSE;
+	pCtx->bIsStepActive = TRUE;
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_StepEnd(FLOC_HANDLE const hHandle)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	if (FLOC_IsTargetDead(pCtx))
+	{
+		return FLOC_STATUS_TARGET_DIED;
+	}
+	if (!pCtx->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ALREADY_STOPPED;
+	}
+
+	pCtx->bIsStepActive = FALSE;
+	pCtx->bIsPendingReset = TRUE;
+
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	/* Page trackers are never hooks, the walk only needs the others. */
+	if (0 != pCtx->vecPools.uElemCount)
+	{
+		U32 uLiveCount = 0;
+		TRACKER** const ppLive = FLOC_TrackerLiveCollect(pCtx, FALSE, &uLiveCount);
+		if (NULL == ppLive)
+		{
+			return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+		}
+		Hook_CollectHits(&(pCtx->vecPools), ppLive, uLiveCount, hProcess);
+		Memory_Free(ppLive);
+	}
+	Atomic_Increment(&(pCtx->uGeneration));
+
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_StepFilterOutExecuted(FLOC_HANDLE const hHandle)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (pCtx->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ACTIVE;
+	}
+	if (!FLOC_StepFilterOut(pCtx, TRUE))
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_StepFilterOutNotExecuted(FLOC_HANDLE const hHandle)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (pCtx->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ACTIVE;
+	}
+	if (!FLOC_StepFilterOut(pCtx, FALSE))
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_StepHistoryGet(FLOC_HANDLE const hHandle, STEP_RECORD* const pRecords, U32 const uCapacity, U32* const puCount)
+{
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	U32 const uCount = pCtx->vecSteps.uElemCount;
+	for (U32 i = 0; i < uCount && i < uCapacity; i++)
+	{
+		pRecords[i] = *(STEP_RECORD const*)Vector_AddressOf(&(pCtx->vecSteps), i);
+	}
+	*puCount = uCount;
+	return (uCount > uCapacity) ? FLOC_STATUS_BUFFER_TOO_SMALL : FLOC_STATUS_SUCCESS;
+}
+
+static int SessionModuleCompare(void const* const pLeft, void const* const pRight)
+{
+	ADDRESS const aLeft = ((TARGET_MODULE const*)pLeft)->aBase;
+	ADDRESS const aRight = ((TARGET_MODULE const*)pRight)->aBase;
+	return (aLeft < aRight) ? -1 : ((aLeft > aRight) ? 1 : 0);
+}
+
+static U32 SessionModuleOf(TARGET_MODULE const * const pModules, U32 const uCount, ADDRESS const aAddress)
+{
+	/* Last module starting at or below aAddress, pModules sorted by base. */
+	U32 uLow = 0;
+	U32 uHigh = uCount;
+	while (uLow < uHigh)
+	{
+		U32 const uMid = uLow + (uHigh - uLow) / 2;
+		if (pModules[uMid].aBase <= aAddress)
+		{
+			uLow = uMid + 1;
+		}
+		else
+		{
+			uHigh = uMid;
+		}
+	}
+	if (0 == uLow || aAddress - pModules[uLow - 1].aBase >= pModules[uLow - 1].uSize)
+	{
+		return SESSION_NO_MODULE;
+	}
+	return uLow - 1;
+}
+
+static int SessionTrackerCompare(void const* const pLeft, void const* const pRight)
+{
+	SESSION_TRACKER const * const pL = (SESSION_TRACKER const*)pLeft;
+	SESSION_TRACKER const * const pR = (SESSION_TRACKER const*)pRight;
+	if (pL->uModule != pR->uModule)
+	{
+		return (pL->uModule < pR->uModule) ? -1 : 1;
+	}
+	return (pL->uOffset < pR->uOffset) ? -1 : ((pL->uOffset > pR->uOffset) ? 1 : 0);
+}
+
+/*
+ * Whether pBytes hold the patch the tracker itself writes: an int3 for breakpoints, or the jump of the
+ * saved length for hooks. Their targets are not compared, the pool they led to may be gone.
+ */
+static BOOL SessionPatchIsOwn(SESSION_TRACKER const * const pTracker, BYTE const * const pBytes)
+{
+	static BYTE const uAbs64Prefix[6] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 };
+	switch (pTracker->uType)
+	{
+	case TRACKER_TYPE_BREAKPOINT_SW:
+		return 1 == pTracker->uOriginalLen && INT3_BYTE == pBytes[0];
+	case TRACKER_TYPE_HOOK_INLINE:
+	case TRACKER_TYPE_HOOK_COUNTER:
+		if (JUMP_REL32_LEN == pTracker->uOriginalLen)
+		{
+			return 0xE9 == pBytes[0];
+		}
+		return JUMP_ABS64_LEN == pTracker->uOriginalLen && 0 == Memory_Compare(pBytes, uAbs64Prefix, sizeof(uAbs64Prefix));
+	default:
+		return FALSE;
+	}
+}
+
+/*
+ * Trackers whose code no longer holds the saved original bytes get a zero address. Code that still
+ * holds the tracker's own patch, left armed by a context that was not uninitialized, counts as
+ * unchanged and the original bytes are queued in pRestore to be written back before re-adding.
+ */
+static void SessionOriginalsVerify(PROCESS const hProcess, SESSION_TRACKER const * const pTrackers, ADDRESS* const pAddresses, U32 const uCount, PATCH_BATCH* const pRestore)
+{
+	BYTE bufSpan[BATCH_READ_SPAN];
+	BYTE bufOne[SESSION_ORIGINAL_MAX];
+
+	U32 uFirst = 0;
+	while (uFirst < uCount)
+	{
+		if (0 == pAddresses[uFirst] || 0 == pTrackers[uFirst].uOriginalLen)
+		{
+			uFirst++;
+			continue;
+		}
+
+		/* Trackers are sorted by module and offset, so those of one module come in ascending order and share span reads. */
+		ADDRESS const aBase = pAddresses[uFirst];
+		U64 uSpanLen = pTrackers[uFirst].uOriginalLen;
+		U32 uLast = uFirst;
+		while (uLast + 1 < uCount)
+		{
+			ADDRESS const aNext = pAddresses[uLast + 1];
+			U64 const uNextLen = pTrackers[uLast + 1].uOriginalLen;
+			if (0 != aNext && 0 != uNextLen && (aNext < aBase || aNext - aBase + uNextLen > BATCH_READ_SPAN))
+			{
+				break;
+			}
+			if (0 != aNext && 0 != uNextLen && aNext - aBase + uNextLen > uSpanLen)
+			{
+				uSpanLen = aNext - aBase + uNextLen;
+			}
+			uLast++;
+		}
+
+		BOOL const bSpanRead = Target_MemoryRead(hProcess, aBase, bufSpan, uSpanLen);
+		for (U32 i = uFirst; i <= uLast; i++)
+		{
+			ADDRESS const aAddress = pAddresses[i];
+			U32 const uLen = pTrackers[i].uOriginalLen;
+			if (0 == aAddress || 0 == uLen)
+			{
+				continue;
+			}
+			BYTE const* pBytes = &(bufSpan[aAddress - aBase]);
+			if (!bSpanRead)
+			{
+				/* Span crossed unreadable memory, fall back to individual reads. */
+				pBytes = Target_MemoryRead(hProcess, aAddress, bufOne, uLen) ? bufOne : NULL;
+			}
+			if (NULL == pBytes || 0 != Memory_Compare(pBytes, pTrackers[i].uOriginal, uLen))
+			{
+				if (NULL == pBytes || !SessionPatchIsOwn(&(pTrackers[i]), pBytes)
+					|| !Target_PatchBatchAdd(pRestore, aAddress, pTrackers[i].uOriginal, uLen, i))
+				{
+					pAddresses[i] = 0;
+				}
+			}
+		}
+
+		uFirst = uLast + 1;
+	}
+}
+
+FLOC_STATUS FLOCDLL_SessionSave(FLOC_HANDLE const hHandle, char const * const szPath)
+{
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (0 == pCtx->pidTarget)
+	{
+		return FLOC_STATUS_TARGET_NOT_SET;
+	}
+	if (pCtx->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ACTIVE;
+	}
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+
+	TARGET_MODULE* pModules = NULL;
+	U32 uModuleCount = 0;
+	if (!Target_ModulesCollect(hProcess, &pModules, &uModuleCount))
+	{
+		return FLOC_STATUS_MEMORY_READ_FAIL;
+	}
+	Sort_Heap(pModules, uModuleCount, sizeof(TARGET_MODULE), SessionModuleCompare);
+
+	/* Only the modules that hold a tracker go into the file, puSlots maps them to their record. */
+	U32* const puSlots = Memory_Alloc((U64)uModuleCount * sizeof(U32) + 1);
+	if (NULL == puSlots)
+	{
+		Memory_Free(pModules);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	Memory_Set(puSlots, 0xFF, (U64)uModuleCount * sizeof(U32));
+
+	VECTOR const * const pvecTrackers = &(pCtx->vecTrackers);
+	U32 const uElemCount = pvecTrackers->uElemCount;
+	U32 uTrackerCount = 0;
+	U32 uUsedCount = 0;
+	for (U32 i = 0; i < uElemCount; i++)
+	{
+		TRACKER const * const pTracker = (TRACKER const*)Vector_AddressOf(pvecTrackers, i);
+		if (NULL == pTracker || TRACKER_TYPE_DELETED == pTracker->eType)
+		{
+			continue;
+		}
+		uTrackerCount++;
+		U32 const uModule = SessionModuleOf(pModules, uModuleCount, pTracker->aAddress);
+		if (SESSION_NO_MODULE != uModule && SESSION_NO_MODULE == puSlots[uModule])
+		{
+			puSlots[uModule] = uUsedCount++;
+		}
+	}
+
+	SESSION_HEADER header;
+	U32 const uStepCount = pCtx->vecSteps.uElemCount;
+	Session_HeaderInit(&header, uUsedCount, uTrackerCount, uStepCount, (U32)pCtx->pidTarget);
+	FILE_VIEW view;
+	if (!File_MapCreate(szPath, header.uFileSize, &view))
+	{
+		Memory_Free(puSlots);
+		Memory_Free(pModules);
+		return FLOC_STATUS_SESSION_FILE_FAIL;
+	}
+
+	/* The records are written in place, the new file reads as zeros. */
+	BYTE* const pFile = (BYTE*)view.pData;
+	SESSION_MODULE* const pFileModules = (SESSION_MODULE*)(pFile + header.uModulesOffset);
+	for (U32 i = 0; i < uModuleCount; i++)
+	{
+		if (SESSION_NO_MODULE != puSlots[i])
+		{
+			SESSION_MODULE* const pRecord = &(pFileModules[puSlots[i]]);
+			pRecord->uSize = pModules[i].uSize;
+			for (U32 c = 0; c < SESSION_MODULE_NAME_MAX - 1 && '\0' != pModules[i].szName[c]; c++)
+			{
+				pRecord->szName[c] = pModules[i].szName[c];
+			}
+		}
+	}
+
+	SESSION_TRACKER* const pFileTrackers = (SESSION_TRACKER*)(pFile + header.uTrackersOffset);
+	U32 uWritten = 0;
+	for (U32 i = 0; i < uElemCount && uWritten < uTrackerCount; i++)
+	{
+		TRACKER const * const pTracker = (TRACKER const*)Vector_AddressOf(pvecTrackers, i);
+		if (NULL == pTracker || TRACKER_TYPE_DELETED == pTracker->eType)
+		{
+			continue;
+		}
+		SESSION_TRACKER* const pRecord = &(pFileTrackers[uWritten++]);
+		U32 const uModule = SessionModuleOf(pModules, uModuleCount, pTracker->aAddress);
+		pRecord->uModule = (SESSION_NO_MODULE == uModule) ? SESSION_NO_MODULE : puSlots[uModule];
+		pRecord->uOffset = (SESSION_NO_MODULE == uModule) ? pTracker->aAddress : pTracker->aAddress - pModules[uModule].aBase;
+		pRecord->uType = (BYTE)pTracker->eType;
+		pRecord->bEnabled = pTracker->bEnabled ? 1 : 0;
+		pRecord->bHit = pTracker->bHit ? 1 : 0;
+
+		/* Hardware breakpoints and pages leave the code as it is, there is nothing to compare on load. */
+		if (TRACKER_TYPE_BREAKPOINT_SW == pTracker->eType)
+		{
+			pRecord->uOriginal[0] = pTracker->u.bp.uOriginalByte;
+			pRecord->uOriginalLen = 1;
+		}
+		else if (TRACKER_TYPE_HOOK_INLINE == pTracker->eType || TRACKER_TYPE_HOOK_COUNTER == pTracker->eType)
+		{
+			BOOL const bRead = Hook_OriginalBytesRead(pTracker, hProcess, pRecord->uOriginal);
+			pRecord->uOriginalLen = bRead ? pTracker->u.hook.uJumpBytesLen : 0;
+			/* Not the jump length, the next run may have no pool in rel32 reach and need the longer jump. */
+			pRecord->uParam = pTracker->uParam;
+		}
+		else if (TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType)
+		{
+			pRecord->uParam = pTracker->u.hwbp.uHitCount;
+		}
+	}
+	Sort_Heap(pFileTrackers, uTrackerCount, sizeof(SESSION_TRACKER), SessionTrackerCompare);
+
+	STEP_RECORD* const pFileSteps = (STEP_RECORD*)(pFile + header.uStepsOffset);
+	for (U32 i = 0; i < uStepCount; i++)
+	{
+		pFileSteps[i] = *(STEP_RECORD const*)Vector_AddressOf(&(pCtx->vecSteps), i);
+	}
+
+	/* Last, so a file that was cut short has no magic. */
+	Memory_Copy(pFile, &header, sizeof(SESSION_HEADER));
+	BOOL const bFlushed = File_MapFlush(&view);
+	File_Unmap(&view);
+	Memory_Free(puSlots);
+	Memory_Free(pModules);
+	return bFlushed ? FLOC_STATUS_SUCCESS : FLOC_STATUS_SESSION_FILE_FAIL;
+}
+
+FLOC_STATUS FLOCDLL_SessionLoad(FLOC_HANDLE const hHandle, char const * const szPath, U32* const puLoaded)
+{
+	FLOC_CTX* const pCtx = FLOC_ContextGet(hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	*puLoaded = 0;
+	if (0 == pCtx->pidTarget)
+	{
+		return FLOC_STATUS_TARGET_NOT_SET;
+	}
+	if (pCtx->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ACTIVE;
+	}
+	PROCESS const hProcess = pCtx->hProcess;
+	if (NULL == hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+
+	FILE_VIEW view;
+	if (!File_MapRead(szPath, &view))
+	{
+		return FLOC_STATUS_SESSION_FILE_FAIL;
+	}
+	SESSION_VIEW session;
+	if (!Session_Open(view.pData, view.uSize, &session))
+	{
+		File_Unmap(&view);
+		return FLOC_STATUS_SESSION_INVALID;
+	}
+	U32 const uModuleCount = session.pHeader->uModuleCount;
+	U32 const uCount = session.pHeader->uTrackerCount;
+	SESSION_TRACKER const * const pRecords = session.pTrackers;
+
+	/* One block for the module bases, the rebased addresses and the inputs of the batches, which take each type in turn. */
+	BYTE* const pBlock = Memory_Alloc((U64)uModuleCount * sizeof(ADDRESS) + (U64)uCount * (2 * sizeof(ADDRESS) + sizeof(U32)) + 1);
+	if (NULL == pBlock)
+	{
+		File_Unmap(&view);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	ADDRESS* const paBases = (ADDRESS*)pBlock;
+	ADDRESS* const pAddresses = (ADDRESS*)(pBlock + (U64)uModuleCount * sizeof(ADDRESS));
+	ADDRESS* const pBatch = pAddresses + uCount;
+	U32* const puFuncLens = (U32*)(pBatch + uCount);
+
+	/*
+	 * Trackers of modules the target did not load stay out, as do those whose code changed since the save.
+	 * Absolute addresses outside any module are only taken back into the process they were saved from.
+	 */
+	BOOL const bSameProcess = (session.pHeader->uPid == (U32)pCtx->pidTarget);
+	for (U32 i = 0; i < uModuleCount; i++)
+	{
+		if (!Target_ModuleFind(hProcess, session.pModules[i].szName, &(paBases[i])))
+		{
+			paBases[i] = 0;
+		}
+	}
+	for (U32 i = 0; i < uCount; i++)
+	{
+		SESSION_TRACKER const * const pRecord = &(pRecords[i]);
+		BOOL const bOriginalFits = (TRACKER_TYPE_BREAKPOINT_SW != pRecord->uType) || (1 == pRecord->uOriginalLen);
+		if (SESSION_NO_MODULE == pRecord->uModule)
+		{
+			pAddresses[i] = (bOriginalFits && bSameProcess) ? pRecord->uOffset : 0;
+		}
+		else
+		{
+			pAddresses[i] = (bOriginalFits && 0 != paBases[pRecord->uModule]) ? paBases[pRecord->uModule] + pRecord->uOffset : 0;
+		}
+	}
+	PATCH_BATCH batchRestore;
+	if (!Target_PatchBatchInit(&batchRestore, uCount))
+	{
+		Memory_Free(pBlock);
+		File_Unmap(&view);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	SessionOriginalsVerify(hProcess, pRecords, pAddresses, uCount, &batchRestore);
+	/* Hooks are built from the bytes in the target and disabled breakpoints must not stay armed. */
+	Target_PatchBatchApply(hProcess, &batchRestore);
+	for (U32 i = 0; i < batchRestore.uCount; i++)
+	{
+		if (!batchRestore.pPatches[i].bApplied)
+		{
+			pAddresses[batchRestore.pPatches[i].uTag] = 0;
+		}
+	}
+	Target_PatchBatchFree(&batchRestore);
+
+	if (!Vector_Reserve(&(pCtx->vecTrackers), pCtx->vecTrackers.uElemCount + uCount)
+		|| !Index_Reserve(&(pCtx->idxTrackers), pCtx->idxTrackers.uCount + uCount)
+		|| !Lookup_Reserve(&(pCtx->lkpTrackers), pCtx->idxTrackers.uCount + uCount))
+	{
+		Memory_Free(pBlock);
+		File_Unmap(&view);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	/*
+	 * Breakpoints take the original byte that was just compared, inline hooks go through one batch for
+	 * their unprotects and neighbouring pages are added as one range.
+	 */
+	U32 uHooks = 0;
+	U32 uAdded = 0;
+	ADDRESS aPagesStart = 0;
+	ADDRESS aPagesEnd = 0;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		ADDRESS const aAddress = pAddresses[i];
+		SESSION_TRACKER const * const pRecord = &(pRecords[i]);
+		if (0 == aAddress)
+		{
+			continue;
+		}
+		switch (pRecord->uType)
+		{
+		case TRACKER_TYPE_BREAKPOINT_SW:
+			TrackerAddBreakpoint(pCtx, aAddress, pRecord->uOriginal[0]);
+			break;
+		case TRACKER_TYPE_HOOK_INLINE:
+			pBatch[uHooks] = aAddress;
+			puFuncLens[uHooks++] = pRecord->uParam;
+			break;
+		case TRACKER_TYPE_HOOK_COUNTER:
+			TrackerAddCounter(pCtx, aAddress, pRecord->uParam, hProcess);
+			break;
+		case TRACKER_TYPE_BREAKPOINT_HW:
+			TrackerAddBreakpointHw(pCtx, aAddress);
+			break;
+		case TRACKER_TYPE_PAGE_EXEC:
+			if (aPagesEnd != aAddress)
+			{
+				if (aPagesEnd != aPagesStart)
+				{
+					FLOCDLL_TrackerAddPages(hHandle, aPagesStart, aPagesEnd - aPagesStart, &uAdded);
+				}
+				aPagesStart = aAddress;
+			}
+			aPagesEnd = aAddress + TRACKER_PAGE_SIZE;
+			break;
+		default:
+			break;
+		}
+	}
+	if (aPagesEnd != aPagesStart)
+	{
+		FLOCDLL_TrackerAddPages(hHandle, aPagesStart, aPagesEnd - aPagesStart, &uAdded);
+	}
+	FLOCDLL_TrackerAddHookMany(hHandle, pBatch, puFuncLens, uHooks, NULL);
+
+	/*
+	 * A tracker counts as loaded once one of the saved type sits at its address, also if the context
+	 * had it before. The enabled ones are armed with one batch and only count if that worked.
+	 */
+	TRACKER** const ppEnable = (TRACKER**)pBatch;
+	U32 uEnable = 0;
+	U32 uLoaded = 0;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		ADDRESS const aAddress = pAddresses[i];
+		SESSION_TRACKER const * const pRecord = &(pRecords[i]);
+		if (0 == aAddress)
+		{
+			continue;
+		}
+		TRACKER* const pTracker = (TRACKER_TYPE_PAGE_EXEC == pRecord->uType) ? FLOC_PageFind(pCtx, aAddress) : FLOC_TrackerFind(pCtx, aAddress);
+		if (NULL == pTracker || pRecord->uType != (BYTE)pTracker->eType)
+		{
+			continue;
+		}
+		uLoaded++;
+		pTracker->bHit = pRecord->bHit ? TRUE : FALSE;
+		if (TRACKER_TYPE_BREAKPOINT_HW == pTracker->eType)
+		{
+			pTracker->u.hwbp.uHitCount = pRecord->uParam;
+		}
+		if (pRecord->bEnabled && !pTracker->bEnabled)
+		{
+			if (TrackerLacksDebugLoop(pCtx, pTracker))
+			{
+				uLoaded--;
+				continue;
+			}
+			ppEnable[uEnable++] = pTracker;
+		}
+	}
+	FLOC_TrackerEnableMany(pCtx, ppEnable, uEnable, hProcess);
+	for (U32 i = 0; i < uEnable; i++)
+	{
+		if (!ppEnable[i]->bEnabled)
+		{
+			uLoaded--;
+		}
+	}
+	Atomic_Increment(&(pCtx->uGeneration));
+
+	/* The saved rounds go after those of this context. A round missing for lack of memory changes nothing else. */
+	for (U32 i = 0; i < session.pHeader->uStepCount; i++)
+	{
+		Vector_PushBackCopy(&(pCtx->vecSteps), &(session.pSteps[i]));
+	}
+
+	Memory_Free(pBlock);
+	File_Unmap(&view);
+	*puLoaded = uLoaded;
+	return (uLoaded == uCount) ? FLOC_STATUS_SUCCESS : FLOC_STATUS_BATCH_INCOMPLETE;
+}
+
+static int GroupTrackerCompare(void const* const pLeft, void const* const pRight)
+{
+	U64 const uLeft = ((GROUP_TRACKER const*)pLeft)->uOffset;
+	U64 const uRight = ((GROUP_TRACKER const*)pRight)->uOffset;
+	return (uLeft < uRight) ? -1 : ((uLeft > uRight) ? 1 : 0);
+}
+
+static ADDRESS* GroupAddressesOf(GROUP_MEMBER const * const pMember, GROUP_TRACKER const * const pTrackers, U32 const uCount, U32* const puBreakpoints)
+{
+	/* Rebased onto the module of the member, breakpoints first and hooks behind them, the lengths follow the addresses. */
+	ADDRESS* const pAddresses = Memory_Alloc((U64)uCount * (sizeof(ADDRESS) + sizeof(U32)) + 1);
+	if (NULL == pAddresses)
+	{
+		return NULL;
+	}
+	U32* const puFuncLens = (U32*)(pAddresses + uCount);
+	U32 uOut = 0;
+	for (U32 uPass = 0; uPass < 2; uPass++)
+	{
+		for (U32 i = 0; i < uCount; i++)
+		{
+			if ((0 == uPass) != !pTrackers[i].bHook)
+			{
+				continue;
+			}
+			pAddresses[uOut] = pMember->aModuleBase + pTrackers[i].uOffset;
+			puFuncLens[uOut] = pTrackers[i].uFuncLen;
+			uOut++;
+		}
+		if (0 == uPass)
+		{
+			*puBreakpoints = uOut;
+		}
+	}
+	return pAddresses;
+}
+
+static FLOC_STATUS GroupJobApply(GROUP* const pGroup, GROUP_MEMBER* const pMember, void* const pParam)
+{
+	(void)pGroup;
+	GROUP_TRACKER_SPAN const * const pSpan = (GROUP_TRACKER_SPAN const*)pParam;
+	U32 const uCount = pSpan->uCount;
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+	U32 uBreakpoints = 0;
+	ADDRESS* const pAddresses = GroupAddressesOf(pMember, pSpan->pTrackers, uCount, &uBreakpoints);
+	if (NULL == pAddresses)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	U32 const * const puFuncLens = (U32 const*)(pAddresses + uCount);
+
+	FLOC_STATUS status = FLOC_STATUS_SUCCESS;
+	if (0 != uBreakpoints)
+	{
+		status = FLOCDLL_TrackerAddBreakpointMany(pMember->hHandle, pAddresses, uBreakpoints, NULL);
+	}
+	if (uBreakpoints < uCount)
+	{
+		FLOC_STATUS const hookStatus = FLOCDLL_TrackerAddHookMany(pMember->hHandle, &(pAddresses[uBreakpoints]), &(puFuncLens[uBreakpoints]), uCount - uBreakpoints, NULL);
+		if (FLOC_STATUS_SUCCESS == status)
+		{
+			status = hookStatus;
+		}
+	}
+
+	/* Trackers start disabled; those that failed to be added fail here too and are already counted. */
+	FLOC_STATUS const enableStatus = FLOCDLL_TrackerEnableMany(pMember->hHandle, pAddresses, uCount, NULL);
+	if (FLOC_STATUS_SUCCESS == status)
+	{
+		status = enableStatus;
+	}
+
+	Memory_Free(pAddresses);
+	return status;
+}
+
+static FLOC_STATUS GroupJobRemove(GROUP* const pGroup, GROUP_MEMBER* const pMember, void* const pParam)
+{
+	(void)pGroup;
+	GROUP_TRACKER_SPAN const * const pSpan = (GROUP_TRACKER_SPAN const*)pParam;
+	U32 const uCount = pSpan->uCount;
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+	U32 uBreakpoints = 0;
+	ADDRESS* const pAddresses = GroupAddressesOf(pMember, pSpan->pTrackers, uCount, &uBreakpoints);
+	FLOC_STATUS* const pStatuses = Memory_Alloc((U64)uCount * sizeof(FLOC_STATUS));
+	if (NULL == pAddresses || NULL == pStatuses)
+	{
+		Memory_Free(pAddresses);
+		Memory_Free(pStatuses);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	/* A tracker the member never got, because adding it failed there, is as good as removed. */
+	FLOC_STATUS status = FLOCDLL_TrackerRemoveMany(pMember->hHandle, pAddresses, uCount, pStatuses);
+	if (FLOC_STATUS_BATCH_INCOMPLETE == status)
+	{
+		status = FLOC_STATUS_SUCCESS;
+		for (U32 i = 0; i < uCount; i++)
+		{
+			if (FLOC_STATUS_SUCCESS != pStatuses[i] && FLOC_STATUS_TRACKER_NOT_FOUND != pStatuses[i])
+			{
+				status = FLOC_STATUS_BATCH_INCOMPLETE;
+				break;
+			}
+		}
+	}
+
+	Memory_Free(pStatuses);
+	Memory_Free(pAddresses);
+	return status;
+}
+
+static FLOC_STATUS GroupJobAttach(GROUP* const pGroup, GROUP_MEMBER* const pMember, void* const pParam)
+{
+	FLOC_HANDLE hHandle = NULL;
+	FLOC_STATUS status = FLOCDLL_Initialize(&hHandle);
+	if (FLOC_STATUS_SUCCESS != status)
+	{
+		return status;
+	}
+
+	status = FLOCDLL_TargetSet(hHandle, pMember->pidTarget);
+	if (FLOC_STATUS_SUCCESS == status && !Target_ModuleFind(FLOC_ContextGet(hHandle)->hProcess, pGroup->szModule, &(pMember->aModuleBase)))
+	{
+		status = FLOC_STATUS_MODULE_NOT_FOUND;
+	}
+	if (FLOC_STATUS_SUCCESS == status)
+	{
+		status = FLOCDLL_DebugLoopStart(hHandle);
+	}
+	if (FLOC_STATUS_SUCCESS != status)
+	{
+		FLOCDLL_Uninitialize(hHandle);
+		return status;
+	}
+
+	pMember->hHandle = hHandle;
+	return GroupJobApply(pGroup, pMember, pParam);
+}
+
+static FLOC_STATUS GroupJobDetach(GROUP* const pGroup, GROUP_MEMBER* const pMember, void* const pParam)
+{
+	(void)pGroup;
+	(void)pParam;
+	FLOC_STATUS const status = FLOCDLL_Uninitialize(pMember->hHandle);
+	if (FLOC_STATUS_SUCCESS == status)
+	{
+		pMember->hHandle = NULL;
+	}
+	return status;
+}
+
+static FLOC_STATUS GroupJobStepBegin(GROUP* const pGroup, GROUP_MEMBER* const pMember, void* const pParam)
+{
+	(void)pGroup;
+	(void)pParam;
+	/* Breakpoints hit in the last step disabled themselves, every step starts with the whole set armed. */
+	FLOC_STATUS const status = FLOCDLL_TrackerAllEnable(pMember->hHandle);
+	if (FLOC_STATUS_SUCCESS != status)
+	{
+		return status;
+	}
+	return FLOCDLL_StepBegin(pMember->hHandle);
+}
+
+static FLOC_STATUS GroupJobStepEnd(GROUP* const pGroup, GROUP_MEMBER* const pMember, void* const pParam)
+{
+	(void)pGroup;
+	(void)pParam;
+	return FLOCDLL_StepEnd(pMember->hHandle);
+}
+
+static FLOC_STATUS GroupJobHitsCollect(GROUP* const pGroup, GROUP_MEMBER* const pMember, void* const pParam)
+{
+	(void)pParam;
+	FLOC_CTX* const pCtx = FLOC_ContextGet(pMember->hHandle);
+	if (NULL == pCtx)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (FLOC_IsTargetDead(pCtx))
+	{
+		return FLOC_STATUS_TARGET_DIED;
+	}
+
+	/* Each member writes only its own words. */
+	U64* const puBits = &(pGroup->puHitBits[(U64)(pMember - pGroup->pMembers) * pGroup->uHitWords]);
+	for (U32 i = 0; i < pGroup->uTrackerCount; i++)
+	{
+		TRACKER const * const pTracker = FLOC_TrackerFind(pCtx, pMember->aModuleBase + pGroup->pTrackers[i].uOffset);
+		if (NULL != pTracker && pTracker->bHit)
+		{
+			puBits[i / 64] |= 1ULL << (i % 64);
+		}
+	}
+	return FLOC_STATUS_SUCCESS;
+}
+
+static FLOC_STATUS GroupRunAll(GROUP* const pGroup, U32 const uFirst, GROUP_JOB_FUNC const fnJob, void* const pParam)
+{
+	Group_Run(pGroup, uFirst, fnJob, pParam);
+	for (U32 i = uFirst; i < pGroup->uMemberCount; i++)
+	{
+		if (FLOC_STATUS_SUCCESS != pGroup->pMembers[i].status)
+		{
+			return FLOC_STATUS_BATCH_INCOMPLETE;
+		}
+	}
+	return FLOC_STATUS_SUCCESS;
+}
+
+static FLOC_STATUS GroupTrackersAdd(GROUP* const pGroup, GROUP_TRACKER* const pTrackers, U32 const uCount, U32* const puAdded)
+{
+	*puAdded = 0;
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	Sort_Heap(pTrackers, uCount, sizeof(GROUP_TRACKER), GroupTrackerCompare);
+	U32 uUnique = 1;
+	for (U32 i = 1; i < uCount; i++)
+	{
+		if (pTrackers[i].uOffset != pTrackers[uUnique - 1].uOffset)
+		{
+			pTrackers[uUnique++] = pTrackers[i];
+		}
+	}
+	U32 uAdded = 0;
+	if (!Group_TrackersMerge(pGroup, pTrackers, uUnique, &uAdded))
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	*puAdded = uAdded;
+
+	GROUP_TRACKER_SPAN span;
+	span.pTrackers = pTrackers;
+	span.uCount = uAdded;
+	/* Offsets repeated in the batch or already in the group are tracked as asked, only member failures count. */
+	return GroupRunAll(pGroup, 0, GroupJobApply, &span);
+}
+
+static FLOC_STATUS GroupTrackersDrop(GROUP* const pGroup, U64 const * const puRemoveBits)
+{
+	U32 uCount = 0;
+	for (U32 i = 0; i < pGroup->uTrackerCount; i++)
+	{
+		uCount += (U32)((puRemoveBits[i / 64] >> (i % 64)) & 1);
+	}
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+	GROUP_TRACKER* const pTrackers = Memory_Alloc((U64)uCount * sizeof(GROUP_TRACKER));
+	if (NULL == pTrackers)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	U32 uOut = 0;
+	for (U32 i = 0; i < pGroup->uTrackerCount; i++)
+	{
+		if (0 != (puRemoveBits[i / 64] & (1ULL << (i % 64))))
+		{
+			pTrackers[uOut++] = pGroup->pTrackers[i];
+		}
+	}
+
+	GROUP_TRACKER_SPAN span;
+	span.pTrackers = pTrackers;
+	span.uCount = uCount;
+	FLOC_STATUS const status = GroupRunAll(pGroup, 0, GroupJobRemove, &span);
+	Group_TrackersRemove(pGroup, puRemoveBits);
+	Memory_Free(pTrackers);
+	return status;
+}
+
+static FLOC_STATUS GroupHitsMerge(GROUP* const pGroup, BOOL const bIntersection, U64** const ppuMerged, U32* const puMembers)
+{
+	*ppuMerged = NULL;
+	*puMembers = 0;
+	if (!Group_HitsReserve(pGroup))
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	U64* const puMerged = Memory_Alloc((U64)pGroup->uHitWords * sizeof(U64) + 1);
+	if (NULL == puMerged)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	/* Members whose target died or that failed otherwise are left out of the union and the intersection. */
+	FLOC_STATUS const status = GroupRunAll(pGroup, 0, GroupJobHitsCollect, NULL);
+	*puMembers = Group_HitsMerge(pGroup, bIntersection, puMerged);
+	*ppuMerged = puMerged;
+	return status;
+}
+
+FLOC_STATUS FLOCDLL_GroupCreate(FLOC_GROUP_HANDLE* const phGroup, char const * const szModule, U32 const uWorkers)
+{
+	if (!Process_CheckPrivileges())
+	{
+		return FLOC_STATUS_INSUFFICIENT_PRIVILEGES;
+	}
+	U32 uNameLen = 0;
+	while (NULL != szModule && uNameLen < GROUP_MODULE_NAME_MAX && '\0' != szModule[uNameLen])
+	{
+		uNameLen++;
+	}
+	if (0 == uNameLen || GROUP_MODULE_NAME_MAX == uNameLen)
+	{
+		return FLOC_STATUS_MODULE_INVALID;
+	}
+
+	GROUP* const pGroup = Group_Create(szModule, uWorkers);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_DEBUG_THREAD_START_FAIL;
+	}
+	FLOC_GROUP_HANDLE const hGroup = FLOC_GroupInsert(pGroup);
+	if (NULL == hGroup)
+	{
+		Group_Free(pGroup);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	*phGroup = hGroup;
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_GroupDestroy(FLOC_GROUP_HANDLE const hGroup)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+
+	FLOC_GroupClear(hGroup);
+	FLOC_STATUS const status = GroupRunAll(pGroup, 0, GroupJobDetach, NULL);
+	if (!Group_Free(pGroup))
+	{
+		return FLOC_STATUS_GROUP_WORKER_STOP_FAIL;
+	}
+	return status;
+}
+
+FLOC_STATUS FLOCDLL_GroupTargetAddMany(FLOC_GROUP_HANDLE const hGroup, PID const * const pPids, U32 const uCount, FLOC_STATUS* const pStatuses)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (pGroup->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ACTIVE;
+	}
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	FLOC_STATUS* const pResults = Memory_Alloc((U64)uCount * sizeof(FLOC_STATUS));
+	if (NULL == pResults || (U64)pGroup->uMemberCount + uCount > (U32)-1 || !Group_MembersReserve(pGroup, pGroup->uMemberCount + uCount))
+	{
+		Memory_Free(pResults);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+
+	/* New members are appended in the order of pPids, so their results are matched back in the same order. */
+	U32 const uFirst = pGroup->uMemberCount;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		if (NULL != Group_MemberFind(pGroup, pPids[i]))
+		{
+			pResults[i] = FLOC_STATUS_TARGET_ALREADY_SET;
+			continue;
+		}
+		GROUP_MEMBER* const pMember = &(pGroup->pMembers[pGroup->uMemberCount++]);
+		pMember->hHandle = NULL;
+		pMember->aModuleBase = 0;
+		pMember->pidTarget = pPids[i];
+		pMember->status = FLOC_STATUS_FAILURE;
+		pResults[i] = FLOC_STATUS_SUCCESS;
+	}
+
+	GROUP_TRACKER_SPAN span;
+	span.pTrackers = pGroup->pTrackers;
+	span.uCount = pGroup->uTrackerCount;
+	Group_Run(pGroup, uFirst, GroupJobAttach, &span);
+
+	FLOC_STATUS status = FLOC_STATUS_SUCCESS;
+	U32 uMember = uFirst;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		if (FLOC_STATUS_SUCCESS == pResults[i])
+		{
+			pResults[i] = pGroup->pMembers[uMember++].status;
+		}
+		if (FLOC_STATUS_SUCCESS != pResults[i])
+		{
+			status = FLOC_STATUS_BATCH_INCOMPLETE;
+		}
+		if (NULL != pStatuses)
+		{
+			pStatuses[i] = pResults[i];
+		}
+	}
+
+	/* Members that could not be attached are dropped, those that only missed some trackers stay. */
+	Group_MembersCompact(pGroup);
+	Memory_Free(pResults);
+	return status;
+}
+
+FLOC_STATUS FLOCDLL_GroupTargetRemove(FLOC_GROUP_HANDLE const hGroup, PID const pidTarget)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	GROUP_MEMBER* const pMember = Group_MemberFind(pGroup, pidTarget);
+	if (NULL == pMember)
+	{
+		return FLOC_STATUS_INVALID_TARGET;
+	}
+
+	FLOC_STATUS const status = FLOCDLL_Uninitialize(pMember->hHandle);
+	if (FLOC_STATUS_SUCCESS != status)
+	{
+		return status;
+	}
+	pMember->hHandle = NULL;
+	Group_MembersCompact(pGroup);
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_GroupInfoGet(FLOC_GROUP_HANDLE const hGroup, U32* const puMemberCount, U32* const puTrackerCount)
+{
+	GROUP const * const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	*puMemberCount = pGroup->uMemberCount;
+	*puTrackerCount = pGroup->uTrackerCount;
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_GroupMemberGet(FLOC_GROUP_HANDLE const hGroup, U32 const uIndex, FLOC_HANDLE* const phHandle, PID* const ppidTarget, ADDRESS* const paModuleBase, FLOC_STATUS* const pLastStatus)
+{
+	GROUP const * const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (uIndex >= pGroup->uMemberCount)
+	{
+		return FLOC_STATUS_INVALID_TARGET;
+	}
+	GROUP_MEMBER const * const pMember = &(pGroup->pMembers[uIndex]);
+	*phHandle = pMember->hHandle;
+	*ppidTarget = pMember->pidTarget;
+	*paModuleBase = pMember->aModuleBase;
+	*pLastStatus = pMember->status;
+	return FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_GroupTrackerAddMany(FLOC_GROUP_HANDLE const hGroup, U64 const * const puOffsets, U32 const * const puFuncLens, U32 const uCount, BOOL const bHooks, U32* const puAdded)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	*puAdded = 0;
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	GROUP_TRACKER* const pTrackers = Memory_Alloc((U64)uCount * sizeof(GROUP_TRACKER));
+	if (NULL == pTrackers)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	for (U32 i = 0; i < uCount; i++)
+	{
+		pTrackers[i].uOffset = puOffsets[i];
+		pTrackers[i].uFuncLen = (NULL == puFuncLens) ? 0 : puFuncLens[i];
+		pTrackers[i].bHook = bHooks;
+	}
+
+	FLOC_STATUS const status = GroupTrackersAdd(pGroup, pTrackers, uCount, puAdded);
+	Memory_Free(pTrackers);
+	return status;
+}
+
+FLOC_STATUS FLOCDLL_GroupTrackerAddModule(FLOC_GROUP_HANDLE const hGroup, BOOL const bHooks, U32* const puAdded)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	*puAdded = 0;
+	if (0 == pGroup->uMemberCount)
+	{
+		return FLOC_STATUS_TARGET_NOT_SET;
+	}
+
+	/* The members run the same module, the first one stands for all of them. */
+	GROUP_MEMBER const * const pFirst = &(pGroup->pMembers[0]);
+	FLOC_CTX const * const pCtx = FLOC_ContextGet(pFirst->hHandle);
+	if (NULL == pCtx || NULL == pCtx->hProcess)
+	{
+		return FLOC_STATUS_PROCESS_HANDLE_ACQUIRE_FAIL;
+	}
+	MODULE_FUNCTIONS functions;
+	if (!Module_FunctionsCollect(pCtx->hProcess, pFirst->aModuleBase, &functions))
+	{
+		return FLOC_STATUS_MODULE_INVALID;
+	}
+	U32 const uCount = functions.uCount;
+	if (0 == uCount)
+	{
+		Module_FunctionsFree(&functions);
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	GROUP_TRACKER* const pTrackers = Memory_Alloc((U64)uCount * sizeof(GROUP_TRACKER));
+	if (NULL == pTrackers)
+	{
+		Module_FunctionsFree(&functions);
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	for (U32 i = 0; i < uCount; i++)
+	{
+		pTrackers[i].uOffset = functions.pFunctions[i].aStart - pFirst->aModuleBase;
+		pTrackers[i].uFuncLen = functions.pFunctions[i].uLen;
+		pTrackers[i].bHook = bHooks;
+	}
+	Module_FunctionsFree(&functions);
+
+	FLOC_STATUS const status = GroupTrackersAdd(pGroup, pTrackers, uCount, puAdded);
+	Memory_Free(pTrackers);
+	return status;
+}
+
+FLOC_STATUS FLOCDLL_GroupTrackerRemoveMany(FLOC_GROUP_HANDLE const hGroup, U64 const * const puOffsets, U32 const uCount)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (0 == uCount)
+	{
+		return FLOC_STATUS_SUCCESS;
+	}
+
+	U64* const puRemoveBits = Memory_Alloc((U64)((pGroup->uTrackerCount + 63) / 64) * sizeof(U64) + 1);
+	if (NULL == puRemoveBits)
+	{
+		return FLOC_STATUS_MEMORY_ALLOC_FAIL;
+	}
+	Memory_Set(puRemoveBits, 0, (U64)((pGroup->uTrackerCount + 63) / 64) * sizeof(U64));
+	BOOL bMissing = FALSE;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		U32 const uAt = Group_TrackerLowerBound(pGroup, puOffsets[i]);
+		if (uAt == pGroup->uTrackerCount || pGroup->pTrackers[uAt].uOffset != puOffsets[i])
+		{
+			bMissing = TRUE;
+			continue;
+		}
+		puRemoveBits[uAt / 64] |= 1ULL << (uAt % 64);
+	}
+
+	FLOC_STATUS const status = GroupTrackersDrop(pGroup, puRemoveBits);
+	Memory_Free(puRemoveBits);
+	return bMissing ? FLOC_STATUS_BATCH_INCOMPLETE : status;
+}
+
+FLOC_STATUS FLOCDLL_GroupTrackersGet(FLOC_GROUP_HANDLE const hGroup, U64* const puOffsets, U32 const uCapacity, U32* const puCount)
+{
+	GROUP const * const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	U32 const uCount = pGroup->uTrackerCount;
+	for (U32 i = 0; i < uCount && i < uCapacity; i++)
+	{
+		puOffsets[i] = pGroup->pTrackers[i].uOffset;
+	}
+	*puCount = uCount;
+	return (uCount > uCapacity) ? FLOC_STATUS_BUFFER_TOO_SMALL : FLOC_STATUS_SUCCESS;
+}
+
+FLOC_STATUS FLOCDLL_GroupStepBegin(FLOC_GROUP_HANDLE const hGroup)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (pGroup->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ALREADY_ACTIVE;
+	}
+	pGroup->bIsStepActive = TRUE;
+	return GroupRunAll(pGroup, 0, GroupJobStepBegin, NULL);
+}
+
+FLOC_STATUS FLOCDLL_GroupStepEnd(FLOC_GROUP_HANDLE const hGroup)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (!pGroup->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ALREADY_STOPPED;
+	}
+	pGroup->bIsStepActive = FALSE;
+	return GroupRunAll(pGroup, 0, GroupJobStepEnd, NULL);
+}
+
+FLOC_STATUS FLOCDLL_GroupHitsGet(FLOC_GROUP_HANDLE const hGroup, BOOL const bIntersection, U64* const puOffsets, U32 const uCapacity, U32* const puCount)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	*puCount = 0;
+
+	U64* puMerged = NULL;
+	U32 uMembers = 0;
+	FLOC_STATUS const status = GroupHitsMerge(pGroup, bIntersection, &puMerged, &uMembers);
+	if (NULL == puMerged)
+	{
+		return status;
+	}
+	U32 uCount = 0;
+	for (U32 i = 0; i < pGroup->uTrackerCount; i++)
+	{
+		if (0 != (puMerged[i / 64] & (1ULL << (i % 64))))
+		{
+			if (uCount < uCapacity)
+			{
+				puOffsets[uCount] = pGroup->pTrackers[i].uOffset;
+			}
+			uCount++;
+		}
+	}
+	Memory_Free(puMerged);
+
+	*puCount = uCount;
+	return (uCount > uCapacity) ? FLOC_STATUS_BUFFER_TOO_SMALL : status;
+}
+
+static FLOC_STATUS GroupStepFilterOut(FLOC_GROUP_HANDLE const hGroup, BOOL const bExecuted, BOOL const bIntersection)
+{
+	GROUP* const pGroup = FLOC_GroupGet(hGroup);
+	if (NULL == pGroup)
+	{
+		return FLOC_STATUS_INVALID_HANDLE;
+	}
+	if (pGroup->bIsStepActive)
+	{
+		return FLOC_STATUS_STEP_ACTIVE;
+	}
+
+	U64* puMerged = NULL;
+	U32 uMembers = 0;
+	FLOC_STATUS const mergeStatus = GroupHitsMerge(pGroup, bIntersection, &puMerged, &uMembers);
+	if (NULL == puMerged)
+	{
+		return mergeStatus;
+	}
+	/* Without a member that could report hits, nothing is known to be executed or not. */
+	if (0 == uMembers)
+	{
+		Memory_Free(puMerged);
+		return mergeStatus;
+	}
+	if (!bExecuted)
+	{
+		for (U32 w = 0; w < pGroup->uHitWords; w++)
+		{
+			puMerged[w] = ~puMerged[w];
+		}
+	}
+
+	/* Bits past the last tracker are never read, the inversion may set them. */
+	FLOC_STATUS const status = GroupTrackersDrop(pGroup, puMerged);
+	Memory_Free(puMerged);
+	return (FLOC_STATUS_SUCCESS != mergeStatus) ? mergeStatus : status;
+}
+
+FLOC_STATUS FLOCDLL_GroupStepFilterOutExecuted(FLOC_GROUP_HANDLE const hGroup, BOOL const bIntersection)
+{
+	return GroupStepFilterOut(hGroup, TRUE, bIntersection);
+}
+
+FLOC_STATUS FLOCDLL_GroupStepFilterOutNotExecuted(FLOC_GROUP_HANDLE const hGroup, BOOL const bIntersection)
+{
+	return GroupStepFilterOut(hGroup, FALSE, bIntersection);
 }
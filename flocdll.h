@@ -20,10 +20,16 @@ extern "C" {
 #include "types.h"
 #include "status.h"
 #include "os.h"
+#include "pool.h"
+#include "ring.h"
+#include "session.h"
 
 struct tdFLOC_HANDLE;
 typedef struct tdFLOC_HANDLE* FLOC_HANDLE;
 
+struct tdFLOC_GROUP_HANDLE;
+typedef struct tdFLOC_GROUP_HANDLE* FLOC_GROUP_HANDLE;
+
 struct tdVECTOR;
 typedef struct tdVECTOR VECTOR;
 
@@ -36,13 +42,87 @@ FLOC_EXPORT FLOC_STATUS FLOCDLL_DebugLoopOverride(FLOC_HANDLE hHandle, BOOL bLoo
 FLOC_EXPORT FLOC_STATUS FLOCDLL_DebugLoopStop(FLOC_HANDLE hHandle);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_CallExceptionBreakpointHandler(FLOC_HANDLE hHandle, PID pidTarget, TID tidThread, ADDRESS aAddress);
 
+/*
+ * Every breakpoint, hardware breakpoint and page tracker the debug loop sees firing is queued as a
+ * HIT_RECORD, in steps or not. Hooks fire inside the target without the debug loop and are not reported.
+ * Start and Stop only while no debug loop runs. uCapacity records are kept, later hits are dropped and
+ * counted until the client drains. fnCallback is optional and runs on the debug loop thread, so it must
+ * be short. The ring has a single consumer: a Drain, Start or Stop that overlaps another one returns
+ * FLOC_STATUS_HIT_STREAM_BUSY without touching the ring, so drain from one thread or retry. puDropped is
+ * optional and receives the running drop count.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_HitStreamStart(FLOC_HANDLE hHandle, U32 uCapacity, HIT_CALLBACK_FUNC fnCallback, void* pCallbackParam);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_HitStreamDrain(FLOC_HANDLE hHandle, HIT_RECORD* pRecords, U32 uCapacity, U32* puCount, U64* puDropped);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_HitStreamStop(FLOC_HANDLE hHandle);
+
 FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAddBreakpoint(FLOC_HANDLE hHandle, ADDRESS aAddress);
+/*
+ * Breakpoint in the debug registers, the code of the target is never written. Only four are armed
+ * at a time, the others wait for a slot and take turns at every step. Needs our own debug loop.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAddBreakpointHw(FLOC_HANDLE hHandle, ADDRESS aAddress);
+/*
+ * The displaced prologue is decoded and relocated into the stub, so the hook stays installed once hit.
+ * uFuncLen is optional (0); when given it bounds the relocated bytes, and if the prologue cannot be
+ * relocated the hook falls back to a one-shot stub that restores the function and needs uFuncLen to fit the jump.
+ */
 FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAddHook(FLOC_HANDLE hHandle, ADDRESS aAddress, U32 uFuncLen);
+/*
+ * Hook that stays installed and counts calls. uPrologueLen is optional (0) and found by the decoder.
+ * A given one that the decoder cannot relocate exactly is copied as is, so it must be whole
+ * instructions that do not depend on their address.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAddCounter(FLOC_HANDLE hHandle, ADDRESS aAddress, U32 uPrologueLen);
+/*
+ * Coarse pass over large code: every executable page in [aStart, aStart + uSize) gets a tracker that
+ * revokes execute permission while enabled. The first instruction fetch on the page is caught by the
+ * debug loop, marks the page hit and gives the permission back, so each page costs one fault per step.
+ * Page trackers do not collide with trackers on their first byte: they are only reached through the
+ * page functions, the All and the step functions. Needs our own debug loop.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAddPages(FLOC_HANDLE hHandle, ADDRESS aStart, U64 uSize, U32* puAdded);
+/* Page bases in ascending order, only pages hit in the current or last step if bHitOnly. Feed them to the fine-grained trackers. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerPagesGet(FLOC_HANDLE hHandle, ADDRESS aStart, U64 uSize, BOOL bHitOnly, ADDRESS* pPages, U32 uCapacity, U32* puCount);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerRemovePages(FLOC_HANDLE hHandle, ADDRESS aStart, U64 uSize);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerRemove(FLOC_HANDLE hHandle, ADDRESS aAddress);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerEnable(FLOC_HANDLE hHandle, ADDRESS aAddress);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerDisable(FLOC_HANDLE hHandle, ADDRESS aAddress);
 
+/*
+ * Batch variants. pStatuses is optional; when given it receives one status per input address. So is puFuncLens.
+ * Return FLOC_STATUS_BATCH_INCOMPLETE if any address failed.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAddBreakpointMany(FLOC_HANDLE hHandle, ADDRESS const* pAddresses, U32 uCount, FLOC_STATUS* pStatuses);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAddHookMany(FLOC_HANDLE hHandle, ADDRESS const* pAddresses, U32 const* puFuncLens, U32 uCount, FLOC_STATUS* pStatuses);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerRemoveMany(FLOC_HANDLE hHandle, ADDRESS const* pAddresses, U32 uCount, FLOC_STATUS* pStatuses);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerEnableMany(FLOC_HANDLE hHandle, ADDRESS const* pAddresses, U32 uCount, FLOC_STATUS* pStatuses);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerDisableMany(FLOC_HANDLE hHandle, ADDRESS const* pAddresses, U32 uCount, FLOC_STATUS* pStatuses);
+
+/*
+ * Functions of the PE or ELF module loaded at aModuleBase, in ascending order, from the unwind tables
+ * and the exported / dynamic symbols. A length of 0 means unknown. puFuncLens is optional.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_ModuleFunctionsGet(FLOC_HANDLE hHandle, ADDRESS aModuleBase, ADDRESS* pAddresses, U32* puFuncLens, U32 uCapacity, U32* puCount);
+/* Every function of the module gets a hook (with its length) or a breakpoint in one batch. Already tracked functions are skipped and make it FLOC_STATUS_BATCH_INCOMPLETE. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAddModule(FLOC_HANDLE hHandle, ADDRESS aModuleBase, BOOL bHooks, U32* puAdded);
+
+/*
+ * Trackers are stored in segments, see VECTOR for how to address them. Deleted ones keep their slot until compaction.
+ * Walking the vector races with the debug loop, FLOCDLL_TrackerSnapshotGet is the cheaper and safer way to poll.
+ */
 FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAllGet(FLOC_HANDLE hHandle, VECTOR const ** ppVec);
+/*
+ * All trackers in ascending address order, page trackers included, as an address array and three
+ * bitsets (bit i of word i / 64 for entry i) of (uCapacity + 63) / 64 words each: hit, enabled and
+ * alive, which is clear for removed trackers until their slots are compacted. The bitsets are optional.
+ * *puGeneration changes with every change to the trackers or their flags; passing the last one as
+ * uKnownGeneration returns FLOC_STATUS_SNAPSHOT_UNCHANGED without touching the buffers. 0 always takes a snapshot.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerSnapshotGet(FLOC_HANDLE hHandle, U32 uKnownGeneration, ADDRESS* pAddresses, U64* puHitBits, U64* puEnabledBits, U64* puAliveBits, U32 uCapacity, U32* puCount, U32* puGeneration);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerRangeGet(FLOC_HANDLE hHandle, ADDRESS aStart, U64 uSize, ADDRESS* pAddresses, U32 uCapacity, U32* puCount);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerCountersGet(FLOC_HANDLE hHandle, ADDRESS* pAddresses, U64* puCounts, U32 uCapacity, U32* puCount);
+/* Target memory held by the hook pools (reserved and committed bytes), including what was reclaimed from removed hooks. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_PoolStatsGet(FLOC_HANDLE hHandle, POOL_STATS* pStats);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAllReset(FLOC_HANDLE hHandle);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAllEnable(FLOC_HANDLE hHandle);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_TrackerAllDisable(FLOC_HANDLE hHandle);
@@ -51,6 +131,63 @@ FLOC_EXPORT FLOC_STATUS FLOCDLL_StepBegin(FLOC_HANDLE hHandle);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_StepEnd(FLOC_HANDLE hHandle);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_StepFilterOutExecuted(FLOC_HANDLE hHandle);
 FLOC_EXPORT FLOC_STATUS FLOCDLL_StepFilterOutNotExecuted(FLOC_HANDLE hHandle);
+/* One record per filter round, oldest first, those of loaded sessions included. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_StepHistoryGet(FLOC_HANDLE hHandle, STEP_RECORD* pRecords, U32 uCapacity, U32* puCount);
+
+/*
+ * A session file keeps the trackers of a context as offsets into the modules they lie in (module name
+ * and offset), with their type, enabled and hit state and the code bytes they replace, plus the step
+ * history; see SESSION_HEADER for the layout. Loading maps the file and re-applies the trackers in
+ * batches to the target, which may be another run of the same program. Trackers whose module is not
+ * loaded or whose code bytes differ are left out, hooks get a new stub and counters start at 0. Code
+ * that still holds the tracker's own int3 or jump, from a context that was not uninitialized, counts
+ * as unchanged and gets its original bytes back first. Trackers outside any module keep their absolute
+ * address and are only loaded into the process that saved them.
+ * Load after TargetSet and DebugLoopStart, so breakpoints can be enabled again. *puLoaded trackers
+ * were restored; FLOC_STATUS_BATCH_INCOMPLETE if that is not all of them.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_SessionSave(FLOC_HANDLE hHandle, char const* szPath);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_SessionLoad(FLOC_HANDLE hHandle, char const* szPath, U32* puLoaded);
+
+/*
+ * A group applies one tracker set to many processes running the same module, szModule (the file name,
+ * e.g. "worker.exe" or "libworker.so"). Trackers are given as offsets from the module base, every member
+ * rebases them onto the base it found for the module in its own process. Each member is a context of
+ * its own with our debug loop running, the calls fan out to all of them on uWorkers threads (0 for the
+ * default). A group is used from one thread at a time. Calls that reach the members return
+ * FLOC_STATUS_BATCH_INCOMPLETE if any member failed; FLOCDLL_GroupMemberGet tells which and why.
+ *
+ * Members that cannot be attached (or lack the module) are not added. New members get every tracker
+ * of the group; trackers added later go to every member. Hits are merged over the members as a union
+ * (hit in any member) or an intersection (hit in every member); members whose target died are left out.
+ * The filters remove the merged executed or not executed trackers from the group and from every member.
+ * A group step begins with every tracker of the group enabled again.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupCreate(FLOC_GROUP_HANDLE* phGroup, char const* szModule, U32 uWorkers);
+/* Detaches every member. If a worker thread does not exit, the group memory is leaked and FLOC_STATUS_GROUP_WORKER_STOP_FAIL returned. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupDestroy(FLOC_GROUP_HANDLE hGroup);
+/* pStatuses is optional; when given it receives one status per PID. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupTargetAddMany(FLOC_GROUP_HANDLE hGroup, PID const* pPids, U32 uCount, FLOC_STATUS* pStatuses);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupTargetRemove(FLOC_GROUP_HANDLE hGroup, PID pidTarget);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupInfoGet(FLOC_GROUP_HANDLE hGroup, U32* puMemberCount, U32* puTrackerCount);
+/* The context of the member stays owned by the group, do not uninitialize it. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupMemberGet(FLOC_GROUP_HANDLE hGroup, U32 uIndex, FLOC_HANDLE* phHandle, PID* ppidTarget, ADDRESS* paModuleBase, FLOC_STATUS* pLastStatus);
+/*
+ * Hooks (puFuncLens is optional) or breakpoints. Offsets the group already tracks are skipped and still
+ * count as success, *puAdded tells how many were new. FLOC_STATUS_BATCH_INCOMPLETE means a member failed.
+ */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupTrackerAddMany(FLOC_GROUP_HANDLE hGroup, U64 const* puOffsets, U32 const* puFuncLens, U32 uCount, BOOL bHooks, U32* puAdded);
+/* Every function of the module, enumerated in the first member, see FLOCDLL_TrackerAddModule. Already tracked ones are skipped like above. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupTrackerAddModule(FLOC_GROUP_HANDLE hGroup, BOOL bHooks, U32* puAdded);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupTrackerRemoveMany(FLOC_GROUP_HANDLE hGroup, U64 const* puOffsets, U32 uCount);
+/* Offsets of the trackers of the group in ascending order. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupTrackersGet(FLOC_GROUP_HANDLE hGroup, U64* puOffsets, U32 uCapacity, U32* puCount);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupStepBegin(FLOC_GROUP_HANDLE hGroup);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupStepEnd(FLOC_GROUP_HANDLE hGroup);
+/* Offsets hit in the current or last step, in ascending order. */
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupHitsGet(FLOC_GROUP_HANDLE hGroup, BOOL bIntersection, U64* puOffsets, U32 uCapacity, U32* puCount);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupStepFilterOutExecuted(FLOC_GROUP_HANDLE hGroup, BOOL bIntersection);
+FLOC_EXPORT FLOC_STATUS FLOCDLL_GroupStepFilterOutNotExecuted(FLOC_GROUP_HANDLE hGroup, BOOL bIntersection);
 
 #ifdef __cplusplus
 }
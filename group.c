@@ -0,0 +1,346 @@
+#include "group.h"
+
+#define GROUP_WORKER_EXIT_TIMEOUT_MS (1000)
+#define GROUP_MIN_CAPACITY (16)
+
+static void Group_Worker(void* pParam);
+static BOOL Group_TrackersReserve(GROUP* pGroup, U32 uCapacity);
+
+static void Group_Worker(void* const pParam)
+{
+	GROUP* const pGroup = (GROUP*)pParam;
+	for (;;)
+	{
+		Semaphore_Wait(pGroup->hWork);
+		if (pGroup->bExit)
+		{
+			return;
+		}
+
+		/* A worker woken after the others took every member just reports back. */
+		for (;;)
+		{
+			U32 const uIndex = Atomic_Increment(&(pGroup->uNextMember)) - 1;
+			if (uIndex >= pGroup->uJobEnd)
+			{
+				break;
+			}
+			GROUP_MEMBER* const pMember = &(pGroup->pMembers[uIndex]);
+			pMember->status = pGroup->fnJob(pGroup, pMember, pGroup->pJobParam);
+		}
+		Semaphore_Post(pGroup->hDone, 1);
+	}
+}
+
+GROUP* Group_Create(char const * const szModule, U32 const uWorkers)
+{
+	U64 uNameLen = 0;
+	while ('\0' != szModule[uNameLen])
+	{
+		uNameLen++;
+	}
+	if (0 == uNameLen || uNameLen >= GROUP_MODULE_NAME_MAX)
+	{
+		return NULL;
+	}
+
+	GROUP* const pGroup = Memory_Alloc(sizeof(GROUP));
+	if (NULL == pGroup)
+	{
+		return NULL;
+	}
+	Memory_Set(pGroup, 0, sizeof(GROUP));
+	Memory_Copy(pGroup->szModule, szModule, uNameLen + 1);
+
+	U32 const uWanted = (0 == uWorkers) ? GROUP_DEFAULT_WORKERS : ((uWorkers > GROUP_MAX_WORKERS) ? GROUP_MAX_WORKERS : uWorkers);
+	pGroup->phWorkers = Memory_Alloc((U64)uWanted * sizeof(THREAD));
+	pGroup->hWork = Semaphore_Create();
+	pGroup->hDone = Semaphore_Create();
+	if (NULL == pGroup->phWorkers || NULL == pGroup->hWork || NULL == pGroup->hDone)
+	{
+		Group_Free(pGroup);
+		return NULL;
+	}
+
+	/* Fewer workers than asked for still run every job, only with less parallelism. */
+	for (U32 i = 0; i < uWanted; i++)
+	{
+		if (!Thread_Start(Group_Worker, pGroup, &(pGroup->phWorkers[pGroup->uWorkerCount])))
+		{
+			break;
+		}
+		pGroup->uWorkerCount++;
+	}
+	if (0 == pGroup->uWorkerCount)
+	{
+		Group_Free(pGroup);
+		return NULL;
+	}
+	return pGroup;
+}
+
+BOOL Group_Free(GROUP* const pGroup)
+{
+	/* A worker that did not exit may still be inside a job and use the group, so nothing is freed then. */
+	if (0 != pGroup->uWorkerCount)
+	{
+		pGroup->bExit = TRUE;
+		Semaphore_Post(pGroup->hWork, pGroup->uWorkerCount);
+		BOOL bAllExited = TRUE;
+		for (U32 i = 0; i < pGroup->uWorkerCount; i++)
+		{
+			bAllExited = Thread_WaitExit(pGroup->phWorkers[i], GROUP_WORKER_EXIT_TIMEOUT_MS) && bAllExited;
+		}
+		if (!bAllExited)
+		{
+			return FALSE;
+		}
+		for (U32 i = 0; i < pGroup->uWorkerCount; i++)
+		{
+			Thread_Close(pGroup->phWorkers[i]);
+		}
+	}
+	if (NULL != pGroup->hWork)
+	{
+		Semaphore_Free(pGroup->hWork);
+	}
+	if (NULL != pGroup->hDone)
+	{
+		Semaphore_Free(pGroup->hDone);
+	}
+	Memory_Free(pGroup->phWorkers);
+	Memory_Free(pGroup->pMembers);
+	Memory_Free(pGroup->pTrackers);
+	Memory_Free(pGroup->puHitBits);
+	Memory_Free(pGroup);
+	return TRUE;
+}
+
+void Group_Run(GROUP* const pGroup, U32 const uFirst, GROUP_JOB_FUNC const fnJob, void* const pParam)
+{
+	if (uFirst >= pGroup->uMemberCount)
+	{
+		return;
+	}
+	U32 const uPending = pGroup->uMemberCount - uFirst;
+	U32 const uWake = (uPending < pGroup->uWorkerCount) ? uPending : pGroup->uWorkerCount;
+
+	pGroup->fnJob = fnJob;
+	pGroup->pJobParam = pParam;
+	pGroup->uNextMember = uFirst;
+	pGroup->uJobEnd = pGroup->uMemberCount;
+	Semaphore_Post(pGroup->hWork, uWake);
+	for (U32 i = 0; i < uWake; i++)
+	{
+		Semaphore_Wait(pGroup->hDone);
+	}
+}
+
+BOOL Group_MembersReserve(GROUP* const pGroup, U32 const uCapacity)
+{
+	if (uCapacity <= pGroup->uMemberCapacity)
+	{
+		return TRUE;
+	}
+	U32 uNewCapacity = (0 == pGroup->uMemberCapacity) ? GROUP_MIN_CAPACITY : pGroup->uMemberCapacity;
+	while (uNewCapacity < uCapacity)
+	{
+		uNewCapacity *= 2;
+	}
+
+	GROUP_MEMBER* const pMembers = Memory_Alloc((U64)uNewCapacity * sizeof(GROUP_MEMBER));
+	if (NULL == pMembers)
+	{
+		return FALSE;
+	}
+	if (0 != pGroup->uMemberCount)
+	{
+		Memory_Copy(pMembers, pGroup->pMembers, (U64)pGroup->uMemberCount * sizeof(GROUP_MEMBER));
+	}
+	Memory_Free(pGroup->pMembers);
+	pGroup->pMembers = pMembers;
+	pGroup->uMemberCapacity = uNewCapacity;
+	return TRUE;
+}
+
+GROUP_MEMBER* Group_MemberFind(GROUP const * const pGroup, PID const pidTarget)
+{
+	for (U32 i = 0; i < pGroup->uMemberCount; i++)
+	{
+		if (pidTarget == pGroup->pMembers[i].pidTarget)
+		{
+			return &(pGroup->pMembers[i]);
+		}
+	}
+	return NULL;
+}
+
+void Group_MembersCompact(GROUP* const pGroup)
+{
+	U32 uKept = 0;
+	for (U32 i = 0; i < pGroup->uMemberCount; i++)
+	{
+		if (NULL != pGroup->pMembers[i].hHandle)
+		{
+			pGroup->pMembers[uKept++] = pGroup->pMembers[i];
+		}
+	}
+	pGroup->uMemberCount = uKept;
+}
+
+static BOOL Group_TrackersReserve(GROUP* const pGroup, U32 const uCapacity)
+{
+	if (uCapacity <= pGroup->uTrackerCapacity)
+	{
+		return TRUE;
+	}
+	U32 uNewCapacity = (0 == pGroup->uTrackerCapacity) ? GROUP_MIN_CAPACITY : pGroup->uTrackerCapacity;
+	while (uNewCapacity < uCapacity)
+	{
+		if (uNewCapacity > ((U32)-1 >> 1))
+		{
+			return FALSE;
+		}
+		uNewCapacity *= 2;
+	}
+
+	GROUP_TRACKER* const pTrackers = Memory_Alloc((U64)uNewCapacity * sizeof(GROUP_TRACKER));
+	if (NULL == pTrackers)
+	{
+		return FALSE;
+	}
+	if (0 != pGroup->uTrackerCount)
+	{
+		Memory_Copy(pTrackers, pGroup->pTrackers, (U64)pGroup->uTrackerCount * sizeof(GROUP_TRACKER));
+	}
+	Memory_Free(pGroup->pTrackers);
+	pGroup->pTrackers = pTrackers;
+	pGroup->uTrackerCapacity = uNewCapacity;
+	return TRUE;
+}
+
+U32 Group_TrackerLowerBound(GROUP const * const pGroup, U64 const uOffset)
+{
+	U32 uLow = 0;
+	U32 uHigh = pGroup->uTrackerCount;
+	while (uLow < uHigh)
+	{
+		U32 const uMid = uLow + (uHigh - uLow) / 2;
+		if (pGroup->pTrackers[uMid].uOffset < uOffset)
+		{
+			uLow = uMid + 1;
+		}
+		else
+		{
+			uHigh = uMid;
+		}
+	}
+	return uLow;
+}
+
+BOOL Group_TrackersMerge(GROUP* const pGroup, GROUP_TRACKER* const pTrackers, U32 const uCount, U32* const puAdded)
+{
+	*puAdded = 0;
+	U32 uAdded = 0;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		U32 const uAt = Group_TrackerLowerBound(pGroup, pTrackers[i].uOffset);
+		if (uAt == pGroup->uTrackerCount || pGroup->pTrackers[uAt].uOffset != pTrackers[i].uOffset)
+		{
+			pTrackers[uAdded++] = pTrackers[i];
+		}
+	}
+	if (0 == uAdded)
+	{
+		return TRUE;
+	}
+	if ((U64)pGroup->uTrackerCount + uAdded > (U32)-1 || !Group_TrackersReserve(pGroup, pGroup->uTrackerCount + uAdded))
+	{
+		return FALSE;
+	}
+
+	/* Merge from the back, so every tracker moves once and none is overwritten before it moved. */
+	U32 uOld = pGroup->uTrackerCount;
+	U32 uNew = uAdded;
+	U32 uOut = pGroup->uTrackerCount + uAdded;
+	while (0 != uNew)
+	{
+		if (0 != uOld && pGroup->pTrackers[uOld - 1].uOffset > pTrackers[uNew - 1].uOffset)
+		{
+			pGroup->pTrackers[--uOut] = pGroup->pTrackers[--uOld];
+		}
+		else
+		{
+			pGroup->pTrackers[--uOut] = pTrackers[--uNew];
+		}
+	}
+	pGroup->uTrackerCount += uAdded;
+	*puAdded = uAdded;
+	return TRUE;
+}
+
+void Group_TrackersRemove(GROUP* const pGroup, U64 const * const puRemoveBits)
+{
+	U32 uKept = 0;
+	for (U32 i = 0; i < pGroup->uTrackerCount; i++)
+	{
+		if (0 == (puRemoveBits[i / 64] & (1ULL << (i % 64))))
+		{
+			pGroup->pTrackers[uKept++] = pGroup->pTrackers[i];
+		}
+	}
+	pGroup->uTrackerCount = uKept;
+}
+
+BOOL Group_HitsReserve(GROUP* const pGroup)
+{
+	U32 const uWords = (pGroup->uTrackerCount + 63) / 64;
+	U64 const uSize = (U64)uWords * pGroup->uMemberCount * sizeof(U64);
+	Memory_Free(pGroup->puHitBits);
+	pGroup->puHitBits = NULL;
+	pGroup->uHitWords = 0;
+	if (0 == uSize)
+	{
+		return TRUE;
+	}
+
+	pGroup->puHitBits = Memory_Alloc(uSize);
+	if (NULL == pGroup->puHitBits)
+	{
+		return FALSE;
+	}
+	Memory_Set(pGroup->puHitBits, 0, uSize);
+	pGroup->uHitWords = uWords;
+	return TRUE;
+}
+
+U32 Group_HitsMerge(GROUP const * const pGroup, BOOL const bIntersection, U64* const puMerged)
+{
+	U32 const uWords = pGroup->uHitWords;
+	U32 uMerged = 0;
+	for (U32 i = 0; i < pGroup->uMemberCount; i++)
+	{
+		if (FLOC_STATUS_SUCCESS != pGroup->pMembers[i].status)
+		{
+			continue;
+		}
+		U64 const * const puBits = &(pGroup->puHitBits[(U64)i * uWords]);
+		for (U32 w = 0; w < uWords; w++)
+		{
+			if (0 == uMerged)
+			{
+				puMerged[w] = puBits[w];
+			}
+			else
+			{
+				puMerged[w] = bIntersection ? (puMerged[w] & puBits[w]) : (puMerged[w] | puBits[w]);
+			}
+		}
+		uMerged++;
+	}
+	if (0 == uMerged && 0 != uWords)
+	{
+		Memory_Set(puMerged, 0, (U64)uWords * sizeof(U64));
+	}
+	return uMerged;
+}
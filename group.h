@@ -0,0 +1,97 @@
+#ifndef GROUP_H
+#define GROUP_H
+
+#include "types.h"
+#include "status.h"
+#include "os.h"
+
+#define GROUP_DEFAULT_WORKERS (4)
+#define GROUP_MAX_WORKERS (64)
+#define GROUP_MODULE_NAME_MAX (256)
+
+typedef struct tdFLOC_HANDLE* FLOC_HANDLE;
+
+/* One function of the logical tracker set, relative to the base of the module in every member. */
+typedef struct tdGROUP_TRACKER {
+	U64 uOffset;
+	U32 uFuncLen;
+	BOOL bHook;
+} GROUP_TRACKER;
+
+/* One target process of the group, with its own context. */
+typedef struct tdGROUP_MEMBER {
+	FLOC_HANDLE hHandle; /* NULL until the member is attached */
+	ADDRESS aModuleBase;
+	PID pidTarget;
+	FLOC_STATUS status; /* of the last job */
+	BYTE _padding[2];
+} GROUP_MEMBER;
+
+struct tdGROUP;
+typedef FLOC_STATUS (*GROUP_JOB_FUNC)(struct tdGROUP* pGroup, GROUP_MEMBER* pMember, void* pParam);
+
+/*
+ * One tracker set applied to many processes that load the same module at different bases. The
+ * trackers are kept sorted by offset, each member rebases them onto its own module base.
+ *
+ * Jobs run on every member in parallel on a fixed pool of worker threads: the caller posts one
+ * wake-up per busy worker, the workers claim members through uNextMember until none is left and
+ * post one completion each. The semaphores order the job setup before the workers and the member
+ * results before the caller. One client thread at a time may use a group.
+ *
+ * puHitBits holds uHitWords words per member, bit i for tracker i, filled by a hit collection.
+ */
+typedef struct tdGROUP {
+	THREAD* phWorkers;
+	SEMAPHORE hWork;
+	SEMAPHORE hDone;
+	GROUP_JOB_FUNC fnJob;
+	void* pJobParam;
+	GROUP_MEMBER* pMembers;
+	GROUP_TRACKER* pTrackers;
+	U64* puHitBits;
+	U32 uWorkerCount;
+	U32 uMemberCount;
+	U32 uMemberCapacity;
+	U32 uTrackerCount;
+	U32 uTrackerCapacity;
+	U32 uHitWords;
+	U32 volatile uNextMember;
+	U32 uJobEnd;
+	BOOL volatile bExit;
+	BOOL bIsStepActive;
+	char szModule[GROUP_MODULE_NAME_MAX];
+} GROUP;
+
+/* uWorkers 0 takes GROUP_DEFAULT_WORKERS, more than GROUP_MAX_WORKERS are capped. */
+GROUP* Group_Create(char const* szModule, U32 uWorkers);
+/* Members must have been detached already. FALSE if a worker did not exit in time, the group is left allocated then. */
+BOOL Group_Free(GROUP* pGroup);
+
+/* Runs fnJob on the members from uFirst on, in parallel, and returns when all are done. */
+void Group_Run(GROUP* pGroup, U32 uFirst, GROUP_JOB_FUNC fnJob, void* pParam);
+
+BOOL Group_MembersReserve(GROUP* pGroup, U32 uCapacity);
+GROUP_MEMBER* Group_MemberFind(GROUP const* pGroup, PID pidTarget);
+/* Drops the members without a handle, keeping the order of the others. */
+void Group_MembersCompact(GROUP* pGroup);
+
+/* Index of the first tracker at or above uOffset. */
+U32 Group_TrackerLowerBound(GROUP const* pGroup, U64 uOffset);
+/*
+ * pTrackers must be sorted by offset without duplicates. Those the group already has are dropped from
+ * pTrackers, the others are merged in and stay at the front of pTrackers, *puAdded of them.
+ */
+BOOL Group_TrackersMerge(GROUP* pGroup, GROUP_TRACKER* pTrackers, U32 uCount, U32* puAdded);
+/* Drops the trackers whose bit is set, keeping the order of the others. */
+void Group_TrackersRemove(GROUP* pGroup, U64 const* puRemoveBits);
+
+/* Sizes and clears the per-member hit bitsets for the current members and trackers. */
+BOOL Group_HitsReserve(GROUP* pGroup);
+/*
+ * Union or intersection of the hit bitsets of the members whose last job succeeded, into uHitWords
+ * words of puMerged. Returns how many members took part; none leaves puMerged empty.
+ */
+U32 Group_HitsMerge(GROUP const* pGroup, BOOL bIntersection, U64* puMerged);
+
+#endif /* GROUP_H */
@@ -1,13 +1,28 @@
 #include "hook.h"
+#include "decode.h"
 #include "pool.h"
 #include "tracker.h"
 #include "vector.h"
 
-typedef signed long I32;
+#include <emmintrin.h>
 
-static BOOL CreateHookRel32(TRACKER* pTracker, POOL* pPool, PROCESS hProcess);
-static BOOL CreateHookAbs64(TRACKER* pTracker, POOL* pPool, PROCESS hProcess);
+typedef signed int I32;
+
+#define HIT_CHUNK_LEN (16)
+#define HIT_SNAPSHOT_UNREAD ((U64)-1)
+/* Function bytes read to relocate a prologue, also scanned for branches back into it. Loops rarely span more. */
+#define HOOK_PROLOGUE_READ_LEN (0x400)
+
+static BOOL CreateHookRel32(TRACKER* pTracker, POOL const* pPool, PROCESS hProcess);
+static BOOL CreateHookAbs64(TRACKER* pTracker, POOL const* pPool, PROCESS hProcess);
+static BOOL CreateHookRelocated(TRACKER* pTracker, POOL const* pPool, BOOL bNear, U32 uFuncLen, U32 uPrologueLen, PROCESS hProcess);
+static BOOL AllocHookRelocated(VECTOR* pvecPools, INDEX* pidxPools, POOL_STATS* pStats, TRACKER* pTracker, REGION_MAP* pRegions, PROCESS hProcess, U32 uFuncLen, U32 uPrologueLen);
+static U32 ReadFunctionBytes(ADDRESS aFunction, PROCESS hProcess, BYTE* pBytes);
+static void BuildJump(BYTE* pJump, ADDRESS aFrom, ADDRESS aTo, BOOL bNear);
+static BOOL AllocSlots(TRACKER* pTracker, VECTOR* pvecPools, INDEX* pidxPools, POOL_STATS* pStats, POOL_REQUEST const* pRequest, REGION_MAP* pRegions, PROCESS hProcess, BOOL* pbNear);
 static I32 CalcSignedDisplacement32(U64 a, U64 b);
+static void HitMapPack(BYTE const* pMap, U32 uChunks, U16* pBits);
+static BOOL SnapshotHitSet(HIT_SNAPSHOT const* pSnapshot, TRACKER const* pTracker);
 
 static I32 CalcSignedDisplacement32(U64 const a, U64 const b)
 {
@@ -15,16 +30,18 @@ static I32 CalcSignedDisplacement32(U64 const a, U64 const b)
 	return (a > b) ? (-1) * (I32)uAbsDiff : (I32)uAbsDiff;
 }
 
-static BOOL CreateHookRel32(TRACKER* const pTracker, POOL* const pPool, PROCESS const hProcess)
+static BOOL CreateHookRel32(TRACKER* const pTracker, POOL const * const pPool, PROCESS const hProcess)
 {
 	ADDRESS const aFunction = pTracker->aAddress;
 	ADDRESS const aHook = pTracker->u.hook.aHookAddress;
 	U32 const uJumpLen = JUMP_REL32_LEN;
-	pTracker->u.hook.uJumpBytesLen = uJumpLen;
+	pTracker->u.hook.uJumpBytesLen = (BYTE)uJumpLen;
+
+	ADDRESS const aHit = pPool->aHitMap + pTracker->u.hook.uHitIndex;
 
 	BYTE bufOriginalBytes[JUMP_REL32_LEN];
 	BYTE bufJump[JUMP_REL32_LEN];
-	BYTE bufHook[30];
+	BYTE bufHook[HOOK_REL32_LEN];
 
 	if (!Target_MemoryRead(hProcess, aFunction, bufOriginalBytes, uJumpLen))
 	{
@@ -48,7 +65,7 @@ static BOOL CreateHookRel32(TRACKER* const pTracker, POOL* const pPool, PROCESS
 	 * 
 	 * 0x0: C6 05 xx xx xx xx 01 
 	 * mov BYTE PTR [rip+xx], 0x1
-	 * xx is displacement from RIP to hit byte
+	 * xx is displacement from RIP to the hook's byte in the pool hit map
 	 *
 	 * 0x7: C7 05 xx xx xx xx AA BB CC DD 
 	 * mov DWORD PTR [rip+xx], 0xDDCCBBAA
@@ -64,11 +81,12 @@ static BOOL CreateHookRel32(TRACKER* const pTracker, POOL* const pPool, PROCESS
 	 * jmp rel32 (RIP = RIP + rel32)
 	 * xx is displacement from RIP to aFunction
 	 * 
-	 * 0x1D: hit byte
+	 * 0x1D: CC CC CC
+	 * int3 padding up to HOOK_REL32_LEN
 	 */
 	bufHook[0x0] = 0xC6;
 	bufHook[0x1] = 0x05;
-	*(I32*)&bufHook[2] = CalcSignedDisplacement32(aHook + 0x07, aHook + 0x1D);
+	*(I32*)&bufHook[2] = CalcSignedDisplacement32(aHook + 0x07, aHit);
 	bufHook[0x6] = 0x01;
 
 	bufHook[0x7] = 0xC7;
@@ -88,34 +106,25 @@ static BOOL CreateHookRel32(TRACKER* const pTracker, POOL* const pPool, PROCESS
 	bufHook[0x18] = 0xE9;
 	*(I32*)&bufHook[0x19] = CalcSignedDisplacement32(aHook + 0x1D, aFunction);
 
-	bufHook[0x1D] = FALSE;
-
-	pTracker->u.hook.uHitOffset = 0x1D;
-
-	if (!Target_MemoryWriteFlush(hProcess, pPool->aCurrentFreeAddress, bufHook, sizeof(bufHook)))
-	{
-		return FALSE;
-	}
-	if (!Target_MemoryUnprotect(hProcess, pTracker->aAddress, pTracker->u.hook.uJumpBytesLen))
-	{
-		return FALSE;
-	}
+	bufHook[0x1D] = 0xCC;
+	bufHook[0x1E] = 0xCC;
+	bufHook[0x1F] = 0xCC;
 
-	pPool->uFreeSize -= sizeof(bufHook);
-	pPool->aCurrentFreeAddress += sizeof(bufHook);
-	return TRUE;
+	return Target_MemoryWriteFlush(hProcess, aHook, bufHook, sizeof(bufHook));
 }
 
-static BOOL CreateHookAbs64(TRACKER* const pTracker, POOL* const pPool, PROCESS const hProcess)
+static BOOL CreateHookAbs64(TRACKER* const pTracker, POOL const * const pPool, PROCESS const hProcess)
 {
 	ADDRESS const aFunction = pTracker->aAddress;
 	ADDRESS const aHook = pTracker->u.hook.aHookAddress;
 	U32 const uJumpLen = JUMP_ABS64_LEN;
-	pTracker->u.hook.uJumpBytesLen = uJumpLen;
+	pTracker->u.hook.uJumpBytesLen = (BYTE)uJumpLen;
+
+	ADDRESS const aHit = pPool->aHitMap + pTracker->u.hook.uHitIndex;
 
 	BYTE bufOriginalBytes[JUMP_ABS64_LEN + 2];
 	BYTE bufJump[JUMP_ABS64_LEN];
-	BYTE bufHook[64];
+	BYTE bufHook[HOOK_ABS64_LEN];
 
 	if (!Target_MemoryRead(hProcess, aFunction, bufOriginalBytes, uJumpLen + 2))
 	{
@@ -142,7 +151,7 @@ static BOOL CreateHookAbs64(TRACKER* const pTracker, POOL* const pPool, PROCESS
 	 * SET HIT BYTE, REMOVE HOOK, JUMP BACK
 	 * 0x0: C6 05 xx xx xx xx 01
 	 * mov BYTE PTR [rip+xx], 0x1
-	 * xx is displacement from RIP to bHIT byte
+	 * xx is displacement from RIP to the hook's byte in the pool hit map
 	 *
 	 * 0x7: 50
 	 * pushq rax
@@ -171,11 +180,12 @@ static BOOL CreateHookAbs64(TRACKER* const pTracker, POOL* const pPool, PROCESS
 	 * zeroed out rel32 to read address from [RIP]
 	 * xx follows after opcode, is the absolute address of aFunction
 	 *
-	 * 0x3F: bHIT
+	 * 0x3F: CC
+	 * int3 padding up to HOOK_ABS64_LEN
 	 */
 	bufHook[0x0] = 0xC6;
 	bufHook[0x1] = 0x05;
-	*(I32*)&bufHook[2] = CalcSignedDisplacement32(aHook + 0x07, aHook + 0x3F);
+	*(I32*)&bufHook[2] = CalcSignedDisplacement32(aHook + 0x07, aHit);
 	bufHook[0x6] = 0x01;
 
 	bufHook[0x7] = 0x50;
@@ -220,93 +230,625 @@ static BOOL CreateHookAbs64(TRACKER* const pTracker, POOL* const pPool, PROCESS
 	bufHook[0x36] = 0x00;
 	*(U64*)&bufHook[0x37] = aFunction;
 
-	bufHook[0x3F] = FALSE;
+	bufHook[0x3F] = 0xCC;
 
-	pTracker->u.hook.uHitOffset = 0x3F;
+	return Target_MemoryWriteFlush(hProcess, aHook, bufHook, sizeof(bufHook));
+}
 
-	if (!Target_MemoryWriteFlush(hProcess, pPool->aCurrentFreeAddress, bufHook, sizeof(bufHook)))
+static BOOL AllocSlots(TRACKER* const pTracker, VECTOR* const pvecPools, INDEX* const pidxPools, POOL_STATS* const pStats, POOL_REQUEST const * const pRequest, REGION_MAP* const pRegions, PROCESS const hProcess, BOOL* const pbNear)
+{
+	POOL* const pPool = Pool_FindOrCreateBest(pvecPools, pidxPools, pStats, pRequest, pRegions, hProcess);
+	if (NULL == pPool)
 	{
 		return FALSE;
 	}
-	if (!Target_MemoryUnprotect(hProcess, pTracker->aAddress, pTracker->u.hook.uJumpBytesLen))
+
+	U32 uHitIndex = 0;
+	if (!Pool_HitAlloc(pPool, pStats, pRequest->uHitLen, hProcess, &uHitIndex))
+	{
+		return FALSE;
+	}
+	ADDRESS const aHook = Pool_StubAlloc(pPool, pStats, pRequest, hProcess, pbNear);
+	if (0 == aHook)
 	{
+		Pool_HitFree(pPool, uHitIndex, pRequest->uHitLen);
 		return FALSE;
 	}
 
-	pPool->uFreeSize -= sizeof(bufHook);
-	pPool->aCurrentFreeAddress += sizeof(bufHook);
+	/* Enough for Hook_Release to give the slots back if creating the stub fails. */
+	pTracker->u.hook.aHookAddress = aHook;
+	pTracker->u.hook.uPoolIndex = Vector_IndexOf(pvecPools, pPool);
+	pTracker->u.hook.uHitIndex = uHitIndex;
+	pTracker->u.hook.uJumpBytesLen = (BYTE)(*pbNear ? JUMP_REL32_LEN : JUMP_ABS64_LEN);
+	pTracker->u.hook.bRelocated = FALSE;
 	return TRUE;
 }
 
-BOOL Hook_Create(VECTOR* const pvecPools, TRACKER* const pTracker, PROCESS const hProcess, U32 const uFuncLen)
+BOOL Hook_Create(VECTOR* const pvecPools, INDEX* const pidxPools, POOL_STATS* const pStats, TRACKER* const pTracker, REGION_MAP* const pRegions, PROCESS const hProcess, U32 const uFuncLen)
 {
 	if (NULL == pvecPools || NULL == pTracker)
 	{
 		return FALSE;
 	}
-	
-	ADDRESS const aFunction = pTracker->aAddress;
-	POOL* const pPool = Pool_FindOrCreateBest(pvecPools, aFunction, HOOK_MAX_LEN, DISTANCE_NEAR - HOOK_MAX_LEN, hProcess);
-	if (NULL == pPool)
+
+	/* Prefer a hook that stays installed. The one-shot stub below only needs uFuncLen to cover its jump. */
+	if (AllocHookRelocated(pvecPools, pidxPools, pStats, pTracker, pRegions, hProcess, uFuncLen, 0))
+	{
+		return TRUE;
+	}
+
+	POOL_REQUEST request;
+	request.aNear = pTracker->aAddress;
+	request.uNearDistance = DISTANCE_NEAR - HOOK_MAX_LEN;
+	request.uNearLen = HOOK_REL32_LEN;
+	request.uFarLen = HOOK_ABS64_LEN;
+	request.uHitLen = 1;
+
+	BOOL bNear = FALSE;
+	if (!AllocSlots(pTracker, pvecPools, pidxPools, pStats, &request, pRegions, hProcess, &bNear))
 	{
 		return FALSE;
 	}
 
-	ADDRESS const aHook = pPool->aCurrentFreeAddress;
-	BOOL const bNear = (aHook > aFunction)
-		? ((aHook - aFunction) < (DISTANCE_NEAR - HOOK_MAX_LEN))
-		: ((aFunction - aHook) < (DISTANCE_NEAR - HOOK_MAX_LEN));		
 	U32 const uJumpLen = bNear ? JUMP_REL32_LEN : JUMP_ABS64_LEN;
-	if (uJumpLen > uFuncLen)
+	POOL* const pPool = (POOL*)Vector_AddressOf(pvecPools, pTracker->u.hook.uPoolIndex);
+	BOOL bRet = FALSE;
+	if (uJumpLen <= uFuncLen)
 	{
-		return FALSE;
+		bRet = bNear
+			? CreateHookRel32(pTracker, pPool, hProcess)
+			: CreateHookAbs64(pTracker, pPool, hProcess);
 	}
 
-	pTracker->u.hook.aHookAddress = aHook;
+	if (!bRet)
+	{
+		Hook_Release(pTracker, pvecPools, pidxPools, pStats, pRegions, hProcess);
+	}
+	return bRet;
+}
 
-	BOOL bRet = FALSE;
+static void BuildJump(BYTE* const pJump, ADDRESS const aFrom, ADDRESS const aTo, BOOL const bNear)
+{
+	/* Same encodings as the jumps to the hook above: E9 rel32, or FF 25 00000000 followed by the absolute target. */
 	if (bNear)
 	{
-		bRet = CreateHookRel32(pTracker, pPool, hProcess);
+		pJump[0] = 0xE9;
+		*(I32*)&pJump[1] = CalcSignedDisplacement32(aFrom + JUMP_REL32_LEN, aTo);
+		return;
+	}
+	pJump[0x0] = 0xFF;
+	pJump[0x1] = 0x25;
+	pJump[0x2] = 0x00;
+	pJump[0x3] = 0x00;
+	pJump[0x4] = 0x00;
+	pJump[0x5] = 0x00;
+	*(U64*)&pJump[0x6] = aTo;
+}
+
+static U32 ReadFunctionBytes(ADDRESS const aFunction, PROCESS const hProcess, BYTE* const pBytes)
+{
+	/* A short function may end right before an unreadable page, then only the rest of its own page is read. */
+	if (Target_MemoryRead(hProcess, aFunction, pBytes, HOOK_PROLOGUE_READ_LEN))
+	{
+		return HOOK_PROLOGUE_READ_LEN;
+	}
+	U32 const uToPageEnd = POOL_PAGE_SIZE - (U32)(aFunction & (POOL_PAGE_SIZE - 1));
+	if (uToPageEnd < HOOK_PROLOGUE_READ_LEN && Target_MemoryRead(hProcess, aFunction, pBytes, uToPageEnd))
+	{
+		return uToPageEnd;
+	}
+	return 0;
+}
+
+static BOOL CreateHookRelocated(TRACKER* const pTracker, POOL const * const pPool, BOOL const bNear, U32 const uFuncLen, U32 const uPrologueLen, PROCESS const hProcess)
+{
+	ADDRESS const aFunction = pTracker->aAddress;
+	ADDRESS const aHook = pTracker->u.hook.aHookAddress;
+	ADDRESS const aHit = pPool->aHitMap + pTracker->u.hook.uHitIndex;
+	BOOL const bCounter = (TRACKER_TYPE_HOOK_COUNTER == pTracker->eType);
+	U32 const uJumpLen = bNear ? JUMP_REL32_LEN : JUMP_ABS64_LEN;
+	U32 const uHeadLen = bCounter ? HOOK_COUNTER_PROLOGUE_OFFSET : HOOK_INLINE_PROLOGUE_OFFSET;
+	U32 const uCodeEnd = HOOK_RELOCATED_LEN - uJumpLen;
+	if (0 != uPrologueLen && uPrologueLen < uJumpLen)
+	{
+		return FALSE;
+	}
+
+	BYTE bufFunction[HOOK_PROLOGUE_READ_LEN];
+	U32 const uReadLen = ReadFunctionBytes(aFunction, hProcess, bufFunction);
+	if (0 == uReadLen)
+	{
+		return FALSE;
+	}
+
+	BYTE bufHook[HOOK_RELOCATED_LEN];
+	U32 const uPrologueCapacity = uCodeEnd - uHeadLen - uJumpLen;
+	U32 uTaken = 0;
+	U32 uPrologueOutLen = 0;
+	BOOL bRelocated = Decode_Relocate(bufFunction, uReadLen, aFunction, aHook + uHeadLen, (0 != uPrologueLen) ? uPrologueLen : uJumpLen,
+		uFuncLen, &bufHook[uHeadLen], uPrologueCapacity, &uTaken, &uPrologueOutLen);
+	if (0 != uPrologueLen && (!bRelocated || uTaken != uPrologueLen))
+	{
+		/* The caller vouched for whole instructions that do not depend on their address. */
+		bRelocated = (uPrologueLen <= uReadLen && uPrologueLen <= uPrologueCapacity);
+		if (bRelocated)
+		{
+			Memory_Copy(&bufHook[uHeadLen], bufFunction, uPrologueLen);
+			uTaken = uPrologueLen;
+			uPrologueOutLen = uPrologueLen;
+		}
+	}
+	if (!bRelocated)
+	{
+		return FALSE;
+	}
+
+	/*
+	 * COUNT OR SET HIT BYTE, RUN RELOCATED PROLOGUE, JUMP BACK
+	 *
+	 * 0x0: F0 48 FF 05 xx xx xx xx
+	 * lock inc QWORD PTR [rip+xx], counter hooks
+	 * 0x0: C6 05 xx xx xx xx 01
+	 * mov BYTE PTR [rip+xx], 0x1, inline hooks
+	 * xx is displacement from RIP to the hook's counter or byte in the pool hit map
+	 *
+	 * uHeadLen: prologue
+	 * the first uTaken function bytes as rewritten by Decode_Relocate
+	 *
+	 * uHeadLen + uPrologueOutLen: E9 xx xx xx xx / FF 25 00 00 00 00 xx xx xx xx xx xx xx xx
+	 * jump to aFunction + uTaken, rel32 when the pool is near, abs64 otherwise
+	 *
+	 * CC ...
+	 * int3 padding up to HOOK_RELOCATED_LEN - uJumpLen
+	 *
+	 * HOOK_RELOCATED_LEN - uJumpLen: the function bytes the jump to the hook overwrites
+	 *
+	 * The function bytes are never restored by the stub, so the hook stays installed until disabled.
+	 */
+	if (bCounter)
+	{
+		bufHook[0x0] = 0xF0;
+		bufHook[0x1] = 0x48;
+		bufHook[0x2] = 0xFF;
+		bufHook[0x3] = 0x05;
+		*(I32*)&bufHook[0x4] = CalcSignedDisplacement32(aHook + HOOK_COUNTER_PROLOGUE_OFFSET, aHit);
 	}
 	else
 	{
-		bRet = CreateHookAbs64(pTracker, pPool, hProcess);
+		bufHook[0x0] = 0xC6;
+		bufHook[0x1] = 0x05;
+		*(I32*)&bufHook[0x2] = CalcSignedDisplacement32(aHook + HOOK_INLINE_PROLOGUE_OFFSET, aHit);
+		bufHook[0x6] = 0x01;
+	}
+
+	U32 const uBackOffset = uHeadLen + uPrologueOutLen;
+	BuildJump(&bufHook[uBackOffset], aHook + uBackOffset, aFunction + uTaken, bNear);
+	Memory_Set(&bufHook[uBackOffset + uJumpLen], 0xCC, uCodeEnd - uBackOffset - uJumpLen);
+	Memory_Copy(&bufHook[uCodeEnd], bufFunction, uJumpLen);
+
+	BuildJump(pTracker->u.hook.uJumpBytes, aFunction, aHook, bNear);
+	pTracker->u.hook.uJumpBytesLen = (BYTE)uJumpLen;
+
+	/* Start from zero in case the slot held an older counter or hit. */
+	U64 const uZero = 0;
+	if (!Target_MemoryWrite(hProcess, aHit, &uZero, bCounter ? HOOK_COUNTER_SIZE : 1))
+	{
+		return FALSE;
+	}
+	if (!Target_MemoryWriteFlush(hProcess, aHook, bufHook, sizeof(bufHook)))
+	{
+		return FALSE;
+	}
+
+	pTracker->u.hook.uCountBase = 0;
+	return TRUE;
+}
+
+static BOOL AllocHookRelocated(VECTOR* const pvecPools, INDEX* const pidxPools, POOL_STATS* const pStats, TRACKER* const pTracker, REGION_MAP* const pRegions, PROCESS const hProcess, U32 const uFuncLen, U32 const uPrologueLen)
+{
+	BOOL const bCounter = (TRACKER_TYPE_HOOK_COUNTER == pTracker->eType);
+	POOL_REQUEST request;
+	request.aNear = pTracker->aAddress;
+	request.uNearDistance = DISTANCE_NEAR - HOOK_MAX_LEN;
+	request.uNearLen = HOOK_RELOCATED_LEN;
+	request.uFarLen = HOOK_RELOCATED_LEN;
+	request.uHitLen = bCounter ? HOOK_COUNTER_SIZE : 1;
+
+	BOOL bNear = FALSE;
+	if (!AllocSlots(pTracker, pvecPools, pidxPools, pStats, &request, pRegions, hProcess, &bNear))
+	{
+		return FALSE;
+	}
+	pTracker->u.hook.bRelocated = TRUE;
+
+	POOL const * const pPool = (POOL*)Vector_AddressOf(pvecPools, pTracker->u.hook.uPoolIndex);
+	BOOL const bRet = CreateHookRelocated(pTracker, pPool, bNear, uFuncLen, uPrologueLen, hProcess);
+	if (!bRet)
+	{
+		Hook_Release(pTracker, pvecPools, pidxPools, pStats, pRegions, hProcess);
 	}
 	return bRet;
 }
 
-BOOL Hook_Enable(TRACKER const * const pTracker, PROCESS const hProcess)
+BOOL Hook_CreateCounter(VECTOR* const pvecPools, INDEX* const pidxPools, POOL_STATS* const pStats, TRACKER* const pTracker, REGION_MAP* const pRegions, PROCESS const hProcess, U32 const uPrologueLen)
 {
-	if (NULL == pTracker)
+	if (NULL == pvecPools || NULL == pTracker || uPrologueLen > HOOK_COUNTER_PROLOGUE_MAX)
+	{
+		return FALSE;
+	}
+	return AllocHookRelocated(pvecPools, pidxPools, pStats, pTracker, pRegions, hProcess, 0, uPrologueLen);
+}
+
+void Hook_Release(TRACKER const * const pTracker, VECTOR* const pvecPools, INDEX* const pidxPools, POOL_STATS* const pStats, REGION_MAP* const pRegions, PROCESS const hProcess)
+{
+	if (NULL == pTracker || NULL == pvecPools)
+	{
+		return;
+	}
+	POOL* const pPool = (POOL*)Vector_AddressOf(pvecPools, pTracker->u.hook.uPoolIndex);
+	if (NULL == pPool || 0 == pPool->aStartAddress)
+	{
+		return;
+	}
+
+	BOOL const bCounter = (TRACKER_TYPE_HOOK_COUNTER == pTracker->eType);
+	U32 const uStubLen = pTracker->u.hook.bRelocated
+		? HOOK_RELOCATED_LEN
+		: ((JUMP_REL32_LEN == pTracker->u.hook.uJumpBytesLen) ? HOOK_REL32_LEN : HOOK_ABS64_LEN);
+	Pool_HitFree(pPool, pTracker->u.hook.uHitIndex, bCounter ? HOOK_COUNTER_SIZE : 1);
+	Pool_StubFree(pPool, pStats, pTracker->u.hook.aHookAddress, uStubLen);
+	Pool_ReleaseIfEmpty(pPool, pidxPools, pStats, pRegions, hProcess);
+}
+
+BOOL Hook_Enable(TRACKER const * const pTracker, VECTOR const * const pvecPools, PROCESS const hProcess)
+{
+	if (NULL == pTracker || NULL == pvecPools)
+	{
+		return FALSE;
+	}
+	POOL const * const pPool = (POOL*)Vector_AddressOf(pvecPools, pTracker->u.hook.uPoolIndex);
+	if (NULL == pPool)
 	{
 		return FALSE;
 	}
+	/* Counters accumulate across steps, only one-shot hooks need their hit byte cleared. */
 	BYTE const zero = 0;
-	if (!Target_MemoryWriteFlush(hProcess, pTracker->u.hook.aHookAddress + pTracker->u.hook.uHitOffset, &zero, 1))
+	if (TRACKER_TYPE_HOOK_INLINE == pTracker->eType
+		&& !Target_MemoryWrite(hProcess, pPool->aHitMap + pTracker->u.hook.uHitIndex, &zero, 1))
 	{
 		return FALSE;
 	}
 	return Target_MemoryWriteFlush(hProcess, pTracker->aAddress, pTracker->u.hook.uJumpBytes, pTracker->u.hook.uJumpBytesLen);
 }
 
-BOOL Hook_IsHit(TRACKER* const pTracker, PROCESS const hProcess)
+BOOL Hook_PatchHitClear(TRACKER const * const pTracker, VECTOR const * const pvecPools, U32 const uTag, PATCH_BATCH* const pBatch)
+{
+	/* Same as the first write of Hook_Enable, collected instead of written. */
+	if (NULL == pTracker || NULL == pvecPools)
+	{
+		return FALSE;
+	}
+	if (TRACKER_TYPE_HOOK_INLINE != pTracker->eType)
+	{
+		return TRUE;
+	}
+	POOL const * const pPool = (POOL*)Vector_AddressOf(pvecPools, pTracker->u.hook.uPoolIndex);
+	if (NULL == pPool)
+	{
+		return FALSE;
+	}
+	BYTE const zero = 0;
+	return Target_PatchBatchAdd(pBatch, pPool->aHitMap + pTracker->u.hook.uHitIndex, &zero, 1, uTag);
+}
+
+BOOL Hook_PatchArm(TRACKER const * const pTracker, U32 const uTag, PATCH_BATCH* const pBatch)
 {
 	if (NULL == pTracker)
 	{
 		return FALSE;
 	}
-	BYTE bHit = FALSE;
-	BOOL const bRet = Target_MemoryRead(hProcess, pTracker->u.hook.aHookAddress + pTracker->u.hook.uHitOffset, &bHit, 1);
-	if (bRet && bHit)
+	return Target_PatchBatchAdd(pBatch, pTracker->aAddress, pTracker->u.hook.uJumpBytes, pTracker->u.hook.uJumpBytesLen, uTag);
+}
+
+BOOL Hook_OriginalBytesRead(TRACKER const * const pTracker, PROCESS const hProcess, BYTE* const pOriginalBytes)
+{
+	/* Every stub holds the bytes its jump overwrote, at the offsets documented where the stub is built. */
+	ADDRESS const aHook = pTracker->u.hook.aHookAddress;
+	if (pTracker->u.hook.bRelocated)
+	{
+		U32 const uJumpLen = pTracker->u.hook.uJumpBytesLen;
+		return Target_MemoryRead(hProcess, aHook + HOOK_RELOCATED_LEN - uJumpLen, pOriginalBytes, uJumpLen);
+	}
+
+	BYTE bufHook[HOOK_ABS64_LEN];
+	if (JUMP_REL32_LEN == pTracker->u.hook.uJumpBytesLen)
 	{
-		/* 
-		 * If bHit is true, it means the hook removed itself as part of the hook code.
-		 * We need to force reenable in TrackerAllEnable / show correct info in GUI. 
-		 * Breakpoints do this automatically.
-		 */
-		pTracker->bEnabled = FALSE;
+		if (!Target_MemoryRead(hProcess, aHook, bufHook, 0x18))
+		{
+			return FALSE;
+		}
+		Memory_Copy(pOriginalBytes, &bufHook[0xD], 4);
+		pOriginalBytes[4] = bufHook[0x17];
 		return TRUE;
 	}
-	return FALSE;
+
+	if (!Target_MemoryRead(hProcess, aHook, bufHook, 0x26))
+	{
+		return FALSE;
+	}
+	Memory_Copy(pOriginalBytes, &bufHook[0xA], 8);
+	Memory_Copy(pOriginalBytes + 8, &bufHook[0x1E], JUMP_ABS64_LEN - 8);
+	return TRUE;
+}
+
+BOOL Hook_PatchDisarm(TRACKER const * const pTracker, U32 const uTag, PATCH_BATCH* const pBatch, PROCESS const hProcess)
+{
+	if (NULL == pTracker)
+	{
+		return FALSE;
+	}
+	BYTE bufOriginalBytes[JUMP_MAX_LEN];
+	if (!Hook_OriginalBytesRead(pTracker, hProcess, bufOriginalBytes))
+	{
+		return FALSE;
+	}
+	return Target_PatchBatchAdd(pBatch, pTracker->aAddress, bufOriginalBytes, pTracker->u.hook.uJumpBytesLen, uTag);
+}
+
+BOOL Hook_Disable(TRACKER const * const pTracker, PROCESS const hProcess)
+{
+	if (NULL == pTracker)
+	{
+		return FALSE;
+	}
+
+	/*
+	 * One-shot hooks restore the function themselves once hit, but an armed one must not
+	 * outlive its stub slot. Writing the original bytes is harmless if the stub already did.
+	 */
+	BYTE bufOriginalBytes[JUMP_MAX_LEN];
+	if (!Hook_OriginalBytesRead(pTracker, hProcess, bufOriginalBytes))
+	{
+		return FALSE;
+	}
+	return Target_MemoryWriteFlush(hProcess, pTracker->aAddress, bufOriginalBytes, pTracker->u.hook.uJumpBytesLen);
+}
+
+static void HitMapPack(BYTE const * const pMap, U32 const uChunks, U16* const pBits)
+{
+	/* 16 hit bytes become 16 bits. SSE2 is part of the x86-64 baseline. */
+	__m128i const zero = _mm_setzero_si128();
+	for (U32 i = 0; i < uChunks; i++)
+	{
+		__m128i const chunk = _mm_loadu_si128((__m128i const*)(pMap + (U64)i * HIT_CHUNK_LEN));
+		pBits[i] = (U16)(~_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero)) & 0xFFFF);
+	}
+}
+
+BOOL Hook_SnapshotTake(HIT_SNAPSHOT* const pSnapshot, VECTOR const * const pvecPools, PROCESS const hProcess)
+{
+	pSnapshot->pMaps = NULL;
+	pSnapshot->puFirstByte = NULL;
+	pSnapshot->uPoolCount = 0;
+	if (NULL == pvecPools)
+	{
+		return FALSE;
+	}
+
+	/* Lay the hit maps of all pools out back to back, each padded to whole chunks. */
+	U32 const uPoolCount = pvecPools->uElemCount;
+	U64 uTotalLen = 0;
+	for (U32 i = 0; i < uPoolCount; i++)
+	{
+		POOL const * const pPool = (POOL*)Vector_AddressOf(pvecPools, i);
+		uTotalLen += ((U64)pPool->uHitCount + HIT_CHUNK_LEN - 1) & ~(U64)(HIT_CHUNK_LEN - 1);
+	}
+
+	pSnapshot->puFirstByte = Memory_Alloc(((U64)uPoolCount + 1) * sizeof(U64));
+	pSnapshot->pMaps = Memory_Alloc(uTotalLen + HIT_CHUNK_LEN);
+	if (NULL == pSnapshot->puFirstByte || NULL == pSnapshot->pMaps)
+	{
+		Hook_SnapshotFree(pSnapshot);
+		return FALSE;
+	}
+	pSnapshot->uPoolCount = uPoolCount;
+
+	/* One read per pool. */
+	U64 uOffset = 0;
+	for (U32 i = 0; i < uPoolCount; i++)
+	{
+		POOL const * const pPool = (POOL*)Vector_AddressOf(pvecPools, i);
+		U64 const uPaddedLen = ((U64)pPool->uHitCount + HIT_CHUNK_LEN - 1) & ~(U64)(HIT_CHUNK_LEN - 1);
+		BYTE* const pMap = pSnapshot->pMaps + uOffset;
+		Memory_Set(pMap + pPool->uHitCount, 0, uPaddedLen - pPool->uHitCount);
+		pSnapshot->puFirstByte[i] = uOffset;
+		if (0 != pPool->uHitCount && !Target_MemoryRead(hProcess, pPool->aHitMap, pMap, pPool->uHitCount))
+		{
+			/* Keep the space so the chunks of later pools stay aligned, but never report from it. */
+			Memory_Set(pMap, 0, pPool->uHitCount);
+			pSnapshot->puFirstByte[i] = HIT_SNAPSHOT_UNREAD;
+		}
+		uOffset += uPaddedLen;
+	}
+	return TRUE;
+}
+
+static BOOL SnapshotHitSet(HIT_SNAPSHOT const * const pSnapshot, TRACKER const * const pTracker)
+{
+	/* Only relocated inline hooks, whose hit byte is not reset by re-arming. */
+	if (NULL == pTracker || TRACKER_TYPE_HOOK_INLINE != pTracker->eType || !pTracker->u.hook.bRelocated)
+	{
+		return FALSE;
+	}
+	U32 const uPool = pTracker->u.hook.uPoolIndex;
+	if (uPool >= pSnapshot->uPoolCount || HIT_SNAPSHOT_UNREAD == pSnapshot->puFirstByte[uPool])
+	{
+		return FALSE;
+	}
+	return 0 != pSnapshot->pMaps[pSnapshot->puFirstByte[uPool] + pTracker->u.hook.uHitIndex];
+}
+
+BOOL Hook_SnapshotCount(HIT_SNAPSHOT const * const pSnapshot, TRACKER const * const pTracker, U64* const puCount)
+{
+	if (NULL == pTracker || TRACKER_TYPE_HOOK_COUNTER != pTracker->eType)
+	{
+		return FALSE;
+	}
+	U32 const uPool = pTracker->u.hook.uPoolIndex;
+	if (uPool >= pSnapshot->uPoolCount || HIT_SNAPSHOT_UNREAD == pSnapshot->puFirstByte[uPool])
+	{
+		return FALSE;
+	}
+	/* Pool maps start on chunk boundaries and counters are 8-byte aligned within them. */
+	*puCount = *(U64 const*)(pSnapshot->pMaps + pSnapshot->puFirstByte[uPool] + pTracker->u.hook.uHitIndex);
+	return TRUE;
+}
+
+void Hook_SnapshotFree(HIT_SNAPSHOT* const pSnapshot)
+{
+	Memory_Free(pSnapshot->pMaps);
+	Memory_Free(pSnapshot->puFirstByte);
+	pSnapshot->pMaps = NULL;
+	pSnapshot->puFirstByte = NULL;
+	pSnapshot->uPoolCount = 0;
+}
+
+void Hook_StepBegin(VECTOR const * const pvecPools, TRACKER* const * const ppTrackers, U32 const uCount, PROCESS const hProcess)
+{
+	if (NULL == pvecPools || NULL == ppTrackers || 0 == pvecPools->uElemCount)
+	{
+		return;
+	}
+
+	HIT_SNAPSHOT snapshot;
+	if (!Hook_SnapshotTake(&snapshot, pvecPools, hProcess))
+	{
+		return;
+	}
+
+	/* A counter hook is hit in a step when its count grows past the value seen here. */
+	U32 uStaleHits = 0;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		TRACKER* const pTracker = ppTrackers[i];
+		U64 uCounted = 0;
+		if (Hook_SnapshotCount(&snapshot, pTracker, &uCounted))
+		{
+			pTracker->u.hook.uCountBase = uCounted;
+		}
+		else if (SnapshotHitSet(&snapshot, pTracker))
+		{
+			uStaleHits++;
+		}
+	}
+
+	/* Relocated hooks stay installed, so their hit bytes also record calls made between steps. */
+	PATCH_BATCH batch;
+	if (0 != uStaleHits && Target_PatchBatchInit(&batch, uStaleHits))
+	{
+		BYTE const zero = 0;
+		for (U32 i = 0; i < uCount; i++)
+		{
+			TRACKER const * const pTracker = ppTrackers[i];
+			if (SnapshotHitSet(&snapshot, pTracker))
+			{
+				POOL const * const pPool = (POOL*)Vector_AddressOf(pvecPools, pTracker->u.hook.uPoolIndex);
+				Target_PatchBatchAdd(&batch, pPool->aHitMap + pTracker->u.hook.uHitIndex, &zero, 1, i);
+			}
+		}
+		Target_PatchBatchApply(hProcess, &batch);
+		Target_PatchBatchFree(&batch);
+	}
+
+	Hook_SnapshotFree(&snapshot);
+}
+
+void Hook_CollectHits(VECTOR const * const pvecPools, TRACKER* const * const ppTrackers, U32 const uCount, PROCESS const hProcess)
+{
+	if (NULL == pvecPools || NULL == ppTrackers || 0 == pvecPools->uElemCount)
+	{
+		return;
+	}
+
+	HIT_SNAPSHOT snapshot;
+	if (!Hook_SnapshotTake(&snapshot, pvecPools, hProcess))
+	{
+		return;
+	}
+
+	/* Pack the whole snapshot at once, one U16 per 16 hit bytes. */
+	U32 const uPoolCount = snapshot.uPoolCount;
+	U64 uTotalChunks = 0;
+	for (U32 i = 0; i < uPoolCount; i++)
+	{
+		POOL const * const pPool = (POOL*)Vector_AddressOf(pvecPools, i);
+		uTotalChunks += ((U64)pPool->uHitCount + HIT_CHUNK_LEN - 1) / HIT_CHUNK_LEN;
+	}
+
+	BOOL* const pbPoolHit = Memory_Alloc((U64)uPoolCount * sizeof(BOOL));
+	U16* const pBits = Memory_Alloc((uTotalChunks + 1) * sizeof(U16));
+	if (NULL == pbPoolHit || NULL == pBits)
+	{
+		goto cleanup;
+	}
+	HitMapPack(snapshot.pMaps, (U32)uTotalChunks, pBits);
+
+	U64 uChunk = 0;
+	for (U32 i = 0; i < uPoolCount; i++)
+	{
+		POOL const * const pPool = (POOL*)Vector_AddressOf(pvecPools, i);
+		U64 const uChunks = ((U64)pPool->uHitCount + HIT_CHUNK_LEN - 1) / HIT_CHUNK_LEN;
+		pbPoolHit[i] = FALSE;
+		for (U64 j = 0; j < uChunks && !pbPoolHit[i]; j++)
+		{
+			pbPoolHit[i] = (0 != pBits[uChunk + j]);
+		}
+		uChunk += uChunks;
+	}
+
+	for (U32 i = 0; i < uCount; i++)
+	{
+		TRACKER* const pTracker = ppTrackers[i];
+
+		/* Counter hooks stay installed, their count only has to have moved during the step. */
+		U64 uCounted = 0;
+		if (Hook_SnapshotCount(&snapshot, pTracker, &uCounted))
+		{
+			if (uCounted > pTracker->u.hook.uCountBase)
+			{
+				pTracker->bHit = TRUE;
+			}
+			continue;
+		}
+
+		/* While breakpoints are aware of the Step status when triggered, hooks are not. */
+		if (TRACKER_TYPE_HOOK_INLINE != pTracker->eType || !pTracker->bEnabled)
+		{
+			continue;
+		}
+		U32 const uPool = pTracker->u.hook.uPoolIndex;
+		if (uPool >= uPoolCount || !pbPoolHit[uPool])
+		{
+			continue;
+		}
+		U32 const uHitIndex = pTracker->u.hook.uHitIndex;
+		if (pBits[snapshot.puFirstByte[uPool] / HIT_CHUNK_LEN + uHitIndex / HIT_CHUNK_LEN] & (1U << (uHitIndex % HIT_CHUNK_LEN)))
+		{
+			pTracker->bHit = TRUE;
+			/* 
+			 * A one-shot hook removed itself as part of the hook code.
+			 * We need to force reenable in TrackerAllEnable / show correct info in GUI. 
+			 * Breakpoints do this automatically.
+			 */
+			if (!pTracker->u.hook.bRelocated)
+			{
+				pTracker->bEnabled = FALSE;
+			}
+		}
+	}
+
+cleanup:
+	Memory_Free(pbPoolHit);
+	Memory_Free(pBits);
+	Hook_SnapshotFree(&snapshot);
 }
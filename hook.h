@@ -13,23 +13,85 @@ typedef struct tdTRACKER TRACKER;
 struct tdPOOL;
 typedef struct tdPOOL POOL;
 
+struct tdINDEX;
+typedef struct tdINDEX INDEX;
+
+struct tdPOOL_STATS;
+typedef struct tdPOOL_STATS POOL_STATS;
+
+/*
+ * uHitIndex is the offset of the hook's byte in the pool hit map.
+ * Counter hooks own 8 aligned bytes there instead, holding a 64-bit call count.
+ * bRelocated stubs run the displaced prologue themselves and stay installed once hit.
+ */
 typedef struct tdHOOK {
 	ADDRESS aHookAddress;
-	U32 uJumpBytesLen;
-	U32 uHitOffset;
+	U32 uPoolIndex;
+	U32 uHitIndex;
+	U64 uCountBase;
 	BYTE uJumpBytes[14];
-	BYTE _padding[2];
+	BYTE uJumpBytesLen;
+	BYTE bRelocated;
 } HOOK;
 
+/* Copy of the used part of every pool hit map, taken with one read per pool. */
+typedef struct tdHIT_SNAPSHOT {
+	BYTE* pMaps;
+	U64* puFirstByte;
+	U32 uPoolCount;
+	BYTE _padding[4];
+} HIT_SNAPSHOT;
+
 #define JUMP_REL32_LEN (5)
 #define JUMP_ABS64_LEN (14)
 #define JUMP_MAX_LEN JUMP_ABS64_LEN
-#define HOOK_REL32_LEN (30)
+#define HOOK_REL32_LEN (32)
 #define HOOK_ABS64_LEN (64)
+#define HOOK_MIN_LEN HOOK_REL32_LEN
 #define HOOK_MAX_LEN HOOK_ABS64_LEN
+/*
+ * Relocated stubs hold the prologue rewritten for its new address right after the hit byte or
+ * counter increment, then the jump back. The function bytes overwritten by the jump are kept
+ * in the last uJumpBytesLen bytes of the slot.
+ */
+#define HOOK_RELOCATED_LEN HOOK_MAX_LEN
+#define HOOK_INLINE_PROLOGUE_OFFSET (7)
+#define HOOK_COUNTER_PROLOGUE_OFFSET (8)
+#define HOOK_COUNTER_PROLOGUE_MAX (32)
+#define HOOK_COUNTER_SIZE (8)
+
+/*
+ * uFuncLen is optional, 0 when unknown. The prologue is relocated into the stub when possible,
+ * otherwise uFuncLen has to cover the jump and the stub restores the function bytes itself once hit.
+ * The caller then has to make them writable afterwards.
+ */
+BOOL Hook_Create(VECTOR* pvecPools, INDEX* pidxPools, POOL_STATS* pStats, TRACKER* pTracker, REGION_MAP* pRegions, PROCESS hProcess, U32 uFuncLen);
+/* uPrologueLen 0 lets the decoder pick it. A given one is taken as is if the decoder cannot relocate exactly that much. */
+BOOL Hook_CreateCounter(VECTOR* pvecPools, INDEX* pidxPools, POOL_STATS* pStats, TRACKER* pTracker, REGION_MAP* pRegions, PROCESS hProcess, U32 uPrologueLen);
+BOOL Hook_Enable(TRACKER const * pTracker, VECTOR const* pvecPools, PROCESS hProcess);
+BOOL Hook_Disable(TRACKER const* pTracker, PROCESS hProcess);
+/* The uJumpBytesLen function bytes the jump overwrites, kept in the stub. */
+BOOL Hook_OriginalBytesRead(TRACKER const* pTracker, PROCESS hProcess, BYTE* pOriginalBytes);
+/* Gives the stub slot and hit map entry back to the pool. The hook must not be armed anymore. */
+void Hook_Release(TRACKER const* pTracker, VECTOR* pvecPools, INDEX* pidxPools, POOL_STATS* pStats, REGION_MAP* pRegions, PROCESS hProcess);
+
+/*
+ * Batched variants of Hook_Enable / Hook_Disable. Hit bytes have to be cleared before the
+ * jumps are armed, so they go to a separate batch that is applied first.
+ */
+BOOL Hook_PatchHitClear(TRACKER const* pTracker, VECTOR const* pvecPools, U32 uTag, PATCH_BATCH* pBatch);
+BOOL Hook_PatchArm(TRACKER const* pTracker, U32 uTag, PATCH_BATCH* pBatch);
+BOOL Hook_PatchDisarm(TRACKER const* pTracker, U32 uTag, PATCH_BATCH* pBatch, PROCESS hProcess);
+
+BOOL Hook_SnapshotTake(HIT_SNAPSHOT* pSnapshot, VECTOR const* pvecPools, PROCESS hProcess);
+BOOL Hook_SnapshotCount(HIT_SNAPSHOT const* pSnapshot, TRACKER const* pTracker, U64* puCount);
+void Hook_SnapshotFree(HIT_SNAPSHOT* pSnapshot);
 
-BOOL Hook_Create(VECTOR* pvecPools, TRACKER* pTracker, PROCESS hProcess, U32 uFuncLen);
-BOOL Hook_Enable(TRACKER const * pTracker, PROCESS hProcess);
-BOOL Hook_IsHit(TRACKER* pTracker, PROCESS hProcess);
+/*
+ * Remembers where counters stand and clears the hit bytes that relocated hooks set since the last step.
+ * Both take the live trackers, trackers of other types are skipped.
+ */
+void Hook_StepBegin(VECTOR const* pvecPools, TRACKER* const* ppTrackers, U32 uCount, PROCESS hProcess);
+void Hook_CollectHits(VECTOR const* pvecPools, TRACKER* const* ppTrackers, U32 uCount, PROCESS hProcess);
 
 #endif /* HOOK_H */
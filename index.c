@@ -0,0 +1,328 @@
+#include "index.h"
+
+#define INDEX_NIL (0)
+#define INDEX_MAX_DEPTH (128)
+
+typedef struct tdINDEX_NODE {
+	ADDRESS aKey;
+	U32 uValue;
+	U32 uLeft;
+	U32 uRight;
+	U32 uLevel;
+} INDEX_NODE;
+
+static INDEX_NODE* Index_Node(INDEX const* pIndex, U32 uNode);
+static U32 Index_NodeAlloc(INDEX* pIndex, ADDRESS aKey, U32 uValue);
+static void Index_NodeRelease(INDEX* pIndex, U32 uNode);
+static U32 Index_Skew(INDEX const* pIndex, U32 uNode);
+static U32 Index_Split(INDEX const* pIndex, U32 uNode);
+static U32 Index_DecreaseLevel(INDEX const* pIndex, U32 uNode);
+static U32 Index_InsertAt(INDEX* pIndex, U32 uNode, ADDRESS aKey, U32 uValue, BOOL* pbSuccess);
+static U32 Index_RemoveAt(INDEX* pIndex, U32 uNode, ADDRESS aKey, BOOL* pbFound);
+
+static INDEX_NODE* Index_Node(INDEX const * const pIndex, U32 const uNode)
+{
+	return (INDEX_NODE*)Vector_AddressOf(&(pIndex->vecNodes), uNode);
+}
+
+static U32 Index_NodeAlloc(INDEX* const pIndex, ADDRESS const aKey, U32 const uValue)
+{
+	U32 uNode = pIndex->uFreeHead;
+	if (INDEX_NIL != uNode)
+	{
+		pIndex->uFreeHead = Index_Node(pIndex, uNode)->uLeft;
+	}
+	else
+	{
+		INDEX_NODE const node = { 0 };
+		if (!Vector_PushBackCopy(&(pIndex->vecNodes), &node))
+		{
+			return INDEX_NIL;
+		}
+		uNode = pIndex->vecNodes.uElemCount - 1;
+	}
+
+	INDEX_NODE* const pNode = Index_Node(pIndex, uNode);
+	pNode->aKey = aKey;
+	pNode->uValue = uValue;
+	pNode->uLeft = INDEX_NIL;
+	pNode->uRight = INDEX_NIL;
+	pNode->uLevel = 1;
+	pIndex->uCount++;
+	return uNode;
+}
+
+static void Index_NodeRelease(INDEX* const pIndex, U32 const uNode)
+{
+	INDEX_NODE* const pNode = Index_Node(pIndex, uNode);
+	pNode->uLeft = pIndex->uFreeHead;
+	pNode->uRight = INDEX_NIL;
+	pNode->uLevel = 0;
+	pIndex->uFreeHead = uNode;
+	pIndex->uCount--;
+}
+
+static U32 Index_Skew(INDEX const * const pIndex, U32 const uNode)
+{
+	if (INDEX_NIL == uNode)
+	{
+		return uNode;
+	}
+
+	/* Rotate right when the left child is on the same level (left horizontal link). */
+	INDEX_NODE* const pNode = Index_Node(pIndex, uNode);
+	U32 const uLeft = pNode->uLeft;
+	INDEX_NODE* const pLeft = Index_Node(pIndex, uLeft);
+	if (INDEX_NIL == uLeft || pLeft->uLevel != pNode->uLevel)
+	{
+		return uNode;
+	}
+	pNode->uLeft = pLeft->uRight;
+	pLeft->uRight = uNode;
+	return uLeft;
+}
+
+static U32 Index_Split(INDEX const * const pIndex, U32 const uNode)
+{
+	if (INDEX_NIL == uNode)
+	{
+		return uNode;
+	}
+
+	/* Rotate left and promote when there are two consecutive right horizontal links. */
+	INDEX_NODE* const pNode = Index_Node(pIndex, uNode);
+	U32 const uRight = pNode->uRight;
+	INDEX_NODE* const pRight = Index_Node(pIndex, uRight);
+	if (INDEX_NIL == uRight || INDEX_NIL == pRight->uRight)
+	{
+		return uNode;
+	}
+	if (Index_Node(pIndex, pRight->uRight)->uLevel != pNode->uLevel)
+	{
+		return uNode;
+	}
+	pNode->uRight = pRight->uLeft;
+	pRight->uLeft = uNode;
+	pRight->uLevel++;
+	return uRight;
+}
+
+static U32 Index_DecreaseLevel(INDEX const * const pIndex, U32 const uNode)
+{
+	INDEX_NODE* const pNode = Index_Node(pIndex, uNode);
+	U32 const uLeftLevel = Index_Node(pIndex, pNode->uLeft)->uLevel;
+	U32 const uRightLevel = Index_Node(pIndex, pNode->uRight)->uLevel;
+	U32 const uShouldBe = ((uLeftLevel < uRightLevel) ? uLeftLevel : uRightLevel) + 1;
+	if (uShouldBe < pNode->uLevel)
+	{
+		pNode->uLevel = uShouldBe;
+		if (INDEX_NIL != pNode->uRight && uShouldBe < uRightLevel)
+		{
+			Index_Node(pIndex, pNode->uRight)->uLevel = uShouldBe;
+		}
+	}
+	return uNode;
+}
+
+static U32 Index_InsertAt(INDEX* const pIndex, U32 uNode, ADDRESS const aKey, U32 const uValue, BOOL* const pbSuccess)
+{
+	if (INDEX_NIL == uNode)
+	{
+		U32 const uNew = Index_NodeAlloc(pIndex, aKey, uValue);
+		*pbSuccess = (INDEX_NIL != uNew);
+		return uNew;
+	}
+
+	/* Child links are written back by index once the recursive insert has placed the new node. */
+	ADDRESS const aNodeKey = Index_Node(pIndex, uNode)->aKey;
+	if (aKey < aNodeKey)
+	{
+		U32 const uLeft = Index_InsertAt(pIndex, Index_Node(pIndex, uNode)->uLeft, aKey, uValue, pbSuccess);
+		Index_Node(pIndex, uNode)->uLeft = uLeft;
+	}
+	else if (aKey > aNodeKey)
+	{
+		U32 const uRight = Index_InsertAt(pIndex, Index_Node(pIndex, uNode)->uRight, aKey, uValue, pbSuccess);
+		Index_Node(pIndex, uNode)->uRight = uRight;
+	}
+	else
+	{
+		Index_Node(pIndex, uNode)->uValue = uValue;
+		*pbSuccess = TRUE;
+		return uNode;
+	}
+
+	uNode = Index_Skew(pIndex, uNode);
+	uNode = Index_Split(pIndex, uNode);
+	return uNode;
+}
+
+static U32 Index_RemoveAt(INDEX* const pIndex, U32 uNode, ADDRESS const aKey, BOOL* const pbFound)
+{
+	if (INDEX_NIL == uNode)
+	{
+		return uNode;
+	}
+
+	INDEX_NODE* pNode = Index_Node(pIndex, uNode);
+	if (aKey > pNode->aKey)
+	{
+		pNode->uRight = Index_RemoveAt(pIndex, pNode->uRight, aKey, pbFound);
+	}
+	else if (aKey < pNode->aKey)
+	{
+		pNode->uLeft = Index_RemoveAt(pIndex, pNode->uLeft, aKey, pbFound);
+	}
+	else
+	{
+		*pbFound = TRUE;
+		if (INDEX_NIL == pNode->uLeft && INDEX_NIL == pNode->uRight)
+		{
+			Index_NodeRelease(pIndex, uNode);
+			return INDEX_NIL;
+		}
+
+		/* Replace the key with its in-order neighbour and remove that one from the subtree instead. */
+		BOOL bIgnored = FALSE;
+		if (INDEX_NIL == pNode->uLeft)
+		{
+			U32 uSuccessor = pNode->uRight;
+			while (INDEX_NIL != Index_Node(pIndex, uSuccessor)->uLeft)
+			{
+				uSuccessor = Index_Node(pIndex, uSuccessor)->uLeft;
+			}
+			INDEX_NODE const successor = *Index_Node(pIndex, uSuccessor);
+			pNode->uRight = Index_RemoveAt(pIndex, pNode->uRight, successor.aKey, &bIgnored);
+			pNode->aKey = successor.aKey;
+			pNode->uValue = successor.uValue;
+		}
+		else
+		{
+			U32 uPredecessor = pNode->uLeft;
+			while (INDEX_NIL != Index_Node(pIndex, uPredecessor)->uRight)
+			{
+				uPredecessor = Index_Node(pIndex, uPredecessor)->uRight;
+			}
+			INDEX_NODE const predecessor = *Index_Node(pIndex, uPredecessor);
+			pNode->uLeft = Index_RemoveAt(pIndex, pNode->uLeft, predecessor.aKey, &bIgnored);
+			pNode->aKey = predecessor.aKey;
+			pNode->uValue = predecessor.uValue;
+		}
+	}
+
+	/* Rebalance: decrease the level of this node and restore the AA-tree invariants along the right spine. */
+	uNode = Index_DecreaseLevel(pIndex, uNode);
+	uNode = Index_Skew(pIndex, uNode);
+	pNode = Index_Node(pIndex, uNode);
+	pNode->uRight = Index_Skew(pIndex, pNode->uRight);
+	if (INDEX_NIL != pNode->uRight)
+	{
+		INDEX_NODE* const pRight = Index_Node(pIndex, pNode->uRight);
+		pRight->uRight = Index_Skew(pIndex, pRight->uRight);
+	}
+	uNode = Index_Split(pIndex, uNode);
+	pNode = Index_Node(pIndex, uNode);
+	pNode->uRight = Index_Split(pIndex, pNode->uRight);
+	return uNode;
+}
+
+BOOL Index_Init(INDEX* const pIndex, U32 const uInitialCapacity)
+{
+	/* One extra slot for the nil sentinel. */
+	if (!Vector_Init(&(pIndex->vecNodes), sizeof(INDEX_NODE), uInitialCapacity + 1))
+	{
+		return FALSE;
+	}
+
+	INDEX_NODE const nil = { 0 };
+	if (!Vector_PushBackCopy(&(pIndex->vecNodes), &nil))
+	{
+		Vector_Free(&(pIndex->vecNodes));
+		return FALSE;
+	}
+
+	pIndex->uRoot = INDEX_NIL;
+	pIndex->uFreeHead = INDEX_NIL;
+	pIndex->uCount = 0;
+	return TRUE;
+}
+
+BOOL Index_Reserve(INDEX* const pIndex, U32 const uCapacity)
+{
+	return Vector_Reserve(&(pIndex->vecNodes), uCapacity + 1);
+}
+
+BOOL Index_Insert(INDEX* const pIndex, ADDRESS const aKey, U32 const uValue)
+{
+	BOOL bSuccess = FALSE;
+	pIndex->uRoot = Index_InsertAt(pIndex, pIndex->uRoot, aKey, uValue, &bSuccess);
+	return bSuccess;
+}
+
+BOOL Index_Find(INDEX const * const pIndex, ADDRESS const aKey, U32* const puValue)
+{
+	U32 uNode = pIndex->uRoot;
+	while (INDEX_NIL != uNode)
+	{
+		INDEX_NODE const * const pNode = Index_Node(pIndex, uNode);
+		if (aKey == pNode->aKey)
+		{
+			*puValue = pNode->uValue;
+			return TRUE;
+		}
+		uNode = (aKey < pNode->aKey) ? pNode->uLeft : pNode->uRight;
+	}
+	return FALSE;
+}
+
+BOOL Index_Remove(INDEX* const pIndex, ADDRESS const aKey)
+{
+	BOOL bFound = FALSE;
+	pIndex->uRoot = Index_RemoveAt(pIndex, pIndex->uRoot, aKey, &bFound);
+	return bFound;
+}
+
+void Index_VisitRange(INDEX const * const pIndex, ADDRESS const aLow, ADDRESS const aHigh, INDEX_VISIT_FUNC const fnVisit, void* const pParam)
+{
+	/* In-order walk that skips every subtree lying entirely below aLow. AA-tree height is bounded by 2*log2(n). */
+	U32 auStack[INDEX_MAX_DEPTH];
+	U32 uDepth = 0;
+	U32 uNode = pIndex->uRoot;
+	for (;;)
+	{
+		while (INDEX_NIL != uNode)
+		{
+			INDEX_NODE const * const pNode = Index_Node(pIndex, uNode);
+			if (pNode->aKey < aLow)
+			{
+				uNode = pNode->uRight;
+				continue;
+			}
+			if (uDepth >= INDEX_MAX_DEPTH)
+			{
+				return;
+			}
+			auStack[uDepth++] = uNode;
+			uNode = pNode->uLeft;
+		}
+		if (0 == uDepth)
+		{
+			return;
+		}
+
+		INDEX_NODE const * const pNode = Index_Node(pIndex, auStack[--uDepth]);
+		if (pNode->aKey > aHigh || !fnVisit(pParam, pNode->aKey, pNode->uValue))
+		{
+			return;
+		}
+		uNode = pNode->uRight;
+	}
+}
+
+BOOL Index_Free(INDEX* const pIndex)
+{
+	pIndex->uRoot = INDEX_NIL;
+	pIndex->uFreeHead = INDEX_NIL;
+	pIndex->uCount = 0;
+	return Vector_Free(&(pIndex->vecNodes));
+}
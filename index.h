@@ -0,0 +1,32 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "types.h"
+#include "vector.h"
+
+/*
+ * Ordered ADDRESS -> U32 map (AA-tree).
+ * Nodes live in a VECTOR and link to each other by index, so growing
+ * the node storage never invalidates the tree. Node 0 is the nil sentinel.
+ */
+typedef struct tdINDEX {
+	VECTOR vecNodes;
+	U32 uRoot;
+	U32 uFreeHead;
+	U32 uCount;
+	BYTE _padding[4];
+} INDEX;
+
+/* Return FALSE to stop the visit. */
+typedef BOOL (*INDEX_VISIT_FUNC)(void* pParam, ADDRESS aKey, U32 uValue);
+
+BOOL Index_Init(INDEX* pIndex, U32 uInitialCapacity);
+/* Makes room for uCapacity keys in total, so the next inserts up to it cannot fail for lack of memory. */
+BOOL Index_Reserve(INDEX* pIndex, U32 uCapacity);
+BOOL Index_Insert(INDEX* pIndex, ADDRESS aKey, U32 uValue);
+BOOL Index_Find(INDEX const* pIndex, ADDRESS aKey, U32* puValue);
+BOOL Index_Remove(INDEX* pIndex, ADDRESS aKey);
+void Index_VisitRange(INDEX const* pIndex, ADDRESS aLow, ADDRESS aHigh, INDEX_VISIT_FUNC fnVisit, void* pParam);
+BOOL Index_Free(INDEX* pIndex);
+
+#endif /* INDEX_H */
@@ -0,0 +1,230 @@
+#include "lookup.h"
+
+/* 2^64 divided by the golden ratio, spreads aligned addresses over the high bits. */
+#define LOOKUP_HASH_MULTIPLIER (0x9E3779B97F4A7C15ULL)
+
+typedef struct tdLOOKUP_ENTRY {
+	U64 volatile uKey;
+	U64 volatile uValue;
+} LOOKUP_ENTRY;
+
+struct tdLOOKUP_TABLE {
+	LOOKUP_ENTRY* pEntries;
+	LOOKUP_TABLE* pNextRetired;
+	U64 uMask;
+	U32 uShift;
+	BYTE _padding[4];
+};
+
+static BOOL Lookup_Fits(U64 uCapacity, U64 uKeys);
+static U64 Lookup_CapacityFor(U64 uKeys);
+static LOOKUP_TABLE* Lookup_TableAlloc(U64 uCapacity);
+static LOOKUP_TABLE* Lookup_TableGet(LOOKUP const* pLookup);
+static LOOKUP_ENTRY* Lookup_Probe(LOOKUP_TABLE const* pTable, ADDRESS aKey);
+static BOOL Lookup_Grow(LOOKUP* pLookup, U64 uCapacity);
+
+static BOOL Lookup_Fits(U64 const uCapacity, U64 const uKeys)
+{
+	/* At most three quarters full, so every probe ends on a free entry soon. */
+	return uKeys * 4 <= uCapacity * 3;
+}
+
+static U64 Lookup_CapacityFor(U64 const uKeys)
+{
+	U64 uCapacity = LOOKUP_MIN_CAPACITY;
+	while (!Lookup_Fits(uCapacity, uKeys))
+	{
+		uCapacity <<= 1;
+	}
+	return uCapacity;
+}
+
+static LOOKUP_TABLE* Lookup_TableAlloc(U64 const uCapacity)
+{
+	LOOKUP_TABLE* const pTable = Memory_Alloc(sizeof(LOOKUP_TABLE) + uCapacity * sizeof(LOOKUP_ENTRY));
+	if (NULL == pTable)
+	{
+		return NULL;
+	}
+	pTable->pEntries = (LOOKUP_ENTRY*)(pTable + 1);
+	pTable->pNextRetired = NULL;
+	pTable->uMask = uCapacity - 1;
+	pTable->uShift = 64;
+	for (U64 uBit = 1; uBit < uCapacity; uBit <<= 1)
+	{
+		pTable->uShift--;
+	}
+	Memory_Set(pTable->pEntries, 0, uCapacity * sizeof(LOOKUP_ENTRY));
+	return pTable;
+}
+
+static LOOKUP_TABLE* Lookup_TableGet(LOOKUP const * const pLookup)
+{
+	return (LOOKUP_TABLE*)Atomic_LoadAcquire(&(pLookup->uTable));
+}
+
+static LOOKUP_ENTRY* Lookup_Probe(LOOKUP_TABLE const * const pTable, ADDRESS const aKey)
+{
+	/* The table is never full, so the probe ends on the key or on the free entry it would go to. */
+	U64 i = (aKey * LOOKUP_HASH_MULTIPLIER) >> pTable->uShift;
+	for (;;)
+	{
+		LOOKUP_ENTRY* const pEntry = &(pTable->pEntries[i]);
+		U64 const uKey = Atomic_LoadAcquire(&(pEntry->uKey));
+		if (aKey == uKey || 0 == uKey)
+		{
+			return pEntry;
+		}
+		i = (i + 1) & pTable->uMask;
+	}
+}
+
+static BOOL Lookup_Grow(LOOKUP* const pLookup, U64 const uCapacity)
+{
+	LOOKUP_TABLE* const pOld = Lookup_TableGet(pLookup);
+	LOOKUP_TABLE* const pNew = Lookup_TableAlloc(uCapacity);
+	if (NULL == pNew)
+	{
+		return FALSE;
+	}
+
+	/* Removed keys are left behind. Nobody reads the new table before it is published. */
+	for (U64 i = 0; i <= pOld->uMask; i++)
+	{
+		LOOKUP_ENTRY const * const pEntry = &(pOld->pEntries[i]);
+		if (0 == pEntry->uKey || 0 == pEntry->uValue)
+		{
+			continue;
+		}
+		LOOKUP_ENTRY* const pDest = Lookup_Probe(pNew, pEntry->uKey);
+		pDest->uKey = pEntry->uKey;
+		pDest->uValue = pEntry->uValue;
+	}
+
+	/* A reader that loaded the old table before this still finds every key it had. */
+	Atomic_StoreRelease(&(pLookup->uTable), (U64)pNew);
+	pOld->pNextRetired = pLookup->pRetired;
+	pLookup->pRetired = pOld;
+	pLookup->uUsed = pLookup->uLive;
+	return TRUE;
+}
+
+BOOL Lookup_Init(LOOKUP* const pLookup, U32 const uInitialCapacity)
+{
+	LOOKUP_TABLE* const pTable = Lookup_TableAlloc(Lookup_CapacityFor(uInitialCapacity));
+	if (NULL == pTable)
+	{
+		return FALSE;
+	}
+	pLookup->uTable = (U64)pTable;
+	pLookup->pRetired = NULL;
+	pLookup->uUsed = 0;
+	pLookup->uLive = 0;
+	return TRUE;
+}
+
+BOOL Lookup_Reserve(LOOKUP* const pLookup, U32 const uCapacity)
+{
+	/* New keys take free entries, so the removed ones still in the table count against the room. */
+	LOOKUP_TABLE const * const pTable = Lookup_TableGet(pLookup);
+	U64 const uAdded = (uCapacity > pLookup->uLive) ? (U64)uCapacity - pLookup->uLive : 0;
+	if (Lookup_Fits(pTable->uMask + 1, pLookup->uUsed + uAdded))
+	{
+		return TRUE;
+	}
+	return Lookup_Grow(pLookup, Lookup_CapacityFor(pLookup->uLive + uAdded));
+}
+
+BOOL Lookup_Insert(LOOKUP* const pLookup, ADDRESS const aKey, void* const pValue)
+{
+	if (0 == aKey || NULL == pValue)
+	{
+		return FALSE;
+	}
+
+	LOOKUP_ENTRY* pEntry = Lookup_Probe(Lookup_TableGet(pLookup), aKey);
+	if (aKey == pEntry->uKey)
+	{
+		if (0 == pEntry->uValue)
+		{
+			pLookup->uLive++;
+		}
+		Atomic_StoreRelease(&(pEntry->uValue), (U64)pValue);
+		return TRUE;
+	}
+
+	if (!Lookup_Reserve(pLookup, pLookup->uLive + 1))
+	{
+		return FALSE;
+	}
+	pEntry = Lookup_Probe(Lookup_TableGet(pLookup), aKey);
+	Atomic_StoreRelease(&(pEntry->uValue), (U64)pValue);
+	Atomic_StoreRelease(&(pEntry->uKey), aKey);
+	pLookup->uUsed++;
+	pLookup->uLive++;
+	return TRUE;
+}
+
+void Lookup_Remove(LOOKUP* const pLookup, ADDRESS const aKey)
+{
+	if (0 == aKey)
+	{
+		return;
+	}
+	LOOKUP_ENTRY* const pEntry = Lookup_Probe(Lookup_TableGet(pLookup), aKey);
+	if (aKey != pEntry->uKey || 0 == pEntry->uValue)
+	{
+		return;
+	}
+	/* The key stays, it may be part of the probe sequence of others. */
+	Atomic_StoreRelease(&(pEntry->uValue), 0);
+	pLookup->uLive--;
+}
+
+void* Lookup_Find(LOOKUP const * const pLookup, ADDRESS const aKey)
+{
+	if (0 == aKey)
+	{
+		return NULL;
+	}
+	LOOKUP_ENTRY const * const pEntry = Lookup_Probe(Lookup_TableGet(pLookup), aKey);
+	if (aKey != pEntry->uKey)
+	{
+		return NULL;
+	}
+	return (void*)Atomic_LoadAcquire(&(pEntry->uValue));
+}
+
+void Lookup_Visit(LOOKUP const * const pLookup, LOOKUP_VISIT_FUNC const fnVisit, void* const pParam)
+{
+	LOOKUP_TABLE const * const pTable = Lookup_TableGet(pLookup);
+	for (U64 i = 0; i <= pTable->uMask; i++)
+	{
+		LOOKUP_ENTRY const * const pEntry = &(pTable->pEntries[i]);
+		ADDRESS const aKey = Atomic_LoadAcquire(&(pEntry->uKey));
+		void* const pValue = (0 == aKey) ? NULL : (void*)Atomic_LoadAcquire(&(pEntry->uValue));
+		if (NULL != pValue && !fnVisit(pParam, aKey, pValue))
+		{
+			return;
+		}
+	}
+}
+
+void Lookup_Reclaim(LOOKUP* const pLookup)
+{
+	while (NULL != pLookup->pRetired)
+	{
+		LOOKUP_TABLE* const pTable = pLookup->pRetired;
+		pLookup->pRetired = pTable->pNextRetired;
+		Memory_Free(pTable);
+	}
+}
+
+void Lookup_Free(LOOKUP* const pLookup)
+{
+	Lookup_Reclaim(pLookup);
+	Memory_Free(Lookup_TableGet(pLookup));
+	pLookup->uTable = 0;
+	pLookup->uUsed = 0;
+	pLookup->uLive = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef LOOKUP_H
+#define LOOKUP_H
+
+#include "types.h"
+#include "os.h"
+
+#define LOOKUP_MIN_CAPACITY (16)
+
+struct tdLOOKUP_TABLE;
+typedef struct tdLOOKUP_TABLE LOOKUP_TABLE;
+
+/*
+ * Unordered ADDRESS -> pointer map (open addressing, linear probing) that one writer changes while
+ * any number of readers look up, without locks on either side. Key 0 marks a free entry and cannot
+ * be stored. An entry gets its value before its key is published, removal only clears the value, so
+ * a reader sees an entry either whole or not at all. Growing copies the live entries into a new table
+ * and publishes it; the old one may still be read and is only freed by Lookup_Reclaim.
+ */
+typedef struct tdLOOKUP {
+	U64 volatile uTable; /* LOOKUP_TABLE*, read with Atomic_LoadAcquire */
+	LOOKUP_TABLE* pRetired;
+	U32 uUsed; /* keys in the table, removed ones included */
+	U32 uLive;
+} LOOKUP;
+
+/* Return FALSE to stop the visit. */
+typedef BOOL (*LOOKUP_VISIT_FUNC)(void* pParam, ADDRESS aKey, void* pValue);
+
+BOOL Lookup_Init(LOOKUP* pLookup, U32 uInitialCapacity);
+
+/* Writer side, one thread at a time. Insert replaces the value of a key that is already there. */
+BOOL Lookup_Reserve(LOOKUP* pLookup, U32 uCapacity);
+BOOL Lookup_Insert(LOOKUP* pLookup, ADDRESS aKey, void* pValue);
+void Lookup_Remove(LOOKUP* pLookup, ADDRESS aKey);
+
+/* Reader side, safe from any thread at any time between Lookup_Init and Lookup_Free. */
+void* Lookup_Find(LOOKUP const* pLookup, ADDRESS aKey);
+void Lookup_Visit(LOOKUP const* pLookup, LOOKUP_VISIT_FUNC fnVisit, void* pParam);
+
+/* Frees the tables replaced by growth. Only when no reader can still hold one of them. */
+void Lookup_Reclaim(LOOKUP* pLookup);
+void Lookup_Free(LOOKUP* pLookup);
+
+#endif /* LOOKUP_H */
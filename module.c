@@ -0,0 +1,913 @@
+#include "module.h"
+#include "sort.h"
+
+/* Only the fields we need, at their offsets in the image. Windows and ELF headers are not available on both platforms. */
+#define MODULE_PE_LFANEW (0x3C)
+#define MODULE_PE_SIGNATURE (0x00004550) /* "PE\0\0" */
+#define MODULE_PE_FILE_HEADER_LEN (24) /* signature and IMAGE_FILE_HEADER */
+#define MODULE_PE_MAGIC_64 (0x20B)
+#define MODULE_PE_SECTION_LEN (40)
+#define MODULE_PE_SCN_MEM_EXECUTE (0x20000000)
+#define MODULE_PE_DIRECTORY_EXPORT (0)
+#define MODULE_PE_DIRECTORY_EXCEPTION (3)
+#define MODULE_PE_RUNTIME_FUNCTION_LEN (12)
+#define MODULE_PE_UNW_FLAG_CHAININFO (0x04)
+
+#define MODULE_ELF_MAGIC (0x464C457F) /* "\x7fELF" */
+#define MODULE_ELF_CLASS_64 (2)
+#define MODULE_ELF_HEADER_LEN (64)
+#define MODULE_ELF_PT_LOAD (1)
+#define MODULE_ELF_PT_DYNAMIC (2)
+#define MODULE_ELF_PT_GNU_EH_FRAME (0x6474E550)
+#define MODULE_ELF_PF_X (1)
+#define MODULE_ELF_DT_NULL (0)
+#define MODULE_ELF_DT_HASH (4)
+#define MODULE_ELF_DT_SYMTAB (6)
+#define MODULE_ELF_DT_GNU_HASH (0x6FFFFEF5)
+#define MODULE_ELF_SYM_LEN (24)
+#define MODULE_ELF_STT_FUNC (2)
+#define MODULE_ELF_GNU_HASH_CHUNK (64)
+
+/* DWARF pointer encodings used by .eh_frame. */
+#define MODULE_DW_EH_PE_OMIT (0xFF)
+#define MODULE_DW_EH_PE_FORMAT (0x0F)
+#define MODULE_DW_EH_PE_APPLICATION (0x70)
+#define MODULE_DW_EH_PE_INDIRECT (0x80)
+#define MODULE_DW_EH_PE_ABSPTR (0x00)
+#define MODULE_DW_EH_PE_ULEB128 (0x01)
+#define MODULE_DW_EH_PE_UDATA2 (0x02)
+#define MODULE_DW_EH_PE_UDATA4 (0x03)
+#define MODULE_DW_EH_PE_UDATA8 (0x04)
+#define MODULE_DW_EH_PE_SLEB128 (0x09)
+#define MODULE_DW_EH_PE_SDATA2 (0x0A)
+#define MODULE_DW_EH_PE_SDATA4 (0x0B)
+#define MODULE_DW_EH_PE_SDATA8 (0x0C)
+#define MODULE_DW_EH_PE_PCREL (0x10)
+#define MODULE_DW_EH_PE_DATAREL (0x30)
+
+/* Tables larger than this are treated as corrupt rather than read. */
+#define MODULE_MAX_TABLE_LEN (0x10000000)
+/* Executable sections beyond this are merged into the last range, which keeps the filter a superset. */
+#define MODULE_MAX_EXEC_RANGES (16)
+
+typedef struct tdMODULE_IMAGE {
+	PROCESS hProcess;
+	ADDRESS aBase;
+	ADDRESS aExecLow[MODULE_MAX_EXEC_RANGES];
+	ADDRESS aExecHigh[MODULE_MAX_EXEC_RANGES];
+	U32 uExecCount;
+	BYTE _padding[4];
+} MODULE_IMAGE;
+
+static U32 Module_Read16(BYTE const* p);
+static U32 Module_Read32(BYTE const* p);
+static U64 Module_Read64(BYTE const* p);
+static void* Module_TableRead(PROCESS hProcess, ADDRESS aAddress, U64 uLen);
+static void Module_ExecRangeAdd(MODULE_IMAGE* pImage, ADDRESS aLow, ADDRESS aHigh);
+static BOOL Module_IsExecutable(MODULE_IMAGE const* pImage, ADDRESS aAddress);
+static BOOL Module_Reserve(MODULE_FUNCTIONS* pFunctions, U32 uExtra);
+static void Module_Push(MODULE_FUNCTIONS* pFunctions, MODULE_IMAGE const* pImage, ADDRESS aStart, U64 uLen);
+static int Module_FunctionCompare(void const* pLeft, void const* pRight);
+static void Module_Unique(MODULE_FUNCTIONS* pFunctions);
+static BOOL Module_PeCollect(MODULE_IMAGE* pImage, MODULE_FUNCTIONS* pFunctions);
+static BOOL Module_PeRuntimeFunctionsCollect(MODULE_IMAGE const* pImage, U32 uRva, U32 uSize, MODULE_FUNCTIONS* pFunctions);
+static BOOL Module_PeExportsCollect(MODULE_IMAGE const* pImage, U32 uRva, U32 uSize, MODULE_FUNCTIONS* pFunctions);
+static BOOL Module_ElfCollect(MODULE_IMAGE* pImage, MODULE_FUNCTIONS* pFunctions);
+static BOOL Module_Leb128Read(BYTE const** pp, BYTE const* pEnd, BOOL bSigned, U64* puValue);
+static BOOL Module_EncodedRead(BYTE const** pp, BYTE const* pEnd, BYTE uEncoding, ADDRESS aField, ADDRESS aDataRel, ADDRESS* paValue);
+static BOOL Module_CieEncodingGet(BYTE const* pCie, BYTE const* pEnd, BYTE* puEncoding);
+static BOOL Module_ElfFramesCollect(MODULE_IMAGE const* pImage, ADDRESS aHdr, U64 uHdrLen, BYTE const* pPhdrs, U32 uPhnum, U32 uPhentsize, ADDRESS aBias, MODULE_FUNCTIONS* pFunctions);
+static BOOL Module_ElfSymbolCount(PROCESS hProcess, ADDRESS aHash, BOOL bGnu, U32* puCount);
+static BOOL Module_ElfSymbolsCollect(MODULE_IMAGE const* pImage, ADDRESS aDynamic, U64 uDynamicLen, ADDRESS aBias, ADDRESS aImageEnd, MODULE_FUNCTIONS* pFunctions);
+
+static U32 Module_Read16(BYTE const* const p)
+{
+	return (U32)p[0] | ((U32)p[1] << 8);
+}
+
+static U32 Module_Read32(BYTE const* const p)
+{
+	return (U32)p[0] | ((U32)p[1] << 8) | ((U32)p[2] << 16) | ((U32)p[3] << 24);
+}
+
+static U64 Module_Read64(BYTE const* const p)
+{
+	return (U64)Module_Read32(p) | ((U64)Module_Read32(p + 4) << 32);
+}
+
+static void* Module_TableRead(PROCESS const hProcess, ADDRESS const aAddress, U64 const uLen)
+{
+	if (0 == uLen || uLen > MODULE_MAX_TABLE_LEN)
+	{
+		return NULL;
+	}
+	void* const pTable = Memory_Alloc(uLen);
+	if (NULL == pTable)
+	{
+		return NULL;
+	}
+	if (!Target_MemoryRead(hProcess, aAddress, pTable, uLen))
+	{
+		Memory_Free(pTable);
+		return NULL;
+	}
+	return pTable;
+}
+
+static void Module_ExecRangeAdd(MODULE_IMAGE* const pImage, ADDRESS const aLow, ADDRESS const aHigh)
+{
+	if (aHigh <= aLow)
+	{
+		return;
+	}
+	if (pImage->uExecCount < MODULE_MAX_EXEC_RANGES)
+	{
+		pImage->aExecLow[pImage->uExecCount] = aLow;
+		pImage->aExecHigh[pImage->uExecCount] = aHigh;
+		pImage->uExecCount++;
+		return;
+	}
+
+	U32 const uLast = MODULE_MAX_EXEC_RANGES - 1;
+	pImage->aExecLow[uLast] = (aLow < pImage->aExecLow[uLast]) ? aLow : pImage->aExecLow[uLast];
+	pImage->aExecHigh[uLast] = (aHigh > pImage->aExecHigh[uLast]) ? aHigh : pImage->aExecHigh[uLast];
+}
+
+static BOOL Module_IsExecutable(MODULE_IMAGE const * const pImage, ADDRESS const aAddress)
+{
+	for (U32 i = 0; i < pImage->uExecCount; i++)
+	{
+		if (aAddress >= pImage->aExecLow[i] && aAddress < pImage->aExecHigh[i])
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static BOOL Module_Reserve(MODULE_FUNCTIONS* const pFunctions, U32 const uExtra)
+{
+	U64 const uNeeded = (U64)pFunctions->uCount + uExtra;
+	if (uNeeded <= pFunctions->uCapacity)
+	{
+		return TRUE;
+	}
+	if (uNeeded > (U32)-1 / 2)
+	{
+		return FALSE;
+	}
+
+	MODULE_FUNCTION* const pNew = Memory_Alloc(uNeeded * sizeof(MODULE_FUNCTION));
+	if (NULL == pNew)
+	{
+		return FALSE;
+	}
+	if (NULL != pFunctions->pFunctions)
+	{
+		Memory_Copy(pNew, pFunctions->pFunctions, (U64)pFunctions->uCount * sizeof(MODULE_FUNCTION));
+		Memory_Free(pFunctions->pFunctions);
+	}
+	pFunctions->pFunctions = pNew;
+	pFunctions->uCapacity = (U32)uNeeded;
+	return TRUE;
+}
+
+static void Module_Push(MODULE_FUNCTIONS* const pFunctions, MODULE_IMAGE const * const pImage, ADDRESS const aStart, U64 const uLen)
+{
+	/* Room was reserved from the table sizes, a table that lies about its count only loses entries. */
+	if (pFunctions->uCount == pFunctions->uCapacity || !Module_IsExecutable(pImage, aStart))
+	{
+		return;
+	}
+	MODULE_FUNCTION* const pFunction = &(pFunctions->pFunctions[pFunctions->uCount++]);
+	pFunction->aStart = aStart;
+	pFunction->uLen = (uLen > (U32)-1) ? 0 : (U32)uLen;
+}
+
+static int Module_FunctionCompare(void const * const pLeft, void const * const pRight)
+{
+	ADDRESS const aLeft = ((MODULE_FUNCTION const*)pLeft)->aStart;
+	ADDRESS const aRight = ((MODULE_FUNCTION const*)pRight)->aStart;
+	return (aLeft < aRight) ? -1 : ((aLeft > aRight) ? 1 : 0);
+}
+
+static void Module_Unique(MODULE_FUNCTIONS* const pFunctions)
+{
+	/* The same start usually comes from several tables, keep it once with the longest known length. */
+	Sort_Heap(pFunctions->pFunctions, pFunctions->uCount, sizeof(MODULE_FUNCTION), Module_FunctionCompare);
+	U32 uKept = 0;
+	for (U32 i = 0; i < pFunctions->uCount; i++)
+	{
+		MODULE_FUNCTION const * const pFunction = &(pFunctions->pFunctions[i]);
+		if (0 != uKept && pFunctions->pFunctions[uKept - 1].aStart == pFunction->aStart)
+		{
+			if (pFunction->uLen > pFunctions->pFunctions[uKept - 1].uLen)
+			{
+				pFunctions->pFunctions[uKept - 1].uLen = pFunction->uLen;
+			}
+			continue;
+		}
+		pFunctions->pFunctions[uKept++] = *pFunction;
+	}
+	pFunctions->uCount = uKept;
+}
+
+static BOOL Module_PeCollect(MODULE_IMAGE* const pImage, MODULE_FUNCTIONS* const pFunctions)
+{
+	BYTE dos[MODULE_PE_LFANEW + 4];
+	if (!Target_MemoryRead(pImage->hProcess, pImage->aBase, dos, sizeof(dos)))
+	{
+		return FALSE;
+	}
+	ADDRESS const aNt = pImage->aBase + Module_Read32(&(dos[MODULE_PE_LFANEW]));
+
+	BYTE file[MODULE_PE_FILE_HEADER_LEN];
+	if (!Target_MemoryRead(pImage->hProcess, aNt, file, sizeof(file)) || MODULE_PE_SIGNATURE != Module_Read32(file))
+	{
+		return FALSE;
+	}
+	U32 const uSectionCount = Module_Read16(&(file[6]));
+	U32 const uOptionalLen = Module_Read16(&(file[20]));
+
+	/* Optional header and section table in one read. */
+	BYTE* const pHeaders = Module_TableRead(pImage->hProcess, aNt + MODULE_PE_FILE_HEADER_LEN, (U64)uOptionalLen + (U64)uSectionCount * MODULE_PE_SECTION_LEN);
+	if (NULL == pHeaders)
+	{
+		return FALSE;
+	}
+	if (uOptionalLen < 112 || MODULE_PE_MAGIC_64 != Module_Read16(pHeaders))
+	{
+		Memory_Free(pHeaders);
+		return FALSE;
+	}
+
+	for (U32 i = 0; i < uSectionCount; i++)
+	{
+		BYTE const * const pSection = pHeaders + uOptionalLen + (U64)i * MODULE_PE_SECTION_LEN;
+		if (0 != (Module_Read32(&(pSection[36])) & MODULE_PE_SCN_MEM_EXECUTE))
+		{
+			ADDRESS const aLow = pImage->aBase + Module_Read32(&(pSection[12]));
+			Module_ExecRangeAdd(pImage, aLow, aLow + Module_Read32(&(pSection[8])));
+		}
+	}
+
+	U32 const uDirectoryCount = Module_Read32(&(pHeaders[108]));
+	U32 uExportRva = 0, uExportSize = 0, uExceptionRva = 0, uExceptionSize = 0;
+	if (uDirectoryCount > MODULE_PE_DIRECTORY_EXPORT && uOptionalLen >= 112 + 8 * (MODULE_PE_DIRECTORY_EXPORT + 1))
+	{
+		uExportRva = Module_Read32(&(pHeaders[112 + 8 * MODULE_PE_DIRECTORY_EXPORT]));
+		uExportSize = Module_Read32(&(pHeaders[112 + 8 * MODULE_PE_DIRECTORY_EXPORT + 4]));
+	}
+	if (uDirectoryCount > MODULE_PE_DIRECTORY_EXCEPTION && uOptionalLen >= 112 + 8 * (MODULE_PE_DIRECTORY_EXCEPTION + 1))
+	{
+		uExceptionRva = Module_Read32(&(pHeaders[112 + 8 * MODULE_PE_DIRECTORY_EXCEPTION]));
+		uExceptionSize = Module_Read32(&(pHeaders[112 + 8 * MODULE_PE_DIRECTORY_EXCEPTION + 4]));
+	}
+	Memory_Free(pHeaders);
+
+	BOOL bSuccess = TRUE;
+	if (0 != uExceptionRva && 0 != uExceptionSize)
+	{
+		bSuccess = Module_PeRuntimeFunctionsCollect(pImage, uExceptionRva, uExceptionSize, pFunctions);
+	}
+	if (bSuccess && 0 != uExportRva && 0 != uExportSize)
+	{
+		bSuccess = Module_PeExportsCollect(pImage, uExportRva, uExportSize, pFunctions);
+	}
+	return bSuccess;
+}
+
+static BOOL Module_PeRuntimeFunctionsCollect(MODULE_IMAGE const * const pImage, U32 const uRva, U32 const uSize, MODULE_FUNCTIONS* const pFunctions)
+{
+	U32 const uCount = uSize / MODULE_PE_RUNTIME_FUNCTION_LEN;
+	if (0 == uCount)
+	{
+		return TRUE;
+	}
+	BYTE* const pTable = Module_TableRead(pImage->hProcess, pImage->aBase + uRva, (U64)uCount * MODULE_PE_RUNTIME_FUNCTION_LEN);
+	if (NULL == pTable)
+	{
+		return FALSE;
+	}
+	if (!Module_Reserve(pFunctions, uCount))
+	{
+		Memory_Free(pTable);
+		return FALSE;
+	}
+
+	/* Chained entries describe a part of the function before them. The flag sits in the unwind info, read all of them at once. */
+	U32 uUnwindLow = (U32)-1, uUnwindHigh = 0;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		U32 const uUnwind = Module_Read32(pTable + (U64)i * MODULE_PE_RUNTIME_FUNCTION_LEN + 8);
+		uUnwindLow = (uUnwind < uUnwindLow) ? uUnwind : uUnwindLow;
+		uUnwindHigh = (uUnwind > uUnwindHigh) ? uUnwind : uUnwindHigh;
+	}
+	BYTE* const pUnwind = (uUnwindLow <= uUnwindHigh) ? Module_TableRead(pImage->hProcess, pImage->aBase + uUnwindLow, (U64)uUnwindHigh - uUnwindLow + 1) : NULL;
+
+	for (U32 i = 0; i < uCount; i++)
+	{
+		BYTE const * const pEntry = pTable + (U64)i * MODULE_PE_RUNTIME_FUNCTION_LEN;
+		U32 const uBegin = Module_Read32(pEntry);
+		U32 const uEnd = Module_Read32(pEntry + 4);
+		U32 const uUnwind = Module_Read32(pEntry + 8);
+		/* An odd unwind address points at the RUNTIME_FUNCTION this range shares its unwind data with. */
+		if (0 != (uUnwind & 1))
+		{
+			continue;
+		}
+		if (NULL != pUnwind && 0 != ((pUnwind[uUnwind - uUnwindLow] >> 3) & MODULE_PE_UNW_FLAG_CHAININFO))
+		{
+			continue;
+		}
+		Module_Push(pFunctions, pImage, pImage->aBase + uBegin, (uEnd > uBegin) ? (U64)uEnd - uBegin : 0);
+	}
+
+	if (NULL != pUnwind)
+	{
+		Memory_Free(pUnwind);
+	}
+	Memory_Free(pTable);
+	return TRUE;
+}
+
+static BOOL Module_PeExportsCollect(MODULE_IMAGE const * const pImage, U32 const uRva, U32 const uSize, MODULE_FUNCTIONS* const pFunctions)
+{
+	BYTE directory[40];
+	if (!Target_MemoryRead(pImage->hProcess, pImage->aBase + uRva, directory, sizeof(directory)))
+	{
+		return FALSE;
+	}
+	U32 const uCount = Module_Read32(&(directory[20]));
+	if (0 == uCount)
+	{
+		return TRUE;
+	}
+	BYTE* const pTable = Module_TableRead(pImage->hProcess, pImage->aBase + Module_Read32(&(directory[28])), (U64)uCount * 4);
+	if (NULL == pTable)
+	{
+		return FALSE;
+	}
+	if (!Module_Reserve(pFunctions, uCount))
+	{
+		Memory_Free(pTable);
+		return FALSE;
+	}
+
+	for (U32 i = 0; i < uCount; i++)
+	{
+		U32 const uFunction = Module_Read32(pTable + (U64)i * 4);
+		/* Forwarders point at a string inside the export directory. */
+		if (0 == uFunction || (uFunction >= uRva && uFunction < uRva + uSize))
+		{
+			continue;
+		}
+		Module_Push(pFunctions, pImage, pImage->aBase + uFunction, 0);
+	}
+
+	Memory_Free(pTable);
+	return TRUE;
+}
+
+static BOOL Module_ElfCollect(MODULE_IMAGE* const pImage, MODULE_FUNCTIONS* const pFunctions)
+{
+	BYTE header[MODULE_ELF_HEADER_LEN];
+	if (!Target_MemoryRead(pImage->hProcess, pImage->aBase, header, sizeof(header)) || MODULE_ELF_CLASS_64 != header[4])
+	{
+		return FALSE;
+	}
+	U64 const uPhoff = Module_Read64(&(header[32]));
+	U32 const uPhentsize = Module_Read16(&(header[54]));
+	U32 const uPhnum = Module_Read16(&(header[56]));
+	if (uPhentsize < 56 || 0 == uPhnum)
+	{
+		return FALSE;
+	}
+	BYTE* const pPhdrs = Module_TableRead(pImage->hProcess, pImage->aBase + uPhoff, (U64)uPhnum * uPhentsize);
+	if (NULL == pPhdrs)
+	{
+		return FALSE;
+	}
+
+	/* The first PT_LOAD is mapped at aBase, which gives the load bias for every virtual address in the image. */
+	ADDRESS aLowest = (ADDRESS)-1, aHighest = 0;
+	for (U32 i = 0; i < uPhnum; i++)
+	{
+		BYTE const * const pPhdr = pPhdrs + (U64)i * uPhentsize;
+		if (MODULE_ELF_PT_LOAD == Module_Read32(pPhdr))
+		{
+			ADDRESS const aVaddr = Module_Read64(&(pPhdr[16]));
+			ADDRESS const aEnd = aVaddr + Module_Read64(&(pPhdr[40]));
+			aLowest = (aVaddr < aLowest) ? aVaddr : aLowest;
+			aHighest = (aEnd > aHighest) ? aEnd : aHighest;
+		}
+	}
+	if (aLowest > aHighest)
+	{
+		Memory_Free(pPhdrs);
+		return FALSE;
+	}
+	ADDRESS const aBias = pImage->aBase - (aLowest & ~(ADDRESS)0xFFF);
+
+	ADDRESS aEhFrameHdr = 0, aDynamic = 0;
+	U64 uEhFrameHdrLen = 0, uDynamicLen = 0;
+	for (U32 i = 0; i < uPhnum; i++)
+	{
+		BYTE const * const pPhdr = pPhdrs + (U64)i * uPhentsize;
+		U32 const uType = Module_Read32(pPhdr);
+		ADDRESS const aVaddr = Module_Read64(&(pPhdr[16])) + aBias;
+		U64 const uMemsz = Module_Read64(&(pPhdr[40]));
+		if (MODULE_ELF_PT_LOAD == uType && 0 != (Module_Read32(&(pPhdr[4])) & MODULE_ELF_PF_X))
+		{
+			Module_ExecRangeAdd(pImage, aVaddr, aVaddr + uMemsz);
+		}
+		else if (MODULE_ELF_PT_GNU_EH_FRAME == uType)
+		{
+			aEhFrameHdr = aVaddr;
+			uEhFrameHdrLen = uMemsz;
+		}
+		else if (MODULE_ELF_PT_DYNAMIC == uType)
+		{
+			aDynamic = aVaddr;
+			uDynamicLen = uMemsz;
+		}
+	}
+
+	BOOL bSuccess = TRUE;
+	if (0 != aEhFrameHdr)
+	{
+		bSuccess = Module_ElfFramesCollect(pImage, aEhFrameHdr, uEhFrameHdrLen, pPhdrs, uPhnum, uPhentsize, aBias, pFunctions);
+	}
+	if (bSuccess && 0 != aDynamic)
+	{
+		bSuccess = Module_ElfSymbolsCollect(pImage, aDynamic, uDynamicLen, aBias, aHighest + aBias, pFunctions);
+	}
+	Memory_Free(pPhdrs);
+	return bSuccess;
+}
+
+static BOOL Module_Leb128Read(BYTE const** const pp, BYTE const * const pEnd, BOOL const bSigned, U64* const puValue)
+{
+	U64 uValue = 0;
+	U32 uShift = 0;
+	BYTE uByte = 0;
+	do
+	{
+		if (*pp >= pEnd || uShift >= 64)
+		{
+			return FALSE;
+		}
+		uByte = *((*pp)++);
+		uValue |= (U64)(uByte & 0x7F) << uShift;
+		uShift += 7;
+	} while (0 != (uByte & 0x80));
+
+	if (bSigned && uShift < 64 && 0 != (uByte & 0x40))
+	{
+		uValue |= ~(U64)0 << uShift;
+	}
+	*puValue = uValue;
+	return TRUE;
+}
+
+static BOOL Module_EncodedRead(BYTE const** const pp, BYTE const * const pEnd, BYTE const uEncoding, ADDRESS const aField, ADDRESS const aDataRel, ADDRESS* const paValue)
+{
+	U64 uValue = 0;
+	U32 uLen = 0;
+	switch (uEncoding & MODULE_DW_EH_PE_FORMAT)
+	{
+	case MODULE_DW_EH_PE_ABSPTR:
+	case MODULE_DW_EH_PE_UDATA8:
+	case MODULE_DW_EH_PE_SDATA8:
+		uLen = 8;
+		break;
+	case MODULE_DW_EH_PE_UDATA4:
+	case MODULE_DW_EH_PE_SDATA4:
+		uLen = 4;
+		break;
+	case MODULE_DW_EH_PE_UDATA2:
+	case MODULE_DW_EH_PE_SDATA2:
+		uLen = 2;
+		break;
+	case MODULE_DW_EH_PE_ULEB128:
+	case MODULE_DW_EH_PE_SLEB128:
+		if (!Module_Leb128Read(pp, pEnd, MODULE_DW_EH_PE_SLEB128 == (uEncoding & MODULE_DW_EH_PE_FORMAT), &uValue))
+		{
+			return FALSE;
+		}
+		break;
+	default:
+		return FALSE;
+	}
+
+	if (0 != uLen)
+	{
+		if ((U64)(pEnd - *pp) < uLen)
+		{
+			return FALSE;
+		}
+		uValue = (8 == uLen) ? Module_Read64(*pp) : ((4 == uLen) ? Module_Read32(*pp) : Module_Read16(*pp));
+		if (4 == uLen && MODULE_DW_EH_PE_SDATA4 == (uEncoding & MODULE_DW_EH_PE_FORMAT))
+		{
+			uValue = (U64)(signed long long)(signed int)(U32)uValue;
+		}
+		else if (2 == uLen && MODULE_DW_EH_PE_SDATA2 == (uEncoding & MODULE_DW_EH_PE_FORMAT))
+		{
+			uValue = (U64)(signed long long)(signed short)(U16)uValue;
+		}
+		*pp += uLen;
+	}
+
+	/* Indirect pointers would need another read per entry, text and function relative ones are not used on x86-64. */
+	switch (uEncoding & MODULE_DW_EH_PE_APPLICATION)
+	{
+	case 0:
+		break;
+	case MODULE_DW_EH_PE_PCREL:
+		uValue += aField;
+		break;
+	case MODULE_DW_EH_PE_DATAREL:
+		uValue += aDataRel;
+		break;
+	default:
+		return FALSE;
+	}
+	if (0 != (uEncoding & MODULE_DW_EH_PE_INDIRECT))
+	{
+		return FALSE;
+	}
+	*paValue = uValue;
+	return TRUE;
+}
+
+static BOOL Module_CieEncodingGet(BYTE const * const pCie, BYTE const * const pEnd, BYTE* const puEncoding)
+{
+	/* pCie is just past the CIE id. Without an 'R' augmentation FDE addresses are absolute. */
+	BYTE const* p = pCie;
+	*puEncoding = MODULE_DW_EH_PE_ABSPTR;
+	if (p >= pEnd)
+	{
+		return FALSE;
+	}
+	BYTE const uVersion = *(p++);
+	BYTE const * const pAugmentation = p;
+	while (p < pEnd && 0 != *p)
+	{
+		p++;
+	}
+	if (p >= pEnd)
+	{
+		return FALSE;
+	}
+	p++;
+	if ('z' != pAugmentation[0])
+	{
+		return TRUE;
+	}
+
+	U64 uIgnored = 0;
+	if (!Module_Leb128Read(&p, pEnd, FALSE, &uIgnored) || !Module_Leb128Read(&p, pEnd, TRUE, &uIgnored))
+	{
+		return FALSE;
+	}
+	if (1 == uVersion)
+	{
+		p++;
+	}
+	else if (!Module_Leb128Read(&p, pEnd, FALSE, &uIgnored))
+	{
+		return FALSE;
+	}
+	if (!Module_Leb128Read(&p, pEnd, FALSE, &uIgnored))
+	{
+		return FALSE;
+	}
+
+	for (BYTE const* pChar = pAugmentation + 1; 0 != *pChar; pChar++)
+	{
+		if (p >= pEnd)
+		{
+			return FALSE;
+		}
+		switch (*pChar)
+		{
+		case 'R':
+			*puEncoding = *p;
+			return TRUE;
+		case 'L':
+			p++;
+			break;
+		case 'P':
+		{
+			/* Only the size of the personality pointer matters, the application is irrelevant here. */
+			BYTE const uPersonality = *(p++);
+			ADDRESS aIgnored = 0;
+			if (!Module_EncodedRead(&p, pEnd, uPersonality & MODULE_DW_EH_PE_FORMAT, 0, 0, &aIgnored))
+			{
+				return FALSE;
+			}
+			break;
+		}
+		case 'S':
+		case 'B':
+		case 'G':
+			break;
+		default:
+			return TRUE;
+		}
+	}
+	return TRUE;
+}
+
+static BOOL Module_ElfFramesCollect(MODULE_IMAGE const * const pImage, ADDRESS const aHdr, U64 const uHdrLen, BYTE const * const pPhdrs, U32 const uPhnum, U32 const uPhentsize, ADDRESS const aBias, MODULE_FUNCTIONS* const pFunctions)
+{
+	/* .eh_frame_hdr only gives the start of .eh_frame and the FDE count, the lengths are in the FDEs themselves. */
+	BYTE* const pHdr = Module_TableRead(pImage->hProcess, aHdr, uHdrLen);
+	if (NULL == pHdr)
+	{
+		return FALSE;
+	}
+	BYTE const* p = pHdr + 4;
+	ADDRESS aEhFrame = 0, aFdeCount = 0;
+	BOOL const bHeader = uHdrLen >= 4 && 1 == pHdr[0] && MODULE_DW_EH_PE_OMIT != pHdr[1] &&
+		Module_EncodedRead(&p, pHdr + uHdrLen, pHdr[1], aHdr + (ADDRESS)(p - pHdr), aHdr, &aEhFrame) &&
+		(MODULE_DW_EH_PE_OMIT == pHdr[2] || Module_EncodedRead(&p, pHdr + uHdrLen, pHdr[2], aHdr + (ADDRESS)(p - pHdr), aHdr, &aFdeCount));
+	Memory_Free(pHdr);
+	if (!bHeader)
+	{
+		return TRUE;
+	}
+
+	/* .eh_frame runs up to its zero terminator, at the latest to the end of its segment. */
+	ADDRESS aSegmentEnd = 0;
+	for (U32 i = 0; i < uPhnum; i++)
+	{
+		BYTE const * const pPhdr = pPhdrs + (U64)i * uPhentsize;
+		ADDRESS const aVaddr = Module_Read64(&(pPhdr[16])) + aBias;
+		ADDRESS const aEnd = aVaddr + Module_Read64(&(pPhdr[40]));
+		if (MODULE_ELF_PT_LOAD == Module_Read32(pPhdr) && aEhFrame >= aVaddr && aEhFrame < aEnd)
+		{
+			aSegmentEnd = aEnd;
+			break;
+		}
+	}
+	if (0 == aSegmentEnd)
+	{
+		return TRUE;
+	}
+	U64 const uFrameLen = aSegmentEnd - aEhFrame;
+	BYTE* const pFrame = Module_TableRead(pImage->hProcess, aEhFrame, uFrameLen);
+	if (NULL == pFrame)
+	{
+		return FALSE;
+	}
+	if (!Module_Reserve(pFunctions, (aFdeCount > 0 && aFdeCount < MODULE_MAX_TABLE_LEN) ? (U32)aFdeCount : (U32)(uFrameLen / 16)))
+	{
+		Memory_Free(pFrame);
+		return FALSE;
+	}
+
+	BYTE const * const pEnd = pFrame + uFrameLen;
+	BYTE const* pCieCached = NULL;
+	BYTE uEncoding = MODULE_DW_EH_PE_ABSPTR;
+	BYTE const* pEntry = pFrame;
+	while ((U64)(pEnd - pEntry) >= 4)
+	{
+		U32 const uLen = Module_Read32(pEntry);
+		if (0 == uLen)
+		{
+			break;
+		}
+		/* 64-bit DWARF entries never show up in practice, step over them without parsing. */
+		if ((U32)-1 == uLen)
+		{
+			if ((U64)(pEnd - pEntry) < 12 || Module_Read64(pEntry + 4) > (U64)(pEnd - pEntry) - 12)
+			{
+				break;
+			}
+			pEntry += 12 + Module_Read64(pEntry + 4);
+			continue;
+		}
+		if ((U64)uLen > (U64)(pEnd - pEntry) - 4 || uLen < 4)
+		{
+			break;
+		}
+		BYTE const * const pNext = pEntry + 4 + uLen;
+		U32 const uCiePointer = Module_Read32(pEntry + 4);
+		if (0 != uCiePointer && (U64)uCiePointer <= (U64)(pEntry + 4 - pFrame))
+		{
+			BYTE const * const pCie = pEntry + 4 - uCiePointer;
+			if (pCie != pCieCached)
+			{
+				pCieCached = NULL;
+				if ((U64)(pEnd - pCie) >= 8 && Module_CieEncodingGet(pCie + 8, pEnd, &uEncoding))
+				{
+					pCieCached = pCie;
+				}
+			}
+
+			BYTE const* p = pEntry + 8;
+			ADDRESS aStart = 0, aRange = 0;
+			if (NULL != pCieCached &&
+				Module_EncodedRead(&p, pNext, uEncoding, aEhFrame + (ADDRESS)(p - pFrame), 0, &aStart) &&
+				Module_EncodedRead(&p, pNext, uEncoding & MODULE_DW_EH_PE_FORMAT, 0, 0, &aRange) &&
+				0 != aStart)
+			{
+				Module_Push(pFunctions, pImage, aStart, aRange);
+			}
+		}
+		pEntry = pNext;
+	}
+
+	Memory_Free(pFrame);
+	return TRUE;
+}
+
+static BOOL Module_ElfSymbolCount(PROCESS const hProcess, ADDRESS const aHash, BOOL const bGnu, U32* const puCount)
+{
+	BYTE header[16];
+	if (!Target_MemoryRead(hProcess, aHash, header, bGnu ? 16 : 8))
+	{
+		return FALSE;
+	}
+	if (!bGnu)
+	{
+		/* nchain of the SysV table is the symbol count. */
+		*puCount = Module_Read32(&(header[4]));
+		return TRUE;
+	}
+
+	/* The GNU table only knows the highest bucket start, follow its chain to the last symbol. */
+	U32 const uBucketCount = Module_Read32(&(header[0]));
+	U32 const uSymOffset = Module_Read32(&(header[4]));
+	U32 const uBloomSize = Module_Read32(&(header[8]));
+	ADDRESS const aBuckets = aHash + 16 + (ADDRESS)uBloomSize * 8;
+	BYTE* const pBuckets = Module_TableRead(hProcess, aBuckets, (U64)uBucketCount * 4);
+	if (NULL == pBuckets)
+	{
+		return FALSE;
+	}
+	U32 uLast = 0;
+	for (U32 i = 0; i < uBucketCount; i++)
+	{
+		U32 const uBucket = Module_Read32(pBuckets + (U64)i * 4);
+		uLast = (uBucket > uLast) ? uBucket : uLast;
+	}
+	Memory_Free(pBuckets);
+	if (uLast < uSymOffset)
+	{
+		*puCount = uSymOffset;
+		return TRUE;
+	}
+
+	ADDRESS const aChains = aBuckets + (ADDRESS)uBucketCount * 4;
+	BYTE chunk[MODULE_ELF_GNU_HASH_CHUNK * 4];
+	for (;;)
+	{
+		if (!Target_MemoryRead(hProcess, aChains + (ADDRESS)(uLast - uSymOffset) * 4, chunk, sizeof(chunk)))
+		{
+			/* The chain may end right before unmapped memory, read it one entry at a time. */
+			if (!Target_MemoryRead(hProcess, aChains + (ADDRESS)(uLast - uSymOffset) * 4, chunk, 4))
+			{
+				return FALSE;
+			}
+			if (0 != (Module_Read32(chunk) & 1))
+			{
+				*puCount = uLast + 1;
+				return TRUE;
+			}
+			uLast++;
+			continue;
+		}
+		for (U32 i = 0; i < MODULE_ELF_GNU_HASH_CHUNK; i++, uLast++)
+		{
+			if (0 != (Module_Read32(&(chunk[i * 4])) & 1))
+			{
+				*puCount = uLast + 1;
+				return TRUE;
+			}
+		}
+	}
+}
+
+static BOOL Module_ElfSymbolsCollect(MODULE_IMAGE const * const pImage, ADDRESS const aDynamic, U64 const uDynamicLen, ADDRESS const aBias, ADDRESS const aImageEnd, MODULE_FUNCTIONS* const pFunctions)
+{
+	BYTE* const pDynamic = Module_TableRead(pImage->hProcess, aDynamic, uDynamicLen);
+	if (NULL == pDynamic)
+	{
+		return FALSE;
+	}
+	ADDRESS aSymtab = 0, aHash = 0, aGnuHash = 0;
+	for (U64 uOffset = 0; uOffset + 16 <= uDynamicLen; uOffset += 16)
+	{
+		U64 const uTag = Module_Read64(pDynamic + uOffset);
+		ADDRESS aValue = Module_Read64(pDynamic + uOffset + 8);
+		if (MODULE_ELF_DT_NULL == uTag)
+		{
+			break;
+		}
+		/* The dynamic linker relocates these in place for most objects but not all, rebase only what is outside the image. */
+		if (aValue < pImage->aBase || aValue >= aImageEnd)
+		{
+			aValue += aBias;
+		}
+		if (MODULE_ELF_DT_SYMTAB == uTag)
+		{
+			aSymtab = aValue;
+		}
+		else if (MODULE_ELF_DT_HASH == uTag)
+		{
+			aHash = aValue;
+		}
+		else if (MODULE_ELF_DT_GNU_HASH == uTag)
+		{
+			aGnuHash = aValue;
+		}
+	}
+	Memory_Free(pDynamic);
+
+	U32 uCount = 0;
+	if (0 == aSymtab || (0 == aHash && 0 == aGnuHash))
+	{
+		return TRUE;
+	}
+	if (!Module_ElfSymbolCount(pImage->hProcess, (0 != aGnuHash) ? aGnuHash : aHash, 0 != aGnuHash, &uCount))
+	{
+		return FALSE;
+	}
+	if (0 == uCount)
+	{
+		return TRUE;
+	}
+	BYTE* const pSymbols = Module_TableRead(pImage->hProcess, aSymtab, (U64)uCount * MODULE_ELF_SYM_LEN);
+	if (NULL == pSymbols)
+	{
+		return FALSE;
+	}
+	if (!Module_Reserve(pFunctions, uCount))
+	{
+		Memory_Free(pSymbols);
+		return FALSE;
+	}
+
+	for (U32 i = 0; i < uCount; i++)
+	{
+		BYTE const * const pSymbol = pSymbols + (U64)i * MODULE_ELF_SYM_LEN;
+		ADDRESS const aValue = Module_Read64(&(pSymbol[8]));
+		if (MODULE_ELF_STT_FUNC != (pSymbol[4] & 0x0F) || 0 == Module_Read16(&(pSymbol[6])) || 0 == aValue)
+		{
+			continue;
+		}
+		Module_Push(pFunctions, pImage, aValue + aBias, Module_Read64(&(pSymbol[16])));
+	}
+
+	Memory_Free(pSymbols);
+	return TRUE;
+}
+
+BOOL Module_FunctionsCollect(PROCESS const hProcess, ADDRESS const aBase, MODULE_FUNCTIONS* const pFunctions)
+{
+	pFunctions->pFunctions = NULL;
+	pFunctions->uCount = 0;
+	pFunctions->uCapacity = 0;
+
+	BYTE magic[4];
+	if (!Target_MemoryRead(hProcess, aBase, magic, sizeof(magic)))
+	{
+		return FALSE;
+	}
+
+	MODULE_IMAGE image;
+	Memory_Set(&image, 0, sizeof(image));
+	image.hProcess = hProcess;
+	image.aBase = aBase;
+
+	BOOL bSuccess = FALSE;
+	if ('M' == magic[0] && 'Z' == magic[1])
+	{
+		bSuccess = Module_PeCollect(&image, pFunctions);
+	}
+	else if (MODULE_ELF_MAGIC == Module_Read32(magic))
+	{
+		bSuccess = Module_ElfCollect(&image, pFunctions);
+	}
+	if (!bSuccess)
+	{
+		Module_FunctionsFree(pFunctions);
+		return FALSE;
+	}
+
+	Module_Unique(pFunctions);
+	return TRUE;
+}
+
+void Module_FunctionsFree(MODULE_FUNCTIONS* const pFunctions)
+{
+	if (NULL != pFunctions->pFunctions)
+	{
+		Memory_Free(pFunctions->pFunctions);
+	}
+	pFunctions->pFunctions = NULL;
+	pFunctions->uCount = 0;
+	pFunctions->uCapacity = 0;
+}
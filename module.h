@@ -0,0 +1,31 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "types.h"
+#include "os.h"
+
+/* A function start found in the image of a loaded module. uLen is 0 when the image does not tell the size. */
+typedef struct tdMODULE_FUNCTION {
+	ADDRESS aStart;
+	U32 uLen;
+	BYTE _padding[4];
+} MODULE_FUNCTION;
+
+/* Sorted by address, one entry per start. */
+typedef struct tdMODULE_FUNCTIONS {
+	MODULE_FUNCTION* pFunctions;
+	U32 uCount;
+	U32 uCapacity;
+} MODULE_FUNCTIONS;
+
+/*
+ * Enumerates the functions of the module loaded at aBase, from the tables the loader maps anyway:
+ * for PE the .pdata RUNTIME_FUNCTION table (chained entries are parts of other functions) and the
+ * exports, for ELF the .eh_frame_hdr search table with the ranges of the FDEs and the .dynsym
+ * functions. .symtab is not loaded into memory and cannot be used. Every table is read with one
+ * Target_MemoryRead and only starts inside executable sections are kept.
+ */
+BOOL Module_FunctionsCollect(PROCESS hProcess, ADDRESS aBase, MODULE_FUNCTIONS* pFunctions);
+void Module_FunctionsFree(MODULE_FUNCTIONS* pFunctions);
+
+#endif /* MODULE_H */
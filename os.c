@@ -1,482 +1,3295 @@
+#if defined(LINUX) && !defined(_GNU_SOURCE)
+/* Must come before any system header, the SIMD ones below included. */
+#define _GNU_SOURCE
+#endif
 #include "os.h"
+#include "sort.h"
+
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MEMORY_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define MEMORY_TARGET_AVX2 __attribute__((target("avx2")))
+#endif /* _MSC_VER */
 
 typedef struct tdTHREAD_INIT_INFO {
 	THREAD_INIT_FUNC fnFunc;
 	void* pParam;
 } THREAD_INIT_INFO;
 
-#define INT3_BYTE (0xCC)
-
-#ifdef _WIN32
-
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
-
-BOOL WINAPI DllMain(HANDLE hHandle, DWORD dwReason, LPVOID lpReserved);
-static BOOL Process_EnableDebugPrivilege(void);
-static DWORD WINAPI Thread_Init(void* lpParam);
-static ADDRESS FindPrevFreeRegion(PROCESS hProcess, ADDRESS aAddress, ADDRESS aMin, U32 uAllocationGranularity, U64* puRegionSize);
-static ADDRESS FindNextFreeRegion(PROCESS hProcess, ADDRESS aAddress, ADDRESS aMax, U32 uAllocationGranularity, U64* puRegionSize);
-
-BOOL WINAPI DllMain(HANDLE const hHandle, DWORD const dwReason, LPVOID const lpReserved)
+#define PATCH_PAGE_SIZE (0x1000)
+/* Adjacent patches are merged into runs of at most this many bytes. */
+#define PATCH_RUN_MAX (0x1000)
+/* Spin rounds that only pause before a waiting thread starts yielding, a short hold is over by then. */
+#define THREAD_SPIN_PAUSE_ROUNDS (64)
+
+static int PatchCompare(void const* pLeft, void const* pRight);
+static void PatchBatchSort(PATCH_BATCH* pBatch);
+static U32 PatchRunBuild(PATCH_BATCH const* pBatch, U32 uFirst, U32 uLimit, BYTE* pRun, U64* puRunLen);
+static void PatchRunMark(PATCH_BATCH* pBatch, U32 uFirst, U32 uEnd, BOOL bApplied);
+
+#define MEMORY_CPUID1_ECX_OSXSAVE (1U << 27)
+#define MEMORY_CPUID1_ECX_AVX (1U << 28)
+#define MEMORY_CPUID7_EBX_AVX2 (1U << 5)
+#define MEMORY_XCR0_YMM (0x6)
+
+typedef void* (*MEMORY_COPY_FUNC)(void*, void const*, U64);
+typedef void* (*MEMORY_SET_FUNC)(void*, BYTE, U64);
+typedef int (*MEMORY_COMPARE_FUNC)(void const*, void const*, U64);
+
+static void Memory_Cpuid(U32 uLeaf, U32 uSubLeaf, U32* puRegs);
+static U64 Memory_Xgetbv(void);
+static BOOL Memory_HasAvx2(void);
+static void Memory_Dispatch(void);
+static U32 Memory_LowestBit(U32 uMask);
+static void* Memory_CopyScalar(void* pDest, void const* pSrc, U64 uLen);
+static void* Memory_SetScalar(void* pDest, BYTE uValue, U64 uLen);
+static int Memory_CompareScalar(void const* pLeft, void const* pRight, U64 uLen);
+static void* Memory_CopySse2(void* pDest, void const* pSrc, U64 uLen);
+static void* Memory_SetSse2(void* pDest, BYTE uValue, U64 uLen);
+static int Memory_CompareSse2(void const* pLeft, void const* pRight, U64 uLen);
+static MEMORY_TARGET_AVX2 void* Memory_CopyAvx2(void* pDest, void const* pSrc, U64 uLen);
+static MEMORY_TARGET_AVX2 void* Memory_SetAvx2(void* pDest, BYTE uValue, U64 uLen);
+static MEMORY_TARGET_AVX2 int Memory_CompareAvx2(void const* pLeft, void const* pRight, U64 uLen);
+
+#define REGION_PAGE_SIZE (0x1000)
+#define REGION_MAP_CAPACITY (256)
+
+static U32 RegionMapLowerBound(REGION_MAP const* pRegions, ADDRESS aAddress);
+static BOOL RegionMapGrow(REGION_MAP* pRegions);
+static BOOL RegionMapAppend(REGION_MAP* pRegions, ADDRESS aStart, ADDRESS aEnd);
+static void RegionMapInsert(REGION_MAP* pRegions, ADDRESS aStart, ADDRESS aEnd);
+static void RegionMapRemove(REGION_MAP* pRegions, ADDRESS aStart, ADDRESS aEnd);
+static ADDRESS RegionMapSearch(PROCESS hProcess, REGION_MAP* pRegions, ADDRESS aNear, ADDRESS aMin, ADDRESS aMax, U64 uAlign, U64 uMinimumSize, U64 uMaximumSize, U64* puSize);
+static ADDRESS RegionMapReserveNear(PROCESS hProcess, REGION_MAP* pRegions, ADDRESS aNear, ADDRESS aMin, ADDRESS aMax, U64 uAlign, U64 uMinimumSize, U64 uMaximumSize, U64* puSize);
+static U64 HwBreakpointsDr7(HW_BREAKPOINTS const* pHwBreakpoints);
+/* Per OS: one sweep of the target address space, and a reservation at exactly the given address. */
+static BOOL RegionMapBuild(PROCESS hProcess, REGION_MAP* pRegions);
+static ADDRESS RegionReserveFixed(PROCESS hProcess, ADDRESS aAddress, U64 uLen);
+
+static void* Memory_CopyDispatch(void* pDest, void const* pSrc, U64 uLen);
+static void* Memory_SetDispatch(void* pDest, BYTE uValue, U64 uLen);
+static int Memory_CompareDispatch(void const* pLeft, void const* pRight, U64 uLen);
+
+static MEMORY_COPY_FUNC gfnMemoryCopy = Memory_CopyDispatch;
+static MEMORY_SET_FUNC gfnMemorySet = Memory_SetDispatch;
+static MEMORY_COMPARE_FUNC gfnMemoryCompare = Memory_CompareDispatch;
+
+static void Memory_Cpuid(U32 const uLeaf, U32 const uSubLeaf, U32* const puRegs)
 {
-	(void)lpReserved;
-	if (DLL_PROCESS_ATTACH == dwReason)
+#ifdef _MSC_VER
+	int aiRegs[4];
+	__cpuidex(aiRegs, (int)uLeaf, (int)uSubLeaf);
+	for (U32 i = 0; i < 4; i++)
 	{
-		DisableThreadLibraryCalls((HMODULE)hHandle);
+		puRegs[i] = (U32)aiRegs[i];
 	}
-	return TRUE;
+#else
+	unsigned int a = 0, b = 0, c = 0, d = 0;
+	__cpuid_count(uLeaf, uSubLeaf, a, b, c, d);
+	puRegs[0] = a;
+	puRegs[1] = b;
+	puRegs[2] = c;
+	puRegs[3] = d;
+#endif /* _MSC_VER */
 }
 
-static BOOL Process_EnableDebugPrivilege(void)
+static U64 Memory_Xgetbv(void)
 {
-	HANDLE hToken = NULL;
-	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int uLow = 0, uHigh = 0;
+	__asm__ __volatile__("xgetbv" : "=a"(uLow), "=d"(uHigh) : "c"(0));
+	return ((U64)uHigh << 32) | uLow;
+#endif /* _MSC_VER */
+}
+
+static BOOL Memory_HasAvx2(void)
+{
+	/* The CPU has to report AVX2 and the OS has to save the YMM state (OSXSAVE, XCR0 bits 1 and 2). */
+	U32 auRegs[4];
+	Memory_Cpuid(0, 0, auRegs);
+	if (auRegs[0] < 7)
 	{
 		return FALSE;
 	}
-	LUID luid;
-	if (!LookupPrivilegeValue(NULL, SE_DEBUG_NAME, &luid))
+	Memory_Cpuid(1, 0, auRegs);
+	if (0 == (auRegs[2] & MEMORY_CPUID1_ECX_OSXSAVE) || 0 == (auRegs[2] & MEMORY_CPUID1_ECX_AVX))
 	{
-		CloseHandle(hToken);
 		return FALSE;
 	}
+	if (MEMORY_XCR0_YMM != (Memory_Xgetbv() & MEMORY_XCR0_YMM))
+	{
+		return FALSE;
+	}
+	Memory_Cpuid(7, 0, auRegs);
+	return 0 != (auRegs[1] & MEMORY_CPUID7_EBX_AVX2);
+}
 
-	TOKEN_PRIVILEGES tp;
-	tp.PrivilegeCount = 1;
-	tp.Privileges[0].Luid = luid;
-	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+static void Memory_Dispatch(void)
+{
+	/* Every thread arrives at the same choice, so racing first calls are harmless. */
+	if (Memory_HasAvx2())
+	{
+		gfnMemoryCopy = Memory_CopyAvx2;
+		gfnMemorySet = Memory_SetAvx2;
+		gfnMemoryCompare = Memory_CompareAvx2;
+	}
+	else
+	{
+		gfnMemoryCopy = Memory_CopySse2;
+		gfnMemorySet = Memory_SetSse2;
+		gfnMemoryCompare = Memory_CompareSse2;
+	}
+}
 
-	BOOL const bRes = AdjustTokenPrivileges(hToken, FALSE, &tp, sizeof(TOKEN_PRIVILEGES), NULL, NULL);
-	CloseHandle(hToken);
-	return bRes;
+static void* Memory_CopyDispatch(void* const pDest, void const * const pSrc, U64 const uLen)
+{
+	Memory_Dispatch();
+	return gfnMemoryCopy(pDest, pSrc, uLen);
 }
 
-BOOL Process_CheckPrivileges(void)
+static void* Memory_SetDispatch(void* const pDest, BYTE const uValue, U64 const uLen)
 {
-	return Process_EnableDebugPrivilege();
+	Memory_Dispatch();
+	return gfnMemorySet(pDest, uValue, uLen);
 }
 
-void* Memory_Alloc(U64 const uSize)
+static int Memory_CompareDispatch(void const * const pLeft, void const * const pRight, U64 const uLen)
 {
-    return HeapAlloc(GetProcessHeap(), 0, uSize);
+	Memory_Dispatch();
+	return gfnMemoryCompare(pLeft, pRight, uLen);
 }
 
-BOOL Memory_Free(void* const pAddress)
+static U32 Memory_LowestBit(U32 const uMask)
 {
-    return HeapFree(GetProcessHeap(), 0, pAddress);
+#ifdef _MSC_VER
+	unsigned long uIndex = 0;
+	_BitScanForward(&uIndex, uMask);
+	return (U32)uIndex;
+#else
+	return (U32)__builtin_ctz(uMask);
+#endif /* _MSC_VER */
 }
 
-void* Memory_Copy(void* const pDest, void const * const pSrc, U64 uLen)
+static void* Memory_CopyScalar(void* const pDest, void const * const pSrc, U64 uLen)
 {
-    BYTE* d = pDest;
-    BYTE const* s = pSrc;
-    while (uLen--)
-        *d++ = *s++;
-    return pDest;
+	BYTE* d = pDest;
+	BYTE const* s = pSrc;
+	while (uLen--)
+	{
+		*d++ = *s++;
+	}
+	return pDest;
 }
 
-BOOL Target_Is64bit(PID const pidTarget)
+static void* Memory_SetScalar(void* const pDest, BYTE const uValue, U64 uLen)
 {
-	HANDLE const hProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, pidTarget);
-	if (NULL == hProcess)
+	BYTE* d = pDest;
+	while (uLen--)
 	{
-		return FALSE;
+		*d++ = uValue;
 	}
+	return pDest;
+}
 
-	BOOL bIsWow64bit = FALSE;
-	if (!IsWow64Process(hProcess, &bIsWow64bit))
+static int Memory_CompareScalar(void const * const pLeft, void const * const pRight, U64 const uLen)
+{
+	BYTE const * const l = pLeft;
+	BYTE const * const r = pRight;
+	for (U64 i = 0; i < uLen; i++)
 	{
-		CloseHandle(hProcess);
-		return FALSE;
+		if (l[i] != r[i])
+		{
+			return (l[i] < r[i]) ? -1 : 1;
+		}
 	}
+	return 0;
+}
 
-	CloseHandle(hProcess);
-	return !bIsWow64bit;
+/*
+ * The SIMD variants run whole vectors and finish with one more vector that ends exactly at
+ * the last byte, overlapping bytes already done. Shorter inputs take the next smaller path.
+ */
+static void* Memory_CopySse2(void* const pDest, void const * const pSrc, U64 const uLen)
+{
+	if (uLen < 16)
+	{
+		return Memory_CopyScalar(pDest, pSrc, uLen);
+	}
+	BYTE* const d = pDest;
+	BYTE const * const s = pSrc;
+	U64 i = 0;
+	for (; i + 64 <= uLen; i += 64)
+	{
+		__m128i const x0 = _mm_loadu_si128((__m128i const*)(s + i));
+		__m128i const x1 = _mm_loadu_si128((__m128i const*)(s + i + 16));
+		__m128i const x2 = _mm_loadu_si128((__m128i const*)(s + i + 32));
+		__m128i const x3 = _mm_loadu_si128((__m128i const*)(s + i + 48));
+		_mm_storeu_si128((__m128i*)(d + i), x0);
+		_mm_storeu_si128((__m128i*)(d + i + 16), x1);
+		_mm_storeu_si128((__m128i*)(d + i + 32), x2);
+		_mm_storeu_si128((__m128i*)(d + i + 48), x3);
+	}
+	for (; i + 16 <= uLen; i += 16)
+	{
+		_mm_storeu_si128((__m128i*)(d + i), _mm_loadu_si128((__m128i const*)(s + i)));
+	}
+	if (i < uLen)
+	{
+		_mm_storeu_si128((__m128i*)(d + uLen - 16), _mm_loadu_si128((__m128i const*)(s + uLen - 16)));
+	}
+	return pDest;
 }
 
-BOOL Target_DebuggerAttach(PID const pidTarget)
+static void* Memory_SetSse2(void* const pDest, BYTE const uValue, U64 const uLen)
 {
-	if (!DebugActiveProcess(pidTarget))
+	if (uLen < 16)
 	{
-		return FALSE;
+		return Memory_SetScalar(pDest, uValue, uLen);
 	}
-	if (!DebugSetProcessKillOnExit(FALSE))
+	BYTE* const d = pDest;
+	__m128i const x = _mm_set1_epi8((char)uValue);
+	U64 i = 0;
+	for (; i + 64 <= uLen; i += 64)
 	{
-		DebugActiveProcessStop(pidTarget);
-		return FALSE;
+		_mm_storeu_si128((__m128i*)(d + i), x);
+		_mm_storeu_si128((__m128i*)(d + i + 16), x);
+		_mm_storeu_si128((__m128i*)(d + i + 32), x);
+		_mm_storeu_si128((__m128i*)(d + i + 48), x);
 	}
-	return TRUE;
+	for (; i + 16 <= uLen; i += 16)
+	{
+		_mm_storeu_si128((__m128i*)(d + i), x);
+	}
+	if (i < uLen)
+	{
+		_mm_storeu_si128((__m128i*)(d + uLen - 16), x);
+	}
+	return pDest;
 }
 
-BOOL Target_DebuggerDetach(PID const pidTarget)
+static int Memory_CompareSse2(void const * const pLeft, void const * const pRight, U64 const uLen)
 {
-    return DebugActiveProcessStop(pidTarget);
+	if (uLen < 16)
+	{
+		return Memory_CompareScalar(pLeft, pRight, uLen);
+	}
+	BYTE const * const l = pLeft;
+	BYTE const * const r = pRight;
+	U64 i = 0;
+	for (;;)
+	{
+		U64 const uAt = (i + 16 <= uLen) ? i : (uLen - 16);
+		__m128i const x = _mm_loadu_si128((__m128i const*)(l + uAt));
+		__m128i const y = _mm_loadu_si128((__m128i const*)(r + uAt));
+		U32 const uDiff = ~(U32)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & 0xFFFF;
+		if (0 != uDiff)
+		{
+			U64 const uByte = uAt + Memory_LowestBit(uDiff);
+			return (l[uByte] < r[uByte]) ? -1 : 1;
+		}
+		if (uAt + 16 >= uLen)
+		{
+			return 0;
+		}
+		i += 16;
+	}
 }
 
-BOOL Target_IsDebuggerAttached(PID const pidTarget, BOOL* const pbDebuggerPresent)
+static MEMORY_TARGET_AVX2 void* Memory_CopyAvx2(void* const pDest, void const * const pSrc, U64 const uLen)
 {
-	HANDLE const hProcess = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, pidTarget);
-	if (hProcess == NULL)
+	if (uLen < 32)
 	{
-		return FALSE;
+		return Memory_CopySse2(pDest, pSrc, uLen);
+	}
+	BYTE* const d = pDest;
+	BYTE const * const s = pSrc;
+	U64 i = 0;
+	for (; i + 128 <= uLen; i += 128)
+	{
+		__m256i const y0 = _mm256_loadu_si256((__m256i const*)(s + i));
+		__m256i const y1 = _mm256_loadu_si256((__m256i const*)(s + i + 32));
+		__m256i const y2 = _mm256_loadu_si256((__m256i const*)(s + i + 64));
+		__m256i const y3 = _mm256_loadu_si256((__m256i const*)(s + i + 96));
+		_mm256_storeu_si256((__m256i*)(d + i), y0);
+		_mm256_storeu_si256((__m256i*)(d + i + 32), y1);
+		_mm256_storeu_si256((__m256i*)(d + i + 64), y2);
+		_mm256_storeu_si256((__m256i*)(d + i + 96), y3);
+	}
+	for (; i + 32 <= uLen; i += 32)
+	{
+		_mm256_storeu_si256((__m256i*)(d + i), _mm256_loadu_si256((__m256i const*)(s + i)));
+	}
+	if (i < uLen)
+	{
+		_mm256_storeu_si256((__m256i*)(d + uLen - 32), _mm256_loadu_si256((__m256i const*)(s + uLen - 32)));
 	}
+	_mm256_zeroupper();
+	return pDest;
+}
 
-	BOOL bIsDbgPresent = FALSE;
-	if (!CheckRemoteDebuggerPresent(hProcess, &bIsDbgPresent))
+static MEMORY_TARGET_AVX2 void* Memory_SetAvx2(void* const pDest, BYTE const uValue, U64 const uLen)
+{
+	if (uLen < 32)
 	{
-		CloseHandle(hProcess);
-		return FALSE;
+		return Memory_SetSse2(pDest, uValue, uLen);
+	}
+	BYTE* const d = pDest;
+	__m256i const y = _mm256_set1_epi8((char)uValue);
+	U64 i = 0;
+	for (; i + 128 <= uLen; i += 128)
+	{
+		_mm256_storeu_si256((__m256i*)(d + i), y);
+		_mm256_storeu_si256((__m256i*)(d + i + 32), y);
+		_mm256_storeu_si256((__m256i*)(d + i + 64), y);
+		_mm256_storeu_si256((__m256i*)(d + i + 96), y);
+	}
+	for (; i + 32 <= uLen; i += 32)
+	{
+		_mm256_storeu_si256((__m256i*)(d + i), y);
+	}
+	if (i < uLen)
+	{
+		_mm256_storeu_si256((__m256i*)(d + uLen - 32), y);
 	}
+	_mm256_zeroupper();
+	return pDest;
+}
 
-	CloseHandle(hProcess);
-	*pbDebuggerPresent = bIsDbgPresent;
-	return TRUE;
+static MEMORY_TARGET_AVX2 int Memory_CompareAvx2(void const * const pLeft, void const * const pRight, U64 const uLen)
+{
+	if (uLen < 32)
+	{
+		return Memory_CompareSse2(pLeft, pRight, uLen);
+	}
+	BYTE const * const l = pLeft;
+	BYTE const * const r = pRight;
+	int iRet = 0;
+	U64 i = 0;
+	for (;;)
+	{
+		U64 const uAt = (i + 32 <= uLen) ? i : (uLen - 32);
+		__m256i const x = _mm256_loadu_si256((__m256i const*)(l + uAt));
+		__m256i const y = _mm256_loadu_si256((__m256i const*)(r + uAt));
+		U32 const uDiff = ~(U32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+		if (0 != uDiff)
+		{
+			U64 const uByte = uAt + Memory_LowestBit(uDiff);
+			iRet = (l[uByte] < r[uByte]) ? -1 : 1;
+			break;
+		}
+		if (uAt + 32 >= uLen)
+		{
+			break;
+		}
+		i += 32;
+	}
+	_mm256_zeroupper();
+	return iRet;
 }
 
-BOOL Target_MemoryRead(PROCESS const hProcess, ADDRESS const aSrc, void* const pDest, U64 const uLen)
+void* Memory_Copy(void* const pDest, void const * const pSrc, U64 const uLen)
 {
-	return ReadProcessMemory(hProcess, (LPCVOID)aSrc, pDest, uLen, NULL);
+	return gfnMemoryCopy(pDest, pSrc, uLen);
 }
 
-BOOL Target_MemoryWrite(PROCESS const hProcess, ADDRESS const aDest, void const * const pSrc, U64 const uLen)
+void* Memory_Set(void* const pDest, BYTE const uValue, U64 const uLen)
 {
-	return WriteProcessMemory(hProcess, (LPVOID)aDest, pSrc, uLen, NULL);
+	return gfnMemorySet(pDest, uValue, uLen);
 }
 
-BOOL Target_MemoryWriteFlush(PROCESS const hProcess, ADDRESS const aDest, void const * const pSrc, U64 const uLen)
+int Memory_Compare(void const * const pLeft, void const * const pRight, U64 const uLen)
 {
-	if (!WriteProcessMemory(hProcess, (LPVOID)aDest, pSrc, uLen, NULL))
+	return gfnMemoryCompare(pLeft, pRight, uLen);
+}
+
+BOOL Target_PatchBatchInit(PATCH_BATCH* const pBatch, U32 const uCapacity)
+{
+	U32 const uInitial = (0 == uCapacity) ? 1 : uCapacity;
+	pBatch->pPatches = Memory_Alloc((U64)uInitial * sizeof(PATCH));
+	pBatch->uCount = 0;
+	pBatch->uCapacity = (NULL == pBatch->pPatches) ? 0 : uInitial;
+	return NULL != pBatch->pPatches;
+}
+
+BOOL Target_PatchBatchAdd(PATCH_BATCH* const pBatch, ADDRESS const aAddress, void const * const pBytes, U32 const uLen, U32 const uTag)
+{
+	if (0 == uLen || uLen > PATCH_MAX_LEN)
 	{
 		return FALSE;
 	}
-	FlushInstructionCache(hProcess, (LPCVOID)aDest, uLen);
+	if (pBatch->uCount == pBatch->uCapacity)
+	{
+		U32 const uNewCapacity = (0 == pBatch->uCapacity) ? 16 : 2 * pBatch->uCapacity;
+		PATCH* const pNew = Memory_Alloc((U64)uNewCapacity * sizeof(PATCH));
+		if (NULL == pNew)
+		{
+			return FALSE;
+		}
+		Memory_Copy(pNew, pBatch->pPatches, (U64)pBatch->uCount * sizeof(PATCH));
+		Memory_Free(pBatch->pPatches);
+		pBatch->pPatches = pNew;
+		pBatch->uCapacity = uNewCapacity;
+	}
+
+	PATCH* const pPatch = &(pBatch->pPatches[pBatch->uCount++]);
+	pPatch->aAddress = aAddress;
+	pPatch->uTag = uTag;
+	pPatch->bApplied = FALSE;
+	pPatch->uLen = (BYTE)uLen;
+	Memory_Copy(pPatch->uBytes, pBytes, uLen);
 	return TRUE;
 }
 
-BOOL Target_MemoryUnprotect(PROCESS const hProcess, ADDRESS const address, U64 const uLen)
+void Target_PatchBatchFree(PATCH_BATCH* const pBatch)
 {
-	DWORD dwOldProtect;
-	return VirtualProtectEx(hProcess, (LPVOID)address, uLen, PAGE_EXECUTE_READWRITE, &dwOldProtect);
+	Memory_Free(pBatch->pPatches);
+	pBatch->pPatches = NULL;
+	pBatch->uCount = 0;
+	pBatch->uCapacity = 0;
+}
+
+static int PatchCompare(void const* const pLeft, void const* const pRight)
+{
+	ADDRESS const aLeft = ((PATCH const*)pLeft)->aAddress;
+	ADDRESS const aRight = ((PATCH const*)pRight)->aAddress;
+	return (aLeft < aRight) ? -1 : ((aLeft > aRight) ? 1 : 0);
 }
 
-ADDRESS Target_MemoryAllocExec(PROCESS const hProcess, U64 const uLen)
+static void PatchBatchSort(PATCH_BATCH* const pBatch)
 {
-	return (ADDRESS)VirtualAllocEx(hProcess, NULL, uLen, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+	Sort_Heap(pBatch->pPatches, pBatch->uCount, sizeof(PATCH), PatchCompare);
 }
 
-static ADDRESS FindPrevFreeRegion(PROCESS const hProcess, ADDRESS const aAddress, ADDRESS const aMin, U32 const uAllocationGranularity, U64* const puRegionSize)
+static U32 PatchRunBuild(PATCH_BATCH const * const pBatch, U32 const uFirst, U32 const uLimit, BYTE* const pRun, U64* const puRunLen)
 {
-	ADDRESS aTry = aAddress;
-	aTry -= aTry % uAllocationGranularity;
-	aTry -= uAllocationGranularity;
-	while (aTry >= aMin)
+	/* Concatenate patches that continue exactly where the previous one ended. Returns one past the last patch of the run. */
+	PATCH const * const pPatches = pBatch->pPatches;
+	U64 uLen = 0;
+	U32 uEnd = uFirst;
+	while (uEnd < uLimit
+		&& pPatches[uEnd].aAddress == pPatches[uFirst].aAddress + uLen
+		&& uLen + pPatches[uEnd].uLen <= PATCH_RUN_MAX)
 	{
-		MEMORY_BASIC_INFORMATION mbi;
-		if (0 == VirtualQueryEx(hProcess, (LPVOID)aTry, &mbi, sizeof(mbi)))
+		Memory_Copy(pRun + uLen, pPatches[uEnd].uBytes, pPatches[uEnd].uLen);
+		uLen += pPatches[uEnd].uLen;
+		uEnd++;
+	}
+	*puRunLen = uLen;
+	return uEnd;
+}
+
+static void PatchRunMark(PATCH_BATCH* const pBatch, U32 const uFirst, U32 const uEnd, BOOL const bApplied)
+{
+	for (U32 i = uFirst; i < uEnd; i++)
+	{
+		pBatch->pPatches[i].bApplied = bApplied;
+	}
+}
+
+U32 Target_PatchBatchUnprotect(PROCESS const hProcess, PATCH_BATCH* const pBatch)
+{
+	/* One protection change per span of consecutive pages touched by the batch. Returns the number of patches covered. */
+	PatchBatchSort(pBatch);
+	PATCH* const pPatches = pBatch->pPatches;
+	U32 uUnprotected = 0;
+	U32 uFirst = 0;
+	while (uFirst < pBatch->uCount)
+	{
+		ADDRESS const aStart = pPatches[uFirst].aAddress & ~(ADDRESS)(PATCH_PAGE_SIZE - 1);
+		ADDRESS aEnd = (pPatches[uFirst].aAddress + pPatches[uFirst].uLen + PATCH_PAGE_SIZE - 1) & ~(ADDRESS)(PATCH_PAGE_SIZE - 1);
+		U32 uEnd = uFirst + 1;
+		while (uEnd < pBatch->uCount && pPatches[uEnd].aAddress <= aEnd)
 		{
-			break;
+			ADDRESS const aPatchEnd = (pPatches[uEnd].aAddress + pPatches[uEnd].uLen + PATCH_PAGE_SIZE - 1) & ~(ADDRESS)(PATCH_PAGE_SIZE - 1);
+			aEnd = (aPatchEnd > aEnd) ? aPatchEnd : aEnd;
+			uEnd++;
 		}
-		if (MEM_FREE == mbi.State)
+
+		BOOL const bUnprotected = Target_MemoryUnprotect(hProcess, aStart, aEnd - aStart);
+		PatchRunMark(pBatch, uFirst, uEnd, bUnprotected);
+		uUnprotected += bUnprotected ? (uEnd - uFirst) : 0;
+		uFirst = uEnd;
+	}
+	return uUnprotected;
+}
+
+static U32 RegionMapLowerBound(REGION_MAP const * const pRegions, ADDRESS const aAddress)
+{
+	/* First region that ends above aAddress. */
+	U32 uLow = 0;
+	U32 uHigh = pRegions->uCount;
+	while (uLow < uHigh)
+	{
+		U32 const uMid = uLow + (uHigh - uLow) / 2;
+		if (pRegions->pRegions[uMid].aEnd <= aAddress)
 		{
-			*puRegionSize = mbi.RegionSize;
-			return aTry;
+			uLow = uMid + 1;
 		}
-		if ((U64)mbi.AllocationBase < uAllocationGranularity)
+		else
 		{
-			break;
+			uHigh = uMid;
 		}
-		aTry = (U64)mbi.AllocationBase - uAllocationGranularity;
 	}
+	return uLow;
+}
 
-	return NULL;
+static BOOL RegionMapGrow(REGION_MAP* const pRegions)
+{
+	if (pRegions->uCount < pRegions->uCapacity)
+	{
+		return TRUE;
+	}
+	U32 const uNewCapacity = (0 == pRegions->uCapacity) ? REGION_MAP_CAPACITY : 2 * pRegions->uCapacity;
+	REGION* const pNew = Memory_Alloc((U64)uNewCapacity * sizeof(REGION));
+	if (NULL == pNew)
+	{
+		return FALSE;
+	}
+	Memory_Copy(pNew, pRegions->pRegions, (U64)pRegions->uCount * sizeof(REGION));
+	Memory_Free(pRegions->pRegions);
+	pRegions->pRegions = pNew;
+	pRegions->uCapacity = uNewCapacity;
+	return TRUE;
+}
+
+static BOOL RegionMapAppend(REGION_MAP* const pRegions, ADDRESS const aStart, ADDRESS const aEnd)
+{
+	/* The sweep reports regions in ascending order, touching ones are merged. */
+	if (0 != pRegions->uCount && pRegions->pRegions[pRegions->uCount - 1].aEnd >= aStart)
+	{
+		REGION* const pLast = &(pRegions->pRegions[pRegions->uCount - 1]);
+		pLast->aEnd = (aEnd > pLast->aEnd) ? aEnd : pLast->aEnd;
+		return TRUE;
+	}
+	if (!RegionMapGrow(pRegions))
+	{
+		return FALSE;
+	}
+	pRegions->pRegions[pRegions->uCount].aStart = aStart;
+	pRegions->pRegions[pRegions->uCount].aEnd = aEnd;
+	pRegions->uCount++;
+	return TRUE;
 }
 
-static ADDRESS FindNextFreeRegion(PROCESS const hProcess, ADDRESS const aAddress, ADDRESS const aMax, U32 const uAllocationGranularity, U64* const puRegionSize)
+static void RegionMapInsert(REGION_MAP* const pRegions, ADDRESS const aStart, ADDRESS const aEnd)
 {
-	ADDRESS aTry = aAddress;
-	aTry -= aTry % uAllocationGranularity;
-	aTry += uAllocationGranularity;
+	/* A range that cannot be recorded would look free, so the map has to be swept again. */
+	if (!RegionMapGrow(pRegions))
+	{
+		pRegions->bStale = TRUE;
+		return;
+	}
 
-	while (aTry <= aMax)
+	U32 const uPos = RegionMapLowerBound(pRegions, aStart);
+	for (U32 i = pRegions->uCount; i > uPos; i--)
 	{
-		MEMORY_BASIC_INFORMATION mbi;
-		if (0 == VirtualQueryEx(hProcess, (LPVOID)aTry, &mbi, sizeof(mbi)))
+		pRegions->pRegions[i] = pRegions->pRegions[i - 1];
+	}
+	pRegions->pRegions[uPos].aStart = aStart;
+	pRegions->pRegions[uPos].aEnd = aEnd;
+	pRegions->uCount++;
+}
+
+static void RegionMapRemove(REGION_MAP* const pRegions, ADDRESS const aStart, ADDRESS const aEnd)
+{
+	/* The freed range may be part of a merged region, so cut it out of whatever overlaps it. */
+	U32 i = RegionMapLowerBound(pRegions, aStart);
+	while (i < pRegions->uCount && pRegions->pRegions[i].aStart < aEnd)
+	{
+		REGION* const pRegion = &(pRegions->pRegions[i]);
+		if (pRegion->aStart < aStart && pRegion->aEnd > aEnd)
 		{
-			break;
+			ADDRESS const aUpperEnd = pRegion->aEnd;
+			pRegion->aEnd = aStart;
+			RegionMapInsert(pRegions, aEnd, aUpperEnd);
+			return;
 		}
-		if (MEM_FREE == mbi.State)
+		if (pRegion->aStart < aStart)
 		{
-			*puRegionSize = mbi.RegionSize;
-			return aTry;
+			pRegion->aEnd = aStart;
+			i++;
+			continue;
+		}
+		if (pRegion->aEnd > aEnd)
+		{
+			pRegion->aStart = aEnd;
+			return;
+		}
+		for (U32 j = i + 1; j < pRegions->uCount; j++)
+		{
+			pRegions->pRegions[j - 1] = pRegions->pRegions[j];
 		}
-		aTry = (U64)mbi.BaseAddress + mbi.RegionSize;
-		aTry += uAllocationGranularity - 1;
-		aTry -= aTry % uAllocationGranularity;
+		pRegions->uCount--;
 	}
-
-	return NULL;
 }
 
-ADDRESS Target_MemoryAllocExecNear(PROCESS const hProcess, ADDRESS const aAddressNear, U64 const uNearDistance, U64 const uMinimumSize, U64* const puSize)
+static ADDRESS RegionMapSearch(PROCESS const hProcess, REGION_MAP* const pRegions, ADDRESS const aNear, ADDRESS const aMin, ADDRESS const aMax, U64 const uAlign, U64 const uMinimumSize, U64 const uMaximumSize, U64* const puSize)
 {
-	SYSTEM_INFO si;
-	GetSystemInfo(&si);
-	ADDRESS aMin = (ADDRESS)si.lpMinimumApplicationAddress;
-	ADDRESS aMax = (ADDRESS)si.lpMaximumApplicationAddress;
+	U64 const uWanted = (uMinimumSize > uMaximumSize)
+		? ((uMinimumSize + uAlign - 1) & ~(U64)(uAlign - 1))
+		: (uMaximumSize & ~(U64)(uAlign - 1));
+	REGION const * const pRegion = pRegions->pRegions;
+	U32 const uCount = pRegions->uCount;
 
-	if (aMin < aAddressNear - uNearDistance)
-	{
-		aMin = aAddressNear - uNearDistance;
-	}
-	if (aMax > aAddressNear + uNearDistance)
-	{
-		aMax = aAddressNear + uNearDistance;
-	}
+	/* Gap i lies between region i-1 and region i; gap uCount is above the last region. */
+	U32 const uNearGap = RegionMapLowerBound(pRegions, aNear);
 
-	ADDRESS aAlloc = NULL;
-	ADDRESS aCurrent = aAddressNear;
-	U64 uRegionSize = 0;
-	while (aCurrent >= aMin)
+	/* Search below the address first, filling each gap from its top. */
+	for (U32 uGap = uNearGap + 1; uGap > 0; uGap--)
 	{
-		aCurrent = FindPrevFreeRegion(hProcess, aCurrent, aMin, si.dwAllocationGranularity, &uRegionSize);
-		if (NULL == aCurrent)
+		U32 const i = uGap - 1;
+		ADDRESS aGapStart = (0 == i) ? 0 : pRegion[i - 1].aEnd;
+		ADDRESS aGapEnd = (i < uCount) ? pRegion[i].aStart : (ADDRESS)-1;
+		if (aGapEnd > aNear)
+		{
+			aGapEnd = aNear;
+		}
+		aGapEnd &= ~(ADDRESS)(uAlign - 1);
+		if (aGapEnd <= aMin)
 		{
 			break;
 		}
-		if (uRegionSize < uMinimumSize)
+		if (aGapStart < aMin)
+		{
+			aGapStart = aMin;
+		}
+		aGapStart = (aGapStart + uAlign - 1) & ~(ADDRESS)(uAlign - 1);
+		if (aGapEnd <= aGapStart || aGapEnd - aGapStart < uMinimumSize)
 		{
 			continue;
 		}
-		aAlloc = (ADDRESS)VirtualAllocEx(hProcess, (LPVOID)aCurrent, uRegionSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-		if (NULL != aAlloc)
+		U64 const uSize = (aGapEnd - aGapStart < uWanted) ? (aGapEnd - aGapStart) : uWanted;
+		ADDRESS const aAlloc = RegionReserveFixed(hProcess, aGapEnd - uSize, uSize);
+		if (0 != aAlloc)
 		{
-			*puSize = uRegionSize;
+			*puSize = uSize;
 			return aAlloc;
 		}
-	}	
+		pRegions->bStale = TRUE;
+	}
 
-	aCurrent = aAddressNear;
-	while (aCurrent <= aMax)
+	/* Then above it, filling each gap from its bottom. */
+	for (U32 i = uNearGap; i <= uCount; i++)
 	{
-		aCurrent = FindNextFreeRegion(hProcess, aCurrent, aMax, si.dwAllocationGranularity, &uRegionSize);
-		if (NULL == aCurrent)
+		ADDRESS aGapStart = (0 == i) ? 0 : pRegion[i - 1].aEnd;
+		ADDRESS aGapEnd = (i < uCount) ? pRegion[i].aStart : (ADDRESS)-1;
+		if (aGapStart < aNear)
+		{
+			aGapStart = aNear;
+		}
+		aGapStart = (aGapStart + uAlign - 1) & ~(ADDRESS)(uAlign - 1);
+		if (aGapStart >= aMax)
 		{
 			break;
 		}
-		if (uRegionSize < uMinimumSize)
+		if (aGapEnd > aMax)
+		{
+			aGapEnd = aMax;
+		}
+		aGapEnd &= ~(ADDRESS)(uAlign - 1);
+		if (aGapEnd <= aGapStart || aGapEnd - aGapStart < uMinimumSize)
 		{
 			continue;
 		}
-		aAlloc = (ADDRESS)VirtualAllocEx(hProcess, (LPVOID)aCurrent, uRegionSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-		if (NULL != aAlloc)
+		U64 const uSize = (aGapEnd - aGapStart < uWanted) ? (aGapEnd - aGapStart) : uWanted;
+		ADDRESS const aAlloc = RegionReserveFixed(hProcess, aGapStart, uSize);
+		if (0 != aAlloc)
 		{
-			*puSize = uRegionSize;
+			*puSize = uSize;
 			return aAlloc;
 		}
+		pRegions->bStale = TRUE;
 	}
 
-	return NULL;
+	return 0;
 }
 
-BOOL Target_DebugBreak(PID const pidTarget)
+static ADDRESS RegionMapReserveNear(PROCESS const hProcess, REGION_MAP* const pRegions, ADDRESS const aNear, ADDRESS const aMin, ADDRESS const aMax, U64 const uAlign, U64 const uMinimumSize, U64 const uMaximumSize, U64* const puSize)
 {
-	HANDLE const hProcess = OpenProcess(PROCESS_ALL_ACCESS, FALSE, pidTarget);
-	if (NULL == hProcess)
+	/* A gap that turned out to be taken marks the map stale; a map not swept by this call gets one more try. */
+	BOOL bSwept = FALSE;
+	for (;;)
 	{
-		return FALSE;
+		if (pRegions->bStale)
+		{
+			if (!RegionMapBuild(hProcess, pRegions))
+			{
+				return 0;
+			}
+			bSwept = TRUE;
+		}
+
+		ADDRESS const aAlloc = RegionMapSearch(hProcess, pRegions, aNear, aMin, aMax, uAlign, uMinimumSize, uMaximumSize, puSize);
+		if (0 != aAlloc)
+		{
+			RegionMapInsert(pRegions, aAlloc, aAlloc + *puSize);
+			return aAlloc;
+		}
+		if (bSwept)
+		{
+			return 0;
+		}
+		pRegions->bStale = TRUE;
 	}
-	BOOL const bRes = DebugBreakProcess(hProcess);
-	CloseHandle(hProcess);
-	return !!bRes;
 }
 
-BOOL Target_BreakpointAdd(PROCESS const hProcess, ADDRESS const aAddress)
+void Target_RegionMapFree(REGION_MAP* const pRegions)
 {
-	BYTE const byte = INT3_BYTE;
-	if (!WriteProcessMemory(hProcess, (LPVOID)aAddress, &byte, 1, NULL))
-	{
-		return FALSE;
-	}
-	FlushInstructionCache(hProcess, (LPCVOID)aAddress, 1);
-	return TRUE;
+	Memory_Free(pRegions->pRegions);
+	pRegions->pRegions = NULL;
+	pRegions->uCount = 0;
+	pRegions->uCapacity = 0;
+	pRegions->bStale = TRUE;
 }
 
-void Target_BreakpointRemoveTriggered(PID const pidProcess, TID const tidThread, ADDRESS const aAddress, BYTE const uOriginalByte)
+U64 Atomic_LoadAcquire(U64 const volatile* const puValue)
 {
-	HANDLE const hThread = OpenThread(THREAD_ALL_ACCESS, FALSE, tidThread);
-	if (NULL == hThread)
-	{
-		return;
-	}
+#ifdef _MSC_VER
+	/* x86-64 never reorders a load with later loads or stores, only the compiler has to be held back. */
+	U64 const uValue = *puValue;
+	_ReadWriteBarrier();
+	return uValue;
+#else
+	return __atomic_load_n(puValue, __ATOMIC_ACQUIRE);
+#endif /* _MSC_VER */
+}
 
-	CONTEXT threadContext;
-	threadContext.ContextFlags = CONTEXT_ALL;
-	if (!GetThreadContext(hThread, &threadContext))
-	{
-		goto ret;
-	}
-	threadContext.Rip -= 1;
-	if (!SetThreadContext(hThread, &threadContext))
-	{
-		goto ret;
-	}
+void Atomic_StoreRelease(U64 volatile* const puValue, U64 const uValue)
+{
+#ifdef _MSC_VER
+	_ReadWriteBarrier();
+	*puValue = uValue;
+#else
+	__atomic_store_n(puValue, uValue, __ATOMIC_RELEASE);
+#endif /* _MSC_VER */
+}
+
+U32 Atomic_Increment(U32 volatile* const puValue)
+{
+#ifdef _MSC_VER
+	/* U32 is an unsigned long here, the same size as the long the intrinsic takes. */
+	return (U32)_InterlockedIncrement((long volatile*)puValue);
+#else
+	return __atomic_add_fetch(puValue, 1, __ATOMIC_SEQ_CST);
+#endif /* _MSC_VER */
+}
+
+BOOL Atomic_CompareExchange(U32 volatile* const puValue, U32 const uExpected, U32 const uDesired)
+{
+#ifdef _MSC_VER
+	return (long)uExpected == _InterlockedCompareExchange((long volatile*)puValue, (long)uDesired, (long)uExpected);
+#else
+	U32 uSeen = uExpected;
+	return __atomic_compare_exchange_n(puValue, &uSeen, uDesired, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif /* _MSC_VER */
+}
+
+static U64 HwBreakpointsDr7(HW_BREAKPOINTS const * const pHwBreakpoints)
+{
+	/* Local enable bit per used slot. R/W and LEN stay 0, which means execute, 1 byte. */
+	U64 uDr7 = 0;
+	for (U32 i = 0; i < HW_BREAKPOINT_COUNT; i++)
+	{
+		if (0 != pHwBreakpoints->aSlots[i])
+		{
+			uDr7 |= (U64)1 << (2 * i);
+		}
+	}
+	return uDr7;
+}
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <Psapi.h>
+
+#define DR6_HIT_MASK (0xF)
+#define EFLAGS_RF (0x10000)
+/* ExceptionInformation[0] of an access violation caused by an instruction fetch. */
+#define ACCESS_VIOLATION_EXECUTE (8)
+
+BOOL WINAPI DllMain(HANDLE hHandle, DWORD dwReason, LPVOID lpReserved);
+static BOOL Process_EnableDebugPrivilege(void);
+static DWORD WINAPI Thread_Init(void* lpParam);
+static BOOL IsProtectWritable(DWORD dwProtect);
+static BOOL IsProtectExecutable(DWORD dwProtect);
+static U32 ThreadTableLowerBound(THREAD_TABLE const* pThreads, TID tid);
+static BOOL ThreadTableInsert(THREAD_TABLE* pThreads, TID tid, THREAD hThread);
+static void ThreadTableRemove(THREAD_TABLE* pThreads, TID tid);
+static THREAD ThreadTableFind(THREAD_TABLE const* pThreads, TID tid);
+static BOOL HwBreakpointsWrite(HANDLE hThread, HW_BREAKPOINTS const* pHwBreakpoints);
+static void HwBreakpointsApply(THREAD_TABLE const* pThreads, HW_BREAKPOINTS* pHwBreakpoints);
+static BOOL HwBreakpointResume(THREAD_TABLE const* pThreads, TID tidThread);
+static BOOL DebugEventHandle(PROCESS hProcess, THREAD_TABLE* pThreads, REGION_MAP* pRegions, HW_BREAKPOINTS* pHwBreakpoints, BREAKPOINT_HANDLER_FUNC pBreakpointHandler, HW_BREAKPOINT_HANDLER_FUNC pHwBreakpointHandler, PAGE_FAULT_HANDLER_FUNC pPageFaultHandler, void* pParam, DEBUG_EVENT const* pEvent);
+
+BOOL WINAPI DllMain(HANDLE const hHandle, DWORD const dwReason, LPVOID const lpReserved)
+{
+	(void)lpReserved;
+	if (DLL_PROCESS_ATTACH == dwReason)
+	{
+		DisableThreadLibraryCalls((HMODULE)hHandle);
+	}
+	return TRUE;
+}
+
+static BOOL Process_EnableDebugPrivilege(void)
+{
+	HANDLE hToken = NULL;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+	{
+		return FALSE;
+	}
+	LUID luid;
+	if (!LookupPrivilegeValue(NULL, SE_DEBUG_NAME, &luid))
+	{
+		CloseHandle(hToken);
+		return FALSE;
+	}
+
+	TOKEN_PRIVILEGES tp;
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Luid = luid;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+	BOOL const bRes = AdjustTokenPrivileges(hToken, FALSE, &tp, sizeof(TOKEN_PRIVILEGES), NULL, NULL);
+	CloseHandle(hToken);
+	return bRes;
+}
+
+BOOL Process_CheckPrivileges(void)
+{
+	return Process_EnableDebugPrivilege();
+}
+
+void* Memory_Alloc(U64 const uSize)
+{
+    return HeapAlloc(GetProcessHeap(), 0, uSize);
+}
+
+BOOL Memory_Free(void* const pAddress)
+{
+    if (NULL == pAddress)
+    {
+        return TRUE;
+    }
+    return HeapFree(GetProcessHeap(), 0, pAddress);
+}
+
+BOOL Target_Is64bit(PROCESS const hProcess)
+{
+	BOOL bIsWow64bit = FALSE;
+	if (!IsWow64Process(hProcess, &bIsWow64bit))
+	{
+		return FALSE;
+	}
+	return !bIsWow64bit;
+}
+
+BOOL Target_IsAlive(PROCESS const hProcess)
+{
+	/* A process handle stays valid after exit, the process object is signaled instead. */
+	return NULL != hProcess && WAIT_TIMEOUT == WaitForSingleObject(hProcess, 0);
+}
+
+static U32 ThreadTableLowerBound(THREAD_TABLE const * const pThreads, TID const tid)
+{
+	U32 uLow = 0;
+	U32 uHigh = pThreads->uCount;
+	while (uLow < uHigh)
+	{
+		U32 const uMid = uLow + (uHigh - uLow) / 2;
+		if (pThreads->pTids[uMid] < tid)
+		{
+			uLow = uMid + 1;
+		}
+		else
+		{
+			uHigh = uMid;
+		}
+	}
+	return uLow;
+}
+
+static BOOL ThreadTableInsert(THREAD_TABLE* const pThreads, TID const tid, THREAD const hThread)
+{
+	if (pThreads->uCount == pThreads->uCapacity)
+	{
+		U32 const uNewCapacity = (0 == pThreads->uCapacity) ? 64 : 2 * pThreads->uCapacity;
+		TID* const pNewTids = Memory_Alloc((U64)uNewCapacity * sizeof(TID));
+		THREAD* const phNewThreads = Memory_Alloc((U64)uNewCapacity * sizeof(THREAD));
+		if (NULL == pNewTids || NULL == phNewThreads)
+		{
+			Memory_Free(pNewTids);
+			Memory_Free(phNewThreads);
+			return FALSE;
+		}
+		Memory_Copy(pNewTids, pThreads->pTids, (U64)pThreads->uCount * sizeof(TID));
+		Memory_Copy(phNewThreads, pThreads->phThreads, (U64)pThreads->uCount * sizeof(THREAD));
+		Memory_Free(pThreads->pTids);
+		Memory_Free(pThreads->phThreads);
+		pThreads->pTids = pNewTids;
+		pThreads->phThreads = phNewThreads;
+		pThreads->uCapacity = uNewCapacity;
+	}
+
+	U32 const uPos = ThreadTableLowerBound(pThreads, tid);
+	for (U32 i = pThreads->uCount; i > uPos; i--)
+	{
+		pThreads->pTids[i] = pThreads->pTids[i - 1];
+		pThreads->phThreads[i] = pThreads->phThreads[i - 1];
+	}
+	pThreads->pTids[uPos] = tid;
+	pThreads->phThreads[uPos] = hThread;
+	pThreads->uCount++;
+	return TRUE;
+}
+
+static void ThreadTableRemove(THREAD_TABLE* const pThreads, TID const tid)
+{
+	U32 const uPos = ThreadTableLowerBound(pThreads, tid);
+	if (uPos >= pThreads->uCount || tid != pThreads->pTids[uPos])
+	{
+		return;
+	}
+	for (U32 i = uPos + 1; i < pThreads->uCount; i++)
+	{
+		pThreads->pTids[i - 1] = pThreads->pTids[i];
+		pThreads->phThreads[i - 1] = pThreads->phThreads[i];
+	}
+	pThreads->uCount--;
+}
+
+static THREAD ThreadTableFind(THREAD_TABLE const * const pThreads, TID const tid)
+{
+	if (NULL == pThreads)
+	{
+		return NULL;
+	}
+	U32 const uPos = ThreadTableLowerBound(pThreads, tid);
+	if (uPos >= pThreads->uCount || tid != pThreads->pTids[uPos])
+	{
+		return NULL;
+	}
+	return pThreads->phThreads[uPos];
+}
+
+BOOL Target_DebuggerAttach(PID const pidTarget, THREAD_TABLE* const pThreads)
+{
+	pThreads->pTids = NULL;
+	pThreads->phThreads = NULL;
+	pThreads->uCount = 0;
+	pThreads->uCapacity = 0;
+
+	if (!DebugActiveProcess(pidTarget))
+	{
+		return FALSE;
+	}
+	if (!DebugSetProcessKillOnExit(FALSE))
+	{
+		DebugActiveProcessStop(pidTarget);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL Target_DebuggerDetach(PID const pidTarget, THREAD_TABLE* const pThreads, HW_BREAKPOINTS* const pHwBreakpoints)
+{
+	/* A breakpoint left in the debug registers would raise an exception nobody handles anymore. */
+	if (0 != pHwBreakpoints->uAppliedGeneration)
+	{
+		HW_BREAKPOINTS cleared;
+		Memory_Set(&cleared, 0, sizeof(cleared));
+		for (U32 i = 0; i < pThreads->uCount; i++)
+		{
+			HANDLE const hThread = pThreads->phThreads[i];
+			if ((DWORD)-1 != SuspendThread(hThread))
+			{
+				HwBreakpointsWrite(hThread, &cleared);
+				ResumeThread(hThread);
+			}
+		}
+		pHwBreakpoints->uGeneration = 0;
+		pHwBreakpoints->uAppliedGeneration = 0;
+	}
+
+	BOOL const bRes = DebugActiveProcessStop(pidTarget);
+
+	/* No exit events follow a detach, so the handles still in the table are ours to close. */
+	for (U32 i = 0; i < pThreads->uCount; i++)
+	{
+		CloseHandle(pThreads->phThreads[i]);
+	}
+	Memory_Free(pThreads->pTids);
+	Memory_Free(pThreads->phThreads);
+	pThreads->pTids = NULL;
+	pThreads->phThreads = NULL;
+	pThreads->uCount = 0;
+	pThreads->uCapacity = 0;
+	return bRes;
+}
+
+BOOL Target_IsDebuggerAttached(PROCESS const hProcess, BOOL* const pbDebuggerPresent)
+{
+	BOOL bIsDbgPresent = FALSE;
+	if (!CheckRemoteDebuggerPresent(hProcess, &bIsDbgPresent))
+	{
+		return FALSE;
+	}
+
+	*pbDebuggerPresent = bIsDbgPresent;
+	return TRUE;
+}
+
+BOOL Target_MemoryRead(PROCESS const hProcess, ADDRESS const aSrc, void* const pDest, U64 const uLen)
+{
+	return ReadProcessMemory(hProcess, (LPCVOID)aSrc, pDest, uLen, NULL);
+}
+
+BOOL Target_MemoryWrite(PROCESS const hProcess, ADDRESS const aDest, void const * const pSrc, U64 const uLen)
+{
+	return WriteProcessMemory(hProcess, (LPVOID)aDest, pSrc, uLen, NULL);
+}
+
+BOOL Target_MemoryWriteFlush(PROCESS const hProcess, ADDRESS const aDest, void const * const pSrc, U64 const uLen)
+{
+	if (!WriteProcessMemory(hProcess, (LPVOID)aDest, pSrc, uLen, NULL))
+	{
+		return FALSE;
+	}
+	FlushInstructionCache(hProcess, (LPCVOID)aDest, uLen);
+	return TRUE;
+}
+
+BOOL Target_MemoryUnprotect(PROCESS const hProcess, ADDRESS const address, U64 const uLen)
+{
+	DWORD dwOldProtect;
+	return VirtualProtectEx(hProcess, (LPVOID)address, uLen, PAGE_EXECUTE_READWRITE, &dwOldProtect);
+}
+
+ADDRESS Target_MemoryReserve(PROCESS const hProcess, REGION_MAP* const pRegions, U64 const uLen)
+{
+	ADDRESS const aAlloc = (ADDRESS)VirtualAllocEx(hProcess, NULL, uLen, MEM_RESERVE, PAGE_NOACCESS);
+	if (0 != aAlloc && NULL != pRegions)
+	{
+		RegionMapInsert(pRegions, aAlloc, aAlloc + ((uLen + REGION_PAGE_SIZE - 1) & ~(U64)(REGION_PAGE_SIZE - 1)));
+	}
+	return aAlloc;
+}
+
+static BOOL RegionMapBuild(PROCESS const hProcess, REGION_MAP* const pRegions)
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+
+	/* One query per region instead of one per allocation granule. */
+	pRegions->bStale = FALSE;
+	pRegions->uCount = 0;
+	ADDRESS aCurrent = (ADDRESS)si.lpMinimumApplicationAddress;
+	ADDRESS const aEnd = (ADDRESS)si.lpMaximumApplicationAddress;
+	while (aCurrent < aEnd)
+	{
+		MEMORY_BASIC_INFORMATION mbi;
+		if (0 == VirtualQueryEx(hProcess, (LPCVOID)aCurrent, &mbi, sizeof(mbi)))
+		{
+			break;
+		}
+		ADDRESS const aRegionEnd = (ADDRESS)mbi.BaseAddress + mbi.RegionSize;
+		if (MEM_FREE != mbi.State && !RegionMapAppend(pRegions, (ADDRESS)mbi.BaseAddress, aRegionEnd))
+		{
+			pRegions->bStale = TRUE;
+			return FALSE;
+		}
+		aCurrent = aRegionEnd;
+	}
+	return TRUE;
+}
+
+static ADDRESS RegionReserveFixed(PROCESS const hProcess, ADDRESS const aAddress, U64 const uLen)
+{
+	return (ADDRESS)VirtualAllocEx(hProcess, (LPVOID)aAddress, uLen, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+ADDRESS Target_MemoryReserveNear(PROCESS const hProcess, REGION_MAP* const pRegions, ADDRESS const aAddressNear, U64 const uNearDistance, U64 const uMinimumSize, U64 const uMaximumSize, U64* const puSize)
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	ADDRESS aMin = (ADDRESS)si.lpMinimumApplicationAddress;
+	ADDRESS aMax = (ADDRESS)si.lpMaximumApplicationAddress;
+
+	if (aAddressNear > uNearDistance && aMin < aAddressNear - uNearDistance)
+	{
+		aMin = aAddressNear - uNearDistance;
+	}
+	if (aMax > aAddressNear + uNearDistance)
+	{
+		aMax = aAddressNear + uNearDistance;
+	}
+
+	return RegionMapReserveNear(hProcess, pRegions, aAddressNear, aMin, aMax, si.dwAllocationGranularity, uMinimumSize, uMaximumSize, puSize);
+}
+
+BOOL Target_MemoryCommitExec(PROCESS const hProcess, ADDRESS const address, U64 const uLen)
+{
+	return NULL != VirtualAllocEx(hProcess, (LPVOID)address, uLen, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+}
+
+BOOL Target_MemoryProtectQuery(PROCESS const hProcess, ADDRESS const aAddress, U32* const puProtect, ADDRESS* const paEnd, BOOL* const pbExecutable)
+{
+	MEMORY_BASIC_INFORMATION mbi;
+	if (0 == VirtualQueryEx(hProcess, (LPCVOID)aAddress, &mbi, sizeof(mbi)))
+	{
+		return FALSE;
+	}
+	*puProtect = (MEM_COMMIT == mbi.State) ? mbi.Protect : PAGE_NOACCESS;
+	*paEnd = (ADDRESS)mbi.BaseAddress + mbi.RegionSize;
+	*pbExecutable = IsProtectExecutable(*puProtect);
+	return TRUE;
+}
+
+BOOL Target_MemoryExecRevoke(PROCESS const hProcess, ADDRESS const address, U64 const uLen, U32 const uProtect)
+{
+	/* Not PAGE_GUARD: it would fire on reads of constants and jump tables in the code as well. */
+	DWORD const dwModifiers = uProtect & (PAGE_GUARD | PAGE_NOCACHE | PAGE_WRITECOMBINE);
+	DWORD dwProtect = PAGE_READONLY;
+	switch (uProtect & ~dwModifiers)
+	{
+		case PAGE_EXECUTE_READWRITE:
+			dwProtect = PAGE_READWRITE;
+			break;
+		case PAGE_EXECUTE_WRITECOPY:
+			dwProtect = PAGE_WRITECOPY;
+			break;
+		case PAGE_EXECUTE:
+		case PAGE_EXECUTE_READ:
+			dwProtect = PAGE_READONLY;
+			break;
+		default:
+			return FALSE;
+	}
+	DWORD dwOldProtect;
+	return VirtualProtectEx(hProcess, (LPVOID)address, uLen, dwProtect | dwModifiers, &dwOldProtect);
+}
+
+BOOL Target_MemoryProtectRestore(PROCESS const hProcess, ADDRESS const address, U64 const uLen, U32 const uProtect)
+{
+	DWORD dwOldProtect;
+	return VirtualProtectEx(hProcess, (LPVOID)address, uLen, uProtect, &dwOldProtect);
+}
+
+BOOL Target_DebugBreak(PROCESS const hProcess)
+{
+	return !!DebugBreakProcess(hProcess);
+}
+
+BOOL Target_BreakpointAdd(PROCESS const hProcess, ADDRESS const aAddress)
+{
+	BYTE const byte = INT3_BYTE;
+	if (!WriteProcessMemory(hProcess, (LPVOID)aAddress, &byte, 1, NULL))
+	{
+		return FALSE;
+	}
+	FlushInstructionCache(hProcess, (LPCVOID)aAddress, 1);
+	return TRUE;
+}
+
+void Target_BreakpointRemoveTriggered(PROCESS const hProcess, THREAD_TABLE const * const pThreads, TID const tidThread, ADDRESS const aAddress, BYTE const uOriginalByte)
+{
+	/* Threads announced by debug events already have a handle, others (foreign debug loops) get a temporary one. */
+	HANDLE hThread = ThreadTableFind(pThreads, tidThread);
+	BOOL const bTemporary = (NULL == hThread);
+	if (bTemporary)
+	{
+		hThread = OpenThread(THREAD_GET_CONTEXT | THREAD_SET_CONTEXT, FALSE, tidThread);
+	}
+	if (NULL == hThread)
+	{
+		return;
+	}
+
+	CONTEXT threadContext;
+	threadContext.ContextFlags = CONTEXT_CONTROL;
+	if (!GetThreadContext(hThread, &threadContext))
+	{
+		goto ret;
+	}
+	threadContext.Rip -= 1;
+	if (!SetThreadContext(hThread, &threadContext))
+	{
+		goto ret;
+	}
+
+	BYTE const byte = uOriginalByte;
+	WriteProcessMemory(hProcess, (LPVOID)aAddress, &byte, 1, NULL);
+	FlushInstructionCache(hProcess, (LPCVOID)aAddress, 1);
+
+ret:
+	if (bTemporary)
+	{
+		CloseHandle(hThread);
+	}
+	return;
+}
+
+void Target_BreakpointRemoveDormant(PROCESS const hProcess, ADDRESS const aAddress, BYTE const uOriginalByte)
+{
+	BYTE const byte = uOriginalByte;
+	WriteProcessMemory(hProcess, (LPVOID)aAddress, &byte, 1, NULL);
+	FlushInstructionCache(hProcess, (LPCVOID)aAddress, 1);
+}
+
+PROCESS Target_HandleAcquire(PID const pidProcess)
+{
+	HANDLE const hProcess = OpenProcess(PROCESS_ALL_ACCESS, FALSE, pidProcess);
+	if (NULL == hProcess)
+	{
+		return NULL;
+	}
+	return hProcess;
+}
+
+BOOL Target_HandleRelease(PROCESS process)
+{
+	return CloseHandle(process);
+}
+
+BOOL Target_ModuleFind(PROCESS const hProcess, char const * const szName, ADDRESS* const paBase)
+{
+	TARGET_MODULE* pModules = NULL;
+	U32 uCount = 0;
+	if (!Target_ModulesCollect(hProcess, &pModules, &uCount))
+	{
+		return FALSE;
+	}
+	BOOL bFound = FALSE;
+	for (U32 i = 0; i < uCount && !bFound; i++)
+	{
+		if (0 == lstrcmpiA(pModules[i].szName, szName))
+		{
+			*paBase = pModules[i].aBase;
+			bFound = TRUE;
+		}
+	}
+	Memory_Free(pModules);
+	return bFound;
+}
+
+BOOL Target_ModulesCollect(PROCESS const hProcess, TARGET_MODULE** const ppModules, U32* const puCount)
+{
+	*ppModules = NULL;
+	*puCount = 0;
+	DWORD dwNeeded = 0;
+	if (!K32EnumProcessModulesEx(hProcess, NULL, 0, &dwNeeded, LIST_MODULES_ALL) || 0 == dwNeeded)
+	{
+		return FALSE;
+	}
+	HMODULE* const phModules = Memory_Alloc(dwNeeded);
+	if (NULL == phModules)
+	{
+		return FALSE;
+	}
+
+	/* Modules loaded between the two calls are not in the list, the same as those loaded later. */
+	DWORD dwFilled = 0;
+	if (!K32EnumProcessModulesEx(hProcess, phModules, dwNeeded, &dwFilled, LIST_MODULES_ALL))
+	{
+		Memory_Free(phModules);
+		return FALSE;
+	}
+	U32 const uListed = ((dwFilled < dwNeeded) ? dwFilled : dwNeeded) / sizeof(HMODULE);
+	TARGET_MODULE* const pModules = Memory_Alloc((U64)uListed * sizeof(TARGET_MODULE) + 1);
+	if (NULL == pModules)
+	{
+		Memory_Free(phModules);
+		return FALSE;
+	}
+
+	/* A module unloaded in the meantime fails its queries and is left out. */
+	U32 uCount = 0;
+	for (U32 i = 0; i < uListed; i++)
+	{
+		TARGET_MODULE* const pModule = &(pModules[uCount]);
+		MODULEINFO info;
+		if (K32GetModuleInformation(hProcess, phModules[i], &info, sizeof(info))
+			&& 0 != K32GetModuleBaseNameA(hProcess, phModules[i], pModule->szName, TARGET_MODULE_NAME_MAX))
+		{
+			pModule->aBase = (ADDRESS)info.lpBaseOfDll;
+			pModule->uSize = info.SizeOfImage;
+			uCount++;
+		}
+	}
+	Memory_Free(phModules);
+	*ppModules = pModules;
+	*puCount = uCount;
+	return TRUE;
+}
+
+BOOL Thread_Start(THREAD_INIT_FUNC const fnFunc, void* const pParam, THREAD* const pThread)
+{
+	THREAD_INIT_INFO* const pInitInfo = Memory_Alloc(sizeof(THREAD_INIT_INFO));
+	if (NULL == pInitInfo)
+	{
+		*pThread = NULL;
+		return FALSE;
+	}
+
+	pInitInfo->fnFunc = fnFunc;
+	pInitInfo->pParam = pParam;
+	
+	HANDLE const hThread = CreateThread(NULL, 0, Thread_Init, pInitInfo, 0, NULL);
+	if (NULL == hThread)
+	{
+		*pThread = NULL;
+		return FALSE;
+	}
+
+	*pThread = hThread;
+	return TRUE;
+}
+
+static DWORD WINAPI Thread_Init(void* lpParam)
+{
+	THREAD_INIT_INFO* const pInitInfo = (THREAD_INIT_INFO*)lpParam;
+	pInitInfo->fnFunc(pInitInfo->pParam);
+	Memory_Free(pInitInfo);
+	return 0;
+}
+
+BOOL Thread_WaitExit(THREAD const hThread, U32 const uTimeoutMS)
+{
+	return WAIT_OBJECT_0 == WaitForSingleObject(hThread, uTimeoutMS);
+}
+
+BOOL Thread_Close(THREAD const hThread)
+{
+	return CloseHandle(hThread);
+}
+
+void Thread_SpinWait(U32 const uRound)
+{
+	if (uRound < THREAD_SPIN_PAUSE_ROUNDS)
+	{
+		_mm_pause();
+		return;
+	}
+	SwitchToThread();
+}
+
+SEMAPHORE Semaphore_Create(void)
+{
+	return CreateSemaphoreW(NULL, 0, MAXLONG, NULL);
+}
+
+void Semaphore_Post(SEMAPHORE const hSemaphore, U32 const uCount)
+{
+	ReleaseSemaphore(hSemaphore, (LONG)uCount, NULL);
+}
+
+void Semaphore_Wait(SEMAPHORE const hSemaphore)
+{
+	WaitForSingleObject(hSemaphore, INFINITE);
+}
+
+void Semaphore_Free(SEMAPHORE const hSemaphore)
+{
+	CloseHandle(hSemaphore);
+}
+
+BOOL File_MapCreate(char const * const szPath, U64 const uSize, FILE_VIEW* const pView)
+{
+	pView->pData = NULL;
+	pView->uSize = 0;
+	HANDLE const hFile = CreateFileA(szPath, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == hFile)
+	{
+		return FALSE;
+	}
+
+	/* The mapping sizes the file. The view keeps the mapping alive after both handles are closed. */
+	HANDLE const hMapping = CreateFileMappingW(hFile, NULL, PAGE_READWRITE, (DWORD)(uSize >> 32), (DWORD)uSize, NULL);
+	CloseHandle(hFile);
+	if (NULL == hMapping)
+	{
+		return FALSE;
+	}
+	void* const pData = MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)uSize);
+	CloseHandle(hMapping);
+	if (NULL == pData)
+	{
+		return FALSE;
+	}
+	pView->pData = pData;
+	pView->uSize = uSize;
+	return TRUE;
+}
+
+BOOL File_MapRead(char const * const szPath, FILE_VIEW* const pView)
+{
+	pView->pData = NULL;
+	pView->uSize = 0;
+	HANDLE const hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == hFile)
+	{
+		return FALSE;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || 0 == size.QuadPart)
+	{
+		CloseHandle(hFile);
+		return FALSE;
+	}
+	HANDLE const hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(hFile);
+	if (NULL == hMapping)
+	{
+		return FALSE;
+	}
+	void* const pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(hMapping);
+	if (NULL == pData)
+	{
+		return FALSE;
+	}
+	pView->pData = pData;
+	pView->uSize = (U64)size.QuadPart;
+	return TRUE;
+}
+
+BOOL File_MapFlush(FILE_VIEW const * const pView)
+{
+	return NULL != pView->pData && FlushViewOfFile(pView->pData, (SIZE_T)pView->uSize);
+}
+
+void File_Unmap(FILE_VIEW* const pView)
+{
+	if (NULL != pView->pData)
+	{
+		UnmapViewOfFile(pView->pData);
+	}
+	pView->pData = NULL;
+	pView->uSize = 0;
+}
+
+U64 Time_Now(void)
+{
+	static LARGE_INTEGER gFrequency = { 0 };
+	if (0 == gFrequency.QuadPart)
+	{
+		QueryPerformanceFrequency(&gFrequency);
+	}
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	/* Split so the multiplication cannot overflow for counters of years. */
+	U64 const uFrequency = (U64)gFrequency.QuadPart;
+	U64 const uCounter = (U64)counter.QuadPart;
+	return (uCounter / uFrequency) * 1000000000ULL + ((uCounter % uFrequency) * 1000000000ULL) / uFrequency;
+}
+
+static BOOL HwBreakpointsWrite(HANDLE const hThread, HW_BREAKPOINTS const * const pHwBreakpoints)
+{
+	CONTEXT threadContext;
+	threadContext.ContextFlags = CONTEXT_DEBUG_REGISTERS;
+	if (!GetThreadContext(hThread, &threadContext))
+	{
+		return FALSE;
+	}
+	threadContext.Dr0 = pHwBreakpoints->aSlots[0];
+	threadContext.Dr1 = pHwBreakpoints->aSlots[1];
+	threadContext.Dr2 = pHwBreakpoints->aSlots[2];
+	threadContext.Dr3 = pHwBreakpoints->aSlots[3];
+	threadContext.Dr6 = 0;
+	threadContext.Dr7 = HwBreakpointsDr7(pHwBreakpoints);
+	return !!SetThreadContext(hThread, &threadContext);
+}
+
+static void HwBreakpointsApply(THREAD_TABLE const * const pThreads, HW_BREAKPOINTS* const pHwBreakpoints)
+{
+	/* Called while a debug event is pending, so every thread of the target is stopped. */
+	U32 const uGeneration = pHwBreakpoints->uGeneration;
+	for (U32 i = 0; i < pThreads->uCount; i++)
+	{
+		HwBreakpointsWrite(pThreads->phThreads[i], pHwBreakpoints);
+	}
+	pHwBreakpoints->uAppliedGeneration = uGeneration;
+}
+
+static BOOL HwBreakpointResume(THREAD_TABLE const * const pThreads, TID const tidThread)
+{
+	/*
+	 * Only a debug register match sets one of B0-B3 in DR6, other single steps belong to the target.
+	 * RF lets the instruction run once even if its slot is still armed in this thread.
+	 */
+	HANDLE const hThread = ThreadTableFind(pThreads, tidThread);
+	if (NULL == hThread)
+	{
+		return FALSE;
+	}
+	CONTEXT threadContext;
+	threadContext.ContextFlags = CONTEXT_CONTROL | CONTEXT_DEBUG_REGISTERS;
+	if (!GetThreadContext(hThread, &threadContext) || 0 == (threadContext.Dr6 & DR6_HIT_MASK))
+	{
+		return FALSE;
+	}
+	threadContext.Dr6 = 0;
+	threadContext.EFlags |= EFLAGS_RF;
+	SetThreadContext(hThread, &threadContext);
+	return TRUE;
+}
+
+static BOOL DebugEventHandle(PROCESS const hProcess, THREAD_TABLE* const pThreads, REGION_MAP* const pRegions, HW_BREAKPOINTS* const pHwBreakpoints, BREAKPOINT_HANDLER_FUNC const pBreakpointHandler, HW_BREAKPOINT_HANDLER_FUNC const pHwBreakpointHandler, PAGE_FAULT_HANDLER_FUNC const pPageFaultHandler, void* const pParam, DEBUG_EVENT const * const pEvent)
+{
+	DEBUG_EVENT const debugEvent = *pEvent;
+	DWORD dwContinueStatus = DBG_CONTINUE;
+	BOOL bTargetDied = FALSE;
+
+	switch(debugEvent.dwDebugEventCode)
+	{
+		case EXCEPTION_DEBUG_EVENT:
+			if(EXCEPTION_BREAKPOINT == debugEvent.u.Exception.ExceptionRecord.ExceptionCode)
+			{
+				ADDRESS const aAddress = (ADDRESS)debugEvent.u.Exception.ExceptionRecord.ExceptionAddress;
+				BYTE uOriginalByte = 0;
+				BOOL bRemoveBreakpoint = pBreakpointHandler(pParam, debugEvent.dwThreadId, aAddress, &uOriginalByte);
+				if (bRemoveBreakpoint)
+				{
+					Target_BreakpointRemoveTriggered(hProcess, pThreads, debugEvent.dwThreadId, aAddress, uOriginalByte);
+				}
+			}
+			else if (EXCEPTION_SINGLE_STEP == debugEvent.u.Exception.ExceptionRecord.ExceptionCode
+				&& HwBreakpointResume(pThreads, debugEvent.dwThreadId))
+			{
+				/* Only we write the debug registers, so the hit is ours even if its slot was freed meanwhile. */
+				pHwBreakpointHandler(pParam, debugEvent.dwThreadId, (ADDRESS)debugEvent.u.Exception.ExceptionRecord.ExceptionAddress);
+			}
+			else if (EXCEPTION_ACCESS_VIOLATION == debugEvent.u.Exception.ExceptionRecord.ExceptionCode
+				&& debugEvent.u.Exception.ExceptionRecord.NumberParameters >= 2
+				&& ACCESS_VIOLATION_EXECUTE == debugEvent.u.Exception.ExceptionRecord.ExceptionInformation[0])
+			{
+				ADDRESS const aPage = (ADDRESS)debugEvent.u.Exception.ExceptionRecord.ExceptionInformation[1] & ~(ADDRESS)(REGION_PAGE_SIZE - 1);
+				U32 uProtect = 0;
+				ADDRESS aEnd = 0;
+				BOOL bExecutable = FALSE;
+				BOOL bResume = FALSE;
+				if (pPageFaultHandler(pParam, debugEvent.dwThreadId, aPage, &uProtect))
+				{
+					bResume = Target_MemoryProtectRestore(hProcess, aPage, REGION_PAGE_SIZE, uProtect);
+				}
+				else
+				{
+					bResume = Target_MemoryProtectQuery(hProcess, aPage, &uProtect, &aEnd, &bExecutable) && bExecutable;
+				}
+				dwContinueStatus = bResume ? DBG_CONTINUE : DBG_EXCEPTION_NOT_HANDLED;
+			}
+			else
+			{
+				dwContinueStatus = DBG_EXCEPTION_NOT_HANDLED;
+			}
+			break;
+
+		case CREATE_THREAD_DEBUG_EVENT:
+			/* The system closes the handle once EXIT_THREAD_DEBUG_EVENT is continued. */
+			if (NULL != debugEvent.u.CreateThread.hThread
+				&& !ThreadTableInsert(pThreads, debugEvent.dwThreadId, debugEvent.u.CreateThread.hThread))
+			{
+				CloseHandle(debugEvent.u.CreateThread.hThread);
+			}
+			/* New threads start with empty debug registers. */
+			else if (NULL != debugEvent.u.CreateThread.hThread && 0 != pHwBreakpoints->uAppliedGeneration)
+			{
+				HwBreakpointsWrite(debugEvent.u.CreateThread.hThread, pHwBreakpoints);
+			}
+			break;
+
+		case EXIT_THREAD_DEBUG_EVENT:
+			ThreadTableRemove(pThreads, debugEvent.dwThreadId);
+			break;
+
+		case CREATE_PROCESS_DEBUG_EVENT:
+			if (NULL != debugEvent.u.CreateProcessInfo.hFile)
+			{
+				CloseHandle(debugEvent.u.CreateProcessInfo.hFile);
+			}
+			if (NULL != debugEvent.u.CreateProcessInfo.hProcess)
+			{
+				CloseHandle(debugEvent.u.CreateProcessInfo.hProcess);
+			}
+			if (NULL != debugEvent.u.CreateProcessInfo.hThread
+				&& !ThreadTableInsert(pThreads, debugEvent.dwThreadId, debugEvent.u.CreateProcessInfo.hThread))
+			{
+				CloseHandle(debugEvent.u.CreateProcessInfo.hThread);
+			}
+			break;
+
+		case LOAD_DLL_DEBUG_EVENT:
+			if (NULL != debugEvent.u.LoadDll.hFile)
+			{
+				CloseHandle(debugEvent.u.LoadDll.hFile);
+			}
+			if (NULL != pRegions)
+			{
+				pRegions->bStale = TRUE;
+			}
+			break;
+
+		case EXIT_PROCESS_DEBUG_EVENT:
+		case RIP_EVENT:
+			/* Remaining thread handles are closed by the system as well. */
+			pThreads->uCount = 0;
+			bTargetDied = TRUE;
+			break;
+
+		default:
+			break;
+	}
+
+	if (!bTargetDied && pHwBreakpoints->uGeneration != pHwBreakpoints->uAppliedGeneration)
+	{
+		HwBreakpointsApply(pThreads, pHwBreakpoints);
+	}
+
+	ContinueDebugEvent(debugEvent.dwProcessId, debugEvent.dwThreadId, dwContinueStatus);
+	return bTargetDied;
+}
+
+BOOL Target_WaitForBreakpoint(PROCESS const hProcess, THREAD_TABLE* const pThreads, REGION_MAP* const pRegions, HW_BREAKPOINTS* const pHwBreakpoints, BREAKPOINT_HANDLER_FUNC const pBreakpointHandler, HW_BREAKPOINT_HANDLER_FUNC const pHwBreakpointHandler, PAGE_FAULT_HANDLER_FUNC const pPageFaultHandler, void* const pParam, U32 const uTimeoutMS)
+{
+	DEBUG_EVENT debugEvent;
+	if (!WaitForDebugEvent(&debugEvent, uTimeoutMS))
+	{
+		return FALSE;
+	}
+
+	/* Every event is continued before the next one can be taken, those already queued come back at once. */
+	for (U32 i = 1; ; i++)
+	{
+		if (DebugEventHandle(hProcess, pThreads, pRegions, pHwBreakpoints, pBreakpointHandler, pHwBreakpointHandler, pPageFaultHandler, pParam, &debugEvent))
+		{
+			return TRUE;
+		}
+		if (i >= TARGET_EVENT_BATCH || !WaitForDebugEvent(&debugEvent, 0))
+		{
+			return FALSE;
+		}
+	}
+}
+
+void Target_HwBreakpointsApply(PROCESS const hProcess, THREAD_TABLE const * const pThreads, HW_BREAKPOINTS* const pHwBreakpoints)
+{
+	/* No event is pending, so each thread is held while its registers are written. */
+	(void)hProcess;
+	U32 const uGeneration = pHwBreakpoints->uGeneration;
+	for (U32 i = 0; i < pThreads->uCount; i++)
+	{
+		HANDLE const hThread = pThreads->phThreads[i];
+		if ((DWORD)-1 == SuspendThread(hThread))
+		{
+			continue;
+		}
+		HwBreakpointsWrite(hThread, pHwBreakpoints);
+		ResumeThread(hThread);
+	}
+	pHwBreakpoints->uAppliedGeneration = uGeneration;
+}
+
+void Target_MemoryFree(PROCESS const hProcess, REGION_MAP* const pRegions, ADDRESS const address, U64 const uLen)
+{
+	/* MEM_RELEASE always frees the whole allocation. */
+	if (VirtualFreeEx(hProcess, (LPVOID)address, 0, MEM_RELEASE) && NULL != pRegions)
+	{
+		RegionMapRemove(pRegions, address, address + ((uLen + REGION_PAGE_SIZE - 1) & ~(U64)(REGION_PAGE_SIZE - 1)));
+	}
+}
+
+static BOOL IsProtectWritable(DWORD const dwProtect)
+{
+	DWORD const dwWritable = PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+	return 0 != (dwProtect & dwWritable);
+}
+
+static BOOL IsProtectExecutable(DWORD const dwProtect)
+{
+	DWORD const dwExecutable = PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+	return 0 != (dwProtect & dwExecutable);
+}
+
+U32 Target_PatchBatchApply(PROCESS const hProcess, PATCH_BATCH* const pBatch)
+{
+	PatchBatchSort(pBatch);
+	PATCH* const pPatches = pBatch->pPatches;
+	BYTE bufRun[PATCH_RUN_MAX];
+	U32 uApplied = 0;
+
+	U32 uFirst = 0;
+	while (uFirst < pBatch->uCount)
+	{
+		/*
+		 * Take every patch inside the region of uniform protection that holds the first one
+		 * and lift the protection of its pages once, instead of letting WriteProcessMemory do it per call.
+		 */
+		MEMORY_BASIC_INFORMATION mbi;
+		ADDRESS aRegionEnd = pPatches[uFirst].aAddress + pPatches[uFirst].uLen;
+		BOOL bQueried = (0 != VirtualQueryEx(hProcess, (LPCVOID)pPatches[uFirst].aAddress, &mbi, sizeof(mbi)));
+		if (bQueried)
+		{
+			aRegionEnd = (ADDRESS)mbi.BaseAddress + mbi.RegionSize;
+		}
+		U32 uRegionEnd = uFirst + 1;
+		while (uRegionEnd < pBatch->uCount && pPatches[uRegionEnd].aAddress + pPatches[uRegionEnd].uLen <= aRegionEnd)
+		{
+			uRegionEnd++;
+		}
+
+		ADDRESS const aLast = pPatches[uRegionEnd - 1].aAddress + pPatches[uRegionEnd - 1].uLen;
+		ADDRESS const aStart = pPatches[uFirst].aAddress & ~(ADDRESS)(PATCH_PAGE_SIZE - 1);
+		ADDRESS const aEnd = (aLast + PATCH_PAGE_SIZE - 1) & ~(ADDRESS)(PATCH_PAGE_SIZE - 1);
+		DWORD dwOldProtect = 0;
+		BOOL const bReprotect = bQueried
+			&& MEM_COMMIT == mbi.State
+			&& !IsProtectWritable(mbi.Protect)
+			&& VirtualProtectEx(hProcess, (LPVOID)aStart, aEnd - aStart, PAGE_EXECUTE_READWRITE, &dwOldProtect);
+
+		U32 uRun = uFirst;
+		while (uRun < uRegionEnd)
+		{
+			U64 uRunLen = 0;
+			U32 const uRunEnd = PatchRunBuild(pBatch, uRun, uRegionEnd, bufRun, &uRunLen);
+			BOOL const bWritten = WriteProcessMemory(hProcess, (LPVOID)pPatches[uRun].aAddress, bufRun, uRunLen, NULL);
+			PatchRunMark(pBatch, uRun, uRunEnd, bWritten);
+			uApplied += bWritten ? (uRunEnd - uRun) : 0;
+			uRun = uRunEnd;
+		}
+
+		if (bReprotect)
+		{
+			DWORD dwIgnored = 0;
+			VirtualProtectEx(hProcess, (LPVOID)aStart, aEnd - aStart, dwOldProtect, &dwIgnored);
+		}
+		uFirst = uRegionEnd;
+	}
+
+	if (0 != uApplied)
+	{
+		FlushInstructionCache(hProcess, NULL, 0);
+	}
+	return uApplied;
+}
+
+#endif /* _WIN32 */
+
+#ifdef LINUX
+
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <elf.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE (0x100000)
+#endif
+#ifndef PTRACE_EVENT_STOP
+#define PTRACE_EVENT_STOP (128)
+#endif
+
+#define PAGE_SIZE_LINUX (0x1000)
+#define MMAP_MIN_ADDRESS (0x10000)
+#define USER_SPACE_END (0x00007FFFFFFFF000ULL)
+#define SI_KERNEL_INT3 (0x80)
+#define SI_TRAP_HWBKPT (4)
+
+#define REMOTE_CALL_TIMEOUT_MS (2000)
+#define EVENT_POLL_MIN_US (50)
+#define EVENT_POLL_MAX_US (1000)
+
+/* A syscall another thread asks the tracer thread to make in the target, see RemoteCallPost. */
+typedef struct tdREMOTE_CALL {
+	long lNumber;
+	U64 uArgs[6];
+	U64 uResult;
+	BOOL bDone;
+	BOOL bRet;
+} REMOTE_CALL;
+
+/*
+ * Only the thread that attached may use ptrace on the target. While our debug loop owns it, syscalls
+ * of other threads are posted in pRemoteCall and made by the loop at its next stop.
+ */
+typedef struct tdTARGET_PROCESS {
+	PID pid;
+	int fdMem;
+	ADDRESS aSyscallGadget;
+	pthread_mutex_t mutexRemote;
+	pthread_cond_t condRemote;
+	REMOTE_CALL* pRemoteCall;
+} TARGET_PROCESS;
+
+typedef struct tdLINUX_THREAD {
+	pthread_t thread;
+	BOOL bJoined;
+	BYTE _padding[4];
+} LINUX_THREAD;
+
+/* The tracer is the thread that attached, just like a Windows debugger thread owns its debuggee. */
+static __thread PID gtlsTracedPid = 0;
+
+static void* Thread_Init(void* lpParam);
+static char* ReadProcFile(PID pid, char const* szName, U64* puLen);
+static TID* ListThreads(PID pid, U32* puCount);
+static BOOL PokeByte(TID tid, ADDRESS aAddress, BYTE uByte);
+static ADDRESS FindSyscallGadget(TARGET_PROCESS* pProcess);
+static BOOL ReadTracerPid(PID pid, PID* pTracer);
+static void DeadlineAfter(U32 uTimeoutMS, struct timespec* pDeadline);
+static BOOL RemoteStop(PID pid, BOOL* pbSeized, int* piPendingSignal);
+static BOOL RemoteSyscallStopped(TARGET_PROCESS* pProcess, TID tid, long lNumber, U64 const* puArgs, U64* puResult, int* piPendingSignal);
+static BOOL RemoteCallPost(TARGET_PROCESS* pProcess, long lNumber, U64 const* puArgs, U64* puResult);
+static void RemoteCallServe(TARGET_PROCESS* pProcess, TID tid, int* piSignal);
+static BOOL RemoteSyscall(TARGET_PROCESS* pProcess, long lNumber, U64 a1, U64 a2, U64 a3, U64 a4, U64 a5, U64 a6, U64* puResult);
+static BOOL IsExecuteFault(TID tid, ADDRESS aFault);
+static ADDRESS RemoteReserve(TARGET_PROCESS* pProcess, ADDRESS aHint, U64 uLen, BOOL bFixed);
+static BOOL DebugEventHandle(PROCESS hProcess, THREAD_TABLE* pThreads, HW_BREAKPOINTS* pHwBreakpoints, BREAKPOINT_HANDLER_FUNC pBreakpointHandler, HW_BREAKPOINT_HANDLER_FUNC pHwBreakpointHandler, PAGE_FAULT_HANDLER_FUNC pPageFaultHandler, void* pParam, TID tid, int status);
+static BOOL HwBreakpointsPoke(TID tid, HW_BREAKPOINTS const* pHwBreakpoints);
+static void HwBreakpointsApply(TID tidStopped, HW_BREAKPOINTS* pHwBreakpoints);
+
+BOOL Process_CheckPrivileges(void)
+{
+	/* Yama scope 3 disables ptrace completely, scope 2 restricts it to CAP_SYS_PTRACE. */
+	int const fd = open("/proc/sys/kernel/yama/ptrace_scope", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return TRUE;
+	}
+	char c = '0';
+	ssize_t const n = read(fd, &c, 1);
+	close(fd);
+	if (1 != n || c < '2')
+	{
+		return TRUE;
+	}
+	return ('2' == c) && (0 == geteuid());
+}
+
+void* Memory_Alloc(U64 const uSize)
+{
+	return malloc(uSize);
+}
+
+BOOL Memory_Free(void* const pAddress)
+{
+	free(pAddress);
+	return TRUE;
+}
+
+static char* ReadProcFile(PID const pid, char const * const szName, U64* const puLen)
+{
+	char szPath[64];
+	snprintf(szPath, sizeof(szPath), "/proc/%d/%s", pid, szName);
+	int const fd = open(szPath, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	/* Proc files report size 0, read until EOF. */
+	U64 uCapacity = 0x4000;
+	U64 uLen = 0;
+	char* pBuf = malloc(uCapacity + 1);
+	while (NULL != pBuf)
+	{
+		ssize_t const n = read(fd, pBuf + uLen, uCapacity - uLen);
+		if (n <= 0)
+		{
+			break;
+		}
+		uLen += (U64)n;
+		if (uLen == uCapacity)
+		{
+			uCapacity *= 2;
+			char* const pNew = realloc(pBuf, uCapacity + 1);
+			if (NULL == pNew)
+			{
+				free(pBuf);
+			}
+			pBuf = pNew;
+		}
+	}
+	close(fd);
+
+	if (NULL != pBuf)
+	{
+		pBuf[uLen] = '\0';
+		*puLen = uLen;
+	}
+	return pBuf;
+}
+
+static TID* ListThreads(PID const pid, U32* const puCount)
+{
+	*puCount = 0;
+	char szPath[64];
+	snprintf(szPath, sizeof(szPath), "/proc/%d/task", pid);
+	DIR* const pDir = opendir(szPath);
+	if (NULL == pDir)
+	{
+		return NULL;
+	}
+
+	/* Like the proc files, the task directory is read until its end into a growing array. */
+	U32 uCapacity = 256;
+	U32 uCount = 0;
+	TID* pTids = malloc((size_t)uCapacity * sizeof(TID));
+	struct dirent* pEntry;
+	while (NULL != pTids && NULL != (pEntry = readdir(pDir)))
+	{
+		TID const tid = (TID)strtol(pEntry->d_name, NULL, 10);
+		if (tid <= 0)
+		{
+			continue;
+		}
+		if (uCount == uCapacity)
+		{
+			uCapacity *= 2;
+			TID* const pNew = realloc(pTids, (size_t)uCapacity * sizeof(TID));
+			if (NULL == pNew)
+			{
+				free(pTids);
+			}
+			pTids = pNew;
+			if (NULL == pTids)
+			{
+				break;
+			}
+		}
+		pTids[uCount++] = tid;
+	}
+	closedir(pDir);
+
+	if (NULL != pTids)
+	{
+		*puCount = uCount;
+	}
+	return pTids;
+}
+
+BOOL Target_Is64bit(PROCESS const hProcess)
+{
+	if (NULL == hProcess)
+	{
+		return FALSE;
+	}
+	char szPath[64];
+	snprintf(szPath, sizeof(szPath), "/proc/%d/exe", ((TARGET_PROCESS const*)hProcess)->pid);
+	int const fd = open(szPath, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return FALSE;
+	}
+
+	Elf64_Ehdr header;
+	ssize_t const n = read(fd, &header, sizeof(header));
+	close(fd);
+	if ((ssize_t)sizeof(header) != n || 0 != memcmp(header.e_ident, ELFMAG, SELFMAG))
+	{
+		return FALSE;
+	}
+	return ELFCLASS64 == header.e_ident[EI_CLASS] && EM_X86_64 == header.e_machine;
+}
+
+BOOL Target_IsAlive(PROCESS const hProcess)
+{
+	if (NULL == hProcess)
+	{
+		return FALSE;
+	}
+
+	/* The pid stays valid until the parent reaps it, so zombies have to be told apart by their state. */
+	U64 uLen = 0;
+	char* const pStat = ReadProcFile(((TARGET_PROCESS const*)hProcess)->pid, "stat", &uLen);
+	if (NULL == pStat)
+	{
+		return FALSE;
+	}
+	char const * const pState = strrchr(pStat, ')');
+	BOOL const bAlive = (NULL != pState && ' ' == pState[1] && 'Z' != pState[2] && 'X' != pState[2]);
+	free(pStat);
+	return bAlive;
+}
+
+BOOL Target_DebuggerAttach(PID const pidTarget, THREAD_TABLE* const pThreads)
+{
+	pThreads->pTids = NULL;
+	pThreads->phThreads = NULL;
+	pThreads->uCount = 0;
+	pThreads->uCapacity = 0;
+
+	if (0 != ptrace(PTRACE_SEIZE, pidTarget, 0, PTRACE_O_TRACECLONE))
+	{
+		return FALSE;
+	}
+	gtlsTracedPid = pidTarget;
+
+	/* Threads spawned while we are seizing the others are picked up by PTRACE_O_TRACECLONE or by the next pass. */
+	BOOL bSeizedAny = TRUE;
+	while (bSeizedAny)
+	{
+		bSeizedAny = FALSE;
+		U32 uCount = 0;
+		TID* const pTids = ListThreads(pidTarget, &uCount);
+		for (U32 i = 0; i < uCount; i++)
+		{
+			if (0 == ptrace(PTRACE_SEIZE, pTids[i], 0, PTRACE_O_TRACECLONE))
+			{
+				bSeizedAny = TRUE;
+			}
+		}
+		free(pTids);
+	}
+	return TRUE;
+}
+
+BOOL Target_DebuggerDetach(PID const pidTarget, THREAD_TABLE* const pThreads, HW_BREAKPOINTS* const pHwBreakpoints)
+{
+	(void)pThreads;
+	/* A breakpoint left in the debug registers would raise a SIGTRAP nobody handles anymore. */
+	BOOL const bHwUsed = (0 != pHwBreakpoints->uAppliedGeneration);
+	HW_BREAKPOINTS cleared;
+	Memory_Set(&cleared, 0, sizeof(cleared));
+	U32 uCount = 0;
+	TID* const pTids = ListThreads(pidTarget, &uCount);
+	for (U32 i = 0; i < uCount; i++)
+	{
+		TID const tid = pTids[i];
+		if (0 != ptrace(PTRACE_INTERRUPT, tid, 0, 0))
+		{
+			continue;
+		}
+
+		int status = 0;
+		if (tid != waitpid(tid, &status, __WALL) || !WIFSTOPPED(status))
+		{
+			continue;
+		}
+
+		if (bHwUsed)
+		{
+			HwBreakpointsPoke(tid, &cleared);
+		}
+
+		/*
+		 * A thread may have hit a breakpoint that was removed before we got to handle it.
+		 * Rewind it so it executes the restored instruction, drop debug register hits
+		 * (the instruction has not run yet) and pass real signals on.
+		 */
+
+		int iSignal = 0;
+		int const iStopSignal = WSTOPSIG(status);
+		siginfo_t si;
+		BOOL const bTrap = (0 == (status >> 16) && SIGTRAP == iStopSignal && 0 == ptrace(PTRACE_GETSIGINFO, tid, 0, &si));
+		if (bTrap && SI_KERNEL_INT3 == si.si_code)
+		{
+			struct user_regs_struct regs;
+			if (0 == ptrace(PTRACE_GETREGS, tid, 0, &regs))
+			{
+				errno = 0;
+				long const lWord = ptrace(PTRACE_PEEKDATA, tid, (void*)(regs.rip - 1), 0);
+				if (0 == errno && INT3_BYTE != (BYTE)lWord)
+				{
+					regs.rip -= 1;
+					ptrace(PTRACE_SETREGS, tid, 0, &regs);
+				}
+			}
+		}
+		else if (bTrap && SI_TRAP_HWBKPT == si.si_code)
+		{
+			iSignal = 0;
+		}
+		else if (0 == (status >> 16) && SIGSTOP != iStopSignal)
+		{
+			iSignal = iStopSignal;
+		}
+		ptrace(PTRACE_DETACH, tid, 0, iSignal);
+	}
+	free(pTids);
+
+	pHwBreakpoints->uGeneration = 0;
+	pHwBreakpoints->uAppliedGeneration = 0;
+	gtlsTracedPid = 0;
+	return TRUE;
+}
+
+static BOOL ReadTracerPid(PID const pid, PID* const pTracer)
+{
+	U64 uLen = 0;
+	char* const pStatus = ReadProcFile(pid, "status", &uLen);
+	if (NULL == pStatus)
+	{
+		return FALSE;
+	}
+
+	char const * const pTracerPid = strstr(pStatus, "TracerPid:");
+	if (NULL == pTracerPid)
+	{
+		free(pStatus);
+		return FALSE;
+	}
+	*pTracer = (PID)strtol(pTracerPid + sizeof("TracerPid:") - 1, NULL, 10);
+	free(pStatus);
+	return TRUE;
+}
+
+BOOL Target_IsDebuggerAttached(PROCESS const hProcess, BOOL* const pbDebuggerPresent)
+{
+	if (NULL == hProcess)
+	{
+		return FALSE;
+	}
+	PID pidTracer = 0;
+	if (!ReadTracerPid(((TARGET_PROCESS const*)hProcess)->pid, &pidTracer))
+	{
+		return FALSE;
+	}
+
+	*pbDebuggerPresent = (0 != pidTracer);
+	return TRUE;
+}
+
+BOOL Target_MemoryRead(PROCESS const hProcess, ADDRESS const aSrc, void* const pDest, U64 const uLen)
+{
+	TARGET_PROCESS const * const pProcess = (TARGET_PROCESS const*)hProcess;
+	struct iovec local = { pDest, uLen };
+	struct iovec remote = { (void*)aSrc, uLen };
+	ssize_t const n = process_vm_readv(pProcess->pid, &local, 1, &remote, 1, 0);
+	if ((ssize_t)uLen == n)
+	{
+		return TRUE;
+	}
+
+	/* process_vm_readv honours page protections, /proc/pid/mem does not. */
+	return (ssize_t)uLen == pread(pProcess->fdMem, pDest, uLen, (off_t)aSrc);
+}
+
+BOOL Target_MemoryWrite(PROCESS const hProcess, ADDRESS const aDest, void const * const pSrc, U64 const uLen)
+{
+	/* Writes through /proc/pid/mem are forced, so read-only code pages can be patched too. */
+	TARGET_PROCESS const * const pProcess = (TARGET_PROCESS const*)hProcess;
+	return (ssize_t)uLen == pwrite(pProcess->fdMem, pSrc, uLen, (off_t)aDest);
+}
+
+BOOL Target_MemoryWriteFlush(PROCESS const hProcess, ADDRESS const aDest, void const * const pSrc, U64 const uLen)
+{
+	/* x86-64 keeps instruction caches coherent with remote writes. */
+	return Target_MemoryWrite(hProcess, aDest, pSrc, uLen);
+}
 
-	BYTE const byte = uOriginalByte;
-	HANDLE const hProcess = OpenProcess(PROCESS_ALL_ACCESS, FALSE, pidProcess);
-	if (NULL == hProcess)
+U32 Target_PatchBatchApply(PROCESS const hProcess, PATCH_BATCH* const pBatch)
+{
+	/* /proc/pid/mem ignores page protection and x86-64 needs no flush, so only the writes are batched. */
+	PatchBatchSort(pBatch);
+	BYTE bufRun[PATCH_RUN_MAX];
+	U32 uApplied = 0;
+	U32 uRun = 0;
+	while (uRun < pBatch->uCount)
 	{
-		goto ret;
+		U64 uRunLen = 0;
+		U32 const uRunEnd = PatchRunBuild(pBatch, uRun, pBatch->uCount, bufRun, &uRunLen);
+		BOOL const bWritten = Target_MemoryWrite(hProcess, pBatch->pPatches[uRun].aAddress, bufRun, uRunLen);
+		PatchRunMark(pBatch, uRun, uRunEnd, bWritten);
+		uApplied += bWritten ? (uRunEnd - uRun) : 0;
+		uRun = uRunEnd;
 	}
+	return uApplied;
+}
 
-	WriteProcessMemory(hProcess, (LPVOID)aAddress, &byte, 1, NULL);
-	FlushInstructionCache(hProcess, (LPCVOID)aAddress, 1);
-	CloseHandle(hProcess);
+static ADDRESS FindSyscallGadget(TARGET_PROCESS* const pProcess)
+{
+	if (0 != pProcess->aSyscallGadget)
+	{
+		return pProcess->aSyscallGadget;
+	}
 
-ret:
-	CloseHandle(hThread);
-	return;
+	U64 uLen = 0;
+	char* const pMaps = ReadProcFile(pProcess->pid, "maps", &uLen);
+	if (NULL == pMaps)
+	{
+		return 0;
+	}
+
+	/* Prefer the vDSO (its fallback paths contain syscall instructions), then any other executable mapping. */
+	BYTE buf[PAGE_SIZE_LINUX + 1];
+	for (int iPass = 0; iPass < 2 && 0 == pProcess->aSyscallGadget; iPass++)
+	{
+		char* pLine = pMaps;
+		while (NULL != pLine && '\0' != *pLine && 0 == pProcess->aSyscallGadget)
+		{
+			char* const pEnd = strchr(pLine, '\n');
+			if (NULL != pEnd)
+			{
+				*pEnd = '\0';
+			}
+
+			unsigned long long uStart = 0;
+			unsigned long long uStop = 0;
+			char szPerms[8] = { 0 };
+			BOOL const bVdso = (NULL != strstr(pLine, "[vdso]"));
+			if (3 == sscanf(pLine, "%llx-%llx %7s", &uStart, &uStop, szPerms)
+				&& 'x' == szPerms[2] && 'r' == szPerms[0] && (0 == iPass) == bVdso)
+			{
+				for (ADDRESS aPage = uStart; aPage < uStop && 0 == pProcess->aSyscallGadget; aPage += PAGE_SIZE_LINUX)
+				{
+					U64 const uRead = (uStop - aPage > sizeof(buf)) ? sizeof(buf) : (uStop - aPage);
+					if (!Target_MemoryRead(pProcess, aPage, buf, uRead))
+					{
+						break;
+					}
+					for (U64 i = 0; i + 1 < uRead; i++)
+					{
+						if (0x0F == buf[i] && 0x05 == buf[i + 1])
+						{
+							pProcess->aSyscallGadget = aPage + i;
+							break;
+						}
+					}
+				}
+			}
+
+			if (NULL != pEnd)
+			{
+				*pEnd = '\n';
+				pLine = pEnd + 1;
+			}
+			else
+			{
+				pLine = NULL;
+			}
+		}
+	}
+
+	free(pMaps);
+	return pProcess->aSyscallGadget;
+}
+
+static BOOL RemoteStop(PID const pid, BOOL* const pbSeized, int* const piPendingSignal)
+{
+	/* Either we already trace the target from this thread, or we seize it just for this call. */
+	*pbSeized = FALSE;
+	*piPendingSignal = 0;
+	if (gtlsTracedPid != pid)
+	{
+		if (0 != ptrace(PTRACE_SEIZE, pid, 0, 0))
+		{
+			return FALSE;
+		}
+		*pbSeized = TRUE;
+	}
+
+	if (0 != ptrace(PTRACE_INTERRUPT, pid, 0, 0))
+	{
+		if (*pbSeized)
+		{
+			ptrace(PTRACE_DETACH, pid, 0, 0);
+		}
+		return FALSE;
+	}
+
+	int status = 0;
+	for (;;)
+	{
+		if (pid != waitpid(pid, &status, __WALL))
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			/* The interrupt is pending either way, a thread we seized must not stay traced by us. */
+			if (*pbSeized)
+			{
+				ptrace(PTRACE_DETACH, pid, 0, 0);
+			}
+			return FALSE;
+		}
+		if (!WIFSTOPPED(status))
+		{
+			return FALSE;
+		}
+		if (PTRACE_EVENT_STOP == (status >> 16))
+		{
+			return TRUE;
+		}
+		if (0 == (status >> 16))
+		{
+			/* A real signal arrived first. Keep it for the resume, the interrupt stop follows. */
+			*piPendingSignal = WSTOPSIG(status);
+			siginfo_t si;
+			if (SIGTRAP == *piPendingSignal && 0 == ptrace(PTRACE_GETSIGINFO, pid, 0, &si) && SI_KERNEL_INT3 == si.si_code)
+			{
+				/* Breakpoint hit: rewind so it traps again once the debug loop is back in control. */
+				struct user_regs_struct regs;
+				if (0 == ptrace(PTRACE_GETREGS, pid, 0, &regs))
+				{
+					regs.rip -= 1;
+					ptrace(PTRACE_SETREGS, pid, 0, &regs);
+				}
+				*piPendingSignal = 0;
+			}
+			return TRUE;
+		}
+		ptrace(PTRACE_CONT, pid, 0, 0);
+	}
+}
+
+static BOOL RemoteSyscallStopped(TARGET_PROCESS* const pProcess, TID const tid, long const lNumber, U64 const * const puArgs, U64* const puResult, int* const piPendingSignal)
+{
+	/* tid must be in a ptrace stop of this thread. Its registers are put back afterwards, the caller resumes it. */
+	ADDRESS const aGadget = FindSyscallGadget(pProcess);
+	if (0 == aGadget)
+	{
+		return FALSE;
+	}
+
+	struct user_regs_struct saved;
+	if (0 != ptrace(PTRACE_GETREGS, tid, 0, &saved))
+	{
+		return FALSE;
+	}
+
+	/* orig_rax = -1 keeps the kernel from applying syscall restart logic to the injected call. */
+	struct user_regs_struct regs = saved;
+	regs.rax = (unsigned long long)lNumber;
+	regs.orig_rax = (unsigned long long)-1;
+	regs.rdi = puArgs[0];
+	regs.rsi = puArgs[1];
+	regs.rdx = puArgs[2];
+	regs.r10 = puArgs[3];
+	regs.r8 = puArgs[4];
+	regs.r9 = puArgs[5];
+	regs.rip = aGadget;
+	if (0 != ptrace(PTRACE_SETREGS, tid, 0, &regs))
+	{
+		return FALSE;
+	}
+
+	BOOL bRet = FALSE;
+	while (!bRet)
+	{
+		int status = 0;
+		if (0 != ptrace(PTRACE_SINGLESTEP, tid, 0, 0) || tid != waitpid(tid, &status, __WALL) || !WIFSTOPPED(status))
+		{
+			break;
+		}
+		BOOL const bRegs = (0 == ptrace(PTRACE_GETREGS, tid, 0, &regs));
+		if (bRegs && aGadget + 2 == regs.rip)
+		{
+			*puResult = regs.rax;
+			bRet = TRUE;
+		}
+		else if (bRegs && aGadget == regs.rip && 0 == (status >> 16) && SIGSEGV == WSTOPSIG(status))
+		{
+			/* The gadget lies on a page without execute permission right now. */
+			break;
+		}
+		else if (0 == (status >> 16) && SIGTRAP != WSTOPSIG(status))
+		{
+			*piPendingSignal = WSTOPSIG(status);
+		}
+	}
+
+	ptrace(PTRACE_SETREGS, tid, 0, &saved);
+	return bRet;
+}
+
+static void DeadlineAfter(U32 const uTimeoutMS, struct timespec* const pDeadline)
+{
+	clock_gettime(CLOCK_REALTIME, pDeadline);
+	pDeadline->tv_sec += uTimeoutMS / 1000;
+	pDeadline->tv_nsec += (long)(uTimeoutMS % 1000) * 1000000L;
+	if (pDeadline->tv_nsec >= 1000000000L)
+	{
+		pDeadline->tv_sec++;
+		pDeadline->tv_nsec -= 1000000000L;
+	}
+}
+
+static BOOL RemoteCallPost(TARGET_PROCESS* const pProcess, long const lNumber, U64 const * const puArgs, U64* const puResult)
+{
+	REMOTE_CALL call;
+	call.lNumber = lNumber;
+	Memory_Copy(call.uArgs, puArgs, sizeof(call.uArgs));
+	call.uResult = 0;
+	call.bDone = FALSE;
+	call.bRet = FALSE;
+
+	struct timespec deadline;
+	DeadlineAfter(REMOTE_CALL_TIMEOUT_MS, &deadline);
+	pthread_mutex_lock(&(pProcess->mutexRemote));
+	BOOL bTimedOut = FALSE;
+	while (NULL != pProcess->pRemoteCall && !bTimedOut)
+	{
+		bTimedOut = (ETIMEDOUT == pthread_cond_timedwait(&(pProcess->condRemote), &(pProcess->mutexRemote), &deadline));
+	}
+	if (NULL != pProcess->pRemoteCall)
+	{
+		pthread_mutex_unlock(&(pProcess->mutexRemote));
+		return FALSE;
+	}
+	pProcess->pRemoteCall = &call;
+	pthread_mutex_unlock(&(pProcess->mutexRemote));
+
+	/* The loop may be waiting for a target that does nothing, the stop wakes it up. */
+	Target_DebugBreak(pProcess);
+
+	pthread_mutex_lock(&(pProcess->mutexRemote));
+	while (!call.bDone)
+	{
+		if (ETIMEDOUT != pthread_cond_timedwait(&(pProcess->condRemote), &(pProcess->mutexRemote), &deadline))
+		{
+			continue;
+		}
+		if (&call == pProcess->pRemoteCall)
+		{
+			/* Not picked up, the loop is gone or stuck. Once picked up it always finishes. */
+			pProcess->pRemoteCall = NULL;
+			pthread_cond_broadcast(&(pProcess->condRemote));
+			break;
+		}
+		/* A past deadline would return at once, the wait for bDone keeps blocking on a fresh one. */
+		DeadlineAfter(REMOTE_CALL_TIMEOUT_MS, &deadline);
+	}
+	pthread_mutex_unlock(&(pProcess->mutexRemote));
+
+	*puResult = call.uResult;
+	return call.bDone && call.bRet;
+}
+
+static void RemoteCallServe(TARGET_PROCESS* const pProcess, TID const tid, int* const piSignal)
+{
+	/* Taking the call frees the slot for the next one, the poster waits on bDone. */
+	pthread_mutex_lock(&(pProcess->mutexRemote));
+	REMOTE_CALL* const pCall = pProcess->pRemoteCall;
+	pProcess->pRemoteCall = NULL;
+	pthread_mutex_unlock(&(pProcess->mutexRemote));
+	if (NULL == pCall)
+	{
+		return;
+	}
+
+	int iPendingSignal = 0;
+	BOOL const bRet = RemoteSyscallStopped(pProcess, tid, pCall->lNumber, pCall->uArgs, &(pCall->uResult), &iPendingSignal);
+	if (0 == *piSignal)
+	{
+		*piSignal = iPendingSignal;
+	}
+
+	pthread_mutex_lock(&(pProcess->mutexRemote));
+	pCall->bRet = bRet;
+	pCall->bDone = TRUE;
+	pthread_cond_broadcast(&(pProcess->condRemote));
+	pthread_mutex_unlock(&(pProcess->mutexRemote));
+}
+
+static BOOL RemoteSyscall(TARGET_PROCESS* const pProcess, long const lNumber, U64 const a1, U64 const a2, U64 const a3, U64 const a4, U64 const a5, U64 const a6, U64* const puResult)
+{
+	PID const pid = pProcess->pid;
+	U64 const uArgs[6] = { a1, a2, a3, a4, a5, a6 };
+
+	/* Traced by another thread of this process, that is by our debug loop. */
+	PID pidTracer = 0;
+	char szTask[64];
+	if (gtlsTracedPid != pid && ReadTracerPid(pid, &pidTracer) && 0 != pidTracer)
+	{
+		snprintf(szTask, sizeof(szTask), "/proc/self/task/%d", pidTracer);
+		return 0 == access(szTask, F_OK) && RemoteCallPost(pProcess, lNumber, uArgs, puResult);
+	}
+
+	BOOL bSeized = FALSE;
+	int iPendingSignal = 0;
+	if (!RemoteStop(pid, &bSeized, &iPendingSignal))
+	{
+		return FALSE;
+	}
+
+	BOOL const bRet = RemoteSyscallStopped(pProcess, pid, lNumber, uArgs, puResult, &iPendingSignal);
+
+	if (bSeized)
+	{
+		ptrace(PTRACE_DETACH, pid, 0, iPendingSignal);
+	}
+	else
+	{
+		ptrace(PTRACE_CONT, pid, 0, iPendingSignal);
+	}
+	return bRet;
+}
+
+static ADDRESS RemoteReserve(TARGET_PROCESS* const pProcess, ADDRESS const aHint, U64 const uLen, BOOL const bFixed)
+{
+	/* Inaccessible and not accounted for until Target_MemoryCommitExec changes the protection. */
+	U64 const uFlags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (bFixed ? MAP_FIXED_NOREPLACE : 0);
+	U64 uResult = 0;
+	if (!RemoteSyscall(pProcess, SYS_mmap, aHint, uLen, PROT_NONE, uFlags, (U64)-1, 0, &uResult))
+	{
+		return 0;
+	}
+	if (uResult > (U64)-4096)
+	{
+		return 0;
+	}
+
+	/* Kernels without MAP_FIXED_NOREPLACE treat the address as a hint only. */
+	if (bFixed && uResult != aHint)
+	{
+		U64 uIgnored = 0;
+		RemoteSyscall(pProcess, SYS_munmap, uResult, uLen, 0, 0, 0, 0, &uIgnored);
+		return 0;
+	}
+	return uResult;
+}
+
+BOOL Target_MemoryUnprotect(PROCESS const hProcess, ADDRESS const address, U64 const uLen)
+{
+	ADDRESS const aStart = address & ~(ADDRESS)(PAGE_SIZE_LINUX - 1);
+	ADDRESS const aEnd = (address + uLen + PAGE_SIZE_LINUX - 1) & ~(ADDRESS)(PAGE_SIZE_LINUX - 1);
+	U64 uResult = 0;
+	if (!RemoteSyscall((TARGET_PROCESS*)hProcess, SYS_mprotect, aStart, aEnd - aStart, PROT_READ | PROT_WRITE | PROT_EXEC, 0, 0, 0, &uResult))
+	{
+		return FALSE;
+	}
+	return 0 == uResult;
+}
+
+ADDRESS Target_MemoryReserve(PROCESS const hProcess, REGION_MAP* const pRegions, U64 const uLen)
+{
+	ADDRESS const aAlloc = RemoteReserve((TARGET_PROCESS*)hProcess, 0, uLen, FALSE);
+	if (0 != aAlloc && NULL != pRegions)
+	{
+		RegionMapInsert(pRegions, aAlloc, aAlloc + ((uLen + PAGE_SIZE_LINUX - 1) & ~(U64)(PAGE_SIZE_LINUX - 1)));
+	}
+	return aAlloc;
+}
+
+static BOOL RegionMapBuild(PROCESS const hProcess, REGION_MAP* const pRegions)
+{
+	U64 uLen = 0;
+	char* const pMaps = ReadProcFile(((TARGET_PROCESS const*)hProcess)->pid, "maps", &uLen);
+	if (NULL == pMaps)
+	{
+		return FALSE;
+	}
+
+	/* The kernel lists the mappings in ascending order. */
+	pRegions->bStale = FALSE;
+	pRegions->uCount = 0;
+	BOOL bRet = TRUE;
+	char const* pLine = pMaps;
+	while ('\0' != *pLine)
+	{
+		unsigned long long uStart = 0;
+		unsigned long long uEnd = 0;
+		if (2 == sscanf(pLine, "%llx-%llx", &uStart, &uEnd) && !RegionMapAppend(pRegions, uStart, uEnd))
+		{
+			pRegions->bStale = TRUE;
+			bRet = FALSE;
+			break;
+		}
+		char const * const pNext = strchr(pLine, '\n');
+		if (NULL == pNext)
+		{
+			break;
+		}
+		pLine = pNext + 1;
+	}
+
+	free(pMaps);
+	return bRet;
+}
+
+static ADDRESS RegionReserveFixed(PROCESS const hProcess, ADDRESS const aAddress, U64 const uLen)
+{
+	return RemoteReserve((TARGET_PROCESS*)hProcess, aAddress, uLen, TRUE);
+}
+
+ADDRESS Target_MemoryReserveNear(PROCESS const hProcess, REGION_MAP* const pRegions, ADDRESS const aAddressNear, U64 const uNearDistance, U64 const uMinimumSize, U64 const uMaximumSize, U64* const puSize)
+{
+	ADDRESS aMin = MMAP_MIN_ADDRESS;
+	ADDRESS aMax = USER_SPACE_END;
+	if (aAddressNear > uNearDistance && aMin < aAddressNear - uNearDistance)
+	{
+		aMin = aAddressNear - uNearDistance;
+	}
+	if (aMax > aAddressNear + uNearDistance)
+	{
+		aMax = aAddressNear + uNearDistance;
+	}
+
+	return RegionMapReserveNear(hProcess, pRegions, aAddressNear, aMin, aMax, PAGE_SIZE_LINUX, uMinimumSize, uMaximumSize, puSize);
+}
+
+BOOL Target_MemoryCommitExec(PROCESS const hProcess, ADDRESS const address, U64 const uLen)
+{
+	/* Anonymous pages are backed on first touch, only the protection has to change. */
+	return Target_MemoryUnprotect(hProcess, address, uLen);
+}
+
+BOOL Target_MemoryProtectQuery(PROCESS const hProcess, ADDRESS const aAddress, U32* const puProtect, ADDRESS* const paEnd, BOOL* const pbExecutable)
+{
+	U64 uLen = 0;
+	char* const pMaps = ReadProcFile(((TARGET_PROCESS const*)hProcess)->pid, "maps", &uLen);
+	if (NULL == pMaps)
+	{
+		return FALSE;
+	}
+
+	/* An address in a gap reports no access up to the next mapping. */
+	*puProtect = PROT_NONE;
+	*paEnd = USER_SPACE_END;
+	char const* pLine = pMaps;
+	while ('\0' != *pLine)
+	{
+		unsigned long long uStart = 0;
+		unsigned long long uEnd = 0;
+		char szPerms[8] = { 0 };
+		if (3 == sscanf(pLine, "%llx-%llx %7s", &uStart, &uEnd, szPerms) && aAddress < uEnd)
+		{
+			if (aAddress < uStart)
+			{
+				*paEnd = uStart;
+				break;
+			}
+			*puProtect = ('r' == szPerms[0] ? PROT_READ : 0) | ('w' == szPerms[1] ? PROT_WRITE : 0) | ('x' == szPerms[2] ? PROT_EXEC : 0);
+			*paEnd = uEnd;
+			break;
+		}
+		char const * const pNext = strchr(pLine, '\n');
+		if (NULL == pNext)
+		{
+			break;
+		}
+		pLine = pNext + 1;
+	}
+
+	free(pMaps);
+	*pbExecutable = (0 != (*puProtect & PROT_EXEC));
+	return TRUE;
+}
+
+BOOL Target_MemoryExecRevoke(PROCESS const hProcess, ADDRESS const address, U64 const uLen, U32 const uProtect)
+{
+	if (0 == (uProtect & PROT_EXEC))
+	{
+		return FALSE;
+	}
+	return Target_MemoryProtectRestore(hProcess, address, uLen, uProtect & ~(U32)PROT_EXEC);
+}
+
+BOOL Target_MemoryProtectRestore(PROCESS const hProcess, ADDRESS const address, U64 const uLen, U32 const uProtect)
+{
+	U64 uResult = 0;
+	if (!RemoteSyscall((TARGET_PROCESS*)hProcess, SYS_mprotect, address, uLen, uProtect, 0, 0, 0, &uResult))
+	{
+		return FALSE;
+	}
+	return 0 == uResult;
+}
+
+void Target_MemoryFree(PROCESS const hProcess, REGION_MAP* const pRegions, ADDRESS const address, U64 const uLen)
+{
+	U64 uResult = 0;
+	if (RemoteSyscall((TARGET_PROCESS*)hProcess, SYS_munmap, address, uLen, 0, 0, 0, 0, &uResult)
+		&& 0 == uResult
+		&& NULL != pRegions)
+	{
+		RegionMapRemove(pRegions, address, address + ((uLen + PAGE_SIZE_LINUX - 1) & ~(U64)(PAGE_SIZE_LINUX - 1)));
+	}
+}
+
+BOOL Target_DebugBreak(PROCESS const hProcess)
+{
+	/* The debug loop swallows SIGSTOP, so this only wakes it up. */
+	return NULL != hProcess && 0 == kill(((TARGET_PROCESS const*)hProcess)->pid, SIGSTOP);
+}
+
+static BOOL PokeByte(TID const tid, ADDRESS const aAddress, BYTE const uByte)
+{
+	errno = 0;
+	long const lWord = ptrace(PTRACE_PEEKDATA, tid, (void*)aAddress, 0);
+	if (0 != errno)
+	{
+		return FALSE;
+	}
+	long const lPatched = (long)(((unsigned long)lWord & ~0xFFUL) | uByte);
+	return 0 == ptrace(PTRACE_POKEDATA, tid, (void*)aAddress, (void*)lPatched);
+}
+
+BOOL Target_BreakpointAdd(PROCESS const hProcess, ADDRESS const aAddress)
+{
+	BYTE const byte = INT3_BYTE;
+	return Target_MemoryWrite(hProcess, aAddress, &byte, 1);
+}
+
+void Target_BreakpointRemoveTriggered(PROCESS const hProcess, THREAD_TABLE const * const pThreads, TID const tidThread, ADDRESS const aAddress, BYTE const uOriginalByte)
+{
+	/* Must run on the tracer thread while tidThread sits in its breakpoint stop. TIDs are usable as they are. */
+	(void)hProcess;
+	(void)pThreads;
+	struct user_regs_struct regs;
+	if (0 != ptrace(PTRACE_GETREGS, tidThread, 0, &regs))
+	{
+		return;
+	}
+	regs.rip -= 1;
+	if (0 != ptrace(PTRACE_SETREGS, tidThread, 0, &regs))
+	{
+		return;
+	}
+	PokeByte(tidThread, aAddress, uOriginalByte);
 }
 
 void Target_BreakpointRemoveDormant(PROCESS const hProcess, ADDRESS const aAddress, BYTE const uOriginalByte)
 {
 	BYTE const byte = uOriginalByte;
-	WriteProcessMemory(hProcess, (LPVOID)aAddress, &byte, 1, NULL);
-	FlushInstructionCache(hProcess, (LPCVOID)aAddress, 1);
+	Target_MemoryWrite(hProcess, aAddress, &byte, 1);
 }
 
 PROCESS Target_HandleAcquire(PID const pidProcess)
 {
-	HANDLE const hProcess = OpenProcess(PROCESS_ALL_ACCESS, FALSE, pidProcess);
-	if (NULL == hProcess)
+	char szPath[64];
+	snprintf(szPath, sizeof(szPath), "/proc/%d/mem", pidProcess);
+	int const fd = open(szPath, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
 	{
 		return NULL;
 	}
-	return hProcess;
+
+	TARGET_PROCESS* const pProcess = malloc(sizeof(TARGET_PROCESS));
+	if (NULL == pProcess)
+	{
+		close(fd);
+		return NULL;
+	}
+	pProcess->pid = pidProcess;
+	pProcess->fdMem = fd;
+	pProcess->aSyscallGadget = 0;
+	pProcess->pRemoteCall = NULL;
+	pthread_mutex_init(&(pProcess->mutexRemote), NULL);
+	pthread_cond_init(&(pProcess->condRemote), NULL);
+	return pProcess;
 }
 
-BOOL Target_HandleRelease(PROCESS process)
+BOOL Target_HandleRelease(PROCESS const process)
 {
-	return CloseHandle(process);
+	TARGET_PROCESS* const pProcess = (TARGET_PROCESS*)process;
+	if (NULL == pProcess)
+	{
+		return FALSE;
+	}
+	close(pProcess->fdMem);
+	pthread_cond_destroy(&(pProcess->condRemote));
+	pthread_mutex_destroy(&(pProcess->mutexRemote));
+	free(pProcess);
+	return TRUE;
+}
+
+BOOL Target_ModuleFind(PROCESS const hProcess, char const * const szName, ADDRESS* const paBase)
+{
+	TARGET_MODULE* pModules = NULL;
+	U32 uCount = 0;
+	if (!Target_ModulesCollect(hProcess, &pModules, &uCount))
+	{
+		return FALSE;
+	}
+	BOOL bFound = FALSE;
+	for (U32 i = 0; i < uCount && !bFound; i++)
+	{
+		if (0 == strcmp(pModules[i].szName, szName))
+		{
+			*paBase = pModules[i].aBase;
+			bFound = TRUE;
+		}
+	}
+	free(pModules);
+	return bFound;
+}
+
+BOOL Target_ModulesCollect(PROCESS const hProcess, TARGET_MODULE** const ppModules, U32* const puCount)
+{
+	*ppModules = NULL;
+	*puCount = 0;
+	U64 uLen = 0;
+	char* const pMaps = ReadProcFile(((TARGET_PROCESS const*)hProcess)->pid, "maps", &uLen);
+	if (NULL == pMaps)
+	{
+		return FALSE;
+	}
+	U32 uLines = 1;
+	for (U64 i = 0; i < uLen; i++)
+	{
+		uLines += ('\n' == pMaps[i]) ? 1 : 0;
+	}
+	TARGET_MODULE* const pModules = malloc((U64)uLines * sizeof(TARGET_MODULE));
+	if (NULL == pModules)
+	{
+		free(pMaps);
+		return FALSE;
+	}
+
+	/*
+	 * The first mapping of a file at offset 0 holds its ELF header, that is where the module starts.
+	 * The mappings of the same file right after it belong to the module too.
+	 */
+	U32 uCount = 0;
+	char const* pLastPath = NULL;
+	U64 uLastPathLen = 0;
+	char const* pLine = pMaps;
+	while ('\0' != *pLine)
+	{
+		char const * const pNext = strchr(pLine, '\n');
+		char const * const pEnd = (NULL == pNext) ? pLine + strlen(pLine) : pNext;
+		unsigned long long uStart = 0;
+		unsigned long long uEnd = 0;
+		unsigned long long uOffset = 0;
+		int iPath = 0; /* set past the inode, the whitespace skip may run into the next line when there is no path */
+		if (3 == sscanf(pLine, "%llx-%llx %*s %llx %*s %*s %n", &uStart, &uEnd, &uOffset, &iPath)
+			&& pLine + iPath < pEnd
+			&& '/' == pLine[iPath])
+		{
+			char const * const pPath = pLine + iPath;
+			U64 const uPathLen = (U64)(pEnd - pPath);
+			if (NULL != pLastPath && uPathLen == uLastPathLen && 0 == memcmp(pPath, pLastPath, uPathLen))
+			{
+				pModules[uCount - 1].uSize = uEnd - pModules[uCount - 1].aBase;
+			}
+			else if (0 != uOffset)
+			{
+				pLastPath = NULL;
+			}
+			else
+			{
+				char const* pFile = pEnd;
+				while ('/' != pFile[-1])
+				{
+					pFile--;
+				}
+				U64 uNameLen = (U64)(pEnd - pFile);
+				uNameLen = (uNameLen < TARGET_MODULE_NAME_MAX) ? uNameLen : TARGET_MODULE_NAME_MAX - 1;
+				TARGET_MODULE* const pModule = &(pModules[uCount++]);
+				pModule->aBase = uStart;
+				pModule->uSize = uEnd - uStart;
+				memcpy(pModule->szName, pFile, uNameLen);
+				pModule->szName[uNameLen] = '\0';
+				pLastPath = pPath;
+				uLastPathLen = uPathLen;
+			}
+		}
+		else
+		{
+			pLastPath = NULL;
+		}
+		if (NULL == pNext)
+		{
+			break;
+		}
+		pLine = pNext + 1;
+	}
+
+	free(pMaps);
+	*ppModules = pModules;
+	*puCount = uCount;
+	return TRUE;
 }
 
 BOOL Thread_Start(THREAD_INIT_FUNC const fnFunc, void* const pParam, THREAD* const pThread)
 {
+	*pThread = NULL;
+	LINUX_THREAD* const pLinuxThread = Memory_Alloc(sizeof(LINUX_THREAD));
 	THREAD_INIT_INFO* const pInitInfo = Memory_Alloc(sizeof(THREAD_INIT_INFO));
-	if (NULL == pInitInfo)
+	if (NULL == pLinuxThread || NULL == pInitInfo)
 	{
-		*pThread = NULL;
+		Memory_Free(pLinuxThread);
+		Memory_Free(pInitInfo);
 		return FALSE;
 	}
 
 	pInitInfo->fnFunc = fnFunc;
 	pInitInfo->pParam = pParam;
-	
-	HANDLE const hThread = CreateThread(NULL, 0, Thread_Init, pInitInfo, 0, NULL);
-	if (NULL == hThread)
+	pLinuxThread->bJoined = FALSE;
+
+	if (0 != pthread_create(&(pLinuxThread->thread), NULL, Thread_Init, pInitInfo))
 	{
-		*pThread = NULL;
+		Memory_Free(pLinuxThread);
+		Memory_Free(pInitInfo);
 		return FALSE;
 	}
 
-	*pThread = hThread;
+	*pThread = pLinuxThread;
 	return TRUE;
 }
 
-static DWORD WINAPI Thread_Init(void* lpParam)
+static void* Thread_Init(void* lpParam)
 {
 	THREAD_INIT_INFO* const pInitInfo = (THREAD_INIT_INFO*)lpParam;
 	pInitInfo->fnFunc(pInitInfo->pParam);
 	Memory_Free(pInitInfo);
-	return 0;
+	return NULL;
 }
 
 BOOL Thread_WaitExit(THREAD const hThread, U32 const uTimeoutMS)
 {
-	return WAIT_OBJECT_0 == WaitForSingleObject(hThread, uTimeoutMS);
+	LINUX_THREAD* const pLinuxThread = (LINUX_THREAD*)hThread;
+	if (pLinuxThread->bJoined)
+	{
+		return TRUE;
+	}
+
+	struct timespec deadline;
+	DeadlineAfter(uTimeoutMS, &deadline);
+
+	pLinuxThread->bJoined = (0 == pthread_timedjoin_np(pLinuxThread->thread, NULL, &deadline));
+	return pLinuxThread->bJoined;
 }
 
 BOOL Thread_Close(THREAD const hThread)
 {
-	return CloseHandle(hThread);
+	LINUX_THREAD* const pLinuxThread = (LINUX_THREAD*)hThread;
+	if (!pLinuxThread->bJoined)
+	{
+		pthread_detach(pLinuxThread->thread);
+	}
+	Memory_Free(pLinuxThread);
+	return TRUE;
 }
 
-BOOL Target_WaitForBreakpoint(BREAKPOINT_HANDLER_FUNC const pBreakpointHandler, void* const pParam)
+void Thread_SpinWait(U32 const uRound)
 {
-	DEBUG_EVENT debugEvent;
-	DWORD dwContinueStatus = DBG_CONTINUE;
-	BOOL bTargetDied = FALSE;
+	if (uRound < THREAD_SPIN_PAUSE_ROUNDS)
+	{
+		_mm_pause();
+		return;
+	}
+	sched_yield();
+}
 
-	WaitForDebugEvent(&debugEvent, INFINITE);
+SEMAPHORE Semaphore_Create(void)
+{
+	sem_t* const pSemaphore = malloc(sizeof(sem_t));
+	if (NULL != pSemaphore && 0 != sem_init(pSemaphore, 0, 0))
+	{
+		free(pSemaphore);
+		return NULL;
+	}
+	return pSemaphore;
+}
 
-	switch(debugEvent.dwDebugEventCode)
+void Semaphore_Post(SEMAPHORE const hSemaphore, U32 const uCount)
+{
+	for (U32 i = 0; i < uCount; i++)
 	{
-		case EXCEPTION_DEBUG_EVENT:
-			if(EXCEPTION_BREAKPOINT == debugEvent.u.Exception.ExceptionRecord.ExceptionCode)
+		sem_post((sem_t*)hSemaphore);
+	}
+}
+
+void Semaphore_Wait(SEMAPHORE const hSemaphore)
+{
+	while (0 != sem_wait((sem_t*)hSemaphore) && EINTR == errno)
+	{
+	}
+}
+
+void Semaphore_Free(SEMAPHORE const hSemaphore)
+{
+	sem_destroy((sem_t*)hSemaphore);
+	free(hSemaphore);
+}
+
+BOOL File_MapCreate(char const * const szPath, U64 const uSize, FILE_VIEW* const pView)
+{
+	pView->pData = NULL;
+	pView->uSize = 0;
+	int const fd = open(szPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		return FALSE;
+	}
+
+	/* The mapping outlives the descriptor. */
+	void* pData = MAP_FAILED;
+	if (0 == ftruncate(fd, (off_t)uSize))
+	{
+		pData = mmap(NULL, uSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (MAP_FAILED == pData)
+	{
+		return FALSE;
+	}
+	pView->pData = pData;
+	pView->uSize = uSize;
+	return TRUE;
+}
+
+BOOL File_MapRead(char const * const szPath, FILE_VIEW* const pView)
+{
+	pView->pData = NULL;
+	pView->uSize = 0;
+	int const fd = open(szPath, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return FALSE;
+	}
+	struct stat st;
+	void* pData = MAP_FAILED;
+	if (0 == fstat(fd, &st) && 0 < st.st_size)
+	{
+		pData = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (MAP_FAILED == pData)
+	{
+		return FALSE;
+	}
+	pView->pData = pData;
+	pView->uSize = (U64)st.st_size;
+	return TRUE;
+}
+
+BOOL File_MapFlush(FILE_VIEW const * const pView)
+{
+	return NULL != pView->pData && 0 == msync(pView->pData, pView->uSize, MS_SYNC);
+}
+
+void File_Unmap(FILE_VIEW* const pView)
+{
+	if (NULL != pView->pData)
+	{
+		munmap(pView->pData, pView->uSize);
+	}
+	pView->pData = NULL;
+	pView->uSize = 0;
+}
+
+U64 Time_Now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (U64)now.tv_sec * 1000000000ULL + (U64)now.tv_nsec;
+}
+
+static BOOL HwBreakpointsPoke(TID const tid, HW_BREAKPOINTS const * const pHwBreakpoints)
+{
+	/* The tracee has to be stopped. Slots are disabled first, so no address is ever armed half written. */
+	if (0 != ptrace(PTRACE_POKEUSER, tid, (void*)offsetof(struct user, u_debugreg[7]), 0))
+	{
+		return FALSE;
+	}
+	for (U32 i = 0; i < HW_BREAKPOINT_COUNT; i++)
+	{
+		ADDRESS const aSlot = pHwBreakpoints->aSlots[i];
+		U64 const uOffset = offsetof(struct user, u_debugreg) + i * sizeof(((struct user*)0)->u_debugreg[0]);
+		if (0 != aSlot && 0 != ptrace(PTRACE_POKEUSER, tid, (void*)uOffset, (void*)aSlot))
+		{
+			return FALSE;
+		}
+	}
+	U64 const uDr7 = HwBreakpointsDr7(pHwBreakpoints);
+	return 0 == uDr7 || 0 == ptrace(PTRACE_POKEUSER, tid, (void*)offsetof(struct user, u_debugreg[7]), (void*)uDr7);
+}
+
+static void HwBreakpointsApply(TID const tidStopped, HW_BREAKPOINTS* const pHwBreakpoints)
+{
+	/* Running threads cannot be written, they are interrupted and pick the slots up at their PTRACE_EVENT_STOP. */
+	pHwBreakpoints->uAppliedGeneration = pHwBreakpoints->uGeneration;
+	if (0 != tidStopped)
+	{
+		HwBreakpointsPoke(tidStopped, pHwBreakpoints);
+	}
+
+	U32 uCount = 0;
+	TID* const pTids = ListThreads(gtlsTracedPid, &uCount);
+	for (U32 i = 0; i < uCount; i++)
+	{
+		if (tidStopped != pTids[i])
+		{
+			ptrace(PTRACE_INTERRUPT, pTids[i], 0, 0);
+		}
+	}
+	free(pTids);
+}
+
+static BOOL IsExecuteFault(TID const tid, ADDRESS const aFault)
+{
+	/* The fetch faults on the page of rip, or on the next one for an instruction that crosses into it. */
+	errno = 0;
+	long const lRip = ptrace(PTRACE_PEEKUSER, tid, (void*)offsetof(struct user_regs_struct, rip), 0);
+	if (0 != errno)
+	{
+		return FALSE;
+	}
+	ADDRESS const aFirst = (ADDRESS)lRip & ~(ADDRESS)(PAGE_SIZE_LINUX - 1);
+	ADDRESS const aLast = ((ADDRESS)lRip + 14) & ~(ADDRESS)(PAGE_SIZE_LINUX - 1);
+	ADDRESS const aPage = aFault & ~(ADDRESS)(PAGE_SIZE_LINUX - 1);
+	return aPage == aFirst || aPage == aLast;
+}
+
+BOOL Target_WaitForBreakpoint(PROCESS const hProcess, THREAD_TABLE* const pThreads, REGION_MAP* const pRegions, HW_BREAKPOINTS* const pHwBreakpoints, BREAKPOINT_HANDLER_FUNC const pBreakpointHandler, HW_BREAKPOINT_HANDLER_FUNC const pHwBreakpointHandler, PAGE_FAULT_HANDLER_FUNC const pPageFaultHandler, void* const pParam, U32 const uTimeoutMS)
+{
+	/*
+	 * ptrace reports no library loads, stale maps are caught when a gap turns out to be taken.
+	 * waitpid has no timeout, it is polled with a pause that starts short for bursts of events
+	 * and grows up to EVENT_POLL_MAX_US while the target runs undisturbed. __WNOTHREAD keeps the
+	 * loop to the tracees of its own thread, the loops of other contexts wait for theirs.
+	 */
+	(void)pRegions;
+	U64 const uDeadline = Time_Now() + (U64)uTimeoutMS * 1000000ULL;
+	U64 uPauseUs = EVENT_POLL_MIN_US;
+	int status = 0;
+	TID tid = waitpid(-1, &status, __WALL | __WNOTHREAD | WNOHANG);
+	while (0 == tid && Time_Now() < uDeadline)
+	{
+		struct timespec const pause = { 0, (long)(uPauseUs * 1000) };
+		nanosleep(&pause, NULL);
+		uPauseUs = (2 * uPauseUs < EVENT_POLL_MAX_US) ? 2 * uPauseUs : EVENT_POLL_MAX_US;
+		tid = waitpid(-1, &status, __WALL | __WNOTHREAD | WNOHANG);
+	}
+
+	for (U32 i = 1; tid > 0; i++)
+	{
+		if (DebugEventHandle(hProcess, pThreads, pHwBreakpoints, pBreakpointHandler, pHwBreakpointHandler, pPageFaultHandler, pParam, tid, status))
+		{
+			return TRUE;
+		}
+		if (i >= TARGET_EVENT_BATCH)
+		{
+			return FALSE;
+		}
+		tid = waitpid(-1, &status, __WALL | __WNOTHREAD | WNOHANG);
+	}
+	/* ECHILD: nothing left to trace. */
+	return tid < 0 && EINTR != errno;
+}
+
+void Target_HwBreakpointsApply(PROCESS const hProcess, THREAD_TABLE const * const pThreads, HW_BREAKPOINTS* const pHwBreakpoints)
+{
+	(void)hProcess;
+	(void)pThreads;
+	HwBreakpointsApply(0, pHwBreakpoints);
+}
+
+static BOOL DebugEventHandle(PROCESS const hProcess, THREAD_TABLE* const pThreads, HW_BREAKPOINTS* const pHwBreakpoints, BREAKPOINT_HANDLER_FUNC const pBreakpointHandler, HW_BREAKPOINT_HANDLER_FUNC const pHwBreakpointHandler, PAGE_FAULT_HANDLER_FUNC const pPageFaultHandler, void* const pParam, TID const tid, int const status)
+{
+	TARGET_PROCESS* const pProcess = (TARGET_PROCESS*)hProcess;
+	if (WIFEXITED(status) || WIFSIGNALED(status))
+	{
+		/* The thread group leader is reported last, after every other thread is gone. */
+		return tid == gtlsTracedPid;
+	}
+	if (!WIFSTOPPED(status))
+	{
+		return FALSE;
+	}
+
+	int const iEvent = status >> 16;
+	int const iStopSignal = WSTOPSIG(status);
+	int iSignal = 0;
+
+	if (PTRACE_EVENT_STOP == iEvent && SIGTRAP != iStopSignal)
+	{
+		/* Group-stop: keep the job control semantics and let the thread sleep. */
+		ptrace(PTRACE_LISTEN, tid, 0, 0);
+		return FALSE;
+	}
+	if (PTRACE_EVENT_STOP == iEvent && 0 != pHwBreakpoints->uAppliedGeneration)
+	{
+		/* Either interrupted by HwBreakpointsApply or the first stop of a new thread, both need the current slots. */
+		HwBreakpointsPoke(tid, pHwBreakpoints);
+	}
+	if (0 == iEvent && SIGTRAP == iStopSignal)
+	{
+		siginfo_t si;
+		BOOL bOurs = FALSE;
+		BOOL const bSigInfo = (0 == ptrace(PTRACE_GETSIGINFO, tid, 0, &si));
+		if (bSigInfo && SI_TRAP_HWBKPT == si.si_code)
+		{
+			/* Only we write the debug registers, so the hit is ours even if its slot was freed meanwhile. */
+			pHwBreakpointHandler(pParam, tid, (ADDRESS)si.si_addr);
+			bOurs = TRUE;
+		}
+		else if (bSigInfo && SI_KERNEL_INT3 == si.si_code)
+		{
+			errno = 0;
+			long const lRip = ptrace(PTRACE_PEEKUSER, tid, (void*)offsetof(struct user_regs_struct, rip), 0);
+			if (0 == errno)
 			{
-				ADDRESS const aAddress = (ADDRESS)debugEvent.u.Exception.ExceptionRecord.ExceptionAddress;
+				ADDRESS const aAddress = (ADDRESS)lRip - 1;
 				BYTE uOriginalByte = 0;
-				BOOL bRemoveBreakpoint = pBreakpointHandler(pParam, aAddress, &uOriginalByte);
-				if (bRemoveBreakpoint)
+				bOurs = pBreakpointHandler(pParam, tid, aAddress, &uOriginalByte);
+				if (bOurs)
 				{
-					Target_BreakpointRemoveTriggered(debugEvent.dwProcessId, debugEvent.dwThreadId, aAddress, uOriginalByte);
+					Target_BreakpointRemoveTriggered(hProcess, pThreads, tid, aAddress, uOriginalByte);
 				}
 			}
-			else
-			{
-				dwContinueStatus = DBG_EXCEPTION_NOT_HANDLED;
-			}
-			break;
-
-		case CREATE_THREAD_DEBUG_EVENT:
-			if (NULL != debugEvent.u.CreateThread.hThread)
-			{
-				CloseHandle(debugEvent.u.CreateThread.hThread);
-			}
-			break;
-
-		case CREATE_PROCESS_DEBUG_EVENT:
-			if (NULL != debugEvent.u.CreateProcessInfo.hFile)
-			{
-				CloseHandle(debugEvent.u.CreateProcessInfo.hFile);
-			}
-			if (NULL != debugEvent.u.CreateProcessInfo.hProcess)
-			{
-				CloseHandle(debugEvent.u.CreateProcessInfo.hProcess);
-			}
-			if (NULL != debugEvent.u.CreateProcessInfo.hThread)
+		}
+		iSignal = bOurs ? 0 : SIGTRAP;
+	}
+	else if (0 == iEvent && SIGSEGV == iStopSignal)
+	{
+		siginfo_t si;
+		iSignal = SIGSEGV;
+		if (0 == ptrace(PTRACE_GETSIGINFO, tid, 0, &si) && SEGV_ACCERR == si.si_code && IsExecuteFault(tid, (ADDRESS)si.si_addr))
+		{
+			ADDRESS const aPage = (ADDRESS)si.si_addr & ~(ADDRESS)(PAGE_SIZE_LINUX - 1);
+			U32 uProtect = 0;
+			ADDRESS aEnd = 0;
+			BOOL bExecutable = FALSE;
+			if (pPageFaultHandler(pParam, tid, aPage, &uProtect))
 			{
-				CloseHandle(debugEvent.u.CreateProcessInfo.hThread);
+				/* The faulting thread is stopped right here, it makes the mprotect itself. */
+				U64 const uArgs[6] = { aPage, PAGE_SIZE_LINUX, uProtect, 0, 0, 0 };
+				U64 uResult = 0;
+				int iPendingSignal = 0;
+				if (RemoteSyscallStopped(pProcess, tid, SYS_mprotect, uArgs, &uResult, &iPendingSignal) && 0 == uResult)
+				{
+					iSignal = iPendingSignal;
+				}
 			}
-			break;
-
-		case LOAD_DLL_DEBUG_EVENT:
-			if (NULL != debugEvent.u.LoadDll.hFile)
+			else if (Target_MemoryProtectQuery(hProcess, aPage, &uProtect, &aEnd, &bExecutable) && bExecutable)
 			{
-				CloseHandle(debugEvent.u.LoadDll.hFile);
+				iSignal = 0;
 			}
-			break;
-
-		case EXIT_PROCESS_DEBUG_EVENT:
-		case RIP_EVENT:
-			bTargetDied = TRUE;
-			break;
-
-		default:
-			break;
+		}
+	}
+	else if (0 == iEvent && SIGSTOP != iStopSignal)
+	{
+		iSignal = iStopSignal;
 	}
 
-	ContinueDebugEvent(debugEvent.dwProcessId, debugEvent.dwThreadId, dwContinueStatus);
-	return bTargetDied;
-}
+	RemoteCallServe(pProcess, tid, &iSignal);
+	if (pHwBreakpoints->uGeneration != pHwBreakpoints->uAppliedGeneration)
+	{
+		HwBreakpointsApply(tid, pHwBreakpoints);
+	}
 
-void Target_MemoryFree(PROCESS const hProcess, ADDRESS const address)
-{
-	VirtualFreeEx(hProcess, (LPVOID)address, 0, MEM_RELEASE);
+	ptrace(PTRACE_CONT, tid, 0, iSignal);
+	return FALSE;
 }
 
-#endif /* _WIN32 */
-
-#ifdef LINUX
-#error "Linux support is not implemented"
 #endif /* LINUX */
@@ -7,47 +7,210 @@
 typedef unsigned long PID;
 typedef unsigned long TID;
 typedef void* THREAD;
+typedef void* SEMAPHORE;
 typedef void (*THREAD_INIT_FUNC)(void*);
-typedef BOOL (*BREAKPOINT_HANDLER_FUNC)(void*, ADDRESS, BYTE*);
+typedef BOOL (*BREAKPOINT_HANDLER_FUNC)(void*, TID, ADDRESS, BYTE*);
+typedef void (*HW_BREAKPOINT_HANDLER_FUNC)(void*, TID, ADDRESS);
+typedef BOOL (*PAGE_FAULT_HANDLER_FUNC)(void*, TID, ADDRESS, U32*);
 typedef void* PROCESS;
 #define DISTANCE_NEAR (0x7FFFFFFF) /* 2GB - 1 */
 #endif /* _WIN32 */
 
 #ifdef LINUX
-#error "Linux support not implemented"
+typedef int PID;
+typedef int TID;
+typedef void* THREAD;
+typedef void* SEMAPHORE;
+typedef void (*THREAD_INIT_FUNC)(void*);
+typedef BOOL (*BREAKPOINT_HANDLER_FUNC)(void*, TID, ADDRESS, BYTE*);
+typedef void (*HW_BREAKPOINT_HANDLER_FUNC)(void*, TID, ADDRESS);
+typedef BOOL (*PAGE_FAULT_HANDLER_FUNC)(void*, TID, ADDRESS, U32*);
+typedef void* PROCESS;
+#define DISTANCE_NEAR (0x7FFFFFFF) /* 2GB - 1 */
 #endif /* LINUX */
 
+#define INT3_BYTE (0xCC)
+
+/* A pending write of a few bytes into the target, see Target_PatchBatch*. */
+#define PATCH_MAX_LEN (16)
+
+typedef struct tdPATCH {
+	ADDRESS aAddress;
+	U32 uTag;
+	BOOL bApplied;
+	BYTE uBytes[PATCH_MAX_LEN];
+	BYTE uLen;
+	BYTE _padding[7];
+} PATCH;
+
+/*
+ * Patches are collected first and then written sorted by address: one write per run of
+ * adjacent patches, one protection change per region and one instruction cache flush per batch.
+ * Patches must not overlap. uTag is free for the caller to map results back.
+ */
+typedef struct tdPATCH_BATCH {
+	PATCH* pPatches;
+	U32 uCount;
+	U32 uCapacity;
+} PATCH_BATCH;
+
+#define TARGET_MODULE_NAME_MAX (256)
+
+/* A loaded module, szName is its file name without directories. */
+typedef struct tdTARGET_MODULE {
+	ADDRESS aBase;
+	U64 uSize;
+	char szName[TARGET_MODULE_NAME_MAX];
+} TARGET_MODULE;
+
+/* A whole file mapped into our own address space. */
+typedef struct tdFILE_VIEW {
+	void* pData;
+	U64 uSize;
+} FILE_VIEW;
+
+/*
+ * Thread handles of the debuggee, sorted by TID. The debug loop keeps them from thread creation
+ * to thread exit, so breakpoint handling does not have to open a handle per hit.
+ * Linux uses TIDs directly and leaves the table empty.
+ */
+typedef struct tdTHREAD_TABLE {
+	TID* pTids;
+	THREAD* phThreads;
+	U32 uCount;
+	U32 uCapacity;
+} THREAD_TABLE;
+
+#define HW_BREAKPOINT_COUNT (4)
+
+/*
+ * Execution breakpoints in the debug registers DR0-DR3, 0 marks a free slot. Whoever changes the
+ * slots bumps uGeneration. The debug loop copies them into every thread, including threads created
+ * later, and keeps uAppliedGeneration at the generation it wrote last.
+ */
+typedef struct tdHW_BREAKPOINTS {
+	ADDRESS aSlots[HW_BREAKPOINT_COUNT];
+	U32 uGeneration;
+	U32 uAppliedGeneration;
+} HW_BREAKPOINTS;
+
+typedef struct tdREGION {
+	ADDRESS aStart;
+	ADDRESS aEnd;
+} REGION;
+
+/*
+ * Used address ranges of the target, sorted and [start, end). Built with one sweep of the address
+ * space and kept current by the allocations and frees made through it, so near allocations search
+ * memory instead of querying the target. Memory mapped by anyone else (module loads, the target's
+ * own allocations) sets bStale and the next near allocation sweeps again.
+ */
+typedef struct tdREGION_MAP {
+	REGION* pRegions;
+	U32 uCount;
+	U32 uCapacity;
+	BOOL bStale;
+	BYTE _padding[4];
+} REGION_MAP;
+
 BOOL Process_CheckPrivileges(void);
 
 void* Memory_Alloc(U64 uSize);
 BOOL Memory_Free(void* address);
+/* Picks AVX2 or SSE2 code on first use, depending on what the CPU and OS support. */
 void* Memory_Copy(void* pDest, void const* pSrc, U64 uLen);
+void* Memory_Set(void* pDest, BYTE uValue, U64 uLen);
+int Memory_Compare(void const* pLeft, void const* pRight, U64 uLen);
+
+/* Loads and stores of values shared between the debug loop and client threads, ordered against the accesses around them. */
+U64 Atomic_LoadAcquire(U64 const volatile* puValue);
+void Atomic_StoreRelease(U64 volatile* puValue, U64 uValue);
+/* Returns the incremented value. Safe against increments from other threads at the same time, a full barrier. */
+U32 Atomic_Increment(U32 volatile* puValue);
+/* Stores uDesired if the value is uExpected and tells if it did, a full barrier. */
+BOOL Atomic_CompareExchange(U32 volatile* puValue, U32 uExpected, U32 uDesired);
 
-BOOL Target_Is64bit(PID pidTarget);
-BOOL Target_DebuggerAttach(PID pidTarget);
-BOOL Target_DebuggerDetach(PID pidTarget);
-BOOL Target_IsDebuggerAttached(PID pidTarget, BOOL* pbDebuggerPresent);
+/* Monotonic clock in nanoseconds, for ordering and timing events only. */
+U64 Time_Now(void);
 
-BOOL Target_WaitForBreakpoint(BREAKPOINT_HANDLER_FUNC pBreakpointHandler, void* pParam);
-BOOL Target_DebugBreak(PID pidTarget);
+BOOL Target_Is64bit(PROCESS hProcess);
+BOOL Target_IsAlive(PROCESS hProcess);
+BOOL Target_DebuggerAttach(PID pidTarget, THREAD_TABLE* pThreads);
+/* Clears the debug registers of every thread first, if breakpoints were ever written there. */
+BOOL Target_DebuggerDetach(PID pidTarget, THREAD_TABLE* pThreads, HW_BREAKPOINTS* pHwBreakpoints);
+BOOL Target_IsDebuggerAttached(PROCESS hProcess, BOOL* pbDebuggerPresent);
+
+#define TARGET_EVENT_BATCH (64)
+
+/*
+ * Execute faults are passed to pPageFaultHandler with the page base. It returns TRUE and the protection to put
+ * back if the page was revoked by Target_MemoryExecRevoke, the faulting instruction then runs again. Faults on
+ * pages that are executable again by the time they are handled (other threads racing into the same page) are
+ * dropped, all others go to the target.
+ *
+ * Waits up to uTimeoutMS for the first event, then handles the events already queued behind it, at most
+ * TARGET_EVENT_BATCH in one call so the caller gets back to its own work. TRUE once the target died.
+ */
+BOOL Target_WaitForBreakpoint(PROCESS hProcess, THREAD_TABLE* pThreads, REGION_MAP* pRegions, HW_BREAKPOINTS* pHwBreakpoints, BREAKPOINT_HANDLER_FUNC pBreakpointHandler, HW_BREAKPOINT_HANDLER_FUNC pHwBreakpointHandler, PAGE_FAULT_HANDLER_FUNC pPageFaultHandler, void* pParam, U32 uTimeoutMS);
+/* Writes changed slots while no event is pending, on the thread that runs Target_WaitForBreakpoint. */
+void Target_HwBreakpointsApply(PROCESS hProcess, THREAD_TABLE const* pThreads, HW_BREAKPOINTS* pHwBreakpoints);
+BOOL Target_DebugBreak(PROCESS hProcess);
 
 BOOL Target_BreakpointAdd(PROCESS hProcess, ADDRESS aAddress);
-void Target_BreakpointRemoveTriggered(PID pidTarget, TID tidThread, ADDRESS aAddress, BYTE uOriginalByte);
+void Target_BreakpointRemoveTriggered(PROCESS hProcess, THREAD_TABLE const* pThreads, TID tidThread, ADDRESS aAddress, BYTE uOriginalByte);
 void Target_BreakpointRemoveDormant(PROCESS hProcess, ADDRESS aAddress, BYTE uOriginalByte);
 
 PROCESS Target_HandleAcquire(PID pidTarget);
 BOOL Target_HandleRelease(PROCESS hProcess);
+/* Base of the loaded module whose file name (without directories) is szName, case-insensitive on Windows. */
+BOOL Target_ModuleFind(PROCESS hProcess, char const* szName, ADDRESS* paBase);
+/* Every loaded module, in no particular order. *ppModules is freed with Memory_Free. */
+BOOL Target_ModulesCollect(PROCESS hProcess, TARGET_MODULE** ppModules, U32* puCount);
 
 BOOL Target_MemoryRead(PROCESS hProcess, ADDRESS aSrc, void* pDest, U64 uLen);
 BOOL Target_MemoryWrite(PROCESS hProcess, ADDRESS aDest, void const * pSrc, U64 uLen);
 BOOL Target_MemoryWriteFlush(PROCESS hProcess, ADDRESS aDest, void const * pSrc, U64 uLen);
 BOOL Target_MemoryUnprotect(PROCESS hProcess, ADDRESS address, U64 uLen);
-ADDRESS Target_MemoryAllocExec(PROCESS hProcess, U64 uLen);
-ADDRESS Target_MemoryAllocExecNear(PROCESS hProcess, ADDRESS aAddressNear, U64 uNearDistance, U64 uMinimumSize, U64* puSize);
-void Target_MemoryFree(PROCESS hProcess, ADDRESS address);
+/* Reserved memory cannot be accessed until Target_MemoryCommitExec makes it executable read-write. */
+ADDRESS Target_MemoryReserve(PROCESS hProcess, REGION_MAP* pRegions, U64 uLen);
+ADDRESS Target_MemoryReserveNear(PROCESS hProcess, REGION_MAP* pRegions, ADDRESS aAddressNear, U64 uNearDistance, U64 uMinimumSize, U64 uMaximumSize, U64* puSize);
+BOOL Target_MemoryCommitExec(PROCESS hProcess, ADDRESS address, U64 uLen);
+/*
+ * Protection of the region holding aAddress, in the terms of the OS, and where that protection ends.
+ * Revoking execute keeps read and write access as they are in uProtect; on Linux the debug loop
+ * carries the change out if it owns the target.
+ */
+BOOL Target_MemoryProtectQuery(PROCESS hProcess, ADDRESS aAddress, U32* puProtect, ADDRESS* paEnd, BOOL* pbExecutable);
+BOOL Target_MemoryExecRevoke(PROCESS hProcess, ADDRESS address, U64 uLen, U32 uProtect);
+BOOL Target_MemoryProtectRestore(PROCESS hProcess, ADDRESS address, U64 uLen, U32 uProtect);
+void Target_MemoryFree(PROCESS hProcess, REGION_MAP* pRegions, ADDRESS address, U64 uLen);
+void Target_RegionMapFree(REGION_MAP* pRegions);
+
+BOOL Target_PatchBatchInit(PATCH_BATCH* pBatch, U32 uCapacity);
+BOOL Target_PatchBatchAdd(PATCH_BATCH* pBatch, ADDRESS aAddress, void const* pBytes, U32 uLen, U32 uTag);
+U32 Target_PatchBatchApply(PROCESS hProcess, PATCH_BATCH* pBatch);
+U32 Target_PatchBatchUnprotect(PROCESS hProcess, PATCH_BATCH* pBatch);
+void Target_PatchBatchFree(PATCH_BATCH* pBatch);
 
 BOOL Thread_Start(THREAD_INIT_FUNC fnFunc, void* pParam, THREAD* pThread);
 BOOL Thread_WaitExit(THREAD hThread, U32 uTimeoutMS);
 BOOL Thread_Close(THREAD hThread);
+/* One round of waiting in a spin loop: a pause instruction for the first rounds, then the time slice is given away. */
+void Thread_SpinWait(U32 uRound);
+
+/* Counting semaphore for handing work to threads of our own. Waits have no timeout. */
+SEMAPHORE Semaphore_Create(void);
+void Semaphore_Post(SEMAPHORE hSemaphore, U32 uCount);
+void Semaphore_Wait(SEMAPHORE hSemaphore);
+void Semaphore_Free(SEMAPHORE hSemaphore);
+
+/*
+ * MapCreate creates or truncates szPath to uSize bytes and maps it writable, MapRead maps it read-only.
+ * MapFlush writes the changed pages of a writable view back to the file before it returns.
+ */
+BOOL File_MapCreate(char const* szPath, U64 uSize, FILE_VIEW* pView);
+BOOL File_MapRead(char const* szPath, FILE_VIEW* pView);
+BOOL File_MapFlush(FILE_VIEW const* pView);
+void File_Unmap(FILE_VIEW* pView);
 
 #endif /* OS_H */
@@ -1,103 +1,348 @@
 #include "pool.h"
 #include "vector.h"
+#include "hook.h"
 
-static BOOL Pool_IsNearAddress(POOL const* pPool, ADDRESS aAddress, U64 uDistance);
-static BOOL Pool_CreateNear(POOL* pPool, ADDRESS aAddress, U64 uNearDistance, PROCESS hProcess);
-static BOOL Pool_CreateAnywhere(POOL* pPool, PROCESS hProcess);
-static void Pool_Free(POOL const* pPool, PROCESS hProcess);
+#define POOL_FREE_LIST_CAPACITY (16)
+/* Address space reserved per pool, enough for 32768 HOOK_MIN_LEN stubs. Only used pages get committed. */
+#define POOL_RESERVE_SIZE (0x100000)
 
-static BOOL Pool_IsNearAddress(POOL const * const pPool, ADDRESS const aAddress, U64 const uDistance)
+typedef struct tdPOOL_NEAR_SEARCH {
+	VECTOR* pVecPools;
+	POOL_REQUEST const* pRequest;
+	POOL* pBest;
+	U64 uBestFree;
+} POOL_NEAR_SEARCH;
+
+typedef enum tdPOOL_SLOT_SOURCE {
+	POOL_SLOT_NONE,
+	POOL_SLOT_SMALL,
+	POOL_SLOT_LARGE,
+	POOL_SLOT_BUMP
+} POOL_SLOT_SOURCE;
+
+static BOOL Pool_IsNear(ADDRESS aSlot, ADDRESS aAddress, U64 uDistance);
+static U64 Pool_FreeBytes(POOL const* pPool);
+static BOOL Pool_NearVisit(void* pParam, ADDRESS aKey, U32 uValue);
+static POOL* Pool_FindFar(VECTOR* pVecPools, POOL_REQUEST const* pRequest);
+static POOL_SLOT_SOURCE Pool_StubPeek(POOL const* pPool, POOL_REQUEST const* pRequest, ADDRESS* paSlot, BOOL* pbNear);
+static BOOL Pool_HasHitRoom(POOL const* pPool, U32 uLen);
+static BOOL Pool_Commit(POOL_STATS* pStats, ADDRESS* paCommitEnd, ADDRESS aEnd, PROCESS hProcess);
+static U64 Pool_CommittedBytes(POOL const* pPool);
+static BOOL Pool_CreateNear(POOL* pPool, ADDRESS aAddress, U64 uNearDistance, REGION_MAP* pRegions, PROCESS hProcess);
+static BOOL Pool_CreateAnywhere(POOL* pPool, REGION_MAP* pRegions, PROCESS hProcess);
+static POOL* Pool_Insert(VECTOR* pVecPools, INDEX* pIdxPools, POOL_STATS* pStats, POOL* pPool, REGION_MAP* pRegions, PROCESS hProcess);
+static void Pool_Free(POOL* pPool, REGION_MAP* pRegions, PROCESS hProcess);
+static BOOL Pool_Init(POOL* pPool, ADDRESS aAddress, U64 uSize);
+static void Pool_ListsFree(POOL* pPool);
+
+static BOOL Pool_IsNear(ADDRESS const aSlot, ADDRESS const aAddress, U64 const uDistance)
 {
-	if (NULL == pPool)
+	return (aSlot > aAddress)
+		? ((aSlot - aAddress) < uDistance)
+		: ((aAddress - aSlot) < uDistance);
+}
+
+static U64 Pool_FreeBytes(POOL const * const pPool)
+{
+	return pPool->uFreeSize
+		+ (U64)pPool->vecFreeSmall.uElemCount * HOOK_MIN_LEN
+		+ (U64)pPool->vecFreeLarge.uElemCount * HOOK_MAX_LEN;
+}
+
+static BOOL Pool_NearVisit(void* const pParam, ADDRESS const aKey, U32 const uValue)
+{
+	(void)aKey;
+	POOL_NEAR_SEARCH* const pSearch = (POOL_NEAR_SEARCH*)pParam;
+	POOL* const pPool = (POOL*)Vector_AddressOf(pSearch->pVecPools, uValue);
+	if (NULL == pPool || !Pool_HasHitRoom(pPool, pSearch->pRequest->uHitLen))
+	{
+		return TRUE;
+	}
+
+	ADDRESS aSlot = NULL;
+	BOOL bNear = FALSE;
+	U64 const uFree = Pool_FreeBytes(pPool);
+	if (POOL_SLOT_NONE != Pool_StubPeek(pPool, pSearch->pRequest, &aSlot, &bNear)
+		&& bNear
+		&& (NULL == pSearch->pBest || uFree > pSearch->uBestFree))
+	{
+		pSearch->pBest = pPool;
+		pSearch->uBestFree = uFree;
+	}
+	return TRUE;
+}
+
+static POOL_SLOT_SOURCE Pool_StubPeek(POOL const * const pPool, POOL_REQUEST const * const pRequest, ADDRESS* const paSlot, BOOL* const pbNear)
+{
+	/*
+	 * Prefer a near slot: a freed small one, then a freed large one, then fresh space.
+	 * Only the most recently freed slot of each list is looked at, all of them lie in the same pool.
+	 */
+	VECTOR const * const pvecSmall = &(pPool->vecFreeSmall);
+	VECTOR const * const pvecLarge = &(pPool->vecFreeLarge);
+	ADDRESS const aSmall = (0 != pvecSmall->uElemCount) ? *(ADDRESS*)Vector_AddressOf(pvecSmall, pvecSmall->uElemCount - 1) : NULL;
+	ADDRESS const aLarge = (0 != pvecLarge->uElemCount) ? *(ADDRESS*)Vector_AddressOf(pvecLarge, pvecLarge->uElemCount - 1) : NULL;
+
+	*pbNear = TRUE;
+	if (NULL != aSmall && pRequest->uNearLen <= HOOK_MIN_LEN && Pool_IsNear(aSmall, pRequest->aNear, pRequest->uNearDistance))
+	{
+		*paSlot = aSmall;
+		return POOL_SLOT_SMALL;
+	}
+	if (NULL != aLarge && Pool_IsNear(aLarge, pRequest->aNear, pRequest->uNearDistance))
+	{
+		*paSlot = aLarge;
+		return POOL_SLOT_LARGE;
+	}
+	if (pPool->uFreeSize >= pRequest->uNearLen && Pool_IsNear(pPool->aCurrentFreeAddress, pRequest->aNear, pRequest->uNearDistance))
+	{
+		*paSlot = pPool->aCurrentFreeAddress;
+		return POOL_SLOT_BUMP;
+	}
+
+	*pbNear = FALSE;
+	if (NULL != aLarge)
+	{
+		*paSlot = aLarge;
+		return POOL_SLOT_LARGE;
+	}
+	if (pPool->uFreeSize >= pRequest->uFarLen)
+	{
+		*paSlot = pPool->aCurrentFreeAddress;
+		return POOL_SLOT_BUMP;
+	}
+	return POOL_SLOT_NONE;
+}
+
+static BOOL Pool_HasHitRoom(POOL const * const pPool, U32 const uLen)
+{
+	if (HOOK_COUNTER_SIZE == uLen)
+	{
+		U32 const uAligned = (pPool->uHitCount + HOOK_COUNTER_SIZE - 1) & ~(U32)(HOOK_COUNTER_SIZE - 1);
+		return 0 != pPool->vecFreeCounters.uElemCount || uAligned + HOOK_COUNTER_SIZE <= pPool->uHitCapacity;
+	}
+	return 0 != pPool->vecFreeHits.uElemCount || pPool->uHitCount < pPool->uHitCapacity;
+}
+
+static BOOL Pool_Commit(POOL_STATS* const pStats, ADDRESS* const paCommitEnd, ADDRESS const aEnd, PROCESS const hProcess)
+{
+	if (aEnd <= *paCommitEnd)
+	{
+		return TRUE;
+	}
+	ADDRESS const aNewEnd = (aEnd + POOL_PAGE_SIZE - 1) & ~(ADDRESS)(POOL_PAGE_SIZE - 1);
+	if (!Target_MemoryCommitExec(hProcess, *paCommitEnd, aNewEnd - *paCommitEnd))
 	{
 		return FALSE;
 	}
+	pStats->uBytesCommitted += aNewEnd - *paCommitEnd;
+	*paCommitEnd = aNewEnd;
+	return TRUE;
+}
 
-	/* Return true if the address is near +-uDistance of the pool's next free address */
-	ADDRESS const aLowerLimit = (pPool->aCurrentFreeAddress > uDistance)
-		? (pPool->aCurrentFreeAddress - uDistance)
-		: 0;
-	ADDRESS const aUpperLimit = pPool->aCurrentFreeAddress + uDistance;
-	return (aAddress >= aLowerLimit && aAddress <= aUpperLimit);
+static U64 Pool_CommittedBytes(POOL const * const pPool)
+{
+	/* The stub area starts right after the page-rounded hit map. */
+	return (pPool->aMapCommitEnd - pPool->aHitMap) + (pPool->aStubCommitEnd - (pPool->aHitMap + pPool->uHitCapacity));
 }
 
-static BOOL Pool_CreateNear(POOL* const pPool, ADDRESS const aAddress, U64 const uNearDistance, PROCESS const hProcess)
+static BOOL Pool_Init(POOL* const pPool, ADDRESS const aAddress, U64 const uSize)
 {
-    U64 uSize;
-    ADDRESS const aAlloc = Target_MemoryAllocExecNear(hProcess, aAddress, uNearDistance, 64, &uSize);
-	if (NULL == aAlloc)
+	U64 const uUsable = (uSize > POOL_MAX_SIZE) ? POOL_MAX_SIZE : uSize;
+
+	/* Every stub is at least HOOK_MIN_LEN bytes, which bounds the number of hit bytes needed. */
+	U64 uMapSize = uUsable / HOOK_MIN_LEN;
+	uMapSize = (uMapSize + POOL_PAGE_SIZE - 1) & ~(U64)(POOL_PAGE_SIZE - 1);
+	if (uMapSize + HOOK_MAX_LEN > uUsable)
 	{
 		return FALSE;
 	}
-	pPool->aStartAddress = aAlloc;
-	pPool->aCurrentFreeAddress = aAlloc;
+
+	BOOL const bSmall = Vector_Init(&(pPool->vecFreeSmall), sizeof(ADDRESS), POOL_FREE_LIST_CAPACITY);
+	BOOL const bLarge = Vector_Init(&(pPool->vecFreeLarge), sizeof(ADDRESS), POOL_FREE_LIST_CAPACITY);
+	BOOL const bHits = Vector_Init(&(pPool->vecFreeHits), sizeof(U32), POOL_FREE_LIST_CAPACITY);
+	BOOL const bCounters = Vector_Init(&(pPool->vecFreeCounters), sizeof(U32), POOL_FREE_LIST_CAPACITY);
+	if (!bSmall || !bLarge || !bHits || !bCounters)
+	{
+		if (bSmall)
+		{
+			Vector_Free(&(pPool->vecFreeSmall));
+		}
+		if (bLarge)
+		{
+			Vector_Free(&(pPool->vecFreeLarge));
+		}
+		if (bHits)
+		{
+			Vector_Free(&(pPool->vecFreeHits));
+		}
+		if (bCounters)
+		{
+			Vector_Free(&(pPool->vecFreeCounters));
+		}
+		return FALSE;
+	}
+
+	pPool->aStartAddress = aAddress;
+	pPool->aHitMap = aAddress;
+	pPool->aCurrentFreeAddress = aAddress + uMapSize;
+	pPool->aMapCommitEnd = aAddress;
+	pPool->aStubCommitEnd = aAddress + uMapSize;
 	pPool->uPoolSize = uSize;
-	pPool->uFreeSize = uSize;
+	pPool->uFreeSize = uUsable - uMapSize;
+	pPool->uHitCount = 0;
+	pPool->uHitCapacity = (U32)uMapSize;
+	pPool->uStubCount = 0;
 	return TRUE;
 }
 
-static BOOL Pool_CreateAnywhere(POOL* const pPool, PROCESS const hProcess)
+static void Pool_ListsFree(POOL* const pPool)
 {
-	/* Can hold a thousand of HOOK_MAX_LEN. */
-	U64 const uPoolSize = 64 * 1000;
+	Vector_Free(&(pPool->vecFreeSmall));
+	Vector_Free(&(pPool->vecFreeLarge));
+	Vector_Free(&(pPool->vecFreeHits));
+	Vector_Free(&(pPool->vecFreeCounters));
+}
 
-	ADDRESS const aAddress = Target_MemoryAllocExec(hProcess, uPoolSize);
+static BOOL Pool_CreateNear(POOL* const pPool, ADDRESS const aAddress, U64 const uNearDistance, REGION_MAP* const pRegions, PROCESS const hProcess)
+{
+	U64 uSize;
+	ADDRESS const aAlloc = Target_MemoryReserveNear(hProcess, pRegions, aAddress, uNearDistance, 2 * POOL_PAGE_SIZE, POOL_RESERVE_SIZE, &uSize);
+	if (NULL == aAlloc)
+	{
+		return FALSE;
+	}
+	if (!Pool_Init(pPool, aAlloc, uSize))
+	{
+		Target_MemoryFree(hProcess, pRegions, aAlloc, uSize);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL Pool_CreateAnywhere(POOL* const pPool, REGION_MAP* const pRegions, PROCESS const hProcess)
+{
+	U64 const uPoolSize = POOL_RESERVE_SIZE;
+
+	ADDRESS const aAddress = Target_MemoryReserve(hProcess, pRegions, uPoolSize);
 	if (NULL == aAddress)
 	{
 		return FALSE;
 	}
-	pPool->aStartAddress = aAddress;
-	pPool->aCurrentFreeAddress = aAddress;
-	pPool->uPoolSize = uPoolSize;
-	pPool->uFreeSize = uPoolSize;
+	if (!Pool_Init(pPool, aAddress, uPoolSize))
+	{
+		Target_MemoryFree(hProcess, pRegions, aAddress, uPoolSize);
+		return FALSE;
+	}
 	return TRUE;
 }
 
-POOL* Pool_FindOrCreateBest(VECTOR* const pVecPools, ADDRESS const aAddressNear, U64 const uRequiredSpace, U64 const uNearDistance, PROCESS const hProcess)
+static POOL* Pool_Insert(VECTOR* const pVecPools, INDEX* const pIdxPools, POOL_STATS* const pStats, POOL* const pPool, REGION_MAP* const pRegions, PROCESS const hProcess)
 {
-	if (NULL == pVecPools)
+	/* Released pools leave their slot behind so the pool indices stored in hooks stay valid. */
+	POOL* pSlot = NULL;
+	for (U32 i = 0; i < pVecPools->uElemCount && NULL == pSlot; i++)
+	{
+		POOL* const pReleased = (POOL*)Vector_AddressOf(pVecPools, i);
+		if (NULL != pReleased && NULL == pReleased->aStartAddress)
+		{
+			pSlot = pReleased;
+		}
+	}
+
+	if (NULL != pSlot)
+	{
+		*pSlot = *pPool;
+	}
+	else if (Vector_PushBackCopy(pVecPools, pPool))
 	{
+		pSlot = (POOL*)Vector_AddressOf(pVecPools, pVecPools->uElemCount - 1);
+	}
+	else
+	{
+		Pool_Free(pPool, pRegions, hProcess);
 		return NULL;
 	}
 
-	POOL* pPoolNear = NULL;
-	POOL* pPoolFar = NULL;
+	if (!Index_Insert(pIdxPools, pSlot->aStartAddress, Vector_IndexOf(pVecPools, pSlot)))
+	{
+		Pool_Free(pSlot, pRegions, hProcess);
+		pSlot->aStartAddress = NULL;
+		return NULL;
+	}
+
+	pStats->uBytesReserved += pPool->uPoolSize;
+	pStats->uPoolCount++;
+	return pSlot;
+}
+
+static POOL* Pool_FindFar(VECTOR* const pVecPools, POOL_REQUEST const * const pRequest)
+{
+	/* Only reached when no near pool exists or can be made, so a plain scan is fine here. */
 	for (U32 i = 0; i < pVecPools->uElemCount; i++)
 	{
 		POOL* const pPool = (POOL*)Vector_AddressOf(pVecPools, i);
-		if (NULL == pPool || pPool->uFreeSize < uRequiredSpace)
+		if (NULL == pPool || NULL == pPool->aStartAddress || !Pool_HasHitRoom(pPool, pRequest->uHitLen))
 		{
 			continue;
 		}
-		if (NULL == pPoolFar)
-		{
-			pPoolFar = pPool;
-		}
-		if (Pool_IsNearAddress(pPool, aAddressNear, uNearDistance))
+		ADDRESS aSlot = NULL;
+		BOOL bNear = FALSE;
+		if (POOL_SLOT_NONE != Pool_StubPeek(pPool, pRequest, &aSlot, &bNear))
 		{
-			pPoolNear = pPool;
-			break;
+			return pPool;
 		}
 	}
+	return NULL;
+}
+
+POOL* Pool_FindOrCreateBest(VECTOR* const pVecPools, INDEX* const pIdxPools, POOL_STATS* const pStats, POOL_REQUEST const * const pRequest, REGION_MAP* const pRegions, PROCESS const hProcess)
+{
+	if (NULL == pVecPools || NULL == pIdxPools || NULL == pStats || NULL == pRequest)
+	{
+		return NULL;
+	}
+
+	/*
+	 * Only pools starting in [aNear - distance - POOL_MAX_SIZE, aNear + distance] can hold a near slot,
+	 * so the index walk touches just those. The one with the most free space wins, which keeps
+	 * stubs of one module together instead of spilling them over every pool in reach.
+	 */
+	U64 const uReach = pRequest->uNearDistance + POOL_MAX_SIZE;
+	ADDRESS const aLow = (pRequest->aNear > uReach) ? (pRequest->aNear - uReach) : 0;
+	ADDRESS const aHigh = (pRequest->aNear < (ADDRESS)-1 - pRequest->uNearDistance) ? (pRequest->aNear + pRequest->uNearDistance) : (ADDRESS)-1;
+	POOL_NEAR_SEARCH search;
+	search.pVecPools = pVecPools;
+	search.pRequest = pRequest;
+	search.pBest = NULL;
+	search.uBestFree = 0;
+	Index_VisitRange(pIdxPools, aLow, aHigh, Pool_NearVisit, &search);
+	POOL* const pPoolNear = search.pBest;
 
 	/* If no pool is near, try to create one. If that fails, fall back to a far one.*/
 	POOL* pPoolBest = pPoolNear;
 	if (NULL == pPoolBest)
 	{
 		POOL pool;
-        BOOL bSuccess = Pool_CreateNear(&pool, aAddressNear, uNearDistance, hProcess);
-        if (bSuccess && !Pool_IsNearAddress(&pool, aAddressNear, uNearDistance))
-        {
-            bSuccess = FALSE;
-            Pool_Free(&pool, hProcess);
-        }
-		if (bSuccess && Vector_PushBackCopy(pVecPools, &pool))
+        BOOL bSuccess = Pool_CreateNear(&pool, pRequest->aNear, pRequest->uNearDistance, pRegions, hProcess);
+		if (bSuccess)
 		{
-			pPoolBest = (POOL*)Vector_AddressOf(pVecPools, pVecPools->uElemCount - 1);
+			ADDRESS aSlot = NULL;
+			BOOL bNear = FALSE;
+			Pool_StubPeek(&pool, pRequest, &aSlot, &bNear);
+			if (!bNear)
+			{
+				bSuccess = FALSE;
+				Pool_Free(&pool, pRegions, hProcess);
+			}
 		}
-		else
+		if (bSuccess)
+		{
+			pPoolBest = Pool_Insert(pVecPools, pIdxPools, pStats, &pool, pRegions, hProcess);
+		}
+		if (NULL == pPoolBest)
 		{
-			pPoolBest = pPoolFar;
+			pPoolBest = Pool_FindFar(pVecPools, pRequest);
 		}
 	}
 
@@ -105,22 +350,171 @@ POOL* Pool_FindOrCreateBest(VECTOR* const pVecPools, ADDRESS const aAddressNear,
 	if (NULL == pPoolBest)
 	{
 		POOL pool;
-		BOOL const bSuccess = Pool_CreateAnywhere(&pool, hProcess);
-		if (!bSuccess || !Vector_PushBackCopy(pVecPools, &pool))
+		if (!Pool_CreateAnywhere(&pool, pRegions, hProcess))
 		{
 			return NULL;
 		}
-		pPoolBest = (POOL*)Vector_AddressOf(pVecPools, pVecPools->uElemCount - 1);
+		pPoolBest = Pool_Insert(pVecPools, pIdxPools, pStats, &pool, pRegions, hProcess);
 	}
 
 	return pPoolBest;
 }
 
-static void Pool_Free(POOL const * const pPool, PROCESS const hProcess)
+ADDRESS Pool_StubAlloc(POOL* const pPool, POOL_STATS* const pStats, POOL_REQUEST const * const pRequest, PROCESS const hProcess, BOOL* const pbNear)
+{
+	ADDRESS aSlot = NULL;
+	POOL_SLOT_SOURCE const eSource = Pool_StubPeek(pPool, pRequest, &aSlot, pbNear);
+	U32 const uLen = *pbNear ? pRequest->uNearLen : pRequest->uFarLen;
+
+	if (POOL_SLOT_SMALL == eSource)
+	{
+		pPool->vecFreeSmall.uElemCount--;
+	}
+	else if (POOL_SLOT_LARGE == eSource)
+	{
+		pPool->vecFreeLarge.uElemCount--;
+		if (uLen <= HOOK_MIN_LEN)
+		{
+			/* The other half becomes a small slot. If that cannot be recorded it stays unused until the pool is released. */
+			ADDRESS const aRest = aSlot + HOOK_MIN_LEN;
+			Vector_PushBackCopy(&(pPool->vecFreeSmall), &aRest);
+		}
+	}
+	else if (POOL_SLOT_BUMP == eSource)
+	{
+		if (!Pool_Commit(pStats, &(pPool->aStubCommitEnd), aSlot + uLen, hProcess))
+		{
+			return NULL;
+		}
+		pPool->aCurrentFreeAddress += uLen;
+		pPool->uFreeSize -= uLen;
+	}
+	else
+	{
+		return NULL;
+	}
+
+	pPool->uStubCount++;
+	pStats->uBytesUsed += uLen;
+	return aSlot;
+}
+
+void Pool_StubFree(POOL* const pPool, POOL_STATS* const pStats, ADDRESS const aStub, U32 const uLen)
+{
+	/* A slot that cannot be recorded stays unused until the pool is released. */
+	VECTOR* const pvecFree = (uLen <= HOOK_MIN_LEN) ? &(pPool->vecFreeSmall) : &(pPool->vecFreeLarge);
+	Vector_PushBackCopy(pvecFree, &aStub);
+
+	pPool->uStubCount--;
+	pStats->uBytesUsed -= uLen;
+	pStats->uBytesReclaimed += uLen;
+}
+
+BOOL Pool_HitAlloc(POOL* const pPool, POOL_STATS* const pStats, U32 const uLen, PROCESS const hProcess, U32* const puHitIndex)
+{
+	VECTOR* const pvecFree = (HOOK_COUNTER_SIZE == uLen) ? &(pPool->vecFreeCounters) : &(pPool->vecFreeHits);
+	if (0 != pvecFree->uElemCount)
+	{
+		pvecFree->uElemCount--;
+		*puHitIndex = *(U32*)Vector_AddressOf(pvecFree, pvecFree->uElemCount);
+		return TRUE;
+	}
+
+	if (HOOK_COUNTER_SIZE != uLen)
+	{
+		if (pPool->uHitCount >= pPool->uHitCapacity
+			|| !Pool_Commit(pStats, &(pPool->aMapCommitEnd), pPool->aHitMap + pPool->uHitCount + 1, hProcess))
+		{
+			return FALSE;
+		}
+		*puHitIndex = pPool->uHitCount++;
+		return TRUE;
+	}
+
+	/* Counters are 8-byte aligned, the bytes skipped to get there serve later one-shot hooks. */
+	U32 const uCounterIndex = (pPool->uHitCount + HOOK_COUNTER_SIZE - 1) & ~(U32)(HOOK_COUNTER_SIZE - 1);
+	if (uCounterIndex + HOOK_COUNTER_SIZE > pPool->uHitCapacity
+		|| !Pool_Commit(pStats, &(pPool->aMapCommitEnd), pPool->aHitMap + uCounterIndex + HOOK_COUNTER_SIZE, hProcess))
+	{
+		return FALSE;
+	}
+	for (U32 i = pPool->uHitCount; i < uCounterIndex; i++)
+	{
+		Vector_PushBackCopy(&(pPool->vecFreeHits), &i);
+	}
+	pPool->uHitCount = uCounterIndex + HOOK_COUNTER_SIZE;
+	*puHitIndex = uCounterIndex;
+	return TRUE;
+}
+
+void Pool_HitFree(POOL* const pPool, U32 const uHitIndex, U32 const uLen)
+{
+	VECTOR* const pvecFree = (HOOK_COUNTER_SIZE == uLen) ? &(pPool->vecFreeCounters) : &(pPool->vecFreeHits);
+	Vector_PushBackCopy(pvecFree, &uHitIndex);
+}
+
+void Pool_ReleaseIfEmpty(POOL* const pPool, INDEX* const pIdxPools, POOL_STATS* const pStats, REGION_MAP* const pRegions, PROCESS const hProcess)
+{
+	if (NULL == pPool || NULL == pPool->aStartAddress || 0 != pPool->uStubCount)
+	{
+		return;
+	}
+
+	Index_Remove(pIdxPools, pPool->aStartAddress);
+	Pool_Free(pPool, pRegions, hProcess);
+	pStats->uBytesReserved -= pPool->uPoolSize;
+	pStats->uBytesCommitted -= Pool_CommittedBytes(pPool);
+	pStats->uBytesReleased += pPool->uPoolSize;
+	pStats->uPoolCount--;
+
+	/* Keep the slot, an empty hit map makes snapshots skip it. */
+	pPool->aStartAddress = NULL;
+	pPool->aCurrentFreeAddress = NULL;
+	pPool->aHitMap = NULL;
+	pPool->aMapCommitEnd = NULL;
+	pPool->aStubCommitEnd = NULL;
+	pPool->uPoolSize = 0;
+	pPool->uFreeSize = 0;
+	pPool->uHitCount = 0;
+	pPool->uHitCapacity = 0;
+}
+
+void Pool_FreeAll(VECTOR* const pVecPools, INDEX* const pIdxPools, POOL_STATS* const pStats, REGION_MAP* const pRegions, PROCESS const hProcess)
+{
+	if (NULL == pVecPools || NULL == pIdxPools || NULL == pStats)
+	{
+		return;
+	}
+
+	for (U32 i = 0; i < pVecPools->uElemCount; i++)
+	{
+		POOL* const pPool = (POOL*)Vector_AddressOf(pVecPools, i);
+		if (NULL == pPool || NULL == pPool->aStartAddress)
+		{
+			continue;
+		}
+		if (0 == pPool->uStubCount)
+		{
+			Pool_ReleaseIfEmpty(pPool, pIdxPools, pStats, pRegions, hProcess);
+		}
+		else
+		{
+			Pool_ListsFree(pPool);
+		}
+	}
+}
+
+static void Pool_Free(POOL* const pPool, REGION_MAP* const pRegions, PROCESS const hProcess)
 {
 	if (NULL == pPool)
 	{
 		return;
 	}
-	Target_MemoryFree(hProcess, pPool->aStartAddress);
+	Pool_ListsFree(pPool);
+
+	/* A dead target took its memory with it. */
+	if (NULL != hProcess)
+	{
+		Target_MemoryFree(hProcess, pRegions, pPool->aStartAddress, pPool->uPoolSize);
+	}
 }
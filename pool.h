@@ -3,17 +3,75 @@
 
 #include "types.h"
 #include "os.h"
+#include "vector.h"
+#include "index.h"
 
-struct tdVECTOR;
-typedef struct tdVECTOR VECTOR;
-
+/*
+ * A pool starts with its hit map, one byte per stub slot, padded to whole pages.
+ * Stubs set their byte RIP-relatively, so the target never writes into the stub pages
+ * and all hits of a pool can be fetched with a single read.
+ * Counter hooks keep their 64-bit counters in the same map, 8-byte aligned.
+ *
+ * Stub slots come in two sizes, HOOK_MIN_LEN and HOOK_MAX_LEN. Slots and hit map entries
+ * of removed hooks go to the free lists below and are handed out again before the pool grows.
+ * A pool whose last stub is freed is given back to the target and its vector slot is reused.
+ *
+ * Live pools are also kept in an INDEX keyed by aStartAddress, mapping to their vector slot.
+ *
+ * The pool is only reserved in the target. Pages of the hit map and of the stub area are committed
+ * as the hit count and the free address grow; a*CommitEnd is where each committed part ends.
+ */
 typedef struct tdPOOL {
 	ADDRESS aStartAddress;
 	ADDRESS aCurrentFreeAddress;
 	U64 uPoolSize;
 	U64 uFreeSize;
+	ADDRESS aHitMap;
+	ADDRESS aMapCommitEnd;
+	ADDRESS aStubCommitEnd;
+	U32 uHitCount;
+	U32 uHitCapacity;
+	VECTOR vecFreeSmall; /* ADDRESS of free HOOK_MIN_LEN slots */
+	VECTOR vecFreeLarge; /* ADDRESS of free HOOK_MAX_LEN slots */
+	VECTOR vecFreeHits; /* U32 hit map index of free hit bytes */
+	VECTOR vecFreeCounters; /* U32 hit map index of free counters */
+	U32 uStubCount;
+	BYTE _padding[4];
 } POOL;
 
-POOL* Pool_FindOrCreateBest(VECTOR* pVecPools, ADDRESS aAddressNear, U64 uRequiredSpace, U64 uNearDistance, PROCESS hProcess);
+/* Reserved, committed and used are current values, reclaimed and released are running totals. */
+typedef struct tdPOOL_STATS {
+	U64 uBytesReserved;
+	U64 uBytesCommitted;
+	U64 uBytesUsed;
+	U64 uBytesReclaimed;
+	U64 uBytesReleased;
+	U32 uPoolCount;
+	BYTE _padding[4];
+} POOL_STATS;
+
+/* The stub takes uNearLen bytes when it lies within uNearDistance of aNear, uFarLen otherwise. */
+typedef struct tdPOOL_REQUEST {
+	ADDRESS aNear;
+	U64 uNearDistance;
+	U32 uNearLen;
+	U32 uFarLen;
+	U32 uHitLen;
+	BYTE _padding[4];
+} POOL_REQUEST;
+
+#define POOL_PAGE_SIZE (0x1000)
+/* Stubs reach the hit map with a rel32 displacement, so only this much of a pool is used. */
+#define POOL_MAX_SIZE (0x40000000)
+
+POOL* Pool_FindOrCreateBest(VECTOR* pVecPools, INDEX* pIdxPools, POOL_STATS* pStats, POOL_REQUEST const* pRequest, REGION_MAP* pRegions, PROCESS hProcess);
+ADDRESS Pool_StubAlloc(POOL* pPool, POOL_STATS* pStats, POOL_REQUEST const* pRequest, PROCESS hProcess, BOOL* pbNear);
+void Pool_StubFree(POOL* pPool, POOL_STATS* pStats, ADDRESS aStub, U32 uLen);
+BOOL Pool_HitAlloc(POOL* pPool, POOL_STATS* pStats, U32 uLen, PROCESS hProcess, U32* puHitIndex);
+void Pool_HitFree(POOL* pPool, U32 uHitIndex, U32 uLen);
+void Pool_ReleaseIfEmpty(POOL* pPool, INDEX* pIdxPools, POOL_STATS* pStats, REGION_MAP* pRegions, PROCESS hProcess);
+
+/* Pools that still hold stubs stay allocated in the target, the hooks may still jump there. */
+void Pool_FreeAll(VECTOR* pVecPools, INDEX* pIdxPools, POOL_STATS* pStats, REGION_MAP* pRegions, PROCESS hProcess);
 
 #endif /* POOL_H */
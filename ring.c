@@ -0,0 +1,77 @@
+#include "ring.h"
+
+BOOL Ring_Init(HIT_RING* const pRing, U32 const uCapacity, HIT_CALLBACK_FUNC const fnCallback, void* const pCallbackParam)
+{
+	U32 uRounded = RING_MIN_CAPACITY;
+	while (uRounded < uCapacity)
+	{
+		if (uRounded > ((U32)-1 >> 1))
+		{
+			return FALSE;
+		}
+		uRounded <<= 1;
+	}
+
+	Memory_Set(pRing, 0, sizeof(HIT_RING));
+	pRing->pRecords = Memory_Alloc((U64)uRounded * sizeof(HIT_RECORD));
+	if (NULL == pRing->pRecords)
+	{
+		return FALSE;
+	}
+	pRing->fnCallback = fnCallback;
+	pRing->pCallbackParam = pCallbackParam;
+	pRing->uMask = uRounded - 1;
+	return TRUE;
+}
+
+BOOL Ring_Push(HIT_RING* const pRing, HIT_RECORD const * const pRecord)
+{
+	/* uHead is ours, the acquire on uTail keeps the slot from being overwritten before the client copied it out. */
+	U64 const uHead = pRing->uHead;
+	if (uHead - Atomic_LoadAcquire(&(pRing->uTail)) > pRing->uMask)
+	{
+		Atomic_StoreRelease(&(pRing->uDropped), pRing->uDropped + 1);
+		return FALSE;
+	}
+
+	HIT_RECORD* const pSlot = &(pRing->pRecords[uHead & pRing->uMask]);
+	*pSlot = *pRecord;
+	Atomic_StoreRelease(&(pRing->uHead), uHead + 1);
+
+	if (NULL != pRing->fnCallback)
+	{
+		pRing->fnCallback(pRing->pCallbackParam, pSlot);
+	}
+	return TRUE;
+}
+
+U32 Ring_Drain(HIT_RING* const pRing, HIT_RECORD* const pRecords, U32 const uCapacity)
+{
+	U64 const uTail = pRing->uTail;
+	U64 const uAvailable = Atomic_LoadAcquire(&(pRing->uHead)) - uTail;
+	U32 const uCount = (uAvailable < uCapacity) ? (U32)uAvailable : uCapacity;
+	if (0 == uCount)
+	{
+		return 0;
+	}
+
+	/* At most two copies, the run up to the end of the array and the wrapped rest. */
+	U32 const uFirst = (U32)(uTail & pRing->uMask);
+	U32 const uFirstCount = (uCount < pRing->uMask + 1 - uFirst) ? uCount : (pRing->uMask + 1 - uFirst);
+	Memory_Copy(pRecords, &(pRing->pRecords[uFirst]), (U64)uFirstCount * sizeof(HIT_RECORD));
+	Memory_Copy(pRecords + uFirstCount, pRing->pRecords, (U64)(uCount - uFirstCount) * sizeof(HIT_RECORD));
+	Atomic_StoreRelease(&(pRing->uTail), uTail + uCount);
+	return uCount;
+}
+
+U64 Ring_DroppedGet(HIT_RING const * const pRing)
+{
+	return Atomic_LoadAcquire(&(pRing->uDropped));
+}
+
+void Ring_Free(HIT_RING* const pRing)
+{
+	Memory_Free(pRing->pRecords);
+	pRing->pRecords = NULL;
+	pRing->uMask = 0;
+}
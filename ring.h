@@ -0,0 +1,48 @@
+#ifndef RING_H
+#define RING_H
+
+#include "types.h"
+#include "os.h"
+
+#define RING_CACHE_LINE (64)
+#define RING_MIN_CAPACITY (16)
+
+/* One tracker firing as seen by the debug loop. uType is a TRACKER_TYPE, uTimestamp comes from Time_Now. */
+typedef struct tdHIT_RECORD {
+	ADDRESS aAddress;
+	U64 uTimestamp;
+	TID tidThread;
+	U32 uType;
+} HIT_RECORD;
+
+/* Runs on the thread that recorded the hit, right after the record became visible to Ring_Drain. */
+typedef void (*HIT_CALLBACK_FUNC)(void* pParam, HIT_RECORD const* pRecord);
+
+/*
+ * Bounded single-producer single-consumer queue of hits. The debug loop pushes and only it moves uHead,
+ * the client drains and only it moves uTail, so neither side ever waits for the other. A push into a full
+ * ring is counted in uDropped and lost. The indices only grow; slot i is pRecords[i & uMask]. Each index
+ * has its own cache line, so the two sides do not invalidate each other's line on every record.
+ */
+typedef struct tdHIT_RING {
+	HIT_RECORD* pRecords;
+	HIT_CALLBACK_FUNC fnCallback;
+	void* pCallbackParam;
+	U32 uMask;
+	BYTE _padding0[RING_CACHE_LINE - 28];
+	U64 volatile uHead;
+	U64 volatile uDropped;
+	BYTE _padding1[RING_CACHE_LINE - 16];
+	U64 volatile uTail;
+	BYTE _padding2[RING_CACHE_LINE - 8];
+} HIT_RING;
+
+/* uCapacity is rounded up to a power of two, at least RING_MIN_CAPACITY. fnCallback is optional. */
+BOOL Ring_Init(HIT_RING* pRing, U32 uCapacity, HIT_CALLBACK_FUNC fnCallback, void* pCallbackParam);
+BOOL Ring_Push(HIT_RING* pRing, HIT_RECORD const* pRecord);
+/* Moves up to uCapacity of the oldest records into pRecords, returns how many. */
+U32 Ring_Drain(HIT_RING* pRing, HIT_RECORD* pRecords, U32 uCapacity);
+U64 Ring_DroppedGet(HIT_RING const* pRing);
+void Ring_Free(HIT_RING* pRing);
+
+#endif /* RING_H */
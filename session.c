@@ -0,0 +1,88 @@
+#include "session.h"
+#include "tracker.h"
+
+static U64 Session_Align(U64 uOffset);
+static BOOL Session_SectionFits(U64 uOffset, U32 uCount, U64 uElemSize, U64 uFileSize);
+
+static U64 Session_Align(U64 const uOffset)
+{
+	return (uOffset + SESSION_SECTION_ALIGN - 1) & ~(U64)(SESSION_SECTION_ALIGN - 1);
+}
+
+static BOOL Session_SectionFits(U64 const uOffset, U32 const uCount, U64 const uElemSize, U64 const uFileSize)
+{
+	/* uCount * uElemSize cannot overflow, both are far below 2^32. */
+	return 0 == (uOffset % SESSION_SECTION_ALIGN)
+		&& uOffset >= sizeof(SESSION_HEADER)
+		&& uOffset <= uFileSize
+		&& (U64)uCount * uElemSize <= uFileSize - uOffset;
+}
+
+void Session_HeaderInit(SESSION_HEADER* const pHeader, U32 const uModuleCount, U32 const uTrackerCount, U32 const uStepCount, U32 const uPid)
+{
+	Memory_Set(pHeader, 0, sizeof(SESSION_HEADER));
+	pHeader->uMagic = SESSION_MAGIC;
+	pHeader->uVersion = SESSION_VERSION;
+	pHeader->uHeaderSize = sizeof(SESSION_HEADER);
+	pHeader->uModuleCount = uModuleCount;
+	pHeader->uTrackerCount = uTrackerCount;
+	pHeader->uStepCount = uStepCount;
+	pHeader->uPid = uPid;
+	pHeader->uModulesOffset = Session_Align(sizeof(SESSION_HEADER));
+	pHeader->uTrackersOffset = Session_Align(pHeader->uModulesOffset + (U64)uModuleCount * sizeof(SESSION_MODULE));
+	pHeader->uStepsOffset = Session_Align(pHeader->uTrackersOffset + (U64)uTrackerCount * sizeof(SESSION_TRACKER));
+	pHeader->uFileSize = pHeader->uStepsOffset + (U64)uStepCount * sizeof(STEP_RECORD);
+}
+
+BOOL Session_Open(void const * const pData, U64 const uSize, SESSION_VIEW* const pView)
+{
+	if (uSize < sizeof(SESSION_HEADER))
+	{
+		return FALSE;
+	}
+	SESSION_HEADER const * const pHeader = (SESSION_HEADER const*)pData;
+	if (SESSION_MAGIC != pHeader->uMagic
+		|| SESSION_VERSION != pHeader->uVersion
+		|| sizeof(SESSION_HEADER) != pHeader->uHeaderSize
+		|| uSize != pHeader->uFileSize
+		|| !Session_SectionFits(pHeader->uModulesOffset, pHeader->uModuleCount, sizeof(SESSION_MODULE), uSize)
+		|| !Session_SectionFits(pHeader->uTrackersOffset, pHeader->uTrackerCount, sizeof(SESSION_TRACKER), uSize)
+		|| !Session_SectionFits(pHeader->uStepsOffset, pHeader->uStepCount, sizeof(STEP_RECORD), uSize))
+	{
+		return FALSE;
+	}
+
+	BYTE const * const pBytes = (BYTE const*)pData;
+	SESSION_MODULE const * const pModules = (SESSION_MODULE const*)(pBytes + pHeader->uModulesOffset);
+	for (U32 i = 0; i < pHeader->uModuleCount; i++)
+	{
+		U32 uLen = 0;
+		while (uLen < SESSION_MODULE_NAME_MAX && '\0' != pModules[i].szName[uLen])
+		{
+			uLen++;
+		}
+		if (0 == uLen || SESSION_MODULE_NAME_MAX == uLen)
+		{
+			return FALSE;
+		}
+	}
+
+	SESSION_TRACKER const * const pTrackers = (SESSION_TRACKER const*)(pBytes + pHeader->uTrackersOffset);
+	for (U32 i = 0; i < pHeader->uTrackerCount; i++)
+	{
+		SESSION_TRACKER const * const pTracker = &(pTrackers[i]);
+		if ((SESSION_NO_MODULE != pTracker->uModule && pTracker->uModule >= pHeader->uModuleCount)
+			|| pTracker->uType < TRACKER_TYPE_BREAKPOINT_SW
+			|| pTracker->uType > TRACKER_TYPE_PAGE_EXEC
+			|| pTracker->uOriginalLen > SESSION_ORIGINAL_MAX)
+		{
+			return FALSE;
+		}
+	}
+
+	pView->pHeader = pHeader;
+	pView->pModules = pModules;
+	pView->pTrackers = pTrackers;
+	pView->pSteps = (STEP_RECORD const*)(pBytes + pHeader->uStepsOffset);
+	return TRUE;
+}
@@ -0,0 +1,79 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "types.h"
+
+/* One filter round of a context: which way it filtered, how many trackers it removed and how many it kept. */
+typedef struct tdSTEP_RECORD {
+	U32 uRemoved;
+	U32 uRemaining;
+	BOOL bExecuted;
+} STEP_RECORD;
+
+#define SESSION_MAGIC (0x53534C46) /* "FLSS" */
+#define SESSION_VERSION (1)
+#define SESSION_SECTION_ALIGN (8)
+#define SESSION_MODULE_NAME_MAX (256)
+#define SESSION_ORIGINAL_MAX (16)
+#define SESSION_NO_MODULE ((U32)-1)
+
+/*
+ * A session file is the header followed by three arrays of fixed size records, each starting on a
+ * SESSION_SECTION_ALIGN boundary at the offset the header gives: the modules, the trackers and the step
+ * history. Everything is in the native x86-64 layout, so a mapped file is used in place. A reader only
+ * takes files whose version it knows and whose sections lie inside the file. uPid is the target the
+ * session was saved from, trackers outside any module only mean something in that process.
+ */
+typedef struct tdSESSION_HEADER {
+	U32 uMagic;
+	U16 uVersion;
+	U16 uHeaderSize;
+	U64 uFileSize;
+	U64 uModulesOffset;
+	U64 uTrackersOffset;
+	U64 uStepsOffset;
+	U32 uModuleCount;
+	U32 uTrackerCount;
+	U32 uStepCount;
+	U32 uPid;
+} SESSION_HEADER;
+
+/* Found again by name in the process a session is loaded into. uSize is what it had when saved. */
+typedef struct tdSESSION_MODULE {
+	U64 uSize;
+	char szName[SESSION_MODULE_NAME_MAX];
+} SESSION_MODULE;
+
+/*
+ * uOffset is from the base of module uModule, or the address itself for SESSION_NO_MODULE. uType is a
+ * TRACKER_TYPE. uOriginal holds the code bytes the tracker replaces in the target, uOriginalLen of them,
+ * and has to match again before the tracker is re-applied. uParam is the length hooks were added with
+ * (function length of inline hooks, prologue length of counters), the hit count of hardware breakpoints
+ * and 0 for everything else.
+ */
+typedef struct tdSESSION_TRACKER {
+	U64 uOffset;
+	U32 uModule;
+	U32 uParam;
+	BYTE uType;
+	BYTE bEnabled;
+	BYTE bHit;
+	BYTE uOriginalLen;
+	BYTE uOriginal[SESSION_ORIGINAL_MAX];
+	BYTE _padding[4];
+} SESSION_TRACKER;
+
+/* Typed pointers into a checked session file. */
+typedef struct tdSESSION_VIEW {
+	SESSION_HEADER const* pHeader;
+	SESSION_MODULE const* pModules;
+	SESSION_TRACKER const* pTrackers;
+	STEP_RECORD const* pSteps;
+} SESSION_VIEW;
+
+/* Lays the sections out. Writers copy the header in last, so a file cut short has no magic and is never taken. */
+void Session_HeaderInit(SESSION_HEADER* pHeader, U32 uModuleCount, U32 uTrackerCount, U32 uStepCount, U32 uPid);
+/* Checks the header, the section bounds and every record that refers to another one. */
+BOOL Session_Open(void const* pData, U64 uSize, SESSION_VIEW* pView);
+
+#endif /* SESSION_H */
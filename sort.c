@@ -0,0 +1,60 @@
+#include "sort.h"
+
+static void Sort_Swap(BYTE* pLeft, BYTE* pRight, U32 uElemSize);
+static void Sort_SiftDown(BYTE* pBase, U32 uRoot, U32 uCount, U32 uElemSize, SORT_COMPARE_FUNC fnCompare);
+
+static void Sort_Swap(BYTE* const pLeft, BYTE* const pRight, U32 const uElemSize)
+{
+	for (U32 i = 0; i < uElemSize; i++)
+	{
+		BYTE const tmp = pLeft[i];
+		pLeft[i] = pRight[i];
+		pRight[i] = tmp;
+	}
+}
+
+static void Sort_SiftDown(BYTE* const pBase, U32 uRoot, U32 const uCount, U32 const uElemSize, SORT_COMPARE_FUNC const fnCompare)
+{
+	for (;;)
+	{
+		U64 const uLeft = (U64)uRoot * 2 + 1;
+		if (uLeft >= uCount)
+		{
+			return;
+		}
+
+		U32 uLargest = (U32)uLeft;
+		U64 const uRight = uLeft + 1;
+		if (uRight < uCount && fnCompare(pBase + uRight * uElemSize, pBase + uLeft * uElemSize) > 0)
+		{
+			uLargest = (U32)uRight;
+		}
+		if (fnCompare(pBase + (U64)uLargest * uElemSize, pBase + (U64)uRoot * uElemSize) <= 0)
+		{
+			return;
+		}
+
+		Sort_Swap(pBase + (U64)uLargest * uElemSize, pBase + (U64)uRoot * uElemSize, uElemSize);
+		uRoot = uLargest;
+	}
+}
+
+void Sort_Heap(void* const pBase, U32 const uCount, U32 const uElemSize, SORT_COMPARE_FUNC const fnCompare)
+{
+	/* In-place and allocation free, so it can run without a CRT. Not stable. */
+	if (NULL == pBase || uCount < 2)
+	{
+		return;
+	}
+
+	BYTE* const pBytes = (BYTE*)pBase;
+	for (U32 i = uCount / 2; i > 0; i--)
+	{
+		Sort_SiftDown(pBytes, i - 1, uCount, uElemSize, fnCompare);
+	}
+	for (U32 uEnd = uCount - 1; uEnd > 0; uEnd--)
+	{
+		Sort_Swap(pBytes, pBytes + (U64)uEnd * uElemSize, uElemSize);
+		Sort_SiftDown(pBytes, 0, uEnd, uElemSize, fnCompare);
+	}
+}
@@ -0,0 +1,11 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include "types.h"
+
+/* Negative if pLeft orders before pRight, zero if equal, positive otherwise. */
+typedef int (*SORT_COMPARE_FUNC)(void const* pLeft, void const* pRight);
+
+void Sort_Heap(void* pBase, U32 uCount, U32 uElemSize, SORT_COMPARE_FUNC fnCompare);
+
+#endif /* SORT_H */
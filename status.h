@@ -50,5 +50,15 @@ typedef unsigned short FLOC_STATUS;
 #define FLOC_STATUS_INSUFFICIENT_PRIVILEGES (43)      
 #define FLOC_STATUS_TARGET_NOT_64BIT (44)
 #define FLOC_STATUS_HOOK_CREATE_FAIL (45)
+#define FLOC_STATUS_BUFFER_TOO_SMALL (46)
+#define FLOC_STATUS_BATCH_INCOMPLETE (47)
+#define FLOC_STATUS_MODULE_INVALID (48)
+#define FLOC_STATUS_SNAPSHOT_UNCHANGED (49)
+#define FLOC_STATUS_HIT_STREAM_STOPPED (50)
+#define FLOC_STATUS_MODULE_NOT_FOUND (51)
+#define FLOC_STATUS_SESSION_FILE_FAIL (52)
+#define FLOC_STATUS_SESSION_INVALID (53)
+#define FLOC_STATUS_HIT_STREAM_BUSY (54)
+#define FLOC_STATUS_GROUP_WORKER_STOP_FAIL (55)
 
 #endif /* STATUS_H */
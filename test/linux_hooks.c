@@ -0,0 +1,179 @@
+/*
+ * End-to-end check of the Linux backend against test/linux_target.c.
+ *
+ * The driver starts the target, attaches the debug loop, and adds a software breakpoint, a hook that
+ * gets a rel32 jump and a hook that needs the abs64 jump. It checks the jump encodings in the target,
+ * runs one step that calls all three functions, and expects every tracker to be hit and every call
+ * to return the right result. After uninitializing, the functions must run unpatched. Build it with
+ * the library sources and pass the target as the first argument:
+ *
+ *   gcc -O1 -DLINUX -I. test/linux_hooks.c *.c -lpthread -o linux_hooks
+ *   gcc -O1 test/linux_target.c -o linux_target
+ *   ./linux_hooks ./linux_target
+ */
+#define _GNU_SOURCE
+#include "flocdll.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_TRACKER_COUNT (3)
+#define TEST_LOOP_ATTACH_US (100000)
+
+static pid_t gpidTarget = 0;
+static int giTargetIn = -1;
+static int giTargetOut = -1;
+static int giFailures = 0;
+
+static void TestCheck(BOOL const bCondition, char const * const szWhat)
+{
+	printf("%s %s\n", bCondition ? "PASS" : "FAIL", szWhat);
+	if (!bCondition)
+	{
+		giFailures++;
+	}
+}
+
+static BOOL TestTargetStart(char const * const szPath, ADDRESS* const pAddresses, U32* const puFarLen)
+{
+	int fdIn[2];
+	int fdOut[2];
+	if (0 != pipe(fdIn) || 0 != pipe(fdOut))
+	{
+		return FALSE;
+	}
+	gpidTarget = fork();
+	if (0 == gpidTarget)
+	{
+		dup2(fdIn[0], 0);
+		dup2(fdOut[1], 1);
+		execl(szPath, szPath, (char*)NULL);
+		_exit(127);
+	}
+	close(fdIn[0]);
+	close(fdOut[1]);
+	giTargetIn = fdIn[1];
+	giTargetOut = fdOut[0];
+	if (gpidTarget < 0)
+	{
+		return FALSE;
+	}
+
+	/* The first line holds the function addresses and the length of the far one. */
+	char szLine[256];
+	U32 uLen = 0;
+	char c = 0;
+	while (uLen + 1 < sizeof(szLine) && 1 == read(giTargetOut, &c, 1) && '\n' != c)
+	{
+		szLine[uLen++] = c;
+	}
+	szLine[uLen] = '\0';
+	unsigned long long uBreakpoint = 0;
+	unsigned long long uNear = 0;
+	unsigned long long uFar = 0;
+	if (4 != sscanf(szLine, "%llx %llx %llx %u", &uBreakpoint, &uNear, &uFar, puFarLen))
+	{
+		return FALSE;
+	}
+	pAddresses[0] = (ADDRESS)uBreakpoint;
+	pAddresses[1] = (ADDRESS)uNear;
+	pAddresses[2] = (ADDRESS)uFar;
+	return TRUE;
+}
+
+static BOOL TestTargetCall(char const cCommand)
+{
+	char cReply = 0;
+	return 1 == write(giTargetIn, &cCommand, 1) && 1 == read(giTargetOut, &cReply, 1) && 'k' == cReply;
+}
+
+static BOOL TestJumpIs(ADDRESS const aFunction, BYTE const uFirst, BYTE const uSecond, U32 const uMatchLen)
+{
+	BYTE bufBytes[2] = { 0, 0 };
+	struct iovec local = { bufBytes, sizeof(bufBytes) };
+	struct iovec remote = { (void*)aFunction, sizeof(bufBytes) };
+	if ((ssize_t)sizeof(bufBytes) != process_vm_readv(gpidTarget, &local, 1, &remote, 1, 0))
+	{
+		return FALSE;
+	}
+	return uFirst == bufBytes[0] && (1 == uMatchLen || uSecond == bufBytes[1]);
+}
+
+static BOOL TestAllHit(FLOC_HANDLE const hHandle, ADDRESS const * const pAddresses)
+{
+	ADDRESS aSnapshot[TEST_TRACKER_COUNT];
+	U64 uHitBits = 0;
+	U32 uCount = 0;
+	U32 uGeneration = 0;
+	if (FLOC_STATUS_SUCCESS != FLOCDLL_TrackerSnapshotGet(hHandle, 0, aSnapshot, &uHitBits, NULL, NULL, TEST_TRACKER_COUNT, &uCount, &uGeneration))
+	{
+		return FALSE;
+	}
+
+	U32 uHit = 0;
+	for (U32 i = 0; i < uCount; i++)
+	{
+		for (U32 j = 0; j < TEST_TRACKER_COUNT; j++)
+		{
+			if (aSnapshot[i] == pAddresses[j] && 0 != (uHitBits & (1ULL << i)))
+			{
+				uHit++;
+			}
+		}
+	}
+	return TEST_TRACKER_COUNT == uCount && TEST_TRACKER_COUNT == uHit;
+}
+
+int main(int const argc, char** const argv)
+{
+	setvbuf(stdout, NULL, _IONBF, 0);
+	/* A target that died makes the writes below fail instead of killing the driver. */
+	signal(SIGPIPE, SIG_IGN);
+	ADDRESS aFunctions[TEST_TRACKER_COUNT];
+	U32 uFarLen = 0;
+	if (!TestTargetStart((argc > 1) ? argv[1] : "./linux_target", aFunctions, &uFarLen))
+	{
+		printf("FAIL target start\n");
+		return 1;
+	}
+
+	FLOC_HANDLE hHandle = NULL;
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_Initialize(&hHandle), "initialize");
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_TargetSet(hHandle, (PID)gpidTarget), "target set");
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_DebugLoopStart(hHandle), "debug loop start");
+	/* The loop seizes the target on its own thread, breakpoints are only served once it did. */
+	usleep(TEST_LOOP_ATTACH_US);
+
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_TrackerAddBreakpoint(hHandle, aFunctions[0]), "add breakpoint");
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_TrackerAddHook(hHandle, aFunctions[1], 0), "add rel32 hook");
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_TrackerAddHook(hHandle, aFunctions[2], uFarLen), "add abs64 hook");
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_TrackerAllEnable(hHandle), "enable all");
+
+	TestCheck(TestJumpIs(aFunctions[0], 0xCC, 0, 1), "breakpoint armed");
+	TestCheck(TestJumpIs(aFunctions[1], 0xE9, 0, 1), "near hook uses jmp rel32");
+	TestCheck(TestJumpIs(aFunctions[2], 0xFF, 0x25, 2), "far hook uses jmp [rip] abs64");
+
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_StepBegin(hHandle), "step begin");
+	TestCheck(TestTargetCall('b'), "breakpoint function result");
+	TestCheck(TestTargetCall('n'), "rel32 hooked function result");
+	TestCheck(TestTargetCall('f'), "abs64 hooked function result");
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_StepEnd(hHandle), "step end");
+	TestCheck(TestAllHit(hHandle, aFunctions), "all trackers hit");
+
+	TestCheck(FLOC_STATUS_SUCCESS == FLOCDLL_Uninitialize(hHandle), "uninitialize");
+	TestCheck(TestTargetCall('b') && TestTargetCall('n') && TestTargetCall('f'), "functions run unpatched");
+
+	/* A target that is stuck after a failed check is not waited for. */
+	if (0 != giFailures)
+	{
+		kill(gpidTarget, SIGKILL);
+	}
+	int iStatus = 0;
+	BOOL const bExited = (1 == write(giTargetIn, "q", 1) && gpidTarget == waitpid(gpidTarget, &iStatus, 0));
+	TestCheck(bExited && WIFEXITED(iStatus) && 0 == WEXITSTATUS(iStatus), "target exits cleanly");
+	return (0 == giFailures) ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/*
+ * Target process for test/linux_hooks.c.
+ *
+ * It prints the addresses of three functions on one line: one for a software breakpoint, one for a
+ * hook that gets a rel32 jump, and one copied into the middle of a reserved 4 GB window, so no pool
+ * can land within rel32 reach and its hook needs the abs64 jump. Then it reads one command byte at a
+ * time from stdin: 'b', 'n' and 'f' call the functions, 'q' quits. Every call is answered with 'k',
+ * or 'x' if the function returned a wrong result.
+ *
+ *   gcc -O1 test/linux_target.c -o linux_target
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define FAR_WINDOW_BASE (0x200000000000ULL)
+#define FAR_WINDOW_SIZE (0x100000000ULL + 0x2000ULL)
+#define FAR_CODE_OFFSET (0x80000000ULL)
+
+typedef int (*TARGET_FUNC)(int);
+
+/* push rbp; mov rbp, rsp; mov eax, edi; add eax, 1; imul eax, edi; add eax, 2; pop rbp; ret */
+static unsigned char const gFarCode[] = {
+	0x55,
+	0x48, 0x89, 0xE5,
+	0x89, 0xF8,
+	0x83, 0xC0, 0x01,
+	0x0F, 0xAF, 0xC7,
+	0x83, 0xC0, 0x02,
+	0x5D,
+	0xC3,
+};
+
+static volatile int giSink = 0;
+
+__attribute__((noinline)) static int TargetBreakpoint(int const iValue)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		giSink += iValue * i;
+	}
+	return iValue * 3;
+}
+
+__attribute__((noinline)) static int TargetNear(int const iValue)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		giSink ^= iValue + i;
+	}
+	return iValue * 5;
+}
+
+static TARGET_FUNC FarFunctionCreate(void)
+{
+	/* Only the page in the middle is usable, the rest stays PROT_NONE and fills the ±2 GB around it. */
+	void* const pWindow = mmap((void*)FAR_WINDOW_BASE, FAR_WINDOW_SIZE, PROT_NONE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+	if (MAP_FAILED == pWindow)
+	{
+		return NULL;
+	}
+	unsigned char* const pCode = (unsigned char*)pWindow + FAR_CODE_OFFSET;
+	if (0 != mprotect(pCode, 0x1000, PROT_READ | PROT_WRITE | PROT_EXEC))
+	{
+		return NULL;
+	}
+	memcpy(pCode, gFarCode, sizeof(gFarCode));
+	return (TARGET_FUNC)pCode;
+}
+
+int main(void)
+{
+	TARGET_FUNC const fnFar = FarFunctionCreate();
+	if (NULL == fnFar)
+	{
+		return 2;
+	}
+	printf("%p %p %p %u\n", (void*)TargetBreakpoint, (void*)TargetNear, (void*)fnFar, (unsigned)sizeof(gFarCode));
+	fflush(stdout);
+
+	char c = 0;
+	while (1 == read(0, &c, 1) && 'q' != c)
+	{
+		int const iValue = 7;
+		int iResult = 0;
+		int iExpected = 0;
+		switch (c)
+		{
+		case 'b':
+			iResult = TargetBreakpoint(iValue);
+			iExpected = iValue * 3;
+			break;
+		case 'n':
+			iResult = TargetNear(iValue);
+			iExpected = iValue * 5;
+			break;
+		case 'f':
+			iResult = fnFar(iValue);
+			iExpected = (iValue + 1) * iValue + 2;
+			break;
+		default:
+			break;
+		}
+		char const cReply = (iResult == iExpected) ? 'k' : 'x';
+		if (1 != write(1, &cReply, 1))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -10,22 +10,58 @@ typedef struct tdPOOL POOL;
 typedef enum tdTRACKER_TYPE {
 	TRACKER_TYPE_DELETED,
 	TRACKER_TYPE_BREAKPOINT_SW,
-	TRACKER_TYPE_HOOK_INLINE
+	TRACKER_TYPE_HOOK_INLINE,
+	TRACKER_TYPE_HOOK_COUNTER,
+	TRACKER_TYPE_BREAKPOINT_HW,
+	TRACKER_TYPE_PAGE_EXEC
 } TRACKER_TYPE;
 
+#define TRACKER_PAGE_SIZE (0x1000)
+
 typedef struct tdBREAKPOINT {
 	BYTE uOriginalByte;
 } BREAKPOINT;
 
+/*
+ * Only HW_BREAKPOINT_COUNT of these are armed at a time. A free slot goes to the enabled one with
+ * the most hits so far, ties to the one armed least recently, then to the lower address. bWatchedStep is set when it stayed
+ * armed since the step began; only then does not being hit mean not executed.
+ */
+typedef struct tdBREAKPOINT_HW {
+	U32 uHitCount;
+	U32 uArmSequence;
+	BOOL bArmed;
+	BOOL bWatchedStep;
+} BREAKPOINT_HW;
+
+/*
+ * A whole code page without execute permission, its first instruction fetch faults once and gives
+ * the permission back. aAddress is the page base, kept in an index of its own so a page never
+ * collides with a tracker on its first byte. uProtect is what the page had before, in OS terms.
+ */
+typedef struct tdPAGE_EXEC {
+	U32 uProtect;
+} PAGE_EXEC;
+
+/*
+ * bEnabled and bHit are also written by the debug loop while client threads read and write them.
+ * Aligned 32 bit accesses are atomic on x86-64, volatile keeps every one of them a single load or
+ * store. The loop only ever sets bHit and clears bEnabled, so a tracker is flagged enabled before
+ * it is armed in the target and flagged disabled after it was disarmed.
+ * uParam is the length the caller added a hook with, the function length of inline hooks and the
+ * prologue length of counters, so a saved session re-creates it the same way. 0 for other types.
+ */
 typedef struct tdTRACKER {
 	ADDRESS aAddress;
 	TRACKER_TYPE eType;
-	BOOL bEnabled;
-	BOOL bHit;
-	BYTE _padding[4];
+	BOOL volatile bEnabled;
+	BOOL volatile bHit;
+	U32 uParam;
 	union UTRACKERTYPE {
 		BREAKPOINT bp;
+		BREAKPOINT_HW hwbp;
 		HOOK hook;
+		PAGE_EXEC page;
 	} u;
 } TRACKER;
 
@@ -2,7 +2,13 @@
 #define TYPES_H
 
 typedef unsigned long long U64;
+#ifdef _WIN32
 typedef unsigned long U32;
+#else
+/* long is 64 bits wide on LP64 platforms. */
+typedef unsigned int U32;
+#endif /* _WIN32 */
+typedef unsigned short U16;
 typedef int BOOL;
 typedef unsigned char BYTE;
 
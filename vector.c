@@ -1,6 +1,10 @@
 #include "vector.h"
 #include "os.h"
 
+#define VECTOR_SEGMENT_TABLE_CAPACITY (8)
+/* Keeps every segment index and element count within U32. */
+#define VECTOR_MAX_SEGMENT_SHIFT (20)
+
 static BOOL Vector_IsFull(VECTOR const * pVec);
 static BOOL Vector_Grow(VECTOR* pVec);
 
@@ -11,16 +15,31 @@ BOOL Vector_Init(VECTOR* const pVec, U32 const uElemSize, U32 const uInitialElem
 		return FALSE;
 	}
 
-	U64 const uBytes = (U64)(uElemSize) * uInitialElemCapacity;
-	pVec->pData = Memory_Alloc(uBytes);
-	if (NULL == pVec->pData)
+	/* Segments hold the initial capacity rounded up to a power of two. */
+	U32 uShift = 0;
+	while (uShift < VECTOR_MAX_SEGMENT_SHIFT && ((U32)1 << uShift) < uInitialElemCapacity)
+	{
+		uShift++;
+	}
+
+	pVec->ppSegments = Memory_Alloc(VECTOR_SEGMENT_TABLE_CAPACITY * sizeof(void*));
+	if (NULL == pVec->ppSegments)
 	{
 		return FALSE;
 	}
 
-	pVec->uElemCapacity = uInitialElemCapacity;
+	pVec->uSegmentShift = uShift;
+	pVec->uSegmentCount = 0;
+	pVec->uSegmentCapacity = VECTOR_SEGMENT_TABLE_CAPACITY;
+	pVec->uElemCapacity = 0;
 	pVec->uElemSize = uElemSize;
 	pVec->uElemCount = 0;
+	if (!Vector_Grow(pVec))
+	{
+		Memory_Free(pVec->ppSegments);
+		pVec->ppSegments = NULL;
+		return FALSE;
+	}
 	return TRUE;
 }
 
@@ -31,21 +50,35 @@ static BOOL Vector_IsFull(VECTOR const * const pVec)
 
 static BOOL Vector_Grow(VECTOR* const pVec)
 {
-	U32 const uOldBytes = pVec->uElemCapacity * pVec->uElemSize;
-	U32 const uNewCapacity = pVec->uElemCapacity * 2;
-	U32 const uNewBytes = uNewCapacity * pVec->uElemSize;
-
-	void* const pNewData = Memory_Alloc(uNewBytes);
-	if (NULL == pNewData)
+	/* Adds one segment. Only the table of segment pointers is ever copied. */
+	U32 const uSegmentElems = (U32)1 << pVec->uSegmentShift;
+	if (pVec->uElemCapacity > (U32)-1 - uSegmentElems)
 	{
 		return FALSE;
 	}
 
-	Memory_Copy(pNewData, pVec->pData, uOldBytes);
-	Memory_Free(pVec->pData);
+	if (pVec->uSegmentCount == pVec->uSegmentCapacity)
+	{
+		U32 const uNewCapacity = 2 * pVec->uSegmentCapacity;
+		void** const ppNew = Memory_Alloc((U64)uNewCapacity * sizeof(void*));
+		if (NULL == ppNew)
+		{
+			return FALSE;
+		}
+		Memory_Copy(ppNew, pVec->ppSegments, (U64)pVec->uSegmentCount * sizeof(void*));
+		Memory_Free(pVec->ppSegments);
+		pVec->ppSegments = ppNew;
+		pVec->uSegmentCapacity = uNewCapacity;
+	}
+
+	void* const pSegment = Memory_Alloc((U64)uSegmentElems * pVec->uElemSize);
+	if (NULL == pSegment)
+	{
+		return FALSE;
+	}
 
-	pVec->uElemCapacity = uNewCapacity;
-	pVec->pData = pNewData;
+	pVec->ppSegments[pVec->uSegmentCount++] = pSegment;
+	pVec->uElemCapacity += uSegmentElems;
 	return TRUE;
 }
 
@@ -68,19 +101,56 @@ BOOL Vector_PushBackCopy(VECTOR* const pVec, void const * const pElem)
 	return TRUE;
 }
 
+BOOL Vector_Reserve(VECTOR* const pVec, U32 const uElemCapacity)
+{
+	while (pVec->uElemCapacity < uElemCapacity)
+	{
+		if (!Vector_Grow(pVec))
+		{
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
 void* Vector_AddressOf(VECTOR const * pVec, U32 const uIndex)
 {
-	BYTE* const pRes = ((BYTE*)pVec->pData + ((U64)uIndex * pVec->uElemSize));
-	BYTE const * const pBegin = (BYTE*)pVec->pData;
-	BYTE const * const pEnd = pBegin + ((U64)pVec->uElemCapacity * pVec->uElemSize);
-	BOOL const valid = pRes >= pBegin && pRes < pEnd;
-	return valid ? pRes : NULL;
+	if (uIndex >= pVec->uElemCapacity)
+	{
+		return NULL;
+	}
+	U32 const uMask = ((U32)1 << pVec->uSegmentShift) - 1;
+	BYTE* const pSegment = (BYTE*)pVec->ppSegments[uIndex >> pVec->uSegmentShift];
+	return pSegment + (U64)(uIndex & uMask) * pVec->uElemSize;
+}
+
+U32 Vector_IndexOf(VECTOR const * const pVec, void const * const pElem)
+{
+	/* Vectors that are searched this way have few segments. */
+	U64 const uSegmentBytes = ((U64)1 << pVec->uSegmentShift) * pVec->uElemSize;
+	for (U32 i = 0; i < pVec->uSegmentCount; i++)
+	{
+		BYTE const * const pBegin = (BYTE const*)pVec->ppSegments[i];
+		if ((BYTE const*)pElem >= pBegin && (BYTE const*)pElem < pBegin + uSegmentBytes)
+		{
+			U64 const uOffset = (U64)((BYTE const*)pElem - pBegin);
+			return (i << pVec->uSegmentShift) + (U32)(uOffset / pVec->uElemSize);
+		}
+	}
+	return (U32)-1;
 }
 
 BOOL Vector_Free(VECTOR* const pVec)
 {
-	BOOL const ret = Memory_Free(pVec->pData);
-	pVec->pData = NULL;
+	BOOL ret = TRUE;
+	for (U32 i = 0; i < pVec->uSegmentCount; i++)
+	{
+		ret = Memory_Free(pVec->ppSegments[i]) && ret;
+	}
+	Memory_Free(pVec->ppSegments);
+	pVec->ppSegments = NULL;
+	pVec->uSegmentCount = 0;
+	pVec->uSegmentCapacity = 0;
 	pVec->uElemCapacity = 0;
 	pVec->uElemSize = 0;
 	return ret;
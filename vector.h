@@ -3,17 +3,26 @@
 
 #include "types.h"
 
+/*
+ * Elements live in segments of (1 << uSegmentShift) elements each. Growing only adds segments
+ * and grows the segment table, so elements never move and pointers to them stay valid until
+ * Vector_Free. Element i is at ppSegments[i >> uSegmentShift] + (i & ((1 << uSegmentShift) - 1)) * uElemSize.
+ */
 typedef struct tdVECTOR {
-    void* pData;
+    void** ppSegments;
     U32 uElemCount;
     U32 uElemSize;
     U32 uElemCapacity;
-    BYTE _padding[4];
+    U32 uSegmentShift;
+    U32 uSegmentCount;
+    U32 uSegmentCapacity;
 } VECTOR;
 
 BOOL Vector_Init(VECTOR* pVec, U32 uElemSize, U32 uInitialElemCapacity);
 void* Vector_AddressOf(VECTOR const * pVec, U32 uIndex);
+U32 Vector_IndexOf(VECTOR const * pVec, void const* pElem);
 BOOL Vector_PushBackCopy(VECTOR* pVec, void const* pElem);
+BOOL Vector_Reserve(VECTOR* pVec, U32 uElemCapacity);
 BOOL Vector_Free(VECTOR* pVec);
 
 #endif /* VECTOR_H */